@@ -0,0 +1,79 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cpu.h"
+#include <stdlib.h>
+
+static const cpu_info *Info;
+static unsigned int Count;
+static unsigned int NodeCount;
+static unsigned int PackageCount;
+
+static int CompareCpus(const void *A, const void *B)
+{
+	const cpu_info *CpuA = A;
+	const cpu_info *CpuB = B;
+
+	if(CpuA->Node != CpuB->Node)
+		return CpuA->Node < CpuB->Node ? -1 : 1;
+	if(CpuA->Package != CpuB->Package)
+		return CpuA->Package < CpuB->Package ? -1 : 1;
+	if(CpuA->Core != CpuB->Core)
+		return CpuA->Core < CpuB->Core ? -1 : 1;
+	if(CpuA->Group != CpuB->Group)
+		return CpuA->Group < CpuB->Group ? -1 : 1;
+	if(CpuA->Number != CpuB->Number)
+		return CpuA->Number < CpuB->Number ? -1 : 1;
+	return 0;
+}
+
+void CpuSetTopology(cpu_info *Cpus, unsigned int CpuCount)
+{
+	qsort(Cpus, CpuCount, sizeof(*Cpus), CompareCpus);
+
+	NodeCount = CpuCount > 0;
+	PackageCount = 0;
+	for(unsigned int i = 0; i < CpuCount; i++) {
+		if(i > 0 && Cpus[i].Node != Cpus[i - 1].Node)
+			NodeCount++;
+		if(Cpus[i].Package >= PackageCount)
+			PackageCount = Cpus[i].Package + 1;
+	}
+
+	Info = Cpus;
+	Count = CpuCount;
+}
+
+const cpu_info *CpuGetInfo(void)
+{
+	return Info;
+}
+
+unsigned int CpuGetCount(void)
+{
+	return Count;
+}
+
+unsigned int CpuGetNodeCount(void)
+{
+	return NodeCount;
+}
+
+unsigned int CpuGetPackageCount(void)
+{
+	return PackageCount;
+}
@@ -0,0 +1,55 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CPU_H
+#define CPU_H
+
+/*
+ * Utilization of every logical processor and the topology it is grouped
+ * by. The interface uses no Windows types so that the same meters can be
+ * fed by cpu_linux.c (/proc/stat and sysfs) for testing, NTop itself is
+ * built with cpu_win32.c.
+ */
+
+typedef struct cpu_info {
+	unsigned int Node;	/* NUMA node */
+	unsigned int Package;	/* physical socket */
+	unsigned int Core;	/* physical core, the same for SMT siblings */
+	unsigned int Group;	/* processor group, always 0 on Linux */
+	unsigned int Number;	/* number within the group */
+	double Usage;		/* busy fraction between the last two samples */
+} cpu_info;
+
+/* Discovers the topology and takes the first sample, returns the processor count or 0 */
+unsigned int CpuInit(void);
+
+/* One bulk query for all processors, written by the collector thread only */
+int CpuSample(void);
+
+/* Processors ordered by node, package, core and number */
+const cpu_info *CpuGetInfo(void);
+unsigned int CpuGetCount(void);
+unsigned int CpuGetNodeCount(void);
+unsigned int CpuGetPackageCount(void);
+
+/*
+ * For the backends in CpuInit: sorts the array in place, which stays owned
+ * by the caller, and counts the nodes and packages.
+ */
+void CpuSetTopology(cpu_info *Info, unsigned int Count);
+
+#endif
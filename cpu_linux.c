@@ -0,0 +1,178 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Linux backend of cpu.h, not part of the Windows build. It lets the
+ * topology grouping and the meters be checked against /proc/stat and
+ * sysfs on machines with many sockets and nodes.
+ */
+
+#ifdef __linux__
+
+#include "cpu.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CPU_NONE ((unsigned int)-1)
+
+/* Prefix of /sys and /proc, set at build time to read a copied tree instead */
+#ifndef CPU_ROOT
+	#define CPU_ROOT ""
+#endif
+
+typedef struct cpu_ticks {
+	unsigned long long Busy;
+	unsigned long long Total;
+} cpu_ticks;
+
+static cpu_info *Cpus;
+static unsigned int CpuCount;
+
+/* By kernel CPU number */
+static unsigned int *Lookup;
+static cpu_ticks *Ticks;
+static unsigned int MaxNumber;
+
+static unsigned int ReadTopologyValue(unsigned int Number, const char *Name)
+{
+	char Path[256];
+	snprintf(Path, sizeof(Path), CPU_ROOT "/sys/devices/system/cpu/cpu%u/topology/%s", Number, Name);
+
+	unsigned int Value = 0;
+	FILE *File = fopen(Path, "r");
+	if(File) {
+		if(fscanf(File, "%u", &Value) != 1)
+			Value = 0;
+		fclose(File);
+	}
+	return Value;
+}
+
+/* The node a CPU belongs to shows up as a nodeN link in its directory */
+static unsigned int ReadNode(unsigned int Number)
+{
+	char Path[256];
+	snprintf(Path, sizeof(Path), CPU_ROOT "/sys/devices/system/cpu/cpu%u", Number);
+
+	unsigned int Node = 0;
+	DIR *Dir = opendir(Path);
+	if(Dir) {
+		struct dirent *Entry;
+		while((Entry = readdir(Dir)) != 0) {
+			if(sscanf(Entry->d_name, "node%u", &Node) == 1)
+				break;
+		}
+		closedir(Dir);
+	}
+	return Node;
+}
+
+/*
+ * Reads one "cpuN" line of /proc/stat per online CPU. Busy time is
+ * everything but idle and iowait, guest time is already part of user.
+ */
+static int ReadStat(int Discover)
+{
+	FILE *File = fopen(CPU_ROOT "/proc/stat", "r");
+	if(!File)
+		return 0;
+
+	char Line[512];
+	while(fgets(Line, sizeof(Line), File)) {
+		unsigned int Number;
+		unsigned long long User = 0, Nice = 0, System = 0, Idle = 0, IoWait = 0, Irq = 0, SoftIrq = 0, Steal = 0;
+
+		if(strncmp(Line, "cpu", 3) != 0)
+			break;
+		/* The aggregate "cpu" line comes first */
+		if(!isdigit((unsigned char)Line[3]))
+			continue;
+		if(sscanf(Line, "cpu%u %llu %llu %llu %llu %llu %llu %llu %llu", &Number,
+					&User, &Nice, &System, &Idle, &IoWait, &Irq, &SoftIrq, &Steal) < 5)
+			continue;
+
+		if(Discover) {
+			cpu_info *Grown = realloc(Cpus, (CpuCount + 1) * sizeof(*Cpus));
+			if(!Grown)
+				break;
+			Cpus = Grown;
+
+			cpu_info *Cpu = &Cpus[CpuCount++];
+			memset(Cpu, 0, sizeof(*Cpu));
+			Cpu->Number = Number;
+			Cpu->Package = ReadTopologyValue(Number, "physical_package_id");
+			Cpu->Core = ReadTopologyValue(Number, "core_id");
+			Cpu->Node = ReadNode(Number);
+			if(Number + 1 > MaxNumber)
+				MaxNumber = Number + 1;
+			continue;
+		}
+
+		if(Number >= MaxNumber || Lookup[Number] == CPU_NONE)
+			continue;
+
+		unsigned long long IdleAll = Idle + IoWait;
+		unsigned long long Total = User + Nice + System + IdleAll + Irq + SoftIrq + Steal;
+		unsigned long long Busy = Total - IdleAll;
+		cpu_ticks *Prev = &Ticks[Number];
+
+		if(Prev->Total != 0 && Total > Prev->Total && Busy >= Prev->Busy) {
+			double Usage = (double)(Busy - Prev->Busy) / (double)(Total - Prev->Total);
+			Cpus[Lookup[Number]].Usage = Usage > 1.0 ? 1.0 : Usage;
+		}
+		Prev->Busy = Busy;
+		Prev->Total = Total;
+	}
+
+	fclose(File);
+	return 1;
+}
+
+unsigned int CpuInit(void)
+{
+	if(!ReadStat(1) || CpuCount == 0)
+		return 0;
+
+	CpuSetTopology(Cpus, CpuCount);
+
+	Lookup = malloc(MaxNumber * sizeof(*Lookup));
+	Ticks = calloc(MaxNumber, sizeof(*Ticks));
+	if(!Lookup || !Ticks)
+		return 0;
+
+	for(unsigned int i = 0; i < MaxNumber; i++) {
+		Lookup[i] = CPU_NONE;
+	}
+	for(unsigned int i = 0; i < CpuCount; i++) {
+		Lookup[Cpus[i].Number] = i;
+	}
+
+	ReadStat(0);
+	return CpuCount;
+}
+
+int CpuSample(void)
+{
+	if(!Lookup)
+		return 0;
+	return ReadStat(0);
+}
+
+#endif
@@ -0,0 +1,217 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <windows.h>
+#include <tchar.h>
+#include <pdh.h>
+#include <pdhmsg.h>
+#include "cpu.h"
+#include "util.h"
+
+/* Processor numbers within a group never reach 64 */
+#define CPU_GROUP_SIZE 64
+#define CPU_NONE ((unsigned int)-1)
+
+static cpu_info *Cpus;
+static unsigned int CpuCount;
+
+/* Index into Cpus by group * CPU_GROUP_SIZE + number */
+static unsigned int *Lookup;
+static unsigned int GroupCount;
+
+static PDH_HQUERY Query;
+static PDH_HCOUNTER Counter;
+static PDH_FMT_COUNTERVALUE_ITEM *Items;
+static DWORD ItemsSize;
+
+static cpu_info *FindCpu(WORD Group, unsigned int Number)
+{
+	for(unsigned int i = 0; i < CpuCount; i++) {
+		if(Cpus[i].Group == Group && Cpus[i].Number == Number)
+			return &Cpus[i];
+	}
+	return 0;
+}
+
+/* Cores first, they create the processors that packages and nodes refer to */
+static void ReadTopology(const BYTE *Buffer, DWORD Length)
+{
+	unsigned int CoreIndex = 0;
+
+	for(DWORD Offset = 0; Offset < Length; Offset += ((const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(Buffer + Offset))->Size) {
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *Info = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(Buffer + Offset);
+		if(Info->Relationship != RelationProcessorCore)
+			continue;
+
+		const GROUP_AFFINITY *Affinity = &Info->Processor.GroupMask[0];
+		for(unsigned int Bit = 0; Bit < sizeof(KAFFINITY) * 8; Bit++) {
+			if(!(Affinity->Mask & ((KAFFINITY)1 << Bit)))
+				continue;
+
+			Cpus = xrealloc(Cpus, (CpuCount + 1) * sizeof(*Cpus));
+			cpu_info *Cpu = &Cpus[CpuCount++];
+			ZeroMemory(Cpu, sizeof(*Cpu));
+			Cpu->Core = CoreIndex;
+			Cpu->Group = Affinity->Group;
+			Cpu->Number = Bit;
+		}
+		CoreIndex++;
+	}
+
+	unsigned int PackageIndex = 0;
+
+	for(DWORD Offset = 0; Offset < Length; Offset += ((const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(Buffer + Offset))->Size) {
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *Info = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(Buffer + Offset);
+		const GROUP_AFFINITY *Masks;
+		WORD MaskCount;
+
+		if(Info->Relationship == RelationProcessorPackage) {
+			Masks = Info->Processor.GroupMask;
+			MaskCount = Info->Processor.GroupCount;
+		} else if(Info->Relationship == RelationNumaNode) {
+			/* Older systems only fill in the first mask of a node */
+			Masks = &Info->NumaNode.GroupMask;
+			MaskCount = 1;
+		} else {
+			continue;
+		}
+
+		for(WORD i = 0; i < MaskCount; i++) {
+			for(unsigned int Bit = 0; Bit < sizeof(KAFFINITY) * 8; Bit++) {
+				if(!(Masks[i].Mask & ((KAFFINITY)1 << Bit)))
+					continue;
+
+				cpu_info *Cpu = FindCpu(Masks[i].Group, Bit);
+				if(!Cpu)
+					continue;
+
+				if(Info->Relationship == RelationProcessorPackage) {
+					Cpu->Package = PackageIndex;
+				} else {
+					Cpu->Node = Info->NumaNode.NodeNumber;
+				}
+			}
+		}
+
+		if(Info->Relationship == RelationProcessorPackage)
+			PackageIndex++;
+	}
+}
+
+unsigned int CpuInit(void)
+{
+	DWORD Length = 0;
+	GetLogicalProcessorInformationEx(RelationAll, 0, &Length);
+
+	if(GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+		BYTE *Buffer = xmalloc(Length);
+		if(GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)Buffer, &Length)) {
+			ReadTopology(Buffer, Length);
+		}
+		free(Buffer);
+	}
+
+	/* Without topology every processor is its own core on one package */
+	if(CpuCount == 0) {
+		SYSTEM_INFO SystemInfo;
+		GetNativeSystemInfo(&SystemInfo);
+		CpuCount = min(SystemInfo.dwNumberOfProcessors, CPU_GROUP_SIZE);
+		Cpus = xcalloc(CpuCount, sizeof(*Cpus));
+		for(unsigned int i = 0; i < CpuCount; i++) {
+			Cpus[i].Core = i;
+			Cpus[i].Number = i;
+		}
+	}
+
+	CpuSetTopology(Cpus, CpuCount);
+
+	for(unsigned int i = 0; i < CpuCount; i++) {
+		GroupCount = max(GroupCount, Cpus[i].Group + 1);
+	}
+	Lookup = xmalloc(GroupCount * CPU_GROUP_SIZE * sizeof(*Lookup));
+	for(unsigned int i = 0; i < GroupCount * CPU_GROUP_SIZE; i++) {
+		Lookup[i] = CPU_NONE;
+	}
+	for(unsigned int i = 0; i < CpuCount; i++) {
+		Lookup[Cpus[i].Group * CPU_GROUP_SIZE + Cpus[i].Number] = i;
+	}
+
+	/*
+	 * A single wildcard counter covers every processor of every group, so
+	 * one collection per cycle is all it takes. Instances are named
+	 * "group,number", plus totals per group and system.
+	 */
+	if(PdhOpenQuery(0, 0, &Query) == ERROR_SUCCESS) {
+		if(PdhAddEnglishCounter(Query, _T("\\Processor Information(*)\\% Processor Time"), 0, &Counter) == ERROR_SUCCESS) {
+			PdhCollectQueryData(Query);
+		} else {
+			PdhCloseQuery(Query);
+			Query = 0;
+		}
+	}
+
+	return CpuCount;
+}
+
+static BOOL ParseInstance(const TCHAR *Name, unsigned int *Group, unsigned int *Number)
+{
+	TCHAR *End;
+
+	*Group = _tcstoul(Name, &End, 10);
+	if(End == Name || *End != _T(','))
+		return FALSE;
+
+	Name = End + 1;
+	*Number = _tcstoul(Name, &End, 10);
+	return End != Name && *End == 0;
+}
+
+int CpuSample(void)
+{
+	if(!Query || PdhCollectQueryData(Query) != ERROR_SUCCESS)
+		return FALSE;
+
+	DWORD Size = ItemsSize;
+	DWORD ItemCount = 0;
+	PDH_STATUS Status = PdhGetFormattedCounterArray(Counter, PDH_FMT_DOUBLE, &Size, &ItemCount, Items);
+	if(Status == PDH_MORE_DATA) {
+		Items = xrealloc(Items, Size);
+		ItemsSize = Size;
+		Status = PdhGetFormattedCounterArray(Counter, PDH_FMT_DOUBLE, &Size, &ItemCount, Items);
+	}
+	if(Status != ERROR_SUCCESS)
+		return FALSE;
+
+	for(DWORD i = 0; i < ItemCount; i++) {
+		const PDH_FMT_COUNTERVALUE *Value = &Items[i].FmtValue;
+		if(Value->CStatus != PDH_CSTATUS_VALID_DATA && Value->CStatus != PDH_CSTATUS_NEW_DATA)
+			continue;
+
+		unsigned int Group, Number;
+		if(!ParseInstance(Items[i].szName, &Group, &Number))
+			continue;
+		if(Group >= GroupCount || Number >= CPU_GROUP_SIZE)
+			continue;
+
+		unsigned int Index = Lookup[Group * CPU_GROUP_SIZE + Number];
+		if(Index != CPU_NONE) {
+			Cpus[Index].Usage = min(max(Value->doubleValue / 100.0, 0.0), 1.0);
+		}
+	}
+
+	return TRUE;
+}
@@ -0,0 +1,279 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "detail.h"
+#include "ntapi.h"
+#include "util.h"
+#include <psapi.h>
+#include <string.h>
+
+#define DETAIL_CACHE_SIZE 256
+#define DETAIL_QUEUE_SIZE 128
+
+/* Cached details are fetched again after this many ms when drawn */
+#define DETAIL_MAX_AGE 5000
+
+typedef struct detail_entry {
+	DWORD ID;			/* 0 if the entry is free */
+	ULONGLONG CreationTime;
+	BOOL Queued;
+	BOOL Fetching;
+	BOOL HasData;
+	DWORD Frame;			/* last frame the row was drawn in */
+	ULONGLONG FetchTicks;
+	process_detail Detail;
+} detail_entry;
+
+static CRITICAL_SECTION Lock;
+static HANDLE WakeEvent;
+static detail_entry Cache[DETAIL_CACHE_SIZE];
+static DWORD Frame = 1;
+static BOOL Updated;
+
+/* Ring of cache indices waiting to be fetched */
+static DWORD Queue[DETAIL_QUEUE_SIZE];
+static DWORD QueueHead;
+static DWORD QueueCount;
+
+static nt_query_information_process NtQueryInformationProcess;
+
+static void ReadCommandLine(HANDLE Process, TCHAR *Dest, DWORD DestSize)
+{
+	Dest[0] = 0;
+	if(!NtQueryInformationProcess)
+		return;
+
+	ULONG Length = 4096;
+	BYTE *Buffer = xmalloc(Length);
+	nt_status Status = NtQueryInformationProcess(Process, NT_PROCESS_COMMAND_LINE_INFORMATION, Buffer, Length, &Length);
+	if(Status == NT_STATUS_INFO_LENGTH_MISMATCH) {
+		Buffer = xrealloc(Buffer, Length);
+		Status = NtQueryInformationProcess(Process, NT_PROCESS_COMMAND_LINE_INFORMATION, Buffer, Length, &Length);
+	}
+
+	if(NT_SUCCEEDED(Status)) {
+		const nt_unicode_string *String = (const nt_unicode_string *)Buffer;
+		int Count = min(String->Length / (int)sizeof(WCHAR), (int)DestSize - 1);
+#ifdef UNICODE
+		memcpy(Dest, String->Buffer, Count * sizeof(WCHAR));
+#else
+		Count = WideCharToMultiByte(CP_ACP, 0, String->Buffer, Count, Dest, DestSize - 1, 0, 0);
+#endif
+		Dest[Count] = 0;
+	}
+
+	free(Buffer);
+}
+
+BOOL DetailFetch(DWORD ID, ULONGLONG CreationTime, process_detail *Detail)
+{
+	/* Module enumeration needs more access than most processes grant */
+	BOOL Limited = FALSE;
+	HANDLE Process = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, ID);
+	if(!Process) {
+		Process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, ID);
+		Limited = TRUE;
+	}
+	if(!Process)
+		return FALSE;
+
+	/* The PID may have been reused since the snapshot */
+	FILETIME Creation, Exit, Kernel, User;
+	ULARGE_INTEGER Created = { 0 };
+	if(GetProcessTimes(Process, &Creation, &Exit, &Kernel, &User)) {
+		Created.LowPart = Creation.dwLowDateTime;
+		Created.HighPart = Creation.dwHighDateTime;
+	}
+	if(Created.QuadPart != CreationTime) {
+		CloseHandle(Process);
+		return FALSE;
+	}
+
+	DWORD Size = MAX_PATH;
+	if(!QueryFullProcessImageName(Process, 0, Detail->ImagePath, &Size)) {
+		Detail->ImagePath[0] = 0;
+	}
+
+	if(!GetProcessHandleCount(Process, &Detail->HandleCount)) {
+		Detail->HandleCount = DETAIL_UNKNOWN;
+	}
+
+	PROCESS_MEMORY_COUNTERS_EX Counters;
+	Detail->PrivateBytes = 0;
+	if(GetProcessMemoryInfo(Process, (PROCESS_MEMORY_COUNTERS *)&Counters, sizeof(Counters))) {
+		Detail->PrivateBytes = Counters.PrivateUsage;
+	}
+
+	DWORD Needed;
+	Detail->ModuleCount = DETAIL_UNKNOWN;
+	if(!Limited && EnumProcessModulesEx(Process, 0, 0, &Needed, LIST_MODULES_ALL)) {
+		Detail->ModuleCount = Needed / sizeof(HMODULE);
+	}
+
+	ReadCommandLine(Process, Detail->CommandLine, DETAIL_COMMAND_LINE_SIZE);
+
+	CloseHandle(Process);
+	return TRUE;
+}
+
+static DWORD WINAPI DetailThreadProc(LPVOID lpParam)
+{
+	UNREFERENCED_PARAMETER(lpParam);
+
+	while(WaitForSingleObject(WakeEvent, INFINITE) == WAIT_OBJECT_0) {
+		while(1) {
+			EnterCriticalSection(&Lock);
+			if(QueueCount == 0) {
+				LeaveCriticalSection(&Lock);
+				break;
+			}
+
+			detail_entry *Entry = &Cache[Queue[QueueHead]];
+			QueueHead = (QueueHead + 1) % DETAIL_QUEUE_SIZE;
+			QueueCount--;
+			Entry->Queued = FALSE;
+
+			/* Scrolled out of view before we got to it */
+			if(Entry->Frame + 1 < Frame) {
+				if(!Entry->HasData) {
+					Entry->ID = 0;
+				}
+				LeaveCriticalSection(&Lock);
+				continue;
+			}
+
+			DWORD ID = Entry->ID;
+			ULONGLONG CreationTime = Entry->CreationTime;
+			Entry->Fetching = TRUE;
+			LeaveCriticalSection(&Lock);
+
+			process_detail Detail;
+			BOOL Fetched = DetailFetch(ID, CreationTime, &Detail);
+
+			/* Fetching entries are never evicted, so the entry is still ours */
+			EnterCriticalSection(&Lock);
+			if(Fetched) {
+				Entry->Detail = Detail;
+				Entry->HasData = TRUE;
+			} else if(!Entry->HasData) {
+				/* Gone or access denied, show the value as unknown */
+				Entry->Detail.HandleCount = DETAIL_UNKNOWN;
+				Entry->Detail.ModuleCount = DETAIL_UNKNOWN;
+				Entry->Detail.PrivateBytes = 0;
+				Entry->Detail.ImagePath[0] = 0;
+				Entry->Detail.CommandLine[0] = 0;
+				Entry->HasData = TRUE;
+			}
+			Entry->FetchTicks = GetTickCount64();
+			Entry->Fetching = FALSE;
+			Updated = TRUE;
+			LeaveCriticalSection(&Lock);
+		}
+	}
+
+	return 0;
+}
+
+void DetailInit(void)
+{
+	NtQueryInformationProcess = (nt_query_information_process)NT_GET_PROC("NtQueryInformationProcess");
+
+	InitializeCriticalSection(&Lock);
+	WakeEvent = CreateEvent(0, FALSE, FALSE, 0);
+	CreateThread(0, 0, DetailThreadProc, 0, 0, 0);
+}
+
+void DetailBeginFrame(void)
+{
+	EnterCriticalSection(&Lock);
+	Frame++;
+	LeaveCriticalSection(&Lock);
+}
+
+/* Least recently drawn entry that the worker is not holding on to */
+static detail_entry *AllocateEntry(void)
+{
+	detail_entry *Oldest = 0;
+
+	for(int i = 0; i < DETAIL_CACHE_SIZE; i++) {
+		detail_entry *Entry = &Cache[i];
+		if(Entry->ID == 0)
+			return Entry;
+		if(Entry->Queued || Entry->Fetching)
+			continue;
+		if(!Oldest || Entry->Frame < Oldest->Frame)
+			Oldest = Entry;
+	}
+
+	return Oldest;
+}
+
+BOOL DetailGet(DWORD ID, ULONGLONG CreationTime, process_detail *Detail)
+{
+	if(ID == 0)
+		return FALSE;
+
+	EnterCriticalSection(&Lock);
+
+	detail_entry *Entry = 0;
+	for(int i = 0; i < DETAIL_CACHE_SIZE; i++) {
+		if(Cache[i].ID == ID && Cache[i].CreationTime == CreationTime) {
+			Entry = &Cache[i];
+			break;
+		}
+	}
+
+	if(!Entry) {
+		Entry = AllocateEntry();
+		if(Entry) {
+			memset(Entry, 0, sizeof(*Entry));
+			Entry->ID = ID;
+			Entry->CreationTime = CreationTime;
+		}
+	}
+
+	BOOL Found = FALSE;
+
+	if(Entry) {
+		Entry->Frame = Frame;
+
+		BOOL Stale = !Entry->HasData || GetTickCount64() - Entry->FetchTicks >= DETAIL_MAX_AGE;
+		if(Stale && !Entry->Queued && !Entry->Fetching && QueueCount < DETAIL_QUEUE_SIZE) {
+			Queue[(QueueHead + QueueCount) % DETAIL_QUEUE_SIZE] = (DWORD)(Entry - Cache);
+			QueueCount++;
+			Entry->Queued = TRUE;
+			SetEvent(WakeEvent);
+		}
+
+		if(Entry->HasData) {
+			*Detail = Entry->Detail;
+			Found = TRUE;
+		}
+	}
+
+	LeaveCriticalSection(&Lock);
+	return Found;
+}
+
+BOOL DetailConsumeUpdate(void)
+{
+	EnterCriticalSection(&Lock);
+	BOOL Result = Updated;
+	Updated = FALSE;
+	LeaveCriticalSection(&Lock);
+	return Result;
+}
@@ -0,0 +1,59 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DETAIL_H
+#define DETAIL_H
+
+#include "ntop.h"
+
+/*
+ * Per-process values that are too expensive to collect for every process
+ * in every snapshot. They are fetched on a background thread only for the
+ * rows that are drawn, and cached by PID and creation time. Every redraw
+ * starts a new frame with DetailBeginFrame. A queued fetch whose row was
+ * not drawn again in the last two frames has scrolled out of view and is
+ * dropped.
+ */
+
+#define DETAIL_UNKNOWN ((DWORD)-1)
+#define DETAIL_COMMAND_LINE_SIZE 512
+
+typedef struct process_detail {
+	DWORD HandleCount;		/* DETAIL_UNKNOWN if it could not be read */
+	DWORD ModuleCount;		/* likewise */
+	ULONGLONG PrivateBytes;
+	TCHAR ImagePath[MAX_PATH];
+	TCHAR CommandLine[DETAIL_COMMAND_LINE_SIZE];
+} process_detail;
+
+void DetailInit(void);
+void DetailBeginFrame(void);
+
+/*
+ * Copies the cached details of a process, queueing a fetch if there are
+ * none yet or they are getting old. Returns FALSE if there was nothing to
+ * copy.
+ */
+BOOL DetailGet(DWORD ID, ULONGLONG CreationTime, process_detail *Detail);
+
+/* Fetches on the calling thread, for non-interactive output */
+BOOL DetailFetch(DWORD ID, ULONGLONG CreationTime, process_detail *Detail);
+
+/* TRUE once after fetches completed, so the UI can redraw */
+BOOL DetailConsumeUpdate(void);
+
+#endif
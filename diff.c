@@ -0,0 +1,247 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "diff.h"
+#include "util.h"
+#include <math.h>
+#include <string.h>
+
+typedef struct diff_row {
+	DWORD ID;
+	DWORD Index;
+	ULONGLONG CreationTime;
+	DWORD NameOffset;
+	DWORD UserOffset;
+	ULONGLONG CPUTime;
+	ULONGLONG Fields[DIFF_FIELD_COUNT];
+} diff_row;
+
+typedef struct diff_snapshot {
+	diff_row *Rows;		/* sorted by ID and creation time */
+	DWORD Count;
+	DWORD Capacity;
+	TCHAR *Names;
+	DWORD NameLength;
+	DWORD NameCapacity;
+} diff_snapshot;
+
+/* The previous snapshot is Snapshots[Previous], the new one is built in the other */
+static diff_snapshot Snapshots[2];
+static int Previous;
+
+static diff_event *Events;
+static DWORD EventCount;
+static DWORD EventCapacity;
+
+static DWORD *Order;
+static DWORD *Scratch;
+static DWORD OrderCapacity;
+
+static const TCHAR *FieldNames[DIFF_FIELD_COUNT] = {
+	_T("parent"),
+	_T("priority"),
+	_T("threads"),
+	_T("cpu"),
+	_T("memory"),
+	_T("disk_read"),
+	_T("disk_write"),
+};
+
+const TCHAR *DiffFieldName(diff_field Field)
+{
+	return FieldNames[Field];
+}
+
+/* LSD radix sort of the process indices by PID, one byte per pass */
+static void SortByID(const process *Processes, DWORD Count)
+{
+	for(DWORD i = 0; i < Count; i++) {
+		Order[i] = i;
+	}
+
+	for(int Shift = 0; Shift < 32; Shift += 8) {
+		DWORD Offsets[257] = { 0 };
+		for(DWORD i = 0; i < Count; i++) {
+			Offsets[((Processes[Order[i]].ID >> Shift) & 0xFF) + 1]++;
+		}
+
+		/* All in one bucket, typically the high bytes of small PIDs */
+		if(Offsets[((Processes[Order[0]].ID >> Shift) & 0xFF) + 1] == Count)
+			continue;
+
+		for(int Digit = 0; Digit < 256; Digit++) {
+			Offsets[Digit + 1] += Offsets[Digit];
+		}
+		for(DWORD i = 0; i < Count; i++) {
+			Scratch[Offsets[(Processes[Order[i]].ID >> Shift) & 0xFF]++] = Order[i];
+		}
+
+		DWORD *Temp = Order;
+		Order = Scratch;
+		Scratch = Temp;
+	}
+
+	/* A PID seen twice in one snapshot is rare, order those by creation time */
+	for(DWORD i = 1; i < Count; i++) {
+		DWORD Index = Order[i];
+		DWORD j = i;
+		while(j > 0 && Processes[Order[j - 1]].ID == Processes[Index].ID &&
+				Processes[Order[j - 1]].CreationTime > Processes[Index].CreationTime) {
+			Order[j] = Order[j - 1];
+			j--;
+		}
+		Order[j] = Index;
+	}
+}
+
+static DWORD AddName(diff_snapshot *Snapshot, const TCHAR *Name)
+{
+	DWORD Length = (DWORD)_tcslen(Name) + 1;
+	if(Snapshot->NameLength + Length > Snapshot->NameCapacity) {
+		Snapshot->NameCapacity = (Snapshot->NameLength + Length) * 2;
+		Snapshot->Names = xrealloc(Snapshot->Names, Snapshot->NameCapacity * sizeof(*Snapshot->Names));
+	}
+
+	DWORD Offset = Snapshot->NameLength;
+	memcpy(&Snapshot->Names[Offset], Name, Length * sizeof(TCHAR));
+	Snapshot->NameLength += Length;
+	return Offset;
+}
+
+static void BuildSnapshot(diff_snapshot *Snapshot, const process *Processes, DWORD Count)
+{
+	if(Count > OrderCapacity) {
+		OrderCapacity = Count + Count / 2;
+		Order = xrealloc(Order, OrderCapacity * sizeof(*Order));
+		Scratch = xrealloc(Scratch, OrderCapacity * sizeof(*Scratch));
+	}
+	if(Count > Snapshot->Capacity) {
+		Snapshot->Capacity = Count + Count / 2;
+		Snapshot->Rows = xrealloc(Snapshot->Rows, Snapshot->Capacity * sizeof(*Snapshot->Rows));
+	}
+
+	if(Count > 0) {
+		SortByID(Processes, Count);
+	}
+
+	Snapshot->Count = Count;
+	Snapshot->NameLength = 0;
+
+	for(DWORD i = 0; i < Count; i++) {
+		const process *Process = &Processes[Order[i]];
+		diff_row *Row = &Snapshot->Rows[i];
+
+		Row->ID = Process->ID;
+		Row->Index = Order[i];
+		Row->CreationTime = Process->CreationTime;
+		Row->Fields[DIFF_FIELD_PARENT] = Process->ParentPID;
+		Row->Fields[DIFF_FIELD_PRIORITY] = (ULONGLONG)(LONGLONG)Process->BasePriority;
+		Row->Fields[DIFF_FIELD_THREADS] = Process->ThreadCount;
+		Row->Fields[DIFF_FIELD_CPU] = (ULONGLONG)floor(Process->PercentProcessorTime * 100.0 + 0.5);
+		Row->Fields[DIFF_FIELD_MEMORY] = Process->UsedMemory;
+		Row->Fields[DIFF_FIELD_DISK_READ] = Process->DiskReadRate;
+		Row->Fields[DIFF_FIELD_DISK_WRITE] = Process->DiskWriteRate;
+
+		Row->CPUTime = Process->CPUTime;
+		Row->NameOffset = AddName(Snapshot, Process->ExeName);
+		Row->UserOffset = AddName(Snapshot, Process->UserName);
+	}
+}
+
+static diff_event *AddEvent(diff_type Type, const diff_snapshot *Snapshot, const diff_row *Row)
+{
+	if(EventCount == EventCapacity) {
+		EventCapacity = EventCapacity ? EventCapacity * 2 : 1024;
+		Events = xrealloc(Events, EventCapacity * sizeof(*Events));
+	}
+
+	diff_event *Event = &Events[EventCount++];
+	Event->Type = Type;
+	Event->Field = DIFF_FIELD_COUNT;
+	Event->ID = Row->ID;
+	Event->CreationTime = Row->CreationTime;
+	Event->Index = Type == DIFF_DEATH ? (DWORD)-1 : Row->Index;
+	Event->ExeName = &Snapshot->Names[Row->NameOffset];
+	Event->UserName = &Snapshot->Names[Row->UserOffset];
+	Event->CPUTime = Row->CPUTime;
+	Event->Values = Row->Fields;
+	Event->Old = 0;
+	Event->New = 0;
+	return Event;
+}
+
+static int CompareKeys(const diff_row *A, const diff_row *B)
+{
+	if(A->ID != B->ID)
+		return A->ID < B->ID ? -1 : 1;
+	if(A->CreationTime != B->CreationTime)
+		return A->CreationTime < B->CreationTime ? -1 : 1;
+	return 0;
+}
+
+void DiffUpdate(const process *Processes, DWORD Count, diff_batch *Batch)
+{
+	const diff_snapshot *Old = &Snapshots[Previous];
+	diff_snapshot *New = &Snapshots[!Previous];
+
+	BuildSnapshot(New, Processes, Count);
+
+	memset(Batch, 0, sizeof(*Batch));
+	EventCount = 0;
+
+	DWORD i = 0, j = 0;
+	while(i < Old->Count || j < New->Count) {
+		int Compare;
+		if(i == Old->Count) {
+			Compare = 1;
+		} else if(j == New->Count) {
+			Compare = -1;
+		} else {
+			Compare = CompareKeys(&Old->Rows[i], &New->Rows[j]);
+		}
+
+		if(Compare < 0) {
+			AddEvent(DIFF_DEATH, Old, &Old->Rows[i++]);
+			Batch->Deaths++;
+		} else if(Compare > 0) {
+			AddEvent(DIFF_BIRTH, New, &New->Rows[j++]);
+			Batch->Births++;
+		} else {
+			const diff_row *OldRow = &Old->Rows[i++];
+			const diff_row *NewRow = &New->Rows[j++];
+
+			for(int Field = 0; Field < DIFF_FIELD_COUNT; Field++) {
+				if(OldRow->Fields[Field] == NewRow->Fields[Field])
+					continue;
+				/* A thread count of 0 is unknown, not a change */
+				if(Field == DIFF_FIELD_THREADS && (OldRow->Fields[Field] == 0 || NewRow->Fields[Field] == 0))
+					continue;
+
+				diff_event *Event = AddEvent(DIFF_CHANGE, New, NewRow);
+				Event->Field = (diff_field)Field;
+				Event->Old = OldRow->Fields[Field];
+				Event->New = NewRow->Fields[Field];
+				Batch->Changes++;
+			}
+		}
+	}
+
+	Previous = !Previous;
+
+	Batch->Events = Events;
+	Batch->Count = EventCount;
+}
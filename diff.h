@@ -0,0 +1,76 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIFF_H
+#define DIFF_H
+
+#include "ntop.h"
+
+/*
+ * Compares each snapshot with the one before and reports what happened in
+ * between as one batch of events: processes that appeared, processes that
+ * went away and fields that changed, with old and new values. Processes
+ * are matched by PID and creation time. The previous snapshot is kept
+ * here as a compact copy sorted by that key, so matching is a single
+ * merge after a radix sort of the new snapshot.
+ */
+
+typedef enum diff_type {
+	DIFF_BIRTH,
+	DIFF_DEATH,
+	DIFF_CHANGE,
+} diff_type;
+
+typedef enum diff_field {
+	DIFF_FIELD_PARENT,
+	DIFF_FIELD_PRIORITY,
+	DIFF_FIELD_THREADS,
+	DIFF_FIELD_CPU,			/* hundredths of a percent */
+	DIFF_FIELD_MEMORY,
+	DIFF_FIELD_DISK_READ,
+	DIFF_FIELD_DISK_WRITE,
+	DIFF_FIELD_COUNT,
+} diff_field;
+
+typedef struct diff_event {
+	diff_type Type;
+	diff_field Field;		/* DIFF_CHANGE only */
+	DWORD ID;
+	ULONGLONG CreationTime;
+	DWORD Index;			/* in the new snapshot, (DWORD)-1 for a death */
+	const TCHAR *ExeName;		/* valid until the next DiffUpdate */
+	const TCHAR *UserName;
+	ULONGLONG CPUTime;		/* 100ns units */
+	const ULONGLONG *Values;	/* DIFF_FIELD_COUNT, the last ones seen for a death */
+	ULONGLONG Old;			/* DIFF_CHANGE only */
+	ULONGLONG New;
+} diff_event;
+
+typedef struct diff_batch {
+	const diff_event *Events;	/* births, deaths and changes in key order */
+	DWORD Count;
+	DWORD Births;
+	DWORD Deaths;
+	DWORD Changes;
+} diff_batch;
+
+/* The batch stays valid until the next call */
+void DiffUpdate(const process *Processes, DWORD Count, diff_batch *Batch);
+
+const TCHAR *DiffFieldName(diff_field Field);
+
+#endif
@@ -0,0 +1,545 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Before windows.h, which would pull in the old winsock.h otherwise */
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include "export.h"
+#include "util.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The listening socket takes one more, select() handles at most FD_SETSIZE */
+#define EXPORT_MAX_CLIENTS 32
+#define EXPORT_REQUEST_SIZE 2048
+#define EXPORT_TIMEOUT 10000	/* ms for a client to send its request and read the response */
+#define EXPORT_LABEL_SIZE 512
+
+typedef struct export_body {
+	LONG References;
+	DWORD Length;
+	char *Data;
+} export_body;
+
+typedef struct export_client {
+	SOCKET Socket;
+	ULONGLONG Start;
+	char Request[EXPORT_REQUEST_SIZE];
+	DWORD RequestLength;
+	BOOL Responding;
+	char Header[256];
+	DWORD HeaderLength;
+	export_body *Body;	/* 0 for responses that fit in Header */
+	DWORD Sent;		/* of Header and Body together */
+} export_client;
+
+static SOCKET Listener = INVALID_SOCKET;
+static export_client Clients[EXPORT_MAX_CLIENTS];
+static DWORD ClientCount;
+
+/* Guards Current and the reference counts */
+static CRITICAL_SECTION BodyLock;
+static export_body *Current;
+
+static DWORD TopN = 20;
+
+/* The response being rendered by the collector */
+static char *Text;
+static DWORD TextLength;
+static DWORD TextCapacity = 64 * 1024;
+
+static const process *RankedProcesses;
+static DWORD *Ranks;
+static BYTE *Chosen;
+static DWORD RankCapacity;
+
+/* Indices of the chosen processes in snapshot order, and their labels */
+static DWORD *Selected;
+static char (*Labels)[EXPORT_LABEL_SIZE];
+static DWORD SelectedCapacity;
+
+static void ReleaseBody(export_body *Body)
+{
+	EnterCriticalSection(&BodyLock);
+	BOOL Last = --Body->References == 0;
+	LeaveCriticalSection(&BodyLock);
+
+	if(Last) {
+		free(Body->Data);
+		free(Body);
+	}
+}
+
+static export_body *AcquireBody(void)
+{
+	EnterCriticalSection(&BodyLock);
+	export_body *Body = Current;
+	if(Body) {
+		Body->References++;
+	}
+	LeaveCriticalSection(&BodyLock);
+	return Body;
+}
+
+static void Append(const char *Fmt, ...)
+{
+	va_list VaList;
+
+	for(;;) {
+		DWORD Free = TextCapacity - TextLength;
+
+		va_start(VaList, Fmt);
+		int Length = vsnprintf(Text + TextLength, Free, Fmt, VaList);
+		va_end(VaList);
+
+		if(Length < 0)
+			return;
+		if((DWORD)Length < Free) {
+			TextLength += Length;
+			return;
+		}
+
+		TextCapacity = TextCapacity * 2 + Length;
+		Text = xrealloc(Text, TextCapacity);
+	}
+}
+
+static void AppendFamily(const char *Name, const char *Type, const char *Help)
+{
+	Append("# HELP %s %s\n# TYPE %s %s\n", Name, Help, Name, Type);
+}
+
+/* Label values escape backslashes, double quotes and line feeds */
+static void EscapeLabel(const TCHAR *Value, char *Dest, size_t DestSize)
+{
+	char Utf8[MAX_PATH * 4];
+	size_t Length = 0;
+
+	TCharToUtf8(Value, Utf8, sizeof(Utf8));
+
+	for(const char *c = Utf8; *c && Length + 2 < DestSize; c++) {
+		if(*c == '\\' || *c == '"') {
+			Dest[Length++] = '\\';
+			Dest[Length++] = *c;
+		} else if(*c == '\n') {
+			Dest[Length++] = '\\';
+			Dest[Length++] = 'n';
+		} else {
+			Dest[Length++] = *c;
+		}
+	}
+	Dest[Length] = '\0';
+}
+
+static int CompareCPU(const void *A, const void *B)
+{
+	double CPUA = RankedProcesses[*(const DWORD *)A].PercentProcessorTime;
+	double CPUB = RankedProcesses[*(const DWORD *)B].PercentProcessorTime;
+	return (CPUA < CPUB) - (CPUA > CPUB);
+}
+
+static int CompareMemory(const void *A, const void *B)
+{
+	unsigned __int64 MemoryA = RankedProcesses[*(const DWORD *)A].UsedMemory;
+	unsigned __int64 MemoryB = RankedProcesses[*(const DWORD *)B].UsedMemory;
+	return (MemoryA < MemoryB) - (MemoryA > MemoryB);
+}
+
+/* Marks the first TopN processes in the order of Compare */
+static void MarkTop(DWORD Count, int (*Compare)(const void *, const void *))
+{
+	qsort(Ranks, Count, sizeof(*Ranks), Compare);
+	for(DWORD i = 0; i < min(TopN, Count); i++) {
+		Chosen[Ranks[i]] = TRUE;
+	}
+}
+
+/*
+ * Selects the top TopN processes by CPU and by memory and labels them,
+ * returns how many there are, at most 2 * TopN.
+ */
+static DWORD ChooseProcesses(const process *Processes, DWORD Count)
+{
+	if(Count > RankCapacity) {
+		RankCapacity = Count + Count / 2;
+		Ranks = xrealloc(Ranks, RankCapacity * sizeof(*Ranks));
+		Chosen = xrealloc(Chosen, RankCapacity * sizeof(*Chosen));
+	}
+	DWORD MaxChosen = min(2 * min(TopN, Count), Count);
+	if(MaxChosen > SelectedCapacity) {
+		SelectedCapacity = MaxChosen;
+		Selected = xrealloc(Selected, SelectedCapacity * sizeof(*Selected));
+		Labels = xrealloc(Labels, SelectedCapacity * sizeof(*Labels));
+	}
+
+	memset(Chosen, 0, Count * sizeof(*Chosen));
+	if(TopN == 0)
+		return 0;
+
+	RankedProcesses = Processes;
+	for(DWORD i = 0; i < Count; i++) {
+		Ranks[i] = i;
+	}
+
+	MarkTop(Count, CompareCPU);
+	MarkTop(Count, CompareMemory);
+
+	DWORD ChosenCount = 0;
+	for(DWORD i = 0; i < Count; i++) {
+		if(!Chosen[i])
+			continue;
+
+		char Name[EXPORT_LABEL_SIZE / 2];
+		char User[UNLEN * 2];
+		EscapeLabel(Processes[i].ExeName, Name, sizeof(Name));
+		EscapeLabel(Processes[i].UserName, User, sizeof(User));
+		_snprintf_s(Labels[ChosenCount], EXPORT_LABEL_SIZE, _TRUNCATE, "pid=\"%u\",name=\"%s\",user=\"%s\"",
+				Processes[i].ID, Name, User);
+		Selected[ChosenCount++] = i;
+	}
+
+	return ChosenCount;
+}
+
+typedef enum export_metric {
+	METRIC_CPU,
+	METRIC_CPU_SECONDS,
+	METRIC_MEMORY,
+	METRIC_THREADS,
+	METRIC_DISK_READ,
+	METRIC_DISK_WRITE,
+	METRIC_START_TIME,
+	METRIC_COUNT,
+} export_metric;
+
+static const struct {
+	const char *Name;
+	const char *Type;
+	const char *Help;
+} ProcessMetrics[METRIC_COUNT] = {
+	{ "ntop_process_cpu_ratio", "gauge", "Share of all processors used by the process over the last interval." },
+	{ "ntop_process_cpu_seconds_total", "counter", "Kernel and user CPU time of the process." },
+	{ "ntop_process_memory_bytes", "gauge", "Working set of the process." },
+	{ "ntop_process_threads", "gauge", "Threads of the process." },
+	{ "ntop_process_disk_read_bytes_per_second", "gauge", "Bytes read by the process per second over the last interval." },
+	{ "ntop_process_disk_write_bytes_per_second", "gauge", "Bytes written by the process per second over the last interval." },
+	{ "ntop_process_start_time_seconds", "gauge", "Creation time of the process since the Unix epoch." },
+};
+
+static double ProcessMetricValue(export_metric Metric, const process *Process)
+{
+	switch(Metric) {
+	case METRIC_CPU:
+		return Process->PercentProcessorTime / 100.0;
+	case METRIC_CPU_SECONDS:
+		return (double)Process->CPUTime / 1e7;
+	case METRIC_MEMORY:
+		return (double)Process->UsedMemory;
+	case METRIC_THREADS:
+		return (double)Process->ThreadCount;
+	case METRIC_DISK_READ:
+		return (double)Process->DiskReadRate;
+	case METRIC_DISK_WRITE:
+		return (double)Process->DiskWriteRate;
+	case METRIC_START_TIME:
+		if(Process->CreationTime <= FILETIME_UNIX_EPOCH)
+			return 0.0;
+		return (double)(Process->CreationTime - FILETIME_UNIX_EPOCH) / 1e7;
+	default:
+		return 0.0;
+	}
+}
+
+/* Called by the collector once per snapshot */
+void ExportPublish(const system_summary *Summary, const process *Processes, DWORD Count)
+{
+	if(Listener == INVALID_SOCKET)
+		return;
+
+	Text = xmalloc(TextCapacity);
+	TextLength = 0;
+
+	DWORD ChosenCount = ChooseProcesses(Processes, Count);
+
+	AppendFamily("ntop_cpu_usage_ratio", "gauge", "Share of all processors in use over the last interval.");
+	Append("ntop_cpu_usage_ratio %.4f\n", Summary->CPUUsage);
+	AppendFamily("ntop_memory_used_bytes", "gauge", "Physical memory in use.");
+	Append("ntop_memory_used_bytes %llu\n", Summary->UsedMemory);
+	AppendFamily("ntop_memory_total_bytes", "gauge", "Physical memory installed.");
+	Append("ntop_memory_total_bytes %llu\n", Summary->TotalMemory);
+	AppendFamily("ntop_pagefile_used_bytes", "gauge", "Commit charge.");
+	Append("ntop_pagefile_used_bytes %llu\n", Summary->UsedPageMemory);
+	AppendFamily("ntop_pagefile_total_bytes", "gauge", "Commit limit.");
+	Append("ntop_pagefile_total_bytes %llu\n", Summary->TotalPageMemory);
+	AppendFamily("ntop_uptime_seconds", "gauge", "Time since the system started.");
+	Append("ntop_uptime_seconds %.3f\n", (double)Summary->UpTime / 1000.0);
+	AppendFamily("ntop_processes", "gauge", "Processes in the snapshot.");
+	Append("ntop_processes %u\n", Summary->ProcessCount);
+	AppendFamily("ntop_processes_running", "gauge", "Processes that used CPU in the last interval.");
+	Append("ntop_processes_running %u\n", Summary->RunningProcessCount);
+	AppendFamily("ntop_exported_processes", "gauge", "Processes with per-process series, the top ones by CPU and by memory.");
+	Append("ntop_exported_processes %u\n", ChosenCount);
+
+	for(int Metric = 0; Metric < METRIC_COUNT && ChosenCount > 0; Metric++) {
+		AppendFamily(ProcessMetrics[Metric].Name, ProcessMetrics[Metric].Type, ProcessMetrics[Metric].Help);
+		for(DWORD i = 0; i < ChosenCount; i++) {
+			/* No sample rather than 0 threads for a process whose threads -p could not walk */
+			if(Metric == METRIC_THREADS && Processes[Selected[i]].ThreadCount == 0)
+				continue;
+			Append("%s{%s} %.17g\n", ProcessMetrics[Metric].Name, Labels[i],
+					ProcessMetricValue((export_metric)Metric, &Processes[Selected[i]]));
+		}
+	}
+
+	export_body *Body = xmalloc(sizeof(*Body));
+	Body->References = 1;
+	Body->Length = TextLength;
+	Body->Data = Text;
+	Text = 0;
+
+	EnterCriticalSection(&BodyLock);
+	export_body *Previous = Current;
+	Current = Body;
+	LeaveCriticalSection(&BodyLock);
+
+	if(Previous) {
+		ReleaseBody(Previous);
+	}
+}
+
+static void Respond(export_client *Client, const char *Status, export_body *Body, const char *Message)
+{
+	DWORD Length = Body ? Body->Length : (DWORD)strlen(Message);
+
+	Client->HeaderLength = (DWORD)_snprintf_s(Client->Header, sizeof(Client->Header), _TRUNCATE,
+			"HTTP/1.1 %s\r\n"
+			"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+			"Content-Length: %u\r\n"
+			"Connection: close\r\n"
+			"\r\n%s", Status, Length, Body ? "" : Message);
+	Client->Body = Body;
+	Client->Sent = 0;
+	Client->Responding = TRUE;
+}
+
+/* FALSE once the client is to be closed */
+static BOOL ReadRequest(export_client *Client)
+{
+	int Received = recv(Client->Socket, Client->Request + Client->RequestLength,
+			EXPORT_REQUEST_SIZE - 1 - Client->RequestLength, 0);
+	if(Received == 0)
+		return FALSE;
+	if(Received == SOCKET_ERROR)
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+
+	Client->RequestLength += Received;
+	Client->Request[Client->RequestLength] = '\0';
+
+	if(!strstr(Client->Request, "\r\n\r\n")) {
+		if(Client->RequestLength == EXPORT_REQUEST_SIZE - 1) {
+			Respond(Client, "431 Request Header Fields Too Large", 0, "Request too large\n");
+		}
+		return TRUE;
+	}
+
+	if(strncmp(Client->Request, "GET /metrics ", 13) != 0 && strncmp(Client->Request, "GET /metrics?", 13) != 0) {
+		Respond(Client, "404 Not Found", 0, "Not found, metrics are at /metrics\n");
+		return TRUE;
+	}
+
+	export_body *Body = AcquireBody();
+	if(Body) {
+		Respond(Client, "200 OK", Body, 0);
+	} else {
+		Respond(Client, "503 Service Unavailable", 0, "No snapshot yet\n");
+	}
+	return TRUE;
+}
+
+/* Header and body go out in one gather send, the body straight from the shared buffer */
+static BOOL SendResponse(export_client *Client)
+{
+	WSABUF Buffers[2];
+	DWORD BufferCount = 0;
+	DWORD BodyLength = Client->Body ? Client->Body->Length : 0;
+
+	if(Client->Sent < Client->HeaderLength) {
+		Buffers[BufferCount].buf = Client->Header + Client->Sent;
+		Buffers[BufferCount].len = Client->HeaderLength - Client->Sent;
+		BufferCount++;
+		if(BodyLength > 0) {
+			Buffers[BufferCount].buf = Client->Body->Data;
+			Buffers[BufferCount].len = BodyLength;
+			BufferCount++;
+		}
+	} else {
+		DWORD Offset = Client->Sent - Client->HeaderLength;
+		Buffers[BufferCount].buf = Client->Body->Data + Offset;
+		Buffers[BufferCount].len = BodyLength - Offset;
+		BufferCount++;
+	}
+
+	DWORD Sent;
+	if(WSASend(Client->Socket, Buffers, BufferCount, &Sent, 0, 0, 0) == SOCKET_ERROR)
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+
+	Client->Sent += Sent;
+	return Client->Sent < Client->HeaderLength + BodyLength;
+}
+
+static void CloseClient(export_client *Client)
+{
+	if(Client->Body) {
+		ReleaseBody(Client->Body);
+	}
+	shutdown(Client->Socket, SD_SEND);
+	closesocket(Client->Socket);
+}
+
+static void AcceptClient(ULONGLONG Now)
+{
+	SOCKET Socket = accept(Listener, 0, 0);
+	if(Socket == INVALID_SOCKET)
+		return;
+
+	unsigned long NonBlocking = 1;
+	ioctlsocket(Socket, FIONBIO, &NonBlocking);
+
+	export_client *Client = &Clients[ClientCount++];
+	memset(Client, 0, sizeof(*Client));
+	Client->Socket = Socket;
+	Client->Start = Now;
+}
+
+static DWORD WINAPI ExportThreadProc(LPVOID lpParam)
+{
+	UNREFERENCED_PARAMETER(lpParam);
+
+	for(;;) {
+		fd_set ReadSet, WriteSet;
+		FD_ZERO(&ReadSet);
+		FD_ZERO(&WriteSet);
+
+		if(ClientCount < EXPORT_MAX_CLIENTS) {
+			FD_SET(Listener, &ReadSet);
+		}
+		for(DWORD i = 0; i < ClientCount; i++) {
+			if(Clients[i].Responding) {
+				FD_SET(Clients[i].Socket, &WriteSet);
+			} else {
+				FD_SET(Clients[i].Socket, &ReadSet);
+			}
+		}
+
+		/* Wakes up now and then to drop clients past their deadline */
+		struct timeval Timeout = { 1, 0 };
+		if(select(0, &ReadSet, &WriteSet, 0, &Timeout) == SOCKET_ERROR) {
+			Sleep(100);
+			continue;
+		}
+
+		ULONGLONG Now = GetTickCount64();
+
+		for(DWORD i = 0; i < ClientCount; ) {
+			export_client *Client = &Clients[i];
+
+			/* The deadline covers the whole exchange, a slow sender or reader is cut off too */
+			BOOL Open = Now - Client->Start < EXPORT_TIMEOUT;
+
+			if(Open && FD_ISSET(Client->Socket, &ReadSet)) {
+				Open = ReadRequest(Client);
+			} else if(Open && FD_ISSET(Client->Socket, &WriteSet)) {
+				Open = SendResponse(Client);
+			}
+
+			if(Open) {
+				i++;
+			} else {
+				CloseClient(Client);
+				Clients[i] = Clients[--ClientCount];
+			}
+		}
+
+		if(FD_ISSET(Listener, &ReadSet)) {
+			AcceptClient(Now);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Binds to Address, "IPv4:PORT", and starts serving. Fails if the
+ * address is malformed or taken.
+ */
+BOOL ExportListen(const TCHAR *Address)
+{
+	char Host[64];
+	TCharToUtf8(Address, Host, sizeof(Host));
+
+	char *Colon = strrchr(Host, ':');
+	if(!Colon)
+		return FALSE;
+	*Colon = '\0';
+
+	unsigned long Port = strtoul(Colon + 1, 0, 10);
+	if(Port == 0 || Port > 65535)
+		return FALSE;
+
+	struct sockaddr_in SockAddr = { 0 };
+	SockAddr.sin_family = AF_INET;
+	SockAddr.sin_port = htons((unsigned short)Port);
+	if(inet_pton(AF_INET, Host, &SockAddr.sin_addr) != 1)
+		return FALSE;
+
+	WSADATA WsaData;
+	if(WSAStartup(MAKEWORD(2, 2), &WsaData) != 0)
+		return FALSE;
+
+	SOCKET Socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if(Socket == INVALID_SOCKET)
+		return FALSE;
+
+	/* Nobody else can bind the same port and read the scrapes */
+	BOOL Exclusive = TRUE;
+	setsockopt(Socket, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char *)&Exclusive, sizeof(Exclusive));
+
+	unsigned long NonBlocking = 1;
+	if(bind(Socket, (struct sockaddr *)&SockAddr, sizeof(SockAddr)) == SOCKET_ERROR ||
+			listen(Socket, SOMAXCONN) == SOCKET_ERROR ||
+			ioctlsocket(Socket, FIONBIO, &NonBlocking) == SOCKET_ERROR) {
+		closesocket(Socket);
+		return FALSE;
+	}
+
+	Listener = Socket;
+	InitializeCriticalSection(&BodyLock);
+	CreateThread(0, 0, ExportThreadProc, 0, 0, 0);
+	return TRUE;
+}
+
+BOOL ExportEnabled(void)
+{
+	return Listener != INVALID_SOCKET;
+}
+
+void ExportSetTopN(DWORD Count)
+{
+	TopN = Count;
+}
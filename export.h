@@ -0,0 +1,36 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "ntop.h"
+
+/*
+ * Serves the latest snapshot at /metrics in the Prometheus text format.
+ * The collector renders the response once per cycle; a small server
+ * thread then sends that same buffer to every scraper, which holds a
+ * reference to it until its response is out. Per-process series are
+ * limited to the top N processes by CPU and the top N by memory.
+ */
+
+BOOL ExportListen(const TCHAR *Address);
+BOOL ExportEnabled(void);
+void ExportSetTopN(DWORD Count);
+void ExportPublish(const system_summary *Summary, const process *Processes, DWORD Count);
+
+#endif
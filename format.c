@@ -0,0 +1,388 @@
+/* 
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "format.h"
+#include "util.h"
+#include <math.h>
+
+int GetOutputFormatFromName(const TCHAR *Name, output_format *Dest)
+{
+	if(!lstrcmpi(Name, _T("text"))) {
+		*Dest = FORMAT_TEXT;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("jsonl"))) {
+		*Dest = FORMAT_JSONL;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("csv"))) {
+		*Dest = FORMAT_CSV;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("tsv"))) {
+		*Dest = FORMAT_TSV;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+void OutReset(out_buffer *Out)
+{
+	Out->Length = 0;
+}
+
+static void OutReserve(out_buffer *Out, size_t Length)
+{
+	if(Out->Length + Length <= Out->Capacity)
+		return;
+
+	size_t Capacity = Out->Capacity ? Out->Capacity : 65536;
+	while(Capacity < Out->Length + Length) {
+		Capacity *= 2;
+	}
+
+	Out->Data = xrealloc(Out->Data, Capacity);
+	Out->Capacity = Capacity;
+}
+
+void OutAppend(out_buffer *Out, const char *Data, size_t Length)
+{
+	OutReserve(Out, Length);
+	memcpy(Out->Data + Out->Length, Data, Length);
+	Out->Length += Length;
+}
+
+void OutAppendStr(out_buffer *Out, const char *Str)
+{
+	OutAppend(Out, Str, strlen(Str));
+}
+
+static void OutAppendChar(out_buffer *Out, char c)
+{
+	OutReserve(Out, 1);
+	Out->Data[Out->Length++] = c;
+}
+
+void OutAppendU64(out_buffer *Out, ULONGLONG Value)
+{
+	char Digits[20];
+	int Count = 0;
+
+	do {
+		Digits[Count++] = (char)('0' + Value % 10);
+		Value /= 10;
+	} while(Value);
+
+	OutReserve(Out, Count);
+	while(Count) {
+		Out->Data[Out->Length++] = Digits[--Count];
+	}
+}
+
+/*
+ * Fixed-point with six decimals and trailing zeros trimmed. That is well
+ * below the resolution of anything NTop measures, and avoids going through
+ * printf for every value.
+ */
+void OutAppendDouble(out_buffer *Out, double Value)
+{
+	if(!(Value == Value) || Value > 1e12 || Value < -1e12) {
+		OutAppendChar(Out, '0');
+		return;
+	}
+
+	if(Value < 0) {
+		OutAppendChar(Out, '-');
+		Value = -Value;
+	}
+
+	ULONGLONG Scaled = (ULONGLONG)(Value * 1000000.0 + 0.5);
+	ULONGLONG Fraction = Scaled % 1000000;
+	OutAppendU64(Out, Scaled / 1000000);
+
+	if(Fraction == 0)
+		return;
+
+	char Digits[7];
+	for(int i = 5; i >= 0; i--) {
+		Digits[i] = (char)('0' + Fraction % 10);
+		Fraction /= 10;
+	}
+
+	int Length = 6;
+	while(Digits[Length - 1] == '0') {
+		Length--;
+	}
+
+	OutAppendChar(Out, '.');
+	OutAppend(Out, Digits, Length);
+}
+
+ULONGLONG GetUnixTimeMs(void)
+{
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+
+	ULARGE_INTEGER Time;
+	Time.LowPart = Now.dwLowDateTime;
+	Time.HighPart = Now.dwHighDateTime;
+
+	/* FILETIME counts 100ns intervals since 1601-01-01 */
+	return (Time.QuadPart - 116444736000000000ULL) / 10000;
+}
+
+static void OutAppendJsonString(out_buffer *Out, const TCHAR *Str)
+{
+	char Utf8[MAX_PATH * 4];
+	int Length = TCharToUtf8(Str, Utf8, sizeof(Utf8));
+
+	OutReserve(Out, Length * 6 + 2);
+	char *Dest = Out->Data + Out->Length;
+	*Dest++ = '"';
+	for(int i = 0; i < Length; i++) {
+		unsigned char c = (unsigned char)Utf8[i];
+		if(c == '"' || c == '\\') {
+			*Dest++ = '\\';
+			*Dest++ = (char)c;
+		} else if(c < 0x20) {
+			static const char Hex[] = "0123456789abcdef";
+			*Dest++ = '\\';
+			*Dest++ = 'u';
+			*Dest++ = '0';
+			*Dest++ = '0';
+			*Dest++ = Hex[c >> 4];
+			*Dest++ = Hex[c & 0xF];
+		} else {
+			*Dest++ = (char)c;
+		}
+	}
+	*Dest++ = '"';
+	Out->Length = Dest - Out->Data;
+}
+
+/*
+ * CSV fields are quoted only when needed (RFC 4180). TSV has no quoting,
+ * so tabs and line breaks inside a field are replaced by spaces.
+ */
+static void OutAppendDelimitedString(out_buffer *Out, const TCHAR *Str, char Delimiter)
+{
+	char Utf8[MAX_PATH * 4];
+	int Length = TCharToUtf8(Str, Utf8, sizeof(Utf8));
+
+	if(Delimiter == '\t') {
+		OutReserve(Out, Length);
+		for(int i = 0; i < Length; i++) {
+			char c = Utf8[i];
+			Out->Data[Out->Length++] = (c == '\t' || c == '\r' || c == '\n') ? ' ' : c;
+		}
+		return;
+	}
+
+	BOOL NeedsQuotes = FALSE;
+	for(int i = 0; i < Length; i++) {
+		char c = Utf8[i];
+		if(c == Delimiter || c == '"' || c == '\r' || c == '\n') {
+			NeedsQuotes = TRUE;
+			break;
+		}
+	}
+
+	if(!NeedsQuotes) {
+		OutAppend(Out, Utf8, Length);
+		return;
+	}
+
+	OutReserve(Out, Length * 2 + 2);
+	Out->Data[Out->Length++] = '"';
+	for(int i = 0; i < Length; i++) {
+		if(Utf8[i] == '"') {
+			Out->Data[Out->Length++] = '"';
+		}
+		Out->Data[Out->Length++] = Utf8[i];
+	}
+	Out->Data[Out->Length++] = '"';
+}
+
+static void FormatJsonLines(out_buffer *Out, ULONGLONG Timestamp, const system_summary *System,
+		const process *Processes, DWORD Count)
+{
+	OutAppendStr(Out, "{\"type\":\"system\",\"ts\":");
+	OutAppendU64(Out, Timestamp);
+	OutAppendStr(Out, ",\"cpu\":");
+	OutAppendDouble(Out, 100.0 * System->CPUUsage);
+	OutAppendStr(Out, ",\"mem_total\":");
+	OutAppendU64(Out, System->TotalMemory);
+	OutAppendStr(Out, ",\"mem_used\":");
+	OutAppendU64(Out, System->UsedMemory);
+	OutAppendStr(Out, ",\"page_total\":");
+	OutAppendU64(Out, System->TotalPageMemory);
+	OutAppendStr(Out, ",\"page_used\":");
+	OutAppendU64(Out, System->UsedPageMemory);
+	OutAppendStr(Out, ",\"uptime_ms\":");
+	OutAppendU64(Out, System->UpTime);
+	OutAppendStr(Out, ",\"processes\":");
+	OutAppendU64(Out, System->ProcessCount);
+	OutAppendStr(Out, ",\"running\":");
+	OutAppendU64(Out, System->RunningProcessCount);
+	OutAppendStr(Out, "}\n");
+
+	for(DWORD i = 0; i < Count; i++) {
+		const process *Process = &Processes[i];
+
+		OutAppendStr(Out, "{\"type\":\"process\",\"ts\":");
+		OutAppendU64(Out, Timestamp);
+		OutAppendStr(Out, ",\"pid\":");
+		OutAppendU64(Out, Process->ID);
+		OutAppendStr(Out, ",\"ppid\":");
+		OutAppendU64(Out, Process->ParentPID);
+		OutAppendStr(Out, ",\"user\":");
+		OutAppendJsonString(Out, Process->UserName);
+		OutAppendStr(Out, ",\"priority\":");
+		OutAppendU64(Out, Process->BasePriority);
+		OutAppendStr(Out, ",\"cpu\":");
+		OutAppendDouble(Out, Process->PercentProcessorTime);
+		OutAppendStr(Out, ",\"mem\":");
+		OutAppendU64(Out, Process->UsedMemory);
+		OutAppendStr(Out, ",\"threads\":");
+		OutAppendU64(Out, Process->ThreadCount);
+		OutAppendStr(Out, ",\"disk_bps\":");
+		OutAppendU64(Out, Process->DiskUsage);
+		OutAppendStr(Out, ",\"disk_bytes\":");
+		OutAppendU64(Out, Process->DiskOperations);
+		OutAppendStr(Out, ",\"disk_read_bps\":");
+		OutAppendU64(Out, Process->DiskReadRate);
+		OutAppendStr(Out, ",\"disk_write_bps\":");
+		OutAppendU64(Out, Process->DiskWriteRate);
+		OutAppendStr(Out, ",\"disk_other_bps\":");
+		OutAppendU64(Out, Process->DiskOtherRate);
+		OutAppendStr(Out, ",\"disk_read_iops\":");
+		OutAppendDouble(Out, Process->DiskReadOps);
+		OutAppendStr(Out, ",\"disk_write_iops\":");
+		OutAppendDouble(Out, Process->DiskWriteOps);
+		OutAppendStr(Out, ",\"uptime_ms\":");
+		OutAppendU64(Out, Process->UpTime);
+		OutAppendStr(Out, ",\"name\":");
+		OutAppendJsonString(Out, Process->ExeName);
+		OutAppendStr(Out, "}\n");
+	}
+}
+
+/*
+ * Every row carries the system values of its snapshot in the leading
+ * columns, so the output stays plain RFC 4180 with one record type. They
+ * are formatted once per snapshot and copied into each row.
+ */
+static void FormatDelimited(out_buffer *Out, char Delimiter, BOOL WriteHeader, ULONGLONG Timestamp,
+		const system_summary *System, const process *Processes, DWORD Count)
+{
+	static const char *Columns[] = {
+		"ts", "sys_cpu", "sys_mem_total", "sys_mem_used", "sys_page_total", "sys_page_used",
+		"sys_uptime_ms", "sys_processes", "sys_running",
+		"pid", "ppid", "user", "priority", "cpu", "mem", "threads",
+		"disk_bps", "disk_bytes", "disk_read_bps", "disk_write_bps", "disk_other_bps",
+		"disk_read_iops", "disk_write_iops", "uptime_ms", "name",
+	};
+
+	if(WriteHeader) {
+		for(DWORD i = 0; i < _countof(Columns); i++) {
+			if(i != 0)
+				OutAppendChar(Out, Delimiter);
+			OutAppendStr(Out, Columns[i]);
+		}
+		OutAppendChar(Out, '\n');
+	}
+
+	/* Built at the end of Out, then taken back out of it */
+	size_t PrefixStart = Out->Length;
+	OutAppendU64(Out, Timestamp);
+	OutAppendChar(Out, Delimiter);
+	OutAppendDouble(Out, 100.0 * System->CPUUsage);
+	OutAppendChar(Out, Delimiter);
+	OutAppendU64(Out, System->TotalMemory);
+	OutAppendChar(Out, Delimiter);
+	OutAppendU64(Out, System->UsedMemory);
+	OutAppendChar(Out, Delimiter);
+	OutAppendU64(Out, System->TotalPageMemory);
+	OutAppendChar(Out, Delimiter);
+	OutAppendU64(Out, System->UsedPageMemory);
+	OutAppendChar(Out, Delimiter);
+	OutAppendU64(Out, System->UpTime);
+	OutAppendChar(Out, Delimiter);
+	OutAppendU64(Out, System->ProcessCount);
+	OutAppendChar(Out, Delimiter);
+	OutAppendU64(Out, System->RunningProcessCount);
+	OutAppendChar(Out, Delimiter);
+
+	char Prefix[256];
+	size_t PrefixLength = Out->Length - PrefixStart;
+	memcpy(Prefix, Out->Data + PrefixStart, PrefixLength);
+	Out->Length = PrefixStart;
+
+	for(DWORD i = 0; i < Count; i++) {
+		const process *Process = &Processes[i];
+
+		OutAppend(Out, Prefix, PrefixLength);
+		OutAppendU64(Out, Process->ID);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->ParentPID);
+		OutAppendChar(Out, Delimiter);
+		OutAppendDelimitedString(Out, Process->UserName, Delimiter);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->BasePriority);
+		OutAppendChar(Out, Delimiter);
+		OutAppendDouble(Out, Process->PercentProcessorTime);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->UsedMemory);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->ThreadCount);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->DiskUsage);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->DiskOperations);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->DiskReadRate);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->DiskWriteRate);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->DiskOtherRate);
+		OutAppendChar(Out, Delimiter);
+		OutAppendDouble(Out, Process->DiskReadOps);
+		OutAppendChar(Out, Delimiter);
+		OutAppendDouble(Out, Process->DiskWriteOps);
+		OutAppendChar(Out, Delimiter);
+		OutAppendU64(Out, Process->UpTime);
+		OutAppendChar(Out, Delimiter);
+		OutAppendDelimitedString(Out, Process->ExeName, Delimiter);
+		OutAppendChar(Out, '\n');
+	}
+}
+
+void FormatSnapshot(out_buffer *Out, output_format Format, BOOL WriteHeader, ULONGLONG Timestamp,
+		const system_summary *System, const process *Processes, DWORD Count)
+{
+	switch(Format) {
+	case FORMAT_JSONL:
+		FormatJsonLines(Out, Timestamp, System, Processes, Count);
+		break;
+	case FORMAT_CSV:
+		FormatDelimited(Out, ',', WriteHeader, Timestamp, System, Processes, Count);
+		break;
+	case FORMAT_TSV:
+		FormatDelimited(Out, '\t', WriteHeader, Timestamp, System, Processes, Count);
+		break;
+	case FORMAT_TEXT:
+		break;
+	}
+}
@@ -0,0 +1,53 @@
+/* 
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "ntop.h"
+
+typedef enum output_format {
+	FORMAT_TEXT,
+	FORMAT_JSONL,
+	FORMAT_CSV,
+	FORMAT_TSV,
+} output_format;
+
+/*
+ * Growable byte buffer that is reused between snapshots, so serializing
+ * does not allocate once it has reached its working size.
+ */
+typedef struct out_buffer {
+	char *Data;
+	size_t Length;
+	size_t Capacity;
+} out_buffer;
+
+int GetOutputFormatFromName(const TCHAR *Name, output_format *Dest);
+
+void OutReset(out_buffer *Out);
+void OutAppend(out_buffer *Out, const char *Data, size_t Length);
+void OutAppendStr(out_buffer *Out, const char *Str);
+void OutAppendU64(out_buffer *Out, ULONGLONG Value);
+void OutAppendDouble(out_buffer *Out, double Value);
+
+ULONGLONG GetUnixTimeMs(void);
+
+void FormatSnapshot(out_buffer *Out, output_format Format, BOOL WriteHeader, ULONGLONG Timestamp,
+		const system_summary *System, const process *Processes, DWORD Count);
+
+#endif
@@ -0,0 +1,809 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "history.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HIST_NONE 0xFFFFFFFF
+#define HIST_INITIAL_BUCKETS 4096
+
+typedef enum hist_codec {
+	CODEC_XOR,	/* doubles, Gorilla XOR */
+	CODEC_DELTA,	/* integers, delta from the previous value */
+	CODEC_DOD,	/* integers that grow steadily, delta-of-delta */
+} hist_codec;
+
+typedef enum hist_process_field {
+	HIST_CPU,
+	HIST_MEMORY,
+	HIST_THREADS,
+	HIST_DISK_USAGE,
+	HIST_PRIORITY,
+	HIST_DISK_READ,
+	HIST_DISK_WRITE,
+	HIST_DISK_OTHER,
+	HIST_DISK_READ_OPS,
+	HIST_DISK_WRITE_OPS,
+	HIST_PROCESS_FIELDS,
+} hist_process_field;
+
+typedef enum hist_system_field {
+	HIST_SYS_TIMESTAMP,
+	HIST_SYS_CPU,
+	HIST_SYS_TOTAL_MEMORY,
+	HIST_SYS_USED_MEMORY,
+	HIST_SYS_TOTAL_PAGE,
+	HIST_SYS_USED_PAGE,
+	HIST_SYS_UPTIME,
+	HIST_SYS_PROCESS_COUNT,
+	HIST_SYS_RUNNING_COUNT,
+	HIST_SYS_QUERIES,
+	HIST_SYSTEM_FIELDS,
+} hist_system_field;
+
+static const BYTE ProcessCodecs[HIST_PROCESS_FIELDS] = {
+	CODEC_XOR, CODEC_DELTA, CODEC_DELTA, CODEC_DELTA, CODEC_DELTA,
+	CODEC_DELTA, CODEC_DELTA, CODEC_DELTA, CODEC_XOR, CODEC_XOR,
+};
+
+static const BYTE SystemCodecs[HIST_SYSTEM_FIELDS] = {
+	CODEC_DOD, CODEC_XOR, CODEC_DELTA, CODEC_DELTA, CODEC_DELTA, CODEC_DELTA, CODEC_DOD, CODEC_DELTA, CODEC_DELTA, CODEC_XOR,
+};
+
+typedef struct hist_bits {
+	BYTE *Data;
+	DWORD Capacity;
+	DWORD BitCount;
+} hist_bits;
+
+typedef struct hist_bit_reader {
+	const BYTE *Data;
+	DWORD BitPos;
+	DWORD BitCount;
+} hist_bit_reader;
+
+/* Codec state of one value column */
+typedef struct hist_field_state {
+	ULONGLONG Prev;
+	LONGLONG PrevDelta;
+	BYTE Leading;
+	BYTE Trailing;
+} hist_field_state;
+
+typedef struct hist_identity {
+	DWORD ID;
+	DWORD ParentPID;
+	ULONGLONG CreationTime;
+	TCHAR *ExeName;
+	TCHAR *UserName;
+	ULONGLONG LastSample;
+	DWORD OpenSeries;
+	DWORD NextInBucket;
+	BOOL Used;
+} hist_identity;
+
+/* Samples FirstSample .. FirstSample+SampleCount-1 of one process within a chunk */
+typedef struct hist_series {
+	DWORD Identity;
+	WORD FirstSample;
+	WORD SampleCount;
+	DWORD BitCount;
+	const BYTE *Data;
+} hist_series;
+
+typedef struct hist_chunk {
+	ULONGLONG FirstSample;
+	DWORD SampleCount;
+	ULONGLONG ProcessSamples;
+	hist_bits System;
+	hist_series *Series;
+	DWORD SeriesCount;
+	DWORD SeriesCapacity;
+	BYTE *Block;
+	SIZE_T Bytes;
+	SIZE_T ValueBytes;
+	struct hist_chunk *Next;
+
+	/* Only while the chunk is being written */
+	hist_bits *SeriesBits;
+	hist_field_state (*SeriesState)[HIST_PROCESS_FIELDS];
+	hist_field_state SystemState[HIST_SYSTEM_FIELDS];
+} hist_chunk;
+
+static BOOL Enabled;
+static CRITICAL_SECTION HistLock;
+static SIZE_T Budget;
+
+static hist_chunk *Oldest;
+static hist_chunk *Open;
+static ULONGLONG NextSample;
+static SIZE_T SealedBytes;
+static SIZE_T SealedValueBytes;
+static ULONGLONG SealedProcessSamples;
+static DWORD ChunkCount;
+
+static hist_identity *Identities;
+static DWORD IdentityCapacity;
+static DWORD IdentityCount;
+static DWORD FreeIdentity = HIST_NONE;
+static DWORD *Buckets;
+static DWORD BucketCount;
+static SIZE_T IdentityBytes;
+
+/*
+ * Bit streams
+ */
+
+static void PutBits(hist_bits *Bits, ULONGLONG Value, int Count)
+{
+	DWORD Needed = (Bits->BitCount + Count + 7) / 8;
+
+	if(Needed > Bits->Capacity) {
+		DWORD Capacity = max(Needed, Bits->Capacity * 2);
+		Capacity = max(Capacity, 16);
+		Bits->Data = xrealloc(Bits->Data, Capacity);
+		memset(Bits->Data + Bits->Capacity, 0, Capacity - Bits->Capacity);
+		Bits->Capacity = Capacity;
+	}
+
+	while(Count > 0) {
+		DWORD Byte = Bits->BitCount / 8;
+		int Free = 8 - (int)(Bits->BitCount % 8);
+		int Take = min(Free, Count);
+		BYTE Part = (BYTE)((Value >> (Count - Take)) & ((1u << Take) - 1));
+
+		Bits->Data[Byte] |= (BYTE)(Part << (Free - Take));
+		Bits->BitCount += Take;
+		Count -= Take;
+	}
+}
+
+static ULONGLONG GetBits(hist_bit_reader *Reader, int Count)
+{
+	ULONGLONG Value = 0;
+
+	if(Reader->BitPos + Count > Reader->BitCount) {
+		Reader->BitPos = Reader->BitCount;
+		return 0;
+	}
+
+	while(Count > 0) {
+		BYTE Byte = Reader->Data[Reader->BitPos / 8];
+		int Left = 8 - (int)(Reader->BitPos % 8);
+		int Take = min(Left, Count);
+
+		Value = (Value << Take) | ((Byte >> (Left - Take)) & ((1u << Take) - 1));
+		Reader->BitPos += Take;
+		Count -= Take;
+	}
+
+	return Value;
+}
+
+static int CountLeadingZeros(ULONGLONG Value)
+{
+	int Count = 0;
+	for(ULONGLONG Bit = 1ULL << 63; Bit && !(Value & Bit); Bit >>= 1)
+		Count++;
+	return Count;
+}
+
+static int CountTrailingZeros(ULONGLONG Value)
+{
+	int Count = 0;
+	for(; Count < 64 && !(Value & 1); Value >>= 1)
+		Count++;
+	return Count;
+}
+
+/*
+ * Signed integers with a width prefix: '0' for zero, then 10, 110, 1110
+ * and 1111 for 8, 16, 32 and 64 bits.
+ */
+static void PutSigned(hist_bits *Bits, LONGLONG Value)
+{
+	if(Value == 0) {
+		PutBits(Bits, 0, 1);
+	} else if(Value >= -128 && Value < 128) {
+		PutBits(Bits, 2, 2);
+		PutBits(Bits, (ULONGLONG)Value, 8);
+	} else if(Value >= -32768 && Value < 32768) {
+		PutBits(Bits, 6, 3);
+		PutBits(Bits, (ULONGLONG)Value, 16);
+	} else if(Value >= -2147483647LL - 1 && Value < 2147483648LL) {
+		PutBits(Bits, 14, 4);
+		PutBits(Bits, (ULONGLONG)Value, 32);
+	} else {
+		PutBits(Bits, 15, 4);
+		PutBits(Bits, (ULONGLONG)Value, 64);
+	}
+}
+
+static LONGLONG GetSigned(hist_bit_reader *Reader)
+{
+	static const int Widths[] = { 8, 16, 32, 64 };
+	int Prefix = 0;
+
+	while(Prefix < 4 && GetBits(Reader, 1))
+		Prefix++;
+
+	if(Prefix == 0)
+		return 0;
+
+	int Width = Widths[Prefix - 1];
+	ULONGLONG Value = GetBits(Reader, Width);
+
+	/* Sign-extend */
+	if(Width < 64 && (Value & (1ULL << (Width - 1))))
+		Value |= ~0ULL << Width;
+
+	return (LONGLONG)Value;
+}
+
+static void EncodeValue(hist_bits *Bits, hist_field_state *State, hist_codec Codec, ULONGLONG Value, BOOL First)
+{
+	if(First) {
+		if(Codec == CODEC_XOR) {
+			PutBits(Bits, Value, 64);
+			State->Leading = 0xFF;
+		} else {
+			PutSigned(Bits, (LONGLONG)Value);
+		}
+		State->Prev = Value;
+		State->PrevDelta = 0;
+		return;
+	}
+
+	if(Codec == CODEC_XOR) {
+		ULONGLONG Xor = Value ^ State->Prev;
+
+		if(Xor == 0) {
+			PutBits(Bits, 0, 1);
+		} else {
+			int Leading = min(CountLeadingZeros(Xor), 31);
+			int Trailing = CountTrailingZeros(Xor);
+
+			if(State->Leading != 0xFF && Leading >= State->Leading && Trailing >= State->Trailing) {
+				/* Fits in the previous window */
+				PutBits(Bits, 2, 2);
+				PutBits(Bits, Xor >> State->Trailing, 64 - State->Leading - State->Trailing);
+			} else {
+				int Length = 64 - Leading - Trailing;
+				PutBits(Bits, 3, 2);
+				PutBits(Bits, Leading, 5);
+				PutBits(Bits, Length - 1, 6);
+				PutBits(Bits, Xor >> Trailing, Length);
+				State->Leading = (BYTE)Leading;
+				State->Trailing = (BYTE)Trailing;
+			}
+		}
+	} else {
+		LONGLONG Delta = (LONGLONG)(Value - State->Prev);
+
+		if(Codec == CODEC_DOD) {
+			PutSigned(Bits, Delta - State->PrevDelta);
+		} else {
+			PutSigned(Bits, Delta);
+		}
+		State->PrevDelta = Delta;
+	}
+
+	State->Prev = Value;
+}
+
+static ULONGLONG DecodeValue(hist_bit_reader *Reader, hist_field_state *State, hist_codec Codec, BOOL First)
+{
+	if(First) {
+		if(Codec == CODEC_XOR) {
+			State->Prev = GetBits(Reader, 64);
+			State->Leading = 0xFF;
+		} else {
+			State->Prev = (ULONGLONG)GetSigned(Reader);
+		}
+		State->PrevDelta = 0;
+		return State->Prev;
+	}
+
+	if(Codec == CODEC_XOR) {
+		if(GetBits(Reader, 1)) {
+			if(GetBits(Reader, 1)) {
+				State->Leading = (BYTE)GetBits(Reader, 5);
+				int Length = (int)GetBits(Reader, 6) + 1;
+				State->Trailing = (BYTE)(64 - State->Leading - Length);
+			}
+			int Length = 64 - State->Leading - State->Trailing;
+			State->Prev ^= GetBits(Reader, Length) << State->Trailing;
+		}
+	} else {
+		LONGLONG Delta = GetSigned(Reader);
+
+		if(Codec == CODEC_DOD)
+			Delta += State->PrevDelta;
+		State->PrevDelta = Delta;
+		State->Prev += (ULONGLONG)Delta;
+	}
+
+	return State->Prev;
+}
+
+static ULONGLONG DoubleBits(double Value)
+{
+	ULONGLONG Bits;
+	memcpy(&Bits, &Value, sizeof(Bits));
+	return Bits;
+}
+
+static double BitsDouble(ULONGLONG Bits)
+{
+	double Value;
+	memcpy(&Value, &Bits, sizeof(Value));
+	return Value;
+}
+
+/*
+ * Identity table
+ */
+
+static DWORD HashIdentity(DWORD ID, ULONGLONG CreationTime)
+{
+	ULONGLONG Hash = (ID * 0x9E3779B97F4A7C15ULL) ^ (CreationTime * 0xC2B2AE3D27D4EB4FULL);
+	return (DWORD)(Hash ^ (Hash >> 32)) & (BucketCount - 1);
+}
+
+static void RehashIdentities(DWORD NewBucketCount)
+{
+	free(Buckets);
+	IdentityBytes -= BucketCount * sizeof(*Buckets);
+
+	BucketCount = NewBucketCount;
+	Buckets = xmalloc(BucketCount * sizeof(*Buckets));
+	memset(Buckets, 0xFF, BucketCount * sizeof(*Buckets));
+	IdentityBytes += BucketCount * sizeof(*Buckets);
+
+	for(DWORD i = 0; i < IdentityCapacity; i++) {
+		hist_identity *Identity = &Identities[i];
+		if(!Identity->Used)
+			continue;
+		DWORD Bucket = HashIdentity(Identity->ID, Identity->CreationTime);
+		Identity->NextInBucket = Buckets[Bucket];
+		Buckets[Bucket] = i;
+	}
+}
+
+static DWORD GetIdentity(const process *Process)
+{
+	DWORD Bucket = HashIdentity(Process->ID, Process->CreationTime);
+
+	for(DWORD i = Buckets[Bucket]; i != HIST_NONE; i = Identities[i].NextInBucket) {
+		if(Identities[i].ID == Process->ID && Identities[i].CreationTime == Process->CreationTime)
+			return i;
+	}
+
+	if(FreeIdentity == HIST_NONE) {
+		DWORD Capacity = IdentityCapacity ? IdentityCapacity * 2 : 1024;
+		Identities = xrealloc(Identities, Capacity * sizeof(*Identities));
+		memset(Identities + IdentityCapacity, 0, (Capacity - IdentityCapacity) * sizeof(*Identities));
+		for(DWORD i = Capacity; i > IdentityCapacity; i--) {
+			Identities[i - 1].NextInBucket = FreeIdentity;
+			FreeIdentity = i - 1;
+		}
+		IdentityBytes += (Capacity - IdentityCapacity) * sizeof(*Identities);
+		IdentityCapacity = Capacity;
+	}
+
+	DWORD Index = FreeIdentity;
+	hist_identity *Identity = &Identities[Index];
+	FreeIdentity = Identity->NextInBucket;
+
+	Identity->ID = Process->ID;
+	Identity->ParentPID = Process->ParentPID;
+	Identity->CreationTime = Process->CreationTime;
+	Identity->ExeName = _tcsdup(Process->ExeName);
+	Identity->UserName = _tcsdup(Process->UserName);
+	Identity->OpenSeries = HIST_NONE;
+	Identity->Used = TRUE;
+	Identity->NextInBucket = Buckets[Bucket];
+	Buckets[Bucket] = Index;
+	IdentityBytes += (_tcslen(Process->ExeName) + _tcslen(Process->UserName) + 2) * sizeof(TCHAR);
+	IdentityCount++;
+
+	if(IdentityCount > BucketCount) {
+		RehashIdentities(BucketCount * 2);
+	}
+
+	return Index;
+}
+
+/* Drops identities no retained sample refers to */
+static void ReleaseIdentities(ULONGLONG FirstRetained)
+{
+	for(DWORD i = 0; i < IdentityCapacity; i++) {
+		hist_identity *Identity = &Identities[i];
+		if(!Identity->Used || Identity->LastSample >= FirstRetained)
+			continue;
+
+		DWORD *Link = &Buckets[HashIdentity(Identity->ID, Identity->CreationTime)];
+		while(*Link != i)
+			Link = &Identities[*Link].NextInBucket;
+		*Link = Identity->NextInBucket;
+
+		IdentityBytes -= (_tcslen(Identity->ExeName) + _tcslen(Identity->UserName) + 2) * sizeof(TCHAR);
+		free(Identity->ExeName);
+		free(Identity->UserName);
+		memset(Identity, 0, sizeof(*Identity));
+		Identity->NextInBucket = FreeIdentity;
+		FreeIdentity = i;
+		IdentityCount--;
+	}
+}
+
+/*
+ * Chunks
+ */
+
+static SIZE_T OpenChunkBytes(void)
+{
+	if(!Open)
+		return 0;
+
+	SIZE_T Bytes = sizeof(*Open) + Open->System.Capacity;
+	Bytes += Open->SeriesCapacity * (sizeof(*Open->Series) + sizeof(*Open->SeriesBits) + sizeof(*Open->SeriesState));
+	for(DWORD i = 0; i < Open->SeriesCount; i++)
+		Bytes += Open->SeriesBits[i].Capacity;
+	return Bytes;
+}
+
+/* Packs all streams of the chunk into one block and drops the codec state */
+static void SealChunk(hist_chunk *Chunk)
+{
+	SIZE_T ValueBytes = (Chunk->System.BitCount + 7) / 8;
+	for(DWORD i = 0; i < Chunk->SeriesCount; i++)
+		ValueBytes += (Chunk->Series[i].BitCount + 7) / 8;
+
+	Chunk->Block = xmalloc(ValueBytes ? ValueBytes : 1);
+	BYTE *Pos = Chunk->Block;
+
+	DWORD Length = (Chunk->System.BitCount + 7) / 8;
+	memcpy(Pos, Chunk->System.Data, Length);
+	free(Chunk->System.Data);
+	Chunk->System.Data = Pos;
+	Chunk->System.Capacity = Length;
+	Pos += Length;
+
+	for(DWORD i = 0; i < Chunk->SeriesCount; i++) {
+		Length = (Chunk->Series[i].BitCount + 7) / 8;
+		memcpy(Pos, Chunk->SeriesBits[i].Data, Length);
+		free(Chunk->SeriesBits[i].Data);
+		Chunk->Series[i].Data = Pos;
+		Pos += Length;
+	}
+
+	free(Chunk->SeriesBits);
+	free(Chunk->SeriesState);
+	Chunk->SeriesBits = 0;
+	Chunk->SeriesState = 0;
+	Chunk->Series = xrealloc(Chunk->Series, (Chunk->SeriesCount ? Chunk->SeriesCount : 1) * sizeof(*Chunk->Series));
+	Chunk->SeriesCapacity = Chunk->SeriesCount;
+
+	Chunk->ValueBytes = ValueBytes;
+	Chunk->Bytes = sizeof(*Chunk) + ValueBytes + Chunk->SeriesCount * sizeof(*Chunk->Series);
+}
+
+static void FreeChunk(hist_chunk *Chunk)
+{
+	free(Chunk->Block);
+	free(Chunk->Series);
+	free(Chunk);
+}
+
+static void OpenChunk(void)
+{
+	hist_chunk *Chunk = xcalloc(1, sizeof(*Chunk));
+	Chunk->FirstSample = NextSample;
+
+	if(Open) {
+		SealChunk(Open);
+		SealedBytes += Open->Bytes;
+		SealedValueBytes += Open->ValueBytes;
+		SealedProcessSamples += Open->ProcessSamples;
+		Open->Next = Chunk;
+	} else {
+		Oldest = Chunk;
+	}
+
+	Open = Chunk;
+	ChunkCount++;
+
+	for(DWORD i = 0; i < IdentityCapacity; i++)
+		Identities[i].OpenSeries = HIST_NONE;
+}
+
+static DWORD AddSeries(DWORD Identity, DWORD FirstSample)
+{
+	if(Open->SeriesCount == Open->SeriesCapacity) {
+		DWORD Capacity = Open->SeriesCapacity ? Open->SeriesCapacity * 2 : 256;
+		Open->Series = xrealloc(Open->Series, Capacity * sizeof(*Open->Series));
+		Open->SeriesBits = xrealloc(Open->SeriesBits, Capacity * sizeof(*Open->SeriesBits));
+		Open->SeriesState = xrealloc(Open->SeriesState, Capacity * sizeof(*Open->SeriesState));
+		Open->SeriesCapacity = Capacity;
+	}
+
+	DWORD Index = Open->SeriesCount++;
+	hist_series *Series = &Open->Series[Index];
+	Series->Identity = Identity;
+	Series->FirstSample = (WORD)FirstSample;
+	Series->SampleCount = 0;
+	Series->BitCount = 0;
+	Series->Data = 0;
+	memset(&Open->SeriesBits[Index], 0, sizeof(Open->SeriesBits[Index]));
+
+	return Index;
+}
+
+static void EvictChunks(void)
+{
+	while(Oldest != Open && SealedBytes + OpenChunkBytes() + IdentityBytes > Budget) {
+		hist_chunk *Chunk = Oldest;
+		Oldest = Chunk->Next;
+
+		SealedBytes -= Chunk->Bytes;
+		SealedValueBytes -= Chunk->ValueBytes;
+		SealedProcessSamples -= Chunk->ProcessSamples;
+		ChunkCount--;
+		FreeChunk(Chunk);
+
+		ReleaseIdentities(Oldest->FirstSample);
+	}
+}
+
+void HistInit(SIZE_T BudgetBytes)
+{
+	InitializeCriticalSection(&HistLock);
+	Budget = BudgetBytes;
+	RehashIdentities(HIST_INITIAL_BUCKETS);
+	Enabled = BudgetBytes > 0;
+}
+
+BOOL HistEnabled(void)
+{
+	return Enabled;
+}
+
+void HistAppend(ULONGLONG Timestamp, const system_summary *System, DWORD Queries, const process *Processes, DWORD Count)
+{
+	if(!Enabled)
+		return;
+
+	EnterCriticalSection(&HistLock);
+
+	if(!Open || Open->SampleCount == HIST_CHUNK_SAMPLES) {
+		OpenChunk();
+	}
+
+	DWORD Index = Open->SampleCount;
+	BOOL First = Index == 0;
+
+	ULONGLONG SystemValues[HIST_SYSTEM_FIELDS];
+	SystemValues[HIST_SYS_TIMESTAMP] = Timestamp;
+	SystemValues[HIST_SYS_CPU] = DoubleBits(System->CPUUsage);
+	SystemValues[HIST_SYS_TOTAL_MEMORY] = System->TotalMemory;
+	SystemValues[HIST_SYS_USED_MEMORY] = System->UsedMemory;
+	SystemValues[HIST_SYS_TOTAL_PAGE] = System->TotalPageMemory;
+	SystemValues[HIST_SYS_USED_PAGE] = System->UsedPageMemory;
+	SystemValues[HIST_SYS_UPTIME] = System->UpTime;
+	SystemValues[HIST_SYS_PROCESS_COUNT] = System->ProcessCount;
+	SystemValues[HIST_SYS_RUNNING_COUNT] = System->RunningProcessCount;
+	SystemValues[HIST_SYS_QUERIES] = Queries;
+
+	for(int f = 0; f < HIST_SYSTEM_FIELDS; f++) {
+		EncodeValue(&Open->System, &Open->SystemState[f], SystemCodecs[f], SystemValues[f], First);
+	}
+
+	for(DWORD i = 0; i < Count; i++) {
+		const process *Process = &Processes[i];
+		DWORD IdentityIndex = GetIdentity(Process);
+		hist_identity *Identity = &Identities[IdentityIndex];
+		DWORD SeriesIndex = Identity->OpenSeries;
+
+		/* The user may not have been queried when the process was first seen */
+		if(!Identity->UserName[0] && Process->UserName[0]) {
+			IdentityBytes += _tcslen(Process->UserName) * sizeof(TCHAR);
+			free(Identity->UserName);
+			Identity->UserName = _tcsdup(Process->UserName);
+		}
+
+		/* Already sampled this round (duplicate PID) */
+		if(Identity->LastSample == NextSample && SeriesIndex != HIST_NONE)
+			continue;
+
+		/* A process that skipped a sample starts a new series */
+		if(SeriesIndex == HIST_NONE
+		|| Open->Series[SeriesIndex].FirstSample + Open->Series[SeriesIndex].SampleCount != Index) {
+			SeriesIndex = AddSeries(IdentityIndex, Index);
+			Identity->OpenSeries = SeriesIndex;
+		}
+
+		Identity->LastSample = NextSample;
+
+		hist_series *Series = &Open->Series[SeriesIndex];
+		hist_bits *Bits = &Open->SeriesBits[SeriesIndex];
+		hist_field_state *State = Open->SeriesState[SeriesIndex];
+		BOOL SeriesFirst = Series->SampleCount == 0;
+
+		ULONGLONG Values[HIST_PROCESS_FIELDS];
+		Values[HIST_CPU] = DoubleBits(Process->PercentProcessorTime);
+		Values[HIST_MEMORY] = Process->UsedMemory;
+		Values[HIST_THREADS] = Process->ThreadCount;
+		Values[HIST_DISK_USAGE] = Process->DiskUsage;
+		Values[HIST_PRIORITY] = Process->BasePriority;
+		Values[HIST_DISK_READ] = Process->DiskReadRate;
+		Values[HIST_DISK_WRITE] = Process->DiskWriteRate;
+		Values[HIST_DISK_OTHER] = Process->DiskOtherRate;
+		Values[HIST_DISK_READ_OPS] = DoubleBits(Process->DiskReadOps);
+		Values[HIST_DISK_WRITE_OPS] = DoubleBits(Process->DiskWriteOps);
+
+		for(int f = 0; f < HIST_PROCESS_FIELDS; f++) {
+			EncodeValue(Bits, &State[f], ProcessCodecs[f], Values[f], SeriesFirst);
+		}
+
+		Series->SampleCount++;
+		Series->BitCount = Bits->BitCount;
+		Series->Data = Bits->Data;
+	}
+
+	Open->SampleCount++;
+	Open->ProcessSamples += Count;
+	NextSample++;
+
+	EvictChunks();
+
+	LeaveCriticalSection(&HistLock);
+}
+
+BOOL HistGetRange(ULONGLONG *OldestSample, ULONGLONG *NewestSample)
+{
+	if(!Enabled)
+		return FALSE;
+
+	EnterCriticalSection(&HistLock);
+	BOOL HaveSamples = Oldest && NextSample > Oldest->FirstSample;
+	if(HaveSamples) {
+		*OldestSample = Oldest->FirstSample;
+		*NewestSample = NextSample - 1;
+	}
+	LeaveCriticalSection(&HistLock);
+	return HaveSamples;
+}
+
+/*
+ * Rebuilds snapshot number Sample. Gorilla streams only decode forwards,
+ * so every stream of the chunk is replayed from its start up to Sample.
+ */
+BOOL HistDecode(ULONGLONG Sample, ULONGLONG *Timestamp, system_summary *System, DWORD *Queries,
+		process **Processes, DWORD *Count, DWORD *Capacity)
+{
+	if(!Enabled)
+		return FALSE;
+
+	EnterCriticalSection(&HistLock);
+
+	hist_chunk *Chunk = Oldest;
+	while(Chunk && Sample >= Chunk->FirstSample + Chunk->SampleCount)
+		Chunk = Chunk->Next;
+
+	if(!Chunk || Sample < Chunk->FirstSample) {
+		LeaveCriticalSection(&HistLock);
+		return FALSE;
+	}
+
+	DWORD Index = (DWORD)(Sample - Chunk->FirstSample);
+	hist_field_state State[HIST_SYSTEM_FIELDS];
+	ULONGLONG Values[HIST_SYSTEM_FIELDS];
+	hist_bit_reader Reader = { Chunk->System.Data, 0, Chunk->System.BitCount };
+
+	for(DWORD s = 0; s <= Index; s++) {
+		for(int f = 0; f < HIST_SYSTEM_FIELDS; f++)
+			Values[f] = DecodeValue(&Reader, &State[f], SystemCodecs[f], s == 0);
+	}
+
+	*Timestamp = Values[HIST_SYS_TIMESTAMP];
+	System->CPUUsage = BitsDouble(Values[HIST_SYS_CPU]);
+	System->TotalMemory = Values[HIST_SYS_TOTAL_MEMORY];
+	System->UsedMemory = Values[HIST_SYS_USED_MEMORY];
+	System->TotalPageMemory = Values[HIST_SYS_TOTAL_PAGE];
+	System->UsedPageMemory = Values[HIST_SYS_USED_PAGE];
+	System->UpTime = Values[HIST_SYS_UPTIME];
+	System->ProcessCount = (DWORD)Values[HIST_SYS_PROCESS_COUNT];
+	System->RunningProcessCount = (DWORD)Values[HIST_SYS_RUNNING_COUNT];
+	*Queries = (DWORD)Values[HIST_SYS_QUERIES];
+
+	if(Chunk->SeriesCount > *Capacity) {
+		*Capacity = Chunk->SeriesCount;
+		*Processes = xrealloc(*Processes, *Capacity * sizeof(**Processes));
+	}
+
+	DWORD Written = 0;
+	for(DWORD i = 0; i < Chunk->SeriesCount; i++) {
+		const hist_series *Series = &Chunk->Series[i];
+		if(Index < Series->FirstSample || Index >= (DWORD)Series->FirstSample + Series->SampleCount)
+			continue;
+
+		hist_field_state ProcessState[HIST_PROCESS_FIELDS];
+		ULONGLONG ProcessValues[HIST_PROCESS_FIELDS];
+		hist_bit_reader SeriesReader = { Series->Data, 0, Series->BitCount };
+
+		for(DWORD s = Series->FirstSample; s <= Index; s++) {
+			for(int f = 0; f < HIST_PROCESS_FIELDS; f++)
+				ProcessValues[f] = DecodeValue(&SeriesReader, &ProcessState[f], ProcessCodecs[f], s == Series->FirstSample);
+		}
+
+		const hist_identity *Identity = &Identities[Series->Identity];
+		process *Process = &(*Processes)[Written++];
+
+		memset(Process, 0, sizeof(*Process));
+		Process->ID = Identity->ID;
+		Process->ParentPID = Identity->ParentPID;
+		Process->CreationTime = Identity->CreationTime;
+		_tcsncpy_s(Process->ExeName, MAX_PATH, Identity->ExeName, _TRUNCATE);
+		_tcsncpy_s(Process->UserName, UNLEN, Identity->UserName, _TRUNCATE);
+		Process->PercentProcessorTime = BitsDouble(ProcessValues[HIST_CPU]);
+		Process->UsedMemory = ProcessValues[HIST_MEMORY];
+		Process->ThreadCount = (DWORD)ProcessValues[HIST_THREADS];
+		Process->DiskUsage = (DWORD)ProcessValues[HIST_DISK_USAGE];
+		Process->BasePriority = (DWORD)ProcessValues[HIST_PRIORITY];
+		Process->DiskReadRate = ProcessValues[HIST_DISK_READ];
+		Process->DiskWriteRate = ProcessValues[HIST_DISK_WRITE];
+		Process->DiskOtherRate = ProcessValues[HIST_DISK_OTHER];
+		Process->DiskReadOps = BitsDouble(ProcessValues[HIST_DISK_READ_OPS]);
+		Process->DiskWriteOps = BitsDouble(ProcessValues[HIST_DISK_WRITE_OPS]);
+
+		ULONGLONG Created = Identity->CreationTime > FILETIME_UNIX_EPOCH ? (Identity->CreationTime - FILETIME_UNIX_EPOCH) / 10000 : 0;
+		Process->UpTime = Created && *Timestamp > Created ? *Timestamp - Created : 0;
+	}
+
+	*Count = Written;
+
+	LeaveCriticalSection(&HistLock);
+	return TRUE;
+}
+
+void HistGetStats(hist_stats *Stats)
+{
+	memset(Stats, 0, sizeof(*Stats));
+
+	if(!Enabled)
+		return;
+
+	EnterCriticalSection(&HistLock);
+
+	if(Open) {
+		SIZE_T OpenValueBytes = (Open->System.BitCount + 7) / 8;
+		for(DWORD i = 0; i < Open->SeriesCount; i++)
+			OpenValueBytes += (Open->Series[i].BitCount + 7) / 8;
+
+		Stats->Bytes = SealedBytes + OpenChunkBytes() + IdentityBytes;
+		Stats->ValueBytes = SealedValueBytes + OpenValueBytes;
+		Stats->SampleCount = NextSample - Oldest->FirstSample;
+		Stats->ProcessSamples = SealedProcessSamples + Open->ProcessSamples;
+		Stats->ChunkCount = ChunkCount;
+		Stats->IdentityCount = IdentityCount;
+	}
+
+	LeaveCriticalSection(&HistLock);
+}
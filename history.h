@@ -0,0 +1,54 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "ntop.h"
+
+/*
+ * Bounded in-memory history of recent snapshots.
+ *
+ * Samples are grouped into chunks of HIST_CHUNK_SAMPLES. Inside a chunk
+ * every process has its own bit stream, compressed the way Gorilla does
+ * it: floats are XORed with the previous value, integers are stored as
+ * deltas and timestamps as delta-of-deltas, each with a short prefix
+ * choosing the bit width. Names and other constant values live once in
+ * a shared identity table keyed by PID and creation time. When the
+ * budget is exceeded whole chunks are dropped, oldest first.
+ */
+
+#define HIST_CHUNK_SAMPLES 64
+
+typedef struct hist_stats {
+	ULONGLONG Bytes;
+	ULONGLONG ValueBytes;
+	ULONGLONG SampleCount;
+	ULONGLONG ProcessSamples;
+	DWORD ChunkCount;
+	DWORD IdentityCount;
+} hist_stats;
+
+void HistInit(SIZE_T BudgetBytes);
+BOOL HistEnabled(void);
+void HistAppend(ULONGLONG Timestamp, const system_summary *System, DWORD Queries, const process *Processes, DWORD Count);
+BOOL HistGetRange(ULONGLONG *Oldest, ULONGLONG *Newest);
+BOOL HistDecode(ULONGLONG Sample, ULONGLONG *Timestamp, system_summary *System, DWORD *Queries,
+		process **Processes, DWORD *Count, DWORD *Capacity);
+void HistGetStats(hist_stats *Stats);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "journal.h"
+#include "util.h"
+#include <string.h>
+
+#define JOURNAL_MAGIC 0x4A544E4E	/* "NNTJ" */
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 64
+
+typedef struct journal_header {
+	DWORD Magic;
+	DWORD Version;
+	DWORD EntrySize;
+	DWORD Capacity;
+	volatile LONGLONG Head;		/* entries appended so far */
+} journal_header;
+
+static HANDLE File = INVALID_HANDLE_VALUE;
+static HANDLE Mapping;
+static journal_header *Header;
+static journal_entry *Entries;
+static DWORD Capacity;
+
+/* Processes created before NTop started are not reported as starts */
+static ULONGLONG StartTime;
+
+/*
+ * Maps the journal at Path, creating it or starting it over if it does not
+ * have the layout of SizeMB. Another NTop writing to the same file makes
+ * this fail, each journal has one writer.
+ */
+BOOL JournalOpen(const char *Path, DWORD SizeMB)
+{
+	Capacity = (DWORD)(((ULONGLONG)SizeMB * 1024 * 1024 - JOURNAL_HEADER_SIZE) / sizeof(journal_entry));
+	if(Capacity == 0)
+		return FALSE;
+
+	File = CreateFileA(Path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if(File == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	LARGE_INTEGER Size, Wanted;
+	Wanted.QuadPart = JOURNAL_HEADER_SIZE + (LONGLONG)Capacity * sizeof(journal_entry);
+	BOOL Fresh = !GetFileSizeEx(File, &Size) || Size.QuadPart != Wanted.QuadPart;
+
+	if(Fresh && (!SetFilePointerEx(File, Wanted, 0, FILE_BEGIN) || !SetEndOfFile(File))) {
+		CloseHandle(File);
+		File = INVALID_HANDLE_VALUE;
+		return FALSE;
+	}
+
+	Mapping = CreateFileMapping(File, 0, PAGE_READWRITE, Wanted.HighPart, Wanted.LowPart, 0);
+	void *View = Mapping ? MapViewOfFile(Mapping, FILE_MAP_WRITE, 0, 0, 0) : 0;
+	if(!View) {
+		if(Mapping) {
+			CloseHandle(Mapping);
+			Mapping = 0;
+		}
+		CloseHandle(File);
+		File = INVALID_HANDLE_VALUE;
+		return FALSE;
+	}
+
+	Header = View;
+	Entries = (journal_entry *)((BYTE *)View + JOURNAL_HEADER_SIZE);
+
+	if(Fresh || Header->Magic != JOURNAL_MAGIC || Header->Version != JOURNAL_VERSION ||
+			Header->EntrySize != sizeof(journal_entry) || Header->Capacity != Capacity) {
+		memset(View, 0, (size_t)Wanted.QuadPart);
+		Header->Magic = JOURNAL_MAGIC;
+		Header->Version = JOURNAL_VERSION;
+		Header->EntrySize = sizeof(journal_entry);
+		Header->Capacity = Capacity;
+	}
+
+	FILETIME Now;
+	GetSystemTimeAsFileTime(&Now);
+	ULARGE_INTEGER NowTime;
+	NowTime.LowPart = Now.dwLowDateTime;
+	NowTime.HighPart = Now.dwHighDateTime;
+	StartTime = NowTime.QuadPart;
+
+	return TRUE;
+}
+
+BOOL JournalEnabled(void)
+{
+	return Header != 0;
+}
+
+static void AppendEntry(journal_type Type, const diff_event *Event, ULONGLONG Timestamp)
+{
+	ULONGLONG Position = (ULONGLONG)Header->Head;
+	journal_entry *Entry = &Entries[Position % Capacity];
+
+	/* Readers drop the slot until the new sequence number is stored */
+	((volatile journal_entry *)Entry)->Sequence = 0;
+	MemoryBarrier();
+
+	Entry->Timestamp = Timestamp;
+	Entry->CreationTime = Event->CreationTime;
+	Entry->Lifetime = 0;
+	Entry->CPUTime = 0;
+	Entry->Memory = Event->Values[DIFF_FIELD_MEMORY];
+	Entry->Type = Type;
+	Entry->ID = Event->ID;
+	Entry->ParentPID = (DWORD)Event->Values[DIFF_FIELD_PARENT];
+	Entry->Reserved = 0;
+	TCharToUtf8(Event->ExeName, Entry->ExeName, JOURNAL_NAME_SIZE);
+	TCharToUtf8(Event->UserName, Entry->UserName, JOURNAL_USER_SIZE);
+
+	if(Type == JOURNAL_EXIT) {
+		ULONGLONG Created = Event->CreationTime > FILETIME_UNIX_EPOCH ?
+			(Event->CreationTime - FILETIME_UNIX_EPOCH) / 10000 : Timestamp;
+		Entry->Lifetime = Timestamp > Created ? Timestamp - Created : 0;
+		Entry->CPUTime = Event->CPUTime;
+	}
+
+	MemoryBarrier();
+	((volatile journal_entry *)Entry)->Sequence = Position + 1;
+	InterlockedExchange64(&Header->Head, (LONGLONG)(Position + 1));
+}
+
+/* Called by the collector with the diff of every live snapshot */
+void JournalAppend(const diff_batch *Batch, ULONGLONG Timestamp)
+{
+	if(!Header || Batch->Births + Batch->Deaths == 0)
+		return;
+
+	for(DWORD i = 0; i < Batch->Count; i++) {
+		const diff_event *Event = &Batch->Events[i];
+
+		if(Event->Type == DIFF_BIRTH && Event->CreationTime >= StartTime) {
+			AppendEntry(JOURNAL_START, Event, Timestamp);
+		} else if(Event->Type == DIFF_DEATH) {
+			AppendEntry(JOURNAL_EXIT, Event, Timestamp);
+		}
+	}
+}
+
+ULONGLONG JournalGetHead(void)
+{
+	return Header ? (ULONGLONG)Header->Head : 0;
+}
+
+DWORD JournalGetCapacity(void)
+{
+	return Capacity;
+}
+
+/*
+ * Copies the entry at Position, FALSE if it has been overwritten since or
+ * is being written right now.
+ */
+BOOL JournalRead(ULONGLONG Position, journal_entry *Entry)
+{
+	if(!Header)
+		return FALSE;
+
+	const volatile journal_entry *Slot = &Entries[Position % Capacity];
+
+	if(Slot->Sequence != Position + 1)
+		return FALSE;
+	MemoryBarrier();
+
+	memcpy(Entry, (const journal_entry *)Slot, sizeof(*Entry));
+
+	MemoryBarrier();
+	return Slot->Sequence == Position + 1 && Entry->Sequence == Position + 1;
+}
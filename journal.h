@@ -0,0 +1,63 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "ntop.h"
+#include "diff.h"
+
+/*
+ * Starts and exits of processes, kept in a ring of fixed-size entries in a
+ * memory-mapped file so that the journal survives restarts and never
+ * grows. The collector is the only writer and never waits: it clears the
+ * sequence number of the oldest slot, fills it in and publishes it by
+ * storing the new sequence number. Readers copy a slot and keep the copy
+ * only if its sequence number was the expected one before and after.
+ */
+
+#define JOURNAL_NAME_SIZE 96
+#define JOURNAL_USER_SIZE 32
+
+typedef enum journal_type {
+	JOURNAL_START,
+	JOURNAL_EXIT,
+} journal_type;
+
+typedef struct journal_entry {
+	ULONGLONG Sequence;		/* position in the journal plus one, 0 while written */
+	ULONGLONG Timestamp;		/* Unix ms, exits are seen up to one interval late */
+	ULONGLONG CreationTime;		/* FILETIME */
+	ULONGLONG Lifetime;		/* ms, exits only */
+	ULONGLONG CPUTime;		/* 100ns units, exits only */
+	ULONGLONG Memory;		/* working set in bytes when last seen */
+	DWORD Type;
+	DWORD ID;
+	DWORD ParentPID;
+	DWORD Reserved;
+	char ExeName[JOURNAL_NAME_SIZE];	/* UTF-8 */
+	char UserName[JOURNAL_USER_SIZE];
+} journal_entry;
+
+BOOL JournalOpen(const char *Path, DWORD SizeMB);
+BOOL JournalEnabled(void);
+void JournalAppend(const diff_batch *Batch, ULONGLONG Timestamp);
+ULONGLONG JournalGetHead(void);
+DWORD JournalGetCapacity(void);
+BOOL JournalRead(ULONGLONG Position, journal_entry *Entry);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NTAPI_H
+#define NTAPI_H
+
+#include <windows.h>
+#include <tchar.h>
+
+/*
+ * The few native API declarations NTop uses. They are not part of the
+ * regular SDK headers, so the types carry their own names, and the
+ * functions are looked up in ntdll.dll at run time with NT_GET_PROC.
+ */
+
+typedef LONG nt_status;
+
+#define NT_SUCCEEDED(Status) ((nt_status)(Status) >= 0)
+#define NT_STATUS_INFO_LENGTH_MISMATCH ((nt_status)0xC0000004L)
+
+typedef struct nt_unicode_string {
+	USHORT Length;		/* bytes, without a terminator */
+	USHORT MaximumLength;
+	WCHAR *Buffer;
+} nt_unicode_string;
+
+/* NtQueryInformationProcess, ProcessCommandLineInformation needs Windows 8.1 */
+#define NT_PROCESS_BASIC_INFORMATION 0
+#define NT_PROCESS_COMMAND_LINE_INFORMATION 60
+
+typedef struct nt_process_basic_information {
+	nt_status ExitStatus;
+	void *PebBaseAddress;
+	ULONG_PTR AffinityMask;
+	LONG BasePriority;
+	ULONG_PTR UniqueProcessId;
+	ULONG_PTR InheritedFromUniqueProcessId;
+} nt_process_basic_information;
+
+typedef nt_status (NTAPI *nt_query_information_process)(HANDLE Process, ULONG InformationClass,
+		void *Information, ULONG InformationLength, ULONG *ReturnLength);
+
+/*
+ * NtGetNextThread, walks the threads of one process without a system
+ * snapshot. Each call returns a new handle to the thread after Thread, or
+ * the first one if Thread is 0. The process handle needs
+ * PROCESS_QUERY_INFORMATION.
+ */
+#define NT_STATUS_NO_MORE_ENTRIES ((nt_status)0x8000001AL)
+
+typedef nt_status (NTAPI *nt_get_next_thread)(HANDLE Process, HANDLE Thread, ACCESS_MASK DesiredAccess,
+		ULONG HandleAttributes, ULONG Flags, HANDLE *NewThread);
+
+/*
+ * NtQueryInformationThread: the basic information with the current
+ * priority, the start address the thread was created with, and the
+ * suspend count, which needs Windows 8.1.
+ */
+#define NT_THREAD_BASIC_INFORMATION 0
+#define NT_THREAD_QUERY_SET_WIN32_START_ADDRESS 9
+#define NT_THREAD_SUSPEND_COUNT 35
+
+typedef struct nt_thread_basic_information {
+	nt_status ExitStatus;
+	void *TebBaseAddress;
+	HANDLE UniqueProcess;	/* CLIENT_ID */
+	HANDLE UniqueThread;
+	ULONG_PTR AffinityMask;
+	LONG Priority;
+	LONG BasePriority;
+} nt_thread_basic_information;
+
+typedef nt_status (NTAPI *nt_query_information_thread)(HANDLE Thread, ULONG InformationClass,
+		void *Information, ULONG InformationLength, ULONG *ReturnLength);
+
+/* Null if ntdll.dll, which every process has loaded, does not export the function */
+#define NT_GET_PROC(Name) GetProcAddress(GetModuleHandle(_T("ntdll.dll")), Name)
+
+#endif
@@ -25,9 +25,27 @@
 #include <pdh.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
 #include "ntop.h"
 #include "util.h"
 #include "vi.h"
+#include "profiler.h"
+#include "trace.h"
+#include "format.h"
+#include "record.h"
+#include "history.h"
+#include "track.h"
+#include "diff.h"
+#include "journal.h"
+#include "export.h"
+#include "publish.h"
+#include "transient.h"
+#include "rules.h"
+#include "cpu.h"
+#include "detail.h"
+#include "threads.h"
+#include "probe.h"
+#include "ntapi.h"
 
 #ifndef NTOP_VER
 #define NTOP_VER "dev"
@@ -48,7 +66,8 @@ static int OldWidth;
 static int OldHeight;
 static int SizeX;
 static int SizeY;
-static const int ProcessWindowPosY = 6;
+/* Below the header, which grows with the per-processor meters */
+static int ProcessWindowPosY = 6;
 static DWORD ProcessWindowHeight;
 static DWORD VisibleProcessCount;
 static WORD SavedAttributes;
@@ -57,6 +76,48 @@ static HANDLE OldConsoleHandle;
 static BOOL InteractiveMode = TRUE;
 static CRITICAL_SECTION SyncLock;
 
+/* Signalled by the collector thread whenever a new snapshot is installed */
+static HANDLE SnapshotEvent;
+static DWORD PollInterval = 1000;
+
+/* Non-interactive mode: 0 iterations means run until interrupted */
+static DWORD BatchIterations = 1;
+static DWORD BatchRowLimit = 0;
+static output_format OutputFormat = FORMAT_TEXT;
+
+/*
+ * Console output is collected here and written out in one go by ConFlush,
+ * which has to happen before anything that changes console state (color,
+ * cursor position, mode) so output still lands where it was meant to.
+ */
+static TCHAR ConBuffer[4096];
+static DWORD ConBufferCount;
+static ULONGLONG ConFlushTicks;
+
+static void ConFlush(void)
+{
+	if(ConBufferCount == 0)
+		return;
+
+	TRACE_BEGIN("flush");
+	ULONGLONG Start = ProfNow();
+	DWORD Dummy;
+	WriteFile(ConsoleHandle, ConBuffer, ConBufferCount * sizeof(*ConBuffer), &Dummy, 0);
+	ConBufferCount = 0;
+	ConFlushTicks += ProfNow() - Start;
+	TRACE_END("flush");
+}
+
+static void ConWrite(const TCHAR *Str, DWORD Count)
+{
+	if(ConBufferCount + Count > _countof(ConBuffer)) {
+		ConFlush();
+	}
+
+	memcpy(&ConBuffer[ConBufferCount], Str, Count * sizeof(*ConBuffer));
+	ConBufferCount += Count;
+}
+
 static int ConPrintf(TCHAR *Fmt, ...)
 {
 	TCHAR Buffer[1024];
@@ -66,16 +127,44 @@ static int ConPrintf(TCHAR *Fmt, ...)
 	int CharsWritten = _vstprintf_s(Buffer, _countof(Buffer), Fmt, VaList);
 	va_end(VaList);
 
-	DWORD Dummy;
-	WriteFile(ConsoleHandle, Buffer, CharsWritten, &Dummy, 0);
+	if(CharsWritten > 0) {
+		ConWrite(Buffer, CharsWritten);
+	}
 
 	return CharsWritten;
 }
 
 static void ConPutc(TCHAR c)
 {
-	DWORD Dummy;
-	WriteFile(ConsoleHandle, &c, 1, &Dummy, 0);
+	ConWrite(&c, 1);
+}
+
+/*
+ * Writes already encoded bytes (machine-readable output) straight to the
+ * console handle, after whatever text is still buffered.
+ */
+static void ConWriteBytes(const char *Data, size_t Length)
+{
+	ConFlush();
+
+	TRACE_BEGIN("flush");
+	ULONGLONG Start = ProfNow();
+	while(Length > 0) {
+		DWORD Chunk = (DWORD)min(Length, 1 << 20);
+		DWORD Written = 0;
+		if(!WriteFile(ConsoleHandle, Data, Chunk, &Written, 0) || Written == 0)
+			break;
+		Data += Written;
+		Length -= Written;
+	}
+	ConFlushTicks += ProfNow() - Start;
+	TRACE_END("flush");
+}
+
+static void ConSetMode(DWORD Mode)
+{
+	ConFlush();
+	SetConsoleMode(ConsoleHandle, Mode);
 }
 
 #define FOREGROUND_WHITE (FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE)
@@ -83,6 +172,18 @@ static void ConPutc(TCHAR c)
 #define BACKGROUND_WHITE (BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE)
 #define BACKGROUND_CYAN (BACKGROUND_INTENSITY | BACKGROUND_GREEN | BACKGROUND_BLUE)
 
+typedef enum sparkline_mode {
+	SPARKLINE_OFF,
+	SPARKLINE_CPU,
+	SPARKLINE_MEMORY,
+} sparkline_mode;
+
+typedef enum cpu_meter_mode {
+	CPU_METERS_OFF,
+	CPU_METERS_ON,
+	CPU_METERS_COMPACT,
+} cpu_meter_mode;
+
 typedef struct config {
 	WORD FGColor;
 	WORD BGColor;
@@ -95,6 +196,13 @@ typedef struct config {
 	WORD PageMemoryBarColor;
 	WORD ErrorColor;
 	ULONGLONG RedrawInterval;
+	DWORD HistoryMemory;	/* MB, 0 disables the history */
+	sparkline_mode Sparkline;
+	DWORD GrowthWindow;	/* seconds */
+	cpu_meter_mode CPUMeters;
+	DWORD ProbeRate;	/* Hz */
+	DWORD JournalSize;	/* MB, 0 disables the journal */
+	DWORD ExportTopN;	/* processes by CPU and by memory with their own series */
 } config;
 
 static config Config = {
@@ -109,7 +217,14 @@ static config Config = {
 	FOREGROUND_GREEN,
 	FOREGROUND_GREEN,
 	BACKGROUND_RED | FOREGROUND_WHITE,
-	1000
+	1000,
+	32,
+	SPARKLINE_OFF,
+	3600,
+	CPU_METERS_ON,
+	50,
+	4,
+	20
 };
 
 static config MonochromeConfig = {
@@ -123,9 +238,136 @@ static config MonochromeConfig = {
 	FOREGROUND_WHITE,
 	FOREGROUND_WHITE,
 	BACKGROUND_WHITE,
-	1000
+	1000,
+	32,
+	SPARKLINE_OFF,
+	3600,
+	CPU_METERS_ON,
+	50,
+	4,
+	20
+};
+
+#define TIME_STR_SIZE 12
+
+/*
+ * The columns of the process list and the per-process queries their
+ * values need. Only the queries of the shown columns, the sort key, the
+ * filters and the rules are issued, see CollectorQueries.
+ */
+typedef enum column_id {
+	COLUMN_ID,
+	COLUMN_USER,
+	COLUMN_PRIORITY,
+	COLUMN_CPU,
+	COLUMN_CPU95,
+	COLUMN_AVG1,
+	COLUMN_AVG5,
+	COLUMN_AVG15,
+	COLUMN_MEMORY,
+	COLUMN_MEMORY95,
+	COLUMN_GROWTH,
+	COLUMN_THREADS,
+	COLUMN_DISK,
+	COLUMN_READ,
+	COLUMN_WRITE,
+	COLUMN_READ_OPS,
+	COLUMN_WRITE_OPS,
+	COLUMN_TIME,
+	/* Fetched in the background for the drawn rows only, see detail.h */
+	COLUMN_HANDLES,
+	COLUMN_PRIVATE,
+	COLUMN_MODULES,
+	COLUMN_COUNT,
+} column_id;
+
+#define COLUMN_DEFAULT_COUNT COLUMN_HANDLES
+
+typedef struct column_def {
+	TCHAR *Name;		/* header, also the name used in ntop.conf */
+	int Width;
+	process_sort_type SortType;
+	DWORD Queries;
+} column_def;
+
+static const column_def ColumnDefs[COLUMN_COUNT] = {
+	{ _T("ID"),	7,	SORT_BY_ID,	0 },
+	{ _T("USER"),	9,	SORT_BY_USER_NAME,	QUERY_USER },
+	{ _T("PRI"),	3,	SORT_BY_PRIORITY,	0 },
+	{ _T("CPU%"),	5,	SORT_BY_PROCESSOR_TIME,	QUERY_TIMES },
+	{ _T("CPU95"),	5,	SORT_BY_PROCESSOR_TIME_P95,	QUERY_TIMES },
+	{ _T("AVG1"),	5,	SORT_BY_PROCESSOR_TIME_AVG1,	QUERY_TIMES },
+	{ _T("AVG5"),	5,	SORT_BY_PROCESSOR_TIME_AVG5,	QUERY_TIMES },
+	{ _T("AVG15"),	5,	SORT_BY_PROCESSOR_TIME_AVG15,	QUERY_TIMES },
+	{ _T("MEM"),	11,	SORT_BY_USED_MEMORY,	QUERY_MEMORY },
+	{ _T("MEM95"),	11,	SORT_BY_USED_MEMORY_P95,	QUERY_MEMORY },
+	{ _T("GROWTH"),	11,	SORT_BY_MEMORY_GROWTH,	QUERY_MEMORY },
+	{ _T("THRD"),	4,	SORT_BY_THREAD_COUNT,	0 },
+	{ _T("DISK"),	9,	SORT_BY_DISK_USAGE,	QUERY_IO },
+	{ _T("READ"),	9,	SORT_BY_DISK_READ,	QUERY_IO },
+	{ _T("WRITE"),	9,	SORT_BY_DISK_WRITE,	QUERY_IO },
+	{ _T("RIOPS"),	5,	SORT_BY_DISK_READ_OPS,	QUERY_IO },
+	{ _T("WIOPS"),	5,	SORT_BY_DISK_WRITE_OPS,	QUERY_IO },
+	{ _T("TIME"),	TIME_STR_SIZE - 1,	SORT_BY_UPTIME,	QUERY_TIMES },
+	{ _T("HNDL"),	5,	SORT_TYPE_MAX,	0 },
+	{ _T("PRIV"),	11,	SORT_TYPE_MAX,	0 },
+	{ _T("MODS"),	4,	SORT_TYPE_MAX,	0 },
 };
 
+/* Shown columns in display order, the default ones until ntop.conf says otherwise */
+static column_id Columns[COLUMN_COUNT];
+static int ColumnCount;
+static char ColumnError[64];
+
+static void ResetColumns(void)
+{
+	for(int i = 0; i < COLUMN_DEFAULT_COUNT; i++) {
+		Columns[i] = (column_id)i;
+	}
+	ColumnCount = COLUMN_DEFAULT_COUNT;
+}
+
+/* The Columns line of ntop.conf: names separated by spaces or commas */
+static void ParseColumns(char *List)
+{
+	const char *Delimeter = " \t,";
+	char *Context;
+	ColumnCount = 0;
+
+	for(char *Name = strtok_s(List, Delimeter, &Context); Name; Name = strtok_s(0, Delimeter, &Context)) {
+		TCHAR NameStr[16];
+		int Length = 0;
+		for(; Name[Length] && Length < _countof(NameStr) - 1; Length++) {
+			NameStr[Length] = (TCHAR)Name[Length];
+		}
+		NameStr[Length] = 0;
+
+		int Id = 0;
+		while(Id < COLUMN_COUNT && lstrcmpi(NameStr, ColumnDefs[Id].Name) != 0) {
+			Id++;
+		}
+
+		BOOL Shown = FALSE;
+		for(int i = 0; i < ColumnCount; i++) {
+			Shown |= Columns[i] == (column_id)Id;
+		}
+
+		if(Id == COLUMN_COUNT) {
+			if(!ColumnError[0]) {
+				strncpy_s(ColumnError, sizeof(ColumnError), Name, _TRUNCATE);
+			}
+		} else if(!Shown) {
+			Columns[ColumnCount++] = (column_id)Id;
+		}
+	}
+
+	if(ColumnCount == 0) {
+		ResetColumns();
+	}
+}
+
+static char JournalPath[MAX_PATH];
+
 static void ParseConfigLine(char *Line)
 {
 	const char *Delimeter = " \t\n";
@@ -135,6 +377,29 @@ static void ParseConfigLine(char *Line)
 		return;
 	if(Key[0] == '#') /* Comment char*/
 		return;
+
+	/* These take the rest of the line */
+	if(_strcmpi(Key, "rule") == 0 || _strcmpi(Key, "AlertLog") == 0 || _strcmpi(Key, "Columns") == 0 ||
+			_strcmpi(Key, "Journal") == 0) {
+		size_t Length = strlen(Context);
+		while(Length > 0 && strchr(" \t\r\n", Context[Length - 1])) {
+			Context[--Length] = '\0';
+		}
+		while(*Context == ' ' || *Context == '\t') {
+			Context++;
+		}
+
+		if(_strcmpi(Key, "rule") == 0) {
+			RuleAdd(Context);
+		} else if(_strcmpi(Key, "Columns") == 0) {
+			ParseColumns(Context);
+		} else if(_strcmpi(Key, "Journal") == 0) {
+			strncpy_s(JournalPath, MAX_PATH, Context, _TRUNCATE);
+		} else {
+			RuleSetLogFile(Context);
+		}
+		return;
+	}
 	char *Value = strtok_s(0, Delimeter, &Context);
 	if(!Value)
 		return;
@@ -163,6 +428,32 @@ static void ParseConfigLine(char *Line)
 		Config.ErrorColor = Num;
 	} else if(_strcmpi(Key, "RedrawInterval") == 0) {
 		Config.RedrawInterval = (ULONGLONG)Num;
+	} else if(_strcmpi(Key, "HistoryMemory") == 0) {
+		Config.HistoryMemory = strtoul(Value, 0, 0);
+	} else if(_strcmpi(Key, "GrowthWindow") == 0) {
+		Config.GrowthWindow = strtoul(Value, 0, 0);
+	} else if(_strcmpi(Key, "ProbeRate") == 0) {
+		Config.ProbeRate = strtoul(Value, 0, 0);
+	} else if(_strcmpi(Key, "JournalSize") == 0) {
+		Config.JournalSize = strtoul(Value, 0, 0);
+	} else if(_strcmpi(Key, "ExportTopN") == 0) {
+		Config.ExportTopN = strtoul(Value, 0, 0);
+	} else if(_strcmpi(Key, "Sparkline") == 0) {
+		if(_strcmpi(Value, "cpu") == 0) {
+			Config.Sparkline = SPARKLINE_CPU;
+		} else if(_strcmpi(Value, "mem") == 0) {
+			Config.Sparkline = SPARKLINE_MEMORY;
+		} else {
+			Config.Sparkline = SPARKLINE_OFF;
+		}
+	} else if(_strcmpi(Key, "CPUMeters") == 0) {
+		if(_strcmpi(Value, "on") == 0) {
+			Config.CPUMeters = CPU_METERS_ON;
+		} else if(_strcmpi(Value, "compact") == 0) {
+			Config.CPUMeters = CPU_METERS_COMPACT;
+		} else {
+			Config.CPUMeters = CPU_METERS_OFF;
+		}
 	}
 }
 
@@ -186,6 +477,14 @@ static void ReadConfigFile(void)
         
     // Construct config file path
     snprintf(configPath, MAX_PATH, "%s\\ntop.conf", exePath);
+
+    // Alerts of rules go next to it unless AlertLog says otherwise
+    char alertLogPath[MAX_PATH];
+    snprintf(alertLogPath, MAX_PATH, "%s\\ntop-alerts.log", exePath);
+    RuleSetLogFile(alertLogPath);
+
+    // So does the process journal
+    snprintf(JournalPath, MAX_PATH, "%s\\ntop-journal.bin", exePath);
     
     Error = fopen_s(&File, configPath, "r");
     if(Error != 0) {
@@ -220,6 +519,7 @@ static void SetColor(WORD Color)
 {
 	Color |= ColorOverride;
 	CurrentColor = Color;
+	ConFlush();
 	SetConsoleTextAttribute(ConsoleHandle, Color);
 }
 
@@ -228,30 +528,10 @@ static void SetConCursorPos(SHORT X, SHORT Y)
 	COORD Coord;
 	Coord.X = X;
 	Coord.Y = Y;
+	ConFlush();
 	SetConsoleCursorPosition(ConsoleHandle, Coord);
 }
 
-typedef struct process {
-	HANDLE Handle;
-	DWORD ID;
-	TCHAR UserName[UNLEN];
-	DWORD BasePriority;
-	double PercentProcessorTime;
-	unsigned __int64 UsedMemory;
-	DWORD ThreadCount;
-	ULONGLONG UpTime;
-	TCHAR ExeName[MAX_PATH];
-	DWORD ParentPID;
-	ULONGLONG DiskOperationsPrev;
-	ULONGLONG DiskOperations;
-	DWORD DiskUsage;
-	DWORD TreeDepth;
-
-	struct process *Next;
-	struct process *Parent;
-	struct process *FirstChild;
-} process;
-
 #define PROCLIST_BUF_INCREASE 64
 
 static process *ProcessList;
@@ -348,12 +628,22 @@ static int SortProcessBy##Attribute(const void *A, const void *B)						\
 
 SORT_PROCESS_BY_INTEGER(ID);
 SORT_PROCESS_BY_DOUBLE(PercentProcessorTime);
+SORT_PROCESS_BY_DOUBLE(PercentProcessorTimeP95);
+SORT_PROCESS_BY_DOUBLE(PercentProcessorTimeAvg1);
+SORT_PROCESS_BY_DOUBLE(PercentProcessorTimeAvg5);
+SORT_PROCESS_BY_DOUBLE(PercentProcessorTimeAvg15);
 SORT_PROCESS_BY_UINT64(UsedMemory);
+SORT_PROCESS_BY_UINT64(UsedMemoryP95);
+SORT_PROCESS_BY_DOUBLE(MemoryGrowth);
 SORT_PROCESS_BY_INTEGER(UpTime);
 SORT_PROCESS_BY_INTEGER(BasePriority);
 SORT_PROCESS_BY_INTEGER(ThreadCount);
 SORT_PROCESS_BY_INTEGER(ParentPID);
 SORT_PROCESS_BY_INTEGER(DiskUsage);
+SORT_PROCESS_BY_UINT64(DiskReadRate);
+SORT_PROCESS_BY_UINT64(DiskWriteRate);
+SORT_PROCESS_BY_DOUBLE(DiskReadOps);
+SORT_PROCESS_BY_DOUBLE(DiskWriteOps);
 SORT_PROCESS_BY_STRING(ExeName, MAX_PATH);
 SORT_PROCESS_BY_STRING(UserName, UNLEN);
 
@@ -362,6 +652,9 @@ static process_sort_type ProcessSortType = SORT_BY_ID;
 static TCHAR OSName[256];
 static DWORD CPUCoreCount;
 static double CPUUsage;
+/* Decayed system CPU% and running process count, see LoadUpdate */
+static load_average CPULoad;
+static load_average RunningLoad;
 
 static ULONGLONG SubtractTimes(const FILETIME *A, const FILETIME *B)
 {
@@ -478,9 +771,27 @@ static void SortProcessList(void)
 		case SORT_BY_PROCESSOR_TIME:
 			SortFn = SortProcessByPercentProcessorTime;
 			break;
+		case SORT_BY_PROCESSOR_TIME_P95:
+			SortFn = SortProcessByPercentProcessorTimeP95;
+			break;
+		case SORT_BY_PROCESSOR_TIME_AVG1:
+			SortFn = SortProcessByPercentProcessorTimeAvg1;
+			break;
+		case SORT_BY_PROCESSOR_TIME_AVG5:
+			SortFn = SortProcessByPercentProcessorTimeAvg5;
+			break;
+		case SORT_BY_PROCESSOR_TIME_AVG15:
+			SortFn = SortProcessByPercentProcessorTimeAvg15;
+			break;
 		case SORT_BY_USED_MEMORY:
 			SortFn = SortProcessByUsedMemory;
 			break;
+		case SORT_BY_USED_MEMORY_P95:
+			SortFn = SortProcessByUsedMemoryP95;
+			break;
+		case SORT_BY_MEMORY_GROWTH:
+			SortFn = SortProcessByMemoryGrowth;
+			break;
 		case SORT_BY_UPTIME:
 			SortFn = SortProcessByUpTime;
 			break;
@@ -493,17 +804,43 @@ static void SortProcessList(void)
 		case SORT_BY_DISK_USAGE:
 			SortFn = SortProcessByDiskUsage;
 			break;
+		case SORT_BY_DISK_READ:
+			SortFn = SortProcessByDiskReadRate;
+			break;
+		case SORT_BY_DISK_WRITE:
+			SortFn = SortProcessByDiskWriteRate;
+			break;
+		case SORT_BY_DISK_READ_OPS:
+			SortFn = SortProcessByDiskReadOps;
+			break;
+		case SORT_BY_DISK_WRITE_OPS:
+			SortFn = SortProcessByDiskWriteOps;
+			break;
 		}
 
+		TRACE_BEGIN("sort");
+		ULONGLONG SortStart = ProfNow();
 		if(SortFn) {
 			qsort(ProcessList, ProcessCount, sizeof(*ProcessList), SortFn);
 		}
+		ProfRecord(PROF_SORT, SortStart);
+		TRACE_END("sort");
 
+		TRACE_BEGIN("tree");
+		ULONGLONG TreeStart = ProfNow();
 		FindParentChildProcesses();
+		ProfRecord(PROF_TREE, TreeStart);
+		TRACE_END("tree");
 	} else {
 		SortOrder = ASCENDING;
+		TRACE_BEGIN("sort");
+		ULONGLONG SortStart = ProfNow();
 		qsort(ProcessList, ProcessCount, sizeof(*ProcessList), SortProcessByParentPID);
+		ProfRecord(PROF_SORT, SortStart);
+		TRACE_END("sort");
 
+		TRACE_BEGIN("tree");
+		ULONGLONG TreeStart = ProfNow();
 		FindParentChildProcesses();
 
 		process *TreeProcessList = xmalloc(ProcessCount * sizeof(*ProcessList));
@@ -514,6 +851,8 @@ static void SortProcessList(void)
 		memcpy(ProcessList, TreeProcessList, ProcessCount * sizeof(*ProcessList));
 
 		free(TreeProcessList);
+		ProfRecord(PROF_TREE, TreeStart);
+		TRACE_END("tree");
 	}
 }
 
@@ -660,10 +999,254 @@ static void SearchPrevious(void)
 	SetViMessage(VI_ERROR, _T("Pattern not found: %s"), SearchPattern);
 }
 
-static void PollProcessList(DWORD UpdateTime)
+/*
+ * The -p and -n filters only need what enumeration already returned, so
+ * the collector checks them before it opens a process at all.
+ */
+static BOOL PassesEarlyFilters(const process *Process)
+{
+	if(FilterByPID) {
+		BOOL InFilter = FALSE;
+		for(DWORD PidIndex = 0; PidIndex < PidFilterCount; PidIndex++) {
+			if(PidFilterList[PidIndex] == Process->ID) {
+				InFilter = TRUE;
+			}
+		}
+
+		if(!InFilter) {
+			return FALSE;
+		}
+	}
+
+	if(FilterByName) {
+		BOOL InFilter = FALSE;
+		for(DWORD NameIndex = 0; NameIndex < NameFilterCount; NameIndex++) {
+			if(_tcsstr(Process->ExeName, NameFilterList[NameIndex]) != NULL) {
+				InFilter = TRUE;
+			}
+		}
+
+		if(!InFilter) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* The -u filter, which needs the token query */
+static BOOL PassesUserFilter(const process *Process)
+{
+	return !FilterByUserName || lstrcmpi(Process->UserName, FilterUserName) == 0;
+}
+
+/* The -u, -p and -n filters, applied to live and replayed snapshots alike */
+static BOOL PassesFilters(const process *Process)
+{
+	return PassesEarlyFilters(Process) && PassesUserFilter(Process);
+}
+
+static rec_writer *Recorder;
+static rec_reader *Replayer;
+static BOOL HistoryViewing;
+/* The queries behind the process list on screen, columns outside of them show "-" */
+static DWORD ShownQueries = QUERY_ALL;
+
+/*
+ * System values to store next to a fresh process list, on the collector
+ * thread. Memory is queried here as PollSystemInfo runs on the main thread.
+ */
+static void GetCollectorSummary(system_summary *Summary, DWORD Count, DWORD RunningCount, double Usage)
+{
+	MEMORYSTATUSEX MemoryInfo;
+	MemoryInfo.dwLength = sizeof(MEMORYSTATUSEX);
+	GlobalMemoryStatusEx(&MemoryInfo);
+
+	Summary->CPUUsage = Usage;
+	Summary->TotalMemory = MemoryInfo.ullTotalPhys;
+	Summary->UsedMemory = MemoryInfo.ullTotalPhys - MemoryInfo.ullAvailPhys;
+	Summary->TotalPageMemory = MemoryInfo.ullTotalPageFile;
+	Summary->UsedPageMemory = MemoryInfo.ullTotalPageFile - MemoryInfo.ullAvailPageFile;
+	Summary->UpTime = GetTickCount64();
+	Summary->ProcessCount = Count;
+	Summary->RunningProcessCount = RunningCount;
+}
+
+static void StopRecording(void)
+{
+	rec_stats Stats;
+	TCHAR Buffer[512];
+
+	RecClose(Recorder);
+	RecGetStats(Recorder, &Stats);
+
+	ULONGLONG Duration = Stats.LastTimestamp - Stats.FirstTimestamp;
+	double MBPerHour = Duration ? (double)Stats.Bytes * 3600000.0 / (double)Duration / (1024.0 * 1024.0) : 0.0;
+	ULONGLONG AverageProcesses = Stats.FrameCount ? Stats.ProcessSamples / Stats.FrameCount : 0;
+
+	int Length = _stprintf_s(Buffer, _countof(Buffer),
+			_T("Recorded %lu frames (%lu keyframes), %llu bytes, %llu processes per frame, %.2f MB/hour\n"),
+			Stats.FrameCount, Stats.KeyframeCount, Stats.Bytes, AverageProcesses, MBPerHour);
+	WriteFile(GetStdHandle(STD_ERROR_HANDLE), Buffer, (DWORD)(sizeof(*Buffer) * Length), 0, 0);
+}
+
+/*
+ * Feeds the per-process ring buffers from values the collector already
+ * has and releases the slots of the processes the diff saw go away.
+ * Queries tells which values were actually read in this cycle.
+ */
+static void UpdateTracking(process *Processes, DWORD Count, const diff_batch *Diff, DWORD Queries, ULONGLONG Timestamp)
+{
+	TrackBeginCycle();
+	for(DWORD i = 0; i < Count; i++) {
+		process *Process = &Processes[i];
+		Process->TrackSlot = TrackAcquire(Process->ID, Process->CreationTime);
+		if(Process->TrackSlot != TRACK_NONE) {
+			TrackPushSample(TrackGet(Process->TrackSlot), Process, Queries, Timestamp);
+		}
+	}
+
+	for(DWORD i = 0; i < Diff->Count; i++) {
+		if(Diff->Events[i].Type == DIFF_DEATH) {
+			TrackRelease(Diff->Events[i].ID, Diff->Events[i].CreationTime);
+		}
+	}
+}
+
+static void UpdateDiff(const process *Processes, DWORD Count, diff_batch *Diff)
+{
+	TRACE_BEGIN("diff");
+	ULONGLONG DiffStart = ProfNow();
+
+	DiffUpdate(Processes, Count, Diff);
+
+	ProfRecord(PROF_DIFF, DiffStart);
+	ProfCount(PROF_BIRTHS, Diff->Births);
+	ProfCount(PROF_DEATHS, Diff->Deaths);
+	ProfCount(PROF_CHANGES, Diff->Changes);
+	TRACE_END("diff");
+}
+
+static void UpdateLoadAverages(double Usage, DWORD RunningCount, ULONGLONG Timestamp)
+{
+	LoadUpdate(&CPULoad, 100.0 * Usage, Timestamp);
+	LoadUpdate(&RunningLoad, (double)RunningCount, Timestamp);
+}
+
+/*
+ * The queries the collector has to issue for what is on screen. Creation
+ * times identify processes and the header counts running ones, so the
+ * process times are always read.
+ */
+static DWORD CollectorQueries(void)
+{
+	/*
+	 * Machine-readable output, recordings, the exporter and local readers
+	 * get every field. The history stores what was queried with each
+	 * sample and shows the rest as unknown.
+	 */
+	if(!InteractiveMode || Recorder || ExportEnabled() || PublishEnabled())
+		return QUERY_ALL;
+
+	DWORD Queries = QUERY_TIMES;
+
+	for(int i = 0; i < ColumnCount; i++) {
+		Queries |= ColumnDefs[Columns[i]].Queries;
+	}
+	for(int i = 0; i < COLUMN_COUNT; i++) {
+		if(ColumnDefs[i].SortType == ProcessSortType)
+			Queries |= ColumnDefs[i].Queries;
+	}
+
+	if(Config.Sparkline == SPARKLINE_MEMORY)
+		Queries |= QUERY_MEMORY;
+	if(FilterByUserName)
+		Queries |= QUERY_USER;
+	/* The journal stores the user and the last working set of every process */
+	if(JournalEnabled())
+		Queries |= QUERY_USER | QUERY_MEMORY;
+
+	return Queries | RuleGetQueries();
+}
+
+/* Calls of the user name query: token open, two token reads and the SID lookup */
+#define USER_QUERY_CALLS 4
+
+/*
+ * The queries that only need a process handle. The user name comes first
+ * so that a process rejected by -u does not have its memory queried.
+ * Returns FALSE if the process was filtered out, its handle is closed then
+ * and Avoided counts the calls that were skipped.
+ */
+static BOOL QueryProcessInfo(process *Process, DWORD Queries, ULONGLONG *Avoided)
+{
+	if(Queries & QUERY_USER) {
+		_tcsncpy_s(Process->UserName, UNLEN, _T("SYSTEM"), UNLEN);
+	}
+
+	HANDLE ProcessTokenHandle;
+	if(Process->Handle && (Queries & QUERY_USER) && OpenProcessToken(Process->Handle, TOKEN_READ, &ProcessTokenHandle)) {
+		DWORD ReturnLength;
+
+		GetTokenInformation(ProcessTokenHandle, TokenUser, 0, 0, &ReturnLength);
+		if(GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
+			PTOKEN_USER TokenUserStruct = xmalloc(ReturnLength);
+
+			if(GetTokenInformation(ProcessTokenHandle, TokenUser, TokenUserStruct, ReturnLength, &ReturnLength)) {
+				SID_NAME_USE NameUse;
+				DWORD NameLength = UNLEN;
+				TCHAR DomainName[MAX_PATH];
+				DWORD DomainLength = MAX_PATH;
+
+				LookupAccountSid(0, TokenUserStruct->User.Sid, Process->UserName, &NameLength, DomainName, &DomainLength, &NameUse);
+			}
+			free(TokenUserStruct);
+		}
+		CloseHandle(ProcessTokenHandle);
+	}
+
+	if(!PassesUserFilter(Process)) {
+		if(Process->Handle) {
+			CloseHandle(Process->Handle);
+			Process->Handle = 0;
+			*Avoided += (Queries & QUERY_MEMORY) != 0;
+		}
+		return FALSE;
+	}
+
+	PROCESS_MEMORY_COUNTERS ProcMemCounters;
+	if(Process->Handle && (Queries & QUERY_MEMORY) && GetProcessMemoryInfo(Process->Handle, &ProcMemCounters, sizeof(ProcMemCounters))) {
+		Process->UsedMemory = (unsigned __int64)ProcMemCounters.WorkingSetSize;
+	}
+
+	return TRUE;
+}
+
+/* What a process rejected right after enumeration would have cost */
+static ULONGLONG EarlyRejectSavings(DWORD Queries)
+{
+	ULONGLONG Calls = 1;			/* OpenProcess */
+	if(Queries & QUERY_USER)
+		Calls += USER_QUERY_CALLS;
+	if(Queries & QUERY_MEMORY)
+		Calls++;
+	return Calls;
+}
+
+static void AddCollectedProcess(const process *Process, DWORD *Count)
+{
+	NewProcessList[(*Count)++] = *Process;
+
+	if(*Count >= ProcessListSize) {
+		IncreaseProcListSize();
+	}
+}
+
+/* One Toolhelp snapshot of the processes only, no threads, heaps or modules */
+static DWORD CollectAllProcesses(DWORD Queries)
 {
-	HANDLE Snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPALL, 0);
-	if(!Snapshot) {
+	HANDLE Snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+	if(Snapshot == INVALID_HANDLE_VALUE) {
 		Die(_T("CreateToolhelp32Snapshot failed: %ld\n"), GetLastError());
 	}
 
@@ -675,7 +1258,8 @@ static void PollProcessList(DWORD UpdateTime)
 		Die(_T("Process32First failed: %ld\n"), GetLastError());
 	}
 
-	DWORD i = 0;
+	DWORD Count = 0;
+	ULONGLONG Avoided = 0;
 
 	for(; Status; Status = Process32Next(Snapshot, &Entry)) {
 		process Process = { 0 };
@@ -687,80 +1271,169 @@ static void PollProcessList(DWORD UpdateTime)
 		Process.ParentPID = Entry.th32ParentProcessID;
 
 		_tcsncpy_s(Process.ExeName, MAX_PATH, Entry.szExeFile, MAX_PATH);
-		_tcsncpy_s(Process.UserName, UNLEN, _T("SYSTEM"), UNLEN);
+
+		if(!PassesEarlyFilters(&Process)) {
+			Avoided += EarlyRejectSavings(Queries);
+			continue;
+		}
 
 		Process.Handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, Entry.th32ProcessID);
-		if(Process.Handle) {
-			PROCESS_MEMORY_COUNTERS ProcMemCounters;
-			if(GetProcessMemoryInfo(Process.Handle, &ProcMemCounters, sizeof(ProcMemCounters))) {
-				Process.UsedMemory = (unsigned __int64)ProcMemCounters.WorkingSetSize;
-			}
+		if(!QueryProcessInfo(&Process, Queries, &Avoided)) {
+			continue;
+		}
 
-			HANDLE ProcessTokenHandle;
-			if(OpenProcessToken(Process.Handle, TOKEN_READ, &ProcessTokenHandle)) {
-				DWORD ReturnLength;
+		AddCollectedProcess(&Process, &Count);
+	}
 
-				GetTokenInformation(ProcessTokenHandle, TokenUser, 0, 0, &ReturnLength);
-				if(GetLastError() == ERROR_INSUFFICIENT_BUFFER) {
-					PTOKEN_USER TokenUserStruct = xmalloc(ReturnLength);
+	CloseHandle(Snapshot);
+	ProfCount(PROF_QUERIES_AVOIDED, Avoided);
+	return Count;
+}
 
-					if(GetTokenInformation(ProcessTokenHandle, TokenUser, TokenUserStruct, ReturnLength, &ReturnLength)) {
-						SID_NAME_USE NameUse;
-						DWORD NameLength = UNLEN;
-						TCHAR DomainName[MAX_PATH];
-						DWORD DomainLength = MAX_PATH;
+/*
+ * With -p only the given PIDs are opened, once, and the handle is kept so
+ * that the PID cannot be reused while we watch it. A process that exits is
+ * reported and dropped, a PID that does not exist yet is tried again on
+ * the next cycle. Nothing else on the system is enumerated.
+ */
+typedef struct pid_target {
+	HANDLE Handle;			/* 0 until the process could be opened */
+	BOOL Exited;
+	DWORD ParentPID;
+	TCHAR ExeName[MAX_PATH];
+} pid_target;
 
-						LookupAccountSid(0, TokenUserStruct->User.Sid, Process.UserName, &NameLength, DomainName, &DomainLength, &NameUse);
+static pid_target PidTargets[_countof(PidFilterList)];
+static nt_query_information_process NtQueryInformationProcess;
+static nt_get_next_thread NtGetNextThread;
 
-						// FIXME: we cut user name here for display purposes because something like %9.9s does not work with MS's vsprintf function?
-						Process.UserName[9] = 0;
-					}
-					free(TokenUserStruct);
-				}
-				CloseHandle(ProcessTokenHandle);
-			}
-		}
+static void OpenTarget(DWORD ID, pid_target *Target)
+{
+	/* Full query access lets CountThreads walk the threads, not every process grants it */
+	Target->Handle = OpenProcess(PROCESS_QUERY_INFORMATION | SYNCHRONIZE, FALSE, ID);
+	if(!Target->Handle) {
+		Target->Handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, FALSE, ID);
+	}
+	if(!Target->Handle)
+		return;
 
-		if(FilterByUserName && lstrcmpi(Process.UserName, FilterUserName) != 0) {
-			continue;
+	TCHAR Path[MAX_PATH];
+	DWORD Size = MAX_PATH;
+	if(QueryFullProcessImageName(Target->Handle, 0, Path, &Size)) {
+		const TCHAR *Name = _tcsrchr(Path, _T('\\'));
+		_tcsncpy_s(Target->ExeName, MAX_PATH, Name ? Name + 1 : Path, _TRUNCATE);
+	}
+
+	nt_process_basic_information Info;
+	if(NtQueryInformationProcess && NT_SUCCEEDED(NtQueryInformationProcess(Target->Handle, NT_PROCESS_BASIC_INFORMATION, &Info, sizeof(Info), 0))) {
+		Target->ParentPID = (DWORD)Info.InheritedFromUniqueProcessId;
+	}
+}
+
+/*
+ * The thread count of a process without enumerating the system, one call
+ * per thread. 0 if the threads cannot be walked, which no running process
+ * has otherwise, so 0 stands for unknown.
+ */
+static DWORD CountThreads(HANDLE Process)
+{
+	DWORD Count = 0;
+	HANDLE Thread = 0;
+	HANDLE Next;
+
+	if(!NtGetNextThread)
+		return 0;
+
+	while(NT_SUCCEEDED(NtGetNextThread(Process, Thread, THREAD_QUERY_LIMITED_INFORMATION, 0, 0, &Next))) {
+		if(Thread) {
+			CloseHandle(Thread);
 		}
+		Thread = Next;
+		Count++;
+	}
+	if(Thread) {
+		CloseHandle(Thread);
+	}
 
-		if(FilterByPID) {
-			BOOL InFilter = FALSE;
-			for(DWORD PidIndex = 0; PidIndex < PidFilterCount; PidIndex++) {
-				if(PidFilterList[PidIndex] == Process.ID) {
-					InFilter = TRUE;
-				}
-			}
+	return Count;
+}
+
+static DWORD CollectTargetedProcesses(DWORD Queries)
+{
+	if(!NtQueryInformationProcess) {
+		NtQueryInformationProcess = (nt_query_information_process)NT_GET_PROC("NtQueryInformationProcess");
+		NtGetNextThread = (nt_get_next_thread)NT_GET_PROC("NtGetNextThread");
+	}
+
+	DWORD Count = 0;
+	ULONGLONG Avoided = 0;
 
-			if(!InFilter) {
+	for(DWORD i = 0; i < PidFilterCount; i++) {
+		DWORD ID = PidFilterList[i];
+		pid_target *Target = &PidTargets[i];
+
+		if(Target->Exited || ID == 0)
+			continue;
+		if(!Target->Handle) {
+			OpenTarget(ID, Target);
+			if(!Target->Handle)
 				continue;
+		}
+
+		if(WaitForSingleObject(Target->Handle, 0) == WAIT_OBJECT_0) {
+			DWORD ExitCode = 0;
+			GetExitCodeProcess(Target->Handle, &ExitCode);
+			RuleQueueAlert(VI_NOTICE, _T("%s (%u) exited with code %u"), Target->ExeName, ID, ExitCode);
+			if(!InteractiveMode) {
+				_ftprintf(stderr, _T("%s (%u) exited with code %u\n"), Target->ExeName, ID, ExitCode);
 			}
+			CloseHandle(Target->Handle);
+			Target->Handle = 0;
+			Target->Exited = TRUE;
+			continue;
 		}
 
-    if (FilterByName) {
-      BOOL InFilter = FALSE;
-      for(DWORD NameIndex = 0; NameIndex < NameFilterCount; NameIndex++) {
-        if(strstr(Process.ExeName, NameFilterList[NameIndex]) != NULL) {
-          InFilter = TRUE;
-        }
-      }
+		process Process = { 0 };
+		Process.ID = ID;
+		Process.ParentPID = Target->ParentPID;
+		_tcsncpy_s(Process.ExeName, MAX_PATH, Target->ExeName, MAX_PATH);
 
-      if (!InFilter) {
-        continue;
-      }
-    }
+		/* -n together with -p, the handle is already open */
+		if(!PassesEarlyFilters(&Process)) {
+			Avoided += EarlyRejectSavings(Queries);
+			continue;
+		}
 
-		NewProcessList[i++] = Process;
+		/* The priority and the thread count can change */
+		nt_process_basic_information Info;
+		if(NtQueryInformationProcess && NT_SUCCEEDED(NtQueryInformationProcess(Target->Handle, NT_PROCESS_BASIC_INFORMATION, &Info, sizeof(Info), 0))) {
+			Process.BasePriority = Info.BasePriority;
+		}
+		Process.ThreadCount = CountThreads(Target->Handle);
 
-		if(i >= ProcessListSize) {
-			IncreaseProcListSize();
+		/* The rest of the collector closes its handle, the target keeps its own */
+		if(!DuplicateHandle(GetCurrentProcess(), Target->Handle, GetCurrentProcess(), &Process.Handle, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+			Process.Handle = 0;
+		}
+		if(!QueryProcessInfo(&Process, Queries, &Avoided)) {
+			continue;
 		}
+
+		AddCollectedProcess(&Process, &Count);
 	}
 
-	CloseHandle(Snapshot);
+	ProfCount(PROF_QUERIES_AVOIDED, Avoided);
+	return Count;
+}
+
+static void PollProcessList(DWORD UpdateTime)
+{
+	TRACE_BEGIN("collect");
+	ULONGLONG CollectStart = ProfNow();
+
+	DWORD Queries = CollectorQueries();
 
-	DWORD NewProcessCount = i;
+	DWORD NewProcessCount = FilterByPID ? CollectTargetedProcesses(Queries) : CollectAllProcesses(Queries);
 
 	typedef struct system_times
 	{
@@ -774,8 +1447,14 @@ static void PollProcessList(DWORD UpdateTime)
 	typedef struct process_times
 	{
 		FILETIME CreationTime, ExitTime, KernelTime, UserTime; 
+		IO_COUNTERS IoCounters;
+		/* QueryPerformanceCounter when the I/O counters were read, 0 if they were not */
+		LONGLONG IoTimestamp;
 	} process_times;
 
+	LARGE_INTEGER PerformanceFrequency;
+	QueryPerformanceFrequency(&PerformanceFrequency);
+
 	process_times *ProcessTimes = (process_times *)xmalloc(NewProcessCount * sizeof(*ProcessTimes));
 
 	for(DWORD ProcIndex = 0; ProcIndex < NewProcessCount; ProcIndex++) {
@@ -784,15 +1463,23 @@ static void PollProcessList(DWORD UpdateTime)
 		if(Process->Handle) {
 			GetProcessTimes(Process->Handle, &ProcessTime->CreationTime, &ProcessTime->ExitTime, &ProcessTime->KernelTime, &ProcessTime->UserTime);
 
-			IO_COUNTERS IoCounters;
-			if(GetProcessIoCounters(Process->Handle, &IoCounters)) {
-				Process->DiskOperationsPrev = IoCounters.ReadTransferCount + IoCounters.WriteTransferCount;
+			ProcessTime->IoTimestamp = 0;
+			if((Queries & QUERY_IO) && GetProcessIoCounters(Process->Handle, &ProcessTime->IoCounters)) {
+				LARGE_INTEGER Now;
+				QueryPerformanceCounter(&Now);
+				ProcessTime->IoTimestamp = Now.QuadPart;
 			}
 		}
 	}
 
+	ProfRecord(PROF_COLLECT, CollectStart);
+	TRACE_END("collect");
+
 	Sleep(UpdateTime);
 
+	TRACE_BEGIN("delta");
+	ULONGLONG DeltaStart = ProfNow();
+
 	system_times SysTimes;
 
 	GetSystemTimes(&SysTimes.IdleTime, &SysTimes.KernelTime, &SysTimes.UserTime);
@@ -801,7 +1488,12 @@ static void PollProcessList(DWORD UpdateTime)
 	ULONGLONG SysUserDiff = SubtractTimes(&SysTimes.UserTime, &PrevSysTimes.UserTime);
 	ULONGLONG SysIdleDiff = SubtractTimes(&SysTimes.IdleTime, &PrevSysTimes.IdleTime);
 
-	RunningProcessCount = 0;
+	/*
+	 * Kept apart from the globals until the list is published, which does
+	 * not happen while a history sample is on screen.
+	 */
+	static double CycleCPUUsage;
+	DWORD CycleRunningCount = 0;
 
 	for(DWORD ProcIndex = 0; ProcIndex < NewProcessCount; ProcIndex++) {
 		process_times ProcessTime = { 0 };
@@ -819,7 +1511,7 @@ static void PollProcessList(DWORD UpdateTime)
 			if(TotalSys > 0) {
 				Process->PercentProcessorTime = (double)((100.0 * (double)TotalProc) / (double)TotalSys);
 				if(Process->PercentProcessorTime >= 0.01) {
-					RunningProcessCount++;
+					CycleRunningCount++;
 				}
 			}
 
@@ -828,10 +1520,36 @@ static void PollProcessList(DWORD UpdateTime)
 
 			Process->UpTime = SubtractTimes(&SysTime, &ProcessTime.CreationTime) / 10000;
 
+			ULARGE_INTEGER CreationTime;
+			CreationTime.LowPart = ProcessTime.CreationTime.dwLowDateTime;
+			CreationTime.HighPart = ProcessTime.CreationTime.dwHighDateTime;
+			Process->CreationTime = CreationTime.QuadPart;
+
+			ULARGE_INTEGER KernelTime, UserTime;
+			KernelTime.LowPart = ProcessTime.KernelTime.dwLowDateTime;
+			KernelTime.HighPart = ProcessTime.KernelTime.dwHighDateTime;
+			UserTime.LowPart = ProcessTime.UserTime.dwLowDateTime;
+			UserTime.HighPart = ProcessTime.UserTime.dwHighDateTime;
+			Process->CPUTime = KernelTime.QuadPart + UserTime.QuadPart;
+
 			IO_COUNTERS IoCounters;
-			if(GetProcessIoCounters(Process->Handle, &IoCounters)) {
+			if((Queries & QUERY_IO) && GetProcessIoCounters(Process->Handle, &IoCounters)) {
+				LARGE_INTEGER Now;
+				QueryPerformanceCounter(&Now);
 				Process->DiskOperations = IoCounters.ReadTransferCount + IoCounters.WriteTransferCount;
-				Process->DiskUsage = (DWORD)((Process->DiskOperations - Process->DiskOperationsPrev) * (1000/UpdateTime));
+
+				/* Rates over the time between the two reads, not the nominal interval */
+				if(PrevProcessTime->IoTimestamp && Now.QuadPart > PrevProcessTime->IoTimestamp) {
+					const IO_COUNTERS *Prev = &PrevProcessTime->IoCounters;
+					double Seconds = (double)(Now.QuadPart - PrevProcessTime->IoTimestamp) / (double)PerformanceFrequency.QuadPart;
+
+					Process->DiskReadRate = (ULONGLONG)((double)(IoCounters.ReadTransferCount - Prev->ReadTransferCount) / Seconds);
+					Process->DiskWriteRate = (ULONGLONG)((double)(IoCounters.WriteTransferCount - Prev->WriteTransferCount) / Seconds);
+					Process->DiskOtherRate = (ULONGLONG)((double)(IoCounters.OtherTransferCount - Prev->OtherTransferCount) / Seconds);
+					Process->DiskReadOps = (double)(IoCounters.ReadOperationCount - Prev->ReadOperationCount) / Seconds;
+					Process->DiskWriteOps = (double)(IoCounters.WriteOperationCount - Prev->WriteOperationCount) / Seconds;
+					Process->DiskUsage = (DWORD)min(Process->DiskReadRate + Process->DiskWriteRate, MAXDWORD);
+				}
 			}
 
 			CloseHandle(Process->Handle);
@@ -845,19 +1563,78 @@ static void PollProcessList(DWORD UpdateTime)
 	ULONGLONG SysTime = SysKernelDiff + SysUserDiff;
 	if(SysTime > 0) {
 		double Percentage = (double)(SysTime - SysIdleDiff) / (double)SysTime;
-		CPUUsage = min(Percentage, 1.0);
+		CycleCPUUsage = min(Percentage, 1.0);
 	}
 
-	EnterCriticalSection(&SyncLock);
+	if(InteractiveMode && Config.CPUMeters != CPU_METERS_OFF) {
+		CpuSample();
+	}
 
-	memcpy(ProcessList, NewProcessList, NewProcessCount * sizeof *ProcessList);
-	ProcessCount = NewProcessCount;
+	/* Returns right away unless the thread pane is open */
+	if(InteractiveMode) {
+		ThreadsSample();
+	}
 
+	diff_batch Diff;
+	UpdateDiff(NewProcessList, NewProcessCount, &Diff);
 
-	SortProcessList();
-	ReadjustCursor();
+	ULONGLONG TrackTimestamp = GetTickCount64();
+	UpdateTracking(NewProcessList, NewProcessCount, &Diff, Queries, TrackTimestamp);
+	JournalAppend(&Diff, GetUnixTimeMs());
+
+	ProfRecord(PROF_DELTA, DeltaStart);
+	TRACE_END("delta");
+
+	if(RuleGetCount() > 0) {
+		TRACE_BEGIN("rules");
+		ULONGLONG RulesStart = ProfNow();
+		RuleEvaluate(NewProcessList, NewProcessCount, TrackTimestamp);
+		ProfRecord(PROF_RULES, RulesStart);
+		TRACE_END("rules");
+	}
+
+	if(Recorder || HistEnabled() || ExportEnabled() || PublishEnabled()) {
+		system_summary Summary;
+		GetCollectorSummary(&Summary, NewProcessCount, CycleRunningCount, CycleCPUUsage);
+		ULONGLONG Timestamp = GetUnixTimeMs();
+
+		if(Recorder) {
+			RecWriteFrame(Recorder, Timestamp, &Summary, NewProcessList, NewProcessCount);
+		}
+		HistAppend(Timestamp, &Summary, Queries, NewProcessList, NewProcessCount);
+
+		TRACE_BEGIN("export");
+		ExportPublish(&Summary, NewProcessList, NewProcessCount);
+		TRACE_END("export");
+
+		TRACE_BEGIN("publish");
+		PublishSnapshot(&Summary, Timestamp, NewProcessList, NewProcessCount);
+		TRACE_END("publish");
+	}
+
+	TRACE_BEGIN("lock");
+	EnterCriticalSection(&SyncLock);
+	TRACE_END("lock");
+
+	/* While a past frame is on screen the new one only goes to the history */
+	if(!HistoryViewing) {
+		memcpy(ProcessList, NewProcessList, NewProcessCount * sizeof *ProcessList);
+		ProcessCount = NewProcessCount;
+		RunningProcessCount = CycleRunningCount;
+		CPUUsage = CycleCPUUsage;
+		ShownQueries = Queries;
+
+		SortProcessList();
+		ReadjustCursor();
+	}
+	/* Fed every cycle, while browsing too, under the lock so the UI copies them whole */
+	UpdateLoadAverages(CycleCPUUsage, CycleRunningCount, TrackTimestamp);
 
 	LeaveCriticalSection(&SyncLock);
+
+	if(SnapshotEvent) {
+		SetEvent(SnapshotEvent);
+	}
 }
 
 static void DisableCursor(void)
@@ -923,15 +1700,24 @@ static double UsedPageMemoryPerc;
 
 static ULONGLONG UpTime;
 
+/* Unrounded values of the last PollSystemInfo, for machine-readable output */
+static MEMORYSTATUSEX LastMemoryInfo;
+
 static void PollInitialSystemInfo(void)
 {
 	LARGE_INTEGER PerformanceFrequency;
 	QueryPerformanceFrequency(&PerformanceFrequency);
 	CPUFrequency = (double)PerformanceFrequency.QuadPart / 1000000.0;
 
-	SYSTEM_INFO SystemInfo;
-	GetNativeSystemInfo(&SystemInfo);
-	CPUCoreCount = SystemInfo.dwNumberOfProcessors;
+	/* The topology covers all processor groups, SYSTEM_INFO only the current one */
+	CPUCoreCount = CpuInit();
+	DetailInit();
+	ThreadsInit();
+	if(CPUCoreCount == 0) {
+		SYSTEM_INFO SystemInfo;
+		GetNativeSystemInfo(&SystemInfo);
+		CPUCoreCount = SystemInfo.dwNumberOfProcessors;
+	}
 
 	HKEY Key;
 	if(SUCCEEDED(RegOpenKey(HKEY_LOCAL_MACHINE, _T("HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\0\\"), &Key))) {
@@ -947,9 +1733,14 @@ static void PollInitialSystemInfo(void)
 
 static void PollSystemInfo(void)
 {
+	/* During replay and time travel these values come from the snapshot */
+	if(Replayer || HistoryViewing)
+		return;
+
 	MEMORYSTATUSEX MemoryInfo;
 	MemoryInfo.dwLength = sizeof(MEMORYSTATUSEX);
 	GlobalMemoryStatusEx(&MemoryInfo);
+	LastMemoryInfo = MemoryInfo;
 	TotalMemory = TO_MB(MemoryInfo.ullTotalPhys);
 	UsedMemory = TO_MB(MemoryInfo.ullTotalPhys - MemoryInfo.ullAvailPhys);
 	UsedMemoryPerc = (double)UsedMemory / (double)TotalMemory;
@@ -961,14 +1752,249 @@ static void PollSystemInfo(void)
 	UpTime = GetTickCount64();
 }
 
+static void GetSystemSummary(system_summary *Summary)
+{
+	Summary->CPUUsage = CPUUsage;
+	Summary->TotalMemory = LastMemoryInfo.ullTotalPhys;
+	Summary->UsedMemory = LastMemoryInfo.ullTotalPhys - LastMemoryInfo.ullAvailPhys;
+	Summary->TotalPageMemory = LastMemoryInfo.ullTotalPageFile;
+	Summary->UsedPageMemory = LastMemoryInfo.ullTotalPageFile - LastMemoryInfo.ullAvailPageFile;
+	Summary->UpTime = UpTime;
+	Summary->ProcessCount = ProcessCount;
+	Summary->RunningProcessCount = RunningProcessCount;
+}
+
+/* Sets the header values from a replayed or historical snapshot */
+static void ApplySystemSummary(const system_summary *Summary)
+{
+	CPUUsage = Summary->CPUUsage;
+	RunningProcessCount = Summary->RunningProcessCount;
+	UpTime = Summary->UpTime;
+	TotalMemory = TO_MB(Summary->TotalMemory);
+	UsedMemory = TO_MB(Summary->UsedMemory);
+	UsedMemoryPerc = TotalMemory ? (double)UsedMemory / (double)TotalMemory : 0.0;
+	TotalPageMemory = TO_MB(Summary->TotalPageMemory);
+	UsedPageMemory = TO_MB(Summary->UsedPageMemory);
+	UsedPageMemoryPerc = TotalPageMemory ? (double)UsedPageMemory / (double)TotalPageMemory : 0.0;
+	LastMemoryInfo.ullTotalPhys = Summary->TotalMemory;
+	LastMemoryInfo.ullAvailPhys = Summary->TotalMemory - Summary->UsedMemory;
+	LastMemoryInfo.ullTotalPageFile = Summary->TotalPageMemory;
+	LastMemoryInfo.ullAvailPageFile = Summary->TotalPageMemory - Summary->UsedPageMemory;
+}
+
+/*
+ * Replay. A thread owns the reader and publishes its frames exactly like
+ * PollProcessList does, so sorting, the tree view, search and filters
+ * all run on recorded data. The UI only posts commands to it.
+ */
+static CRITICAL_SECTION ReplayLock;
+static HANDLE ReplayWakeEvent;
+static BOOL ReplayPaused;
+static DWORD ReplaySpeed = 1;
+static int ReplayPendingSteps;
+static LONGLONG ReplayPendingSeek;
+static ULONGLONG ReplayTimestamp;
+static BOOL ReplayAtEnd;
+
+#define REPLAY_MAX_SPEED 64
+
+static void PublishReplayFrame(void)
+{
+	const process *Processes = RecGetProcesses(Replayer);
+	DWORD Count = RecGetProcessCount(Replayer);
+	system_summary Summary;
+
+	RecGetSystem(Replayer, &Summary);
+
+	EnterCriticalSection(&SyncLock);
+
+	while(Count >= ProcessListSize) {
+		IncreaseProcListSize();
+	}
+	memcpy(ProcessList, Processes, Count * sizeof *ProcessList);
+
+	/*
+	 * The diff and the trackers see the whole frame, so changing a filter
+	 * or seeking does not count the processes it hides as exits.
+	 */
+	diff_batch Diff;
+	UpdateDiff(ProcessList, Count, &Diff);
+	UpdateTracking(ProcessList, Count, &Diff, QUERY_ALL, RecGetTimestamp(Replayer));
+
+	DWORD Shown = 0;
+	for(DWORD i = 0; i < Count; i++) {
+		if(PassesFilters(&ProcessList[i])) {
+			ProcessList[Shown++] = ProcessList[i];
+		}
+	}
+	ProcessCount = Shown;
+
+	ApplySystemSummary(&Summary);
+	ReplayTimestamp = RecGetTimestamp(Replayer);
+	UpdateLoadAverages(CPUUsage, RunningProcessCount, ReplayTimestamp);
+
+	SortProcessList();
+	ReadjustCursor();
+
+	LeaveCriticalSection(&SyncLock);
+
+	if(SnapshotEvent) {
+		SetEvent(SnapshotEvent);
+	}
+}
+
+DWORD WINAPI ReplayThreadProc(LPVOID lpParam)
+{
+	UNREFERENCED_PARAMETER(lpParam);
+
+	TraceThreadName("replay");
+
+	ULONGLONG PublishTicks = GetTickCount64();
+
+	while(1) {
+		EnterCriticalSection(&ReplayLock);
+		int Steps = ReplayPendingSteps;
+		LONGLONG Seek = ReplayPendingSeek;
+		BOOL Paused = ReplayPaused;
+		DWORD Speed = ReplaySpeed;
+		ReplayPendingSteps = 0;
+		ReplayPendingSeek = 0;
+		LeaveCriticalSection(&ReplayLock);
+
+		BOOL Moved = FALSE;
+		ULONGLONG Current = RecGetTimestamp(Replayer);
+
+		if(Seek != 0 || Steps < 0) {
+			ULONGLONG Target = Current + Seek;
+			if(Seek < 0 && (ULONGLONG)-Seek > Current) {
+				Target = 0;
+			}
+			RecSeek(Replayer, Target);
+
+			/* Stepping back is a seek to just before the current frame */
+			for(; Steps < 0; Steps++) {
+				ULONGLONG Frame = RecGetTimestamp(Replayer);
+				if(Frame == 0 || !RecSeek(Replayer, Frame - 1))
+					break;
+			}
+			TrackRestart();
+			Moved = TRUE;
+		}
+
+		for(; Steps > 0; Steps--) {
+			Moved |= RecNextFrame(Replayer);
+		}
+
+		if(!Moved && !Paused) {
+			ULONGLONG Next;
+
+			if(!RecPeekNextTimestamp(Replayer, &Next)) {
+				EnterCriticalSection(&ReplayLock);
+				ReplayAtEnd = TRUE;
+				LeaveCriticalSection(&ReplayLock);
+				WaitForSingleObject(ReplayWakeEvent, INFINITE);
+				continue;
+			}
+
+			ULONGLONG Due = PublishTicks + (Next - Current) / Speed;
+			ULONGLONG Now = GetTickCount64();
+			if(Due > Now && WaitForSingleObject(ReplayWakeEvent, (DWORD)(Due - Now)) == WAIT_OBJECT_0) {
+				continue;
+			}
+
+			Moved = RecNextFrame(Replayer);
+		} else if(!Moved) {
+			WaitForSingleObject(ReplayWakeEvent, INFINITE);
+			continue;
+		}
+
+		if(Moved) {
+			EnterCriticalSection(&ReplayLock);
+			ReplayAtEnd = FALSE;
+			LeaveCriticalSection(&ReplayLock);
+
+			PublishTicks = GetTickCount64();
+			ULONGLONG PublishStart = ProfNow();
+			PublishReplayFrame();
+			ProfRecord(PROF_COLLECT, PublishStart);
+		}
+	}
+}
+
+static void ReplayTogglePause(void)
+{
+	EnterCriticalSection(&ReplayLock);
+	ReplayPaused = !ReplayPaused;
+	LeaveCriticalSection(&ReplayLock);
+	SetEvent(ReplayWakeEvent);
+}
+
+/* Stepping pauses playback so the frame stays on screen */
+static void ReplayStep(int Steps)
+{
+	EnterCriticalSection(&ReplayLock);
+	ReplayPaused = TRUE;
+	ReplayPendingSteps += Steps;
+	LeaveCriticalSection(&ReplayLock);
+	SetEvent(ReplayWakeEvent);
+}
+
+static void ReplaySeek(LONGLONG Milliseconds)
+{
+	EnterCriticalSection(&ReplayLock);
+	ReplayPendingSeek += Milliseconds;
+	LeaveCriticalSection(&ReplayLock);
+	SetEvent(ReplayWakeEvent);
+}
+
+static void ReplayChangeSpeed(BOOL Faster)
+{
+	EnterCriticalSection(&ReplayLock);
+	if(Faster && ReplaySpeed < REPLAY_MAX_SPEED) {
+		ReplaySpeed *= 2;
+	} else if(!Faster && ReplaySpeed > 1) {
+		ReplaySpeed /= 2;
+	}
+	LeaveCriticalSection(&ReplayLock);
+	SetEvent(ReplayWakeEvent);
+}
+
+static void FormatReplayStatus(TCHAR *Buffer, int BufferSize)
+{
+	FILETIME UtcTime, LocalTime;
+	SYSTEMTIME Time;
+
+	EnterCriticalSection(&SyncLock);
+	ULONGLONG Timestamp = ReplayTimestamp;
+	LeaveCriticalSection(&SyncLock);
+
+	ULARGE_INTEGER FileTime;
+	FileTime.QuadPart = Timestamp * 10000 + FILETIME_UNIX_EPOCH;
+	UtcTime.dwLowDateTime = FileTime.LowPart;
+	UtcTime.dwHighDateTime = FileTime.HighPart;
+	FileTimeToLocalFileTime(&UtcTime, &LocalTime);
+	FileTimeToSystemTime(&LocalTime, &Time);
+
+	EnterCriticalSection(&ReplayLock);
+	const TCHAR *State = ReplayAtEnd ? _T("end") : ReplayPaused ? _T("paused") : _T("playing");
+	DWORD Speed = ReplaySpeed;
+	LeaveCriticalSection(&ReplayLock);
+
+	_stprintf_s(Buffer, BufferSize, _T("NTop replay  %04u-%02u-%02u %02u:%02u:%02u  %s  %lux"),
+			Time.wYear, Time.wMonth, Time.wDay, Time.wHour, Time.wMinute, Time.wSecond,
+			State, Speed);
+}
+
 static HANDLE ProcessListThread;
 
 DWORD WINAPI PollProcessListThreadProc(LPVOID lpParam)
 {
 	UNREFERENCED_PARAMETER(lpParam);
 
+	TraceThreadName("collector");
+
 	while(1) {
-		PollProcessList(1000);
+		PollProcessList(PollInterval);
 	}
 	return 0;
 }
@@ -979,8 +2005,6 @@ typedef enum input_mode {
 
 static input_mode InputMode = EXEC;
 
-#define TIME_STR_SIZE 12
-
 /*
  * Create a dd:hh:mm:ss time-string similar to how the modern taskmgr does it.
  *
@@ -1032,14 +2056,184 @@ static BOOL WINAPI CtrlHandler(DWORD signal)
 
 typedef struct process_list_column {
 	TCHAR *Name;
-	int Width;
+	int Width;		/* 0 hides the column */
+	process_sort_type SortType;
 } process_list_column;
 
+/* Show the command line instead of the executable name, toggled with c */
+static BOOL ShowCommandLine;
+
+static BOOL NeedsProcessDetail(void)
+{
+	if(ShowCommandLine && InteractiveMode)
+		return TRUE;
+	for(int i = 0; i < ColumnCount; i++) {
+		if(Columns[i] >= COLUMN_HANDLES)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/*
+ * The UI only reads the cache and lets the detail thread catch up, while
+ * -d fetches right away since each row is written only once.
+ */
+static BOOL GetProcessDetail(const process *Process, process_detail *Detail)
+{
+	if(IsReplaying())
+		return FALSE;
+	if(InteractiveMode)
+		return DetailGet(Process->ID, Process->CreationTime, Detail);
+	return DetailFetch(Process->ID, Process->CreationTime, Detail);
+}
+
+/*
+ * Formats the value of a column in exactly its width. Detail is 0 while
+ * the details of the process are not known. Returns TRUE if the cell
+ * should stand out.
+ */
+static BOOL FormatColumn(column_id Id, const process *Process, const process_detail *Detail, TCHAR *Buffer, DWORD BufferSize)
+{
+	if(ColumnDefs[Id].Queries & ~ShownQueries) {
+		_stprintf_s(Buffer, BufferSize, _T("%*s"), ColumnDefs[Id].Width, _T("-"));
+		return FALSE;
+	}
+
+	switch(Id) {
+	case COLUMN_ID:
+		_stprintf_s(Buffer, BufferSize, _T("%7u"), Process->ID);
+		break;
+	case COLUMN_USER: {
+		// NOTE: the user name is cut here for display purposes because something like %9.9s does not work with MS's vsprintf function
+		TCHAR UserName[10];
+		_tcsncpy_s(UserName, _countof(UserName), Process->UserName, _TRUNCATE);
+		_stprintf_s(Buffer, BufferSize, _T("%9s"), UserName);
+		break;
+	}
+	case COLUMN_PRIORITY:
+		_stprintf_s(Buffer, BufferSize, _T("%3u"), Process->BasePriority);
+		break;
+	case COLUMN_CPU:
+		_stprintf_s(Buffer, BufferSize, _T("%04.1f%%"), Process->PercentProcessorTime);
+		break;
+	case COLUMN_CPU95:
+		_stprintf_s(Buffer, BufferSize, _T("%04.1f%%"), Process->PercentProcessorTimeP95);
+		break;
+	case COLUMN_AVG1:
+		_stprintf_s(Buffer, BufferSize, _T("%04.1f%%"), Process->PercentProcessorTimeAvg1);
+		break;
+	case COLUMN_AVG5:
+		_stprintf_s(Buffer, BufferSize, _T("%04.1f%%"), Process->PercentProcessorTimeAvg5);
+		break;
+	case COLUMN_AVG15:
+		_stprintf_s(Buffer, BufferSize, _T("%04.1f%%"), Process->PercentProcessorTimeAvg15);
+		break;
+	case COLUMN_MEMORY:
+		FormatMemoryString(Buffer, BufferSize, Process->UsedMemory);
+		break;
+	case COLUMN_MEMORY95:
+		FormatMemoryString(Buffer, BufferSize, Process->UsedMemoryP95);
+		break;
+	case COLUMN_GROWTH:
+		_stprintf_s(Buffer, BufferSize, _T("%+6.1f MB/h"), Process->MemoryGrowth);
+		/* A steady working set growth is likely a leak, make it stand out */
+		return Process->MemoryGrowthSteady;
+	case COLUMN_THREADS:
+		/* 0 only with -p, for a process whose threads could not be walked */
+		if(Process->ThreadCount) {
+			_stprintf_s(Buffer, BufferSize, _T("%4u"), Process->ThreadCount);
+		} else {
+			_stprintf_s(Buffer, BufferSize, _T("%4s"), _T("-"));
+		}
+		break;
+	case COLUMN_DISK:
+		_stprintf_s(Buffer, BufferSize, _T("% 03.1f MB/s"), ceil((double)Process->DiskUsage / 1000000.0 * 10.0) / 10.0);
+		break;
+	case COLUMN_READ:
+		_stprintf_s(Buffer, BufferSize, _T("% 03.1f MB/s"), ceil((double)Process->DiskReadRate / 1000000.0 * 10.0) / 10.0);
+		break;
+	case COLUMN_WRITE:
+		_stprintf_s(Buffer, BufferSize, _T("% 03.1f MB/s"), ceil((double)Process->DiskWriteRate / 1000000.0 * 10.0) / 10.0);
+		break;
+	case COLUMN_READ_OPS:
+		_stprintf_s(Buffer, BufferSize, _T("%5.0f"), Process->DiskReadOps);
+		break;
+	case COLUMN_WRITE_OPS:
+		_stprintf_s(Buffer, BufferSize, _T("%5.0f"), Process->DiskWriteOps);
+		break;
+	case COLUMN_TIME:
+		FormatTimeString(Buffer, BufferSize, Process->UpTime);
+		break;
+	case COLUMN_HANDLES:
+		if(Detail && Detail->HandleCount != DETAIL_UNKNOWN) {
+			_stprintf_s(Buffer, BufferSize, _T("%5u"), Detail->HandleCount);
+		} else {
+			_stprintf_s(Buffer, BufferSize, _T("%5s"), _T("-"));
+		}
+		break;
+	case COLUMN_PRIVATE:
+		if(Detail && Detail->PrivateBytes != 0) {
+			FormatMemoryString(Buffer, BufferSize, Detail->PrivateBytes);
+		} else {
+			_stprintf_s(Buffer, BufferSize, _T("%11s"), _T("-"));
+		}
+		break;
+	case COLUMN_MODULES:
+		if(Detail && Detail->ModuleCount != DETAIL_UNKNOWN) {
+			_stprintf_s(Buffer, BufferSize, _T("%4u"), Detail->ModuleCount);
+		} else {
+			_stprintf_s(Buffer, BufferSize, _T("%4s"), _T("-"));
+		}
+		break;
+	default:
+		Buffer[0] = 0;
+		break;
+	}
+	return FALSE;
+}
+
+/* Header of the shown columns without colors, for non-interactive mode */
+static void WriteColumnHeader(void)
+{
+	for(int i = 0; i < ColumnCount; i++) {
+		const column_def *Column = &ColumnDefs[Columns[i]];
+		ConPrintf(_T("%*s  "), Column->Width, Column->Name);
+	}
+	ConPrintf(_T("PROCESS"));
+}
+
+/* Ctrl+Left and Right step through the sort keys of the shown columns */
+static process_sort_type StepSortType(int Direction)
+{
+	process_sort_type SortTypes[COLUMN_COUNT + 1];
+	int Count = 0;
+	int Current = -1;
+
+	for(int i = 0; i < ColumnCount; i++) {
+		if(ColumnDefs[Columns[i]].SortType != SORT_TYPE_MAX)
+			SortTypes[Count++] = ColumnDefs[Columns[i]].SortType;
+	}
+	SortTypes[Count++] = SORT_BY_PROCESS;
+
+	for(int i = 0; i < Count; i++) {
+		if(SortTypes[i] == ProcessSortType)
+			Current = i;
+	}
+
+	if(Current < 0)
+		return SortTypes[0];
+	return SortTypes[(Current + Direction + Count) % Count];
+}
+
+
 static void DrawProcessListHeader(const process_list_column *Columns, int Count)
 {
 	int CharsWritten = 0;
 	for(int i = 0; i < Count; i++) {
-		if(i == (int)ProcessSortType) {
+		if(Columns[i].Width == 0)
+			continue;
+
+		if(Columns[i].SortType == ProcessSortType) {
 			SetColor(Config.BGHighlightColor);
 		} else {
 			SetColor(Config.ProcessListHeaderColor);
@@ -1074,7 +2268,7 @@ static void DrawOptions(const options_column *Columns, int Count)
 
 #define BAR_WIDTH 25
 
-static int DrawPercentageBar(TCHAR *Name, double Percentage, WORD Color)
+static int DrawMeter(const TCHAR *Name, double Percentage, WORD Color, int BarWidth)
 {
 	int CharsWritten = 0;
 
@@ -1084,17 +2278,17 @@ static int DrawPercentageBar(TCHAR *Name, double Percentage, WORD Color)
 	ConPutc(_T('['));
 	CharsWritten++;
 
-	int Bars = (int)((double)BAR_WIDTH * Percentage);
+	int Bars = (int)((double)BarWidth * Percentage);
 	SetColor(Color);
 	for(int i = 0; i < Bars; i++) {
 		ConPutc(_T('|'));
 	}
 	CharsWritten+= Bars;
 	SetColor(Config.FGColor);
-	for(int i = 0; i < BAR_WIDTH - Bars; i++) {
+	for(int i = 0; i < BarWidth - Bars; i++) {
 		ConPutc(_T(' '));
 	}
-	CharsWritten += BAR_WIDTH - Bars;
+	CharsWritten += BarWidth - Bars;
 	SetColor(Config.BGColor);
 	CharsWritten += ConPrintf(_T("%04.1f%%"), 100.0 * Percentage);
 	SetColor(Config.FGColor);
@@ -1103,11 +2297,228 @@ static int DrawPercentageBar(TCHAR *Name, double Percentage, WORD Color)
 	return CharsWritten;
 }
 
+static int DrawPercentageBar(TCHAR *Name, double Percentage, WORD Color)
+{
+	return DrawMeter(Name, Percentage, Color, BAR_WIDTH);
+}
+
+static BOOL ShowProfiler = FALSE;
+static BOOL DumpProfiler = FALSE;
+
+/*
+ * One line of p50/p99/max per pipeline stage, clipped to the window width.
+ */
+static void DrawProfilerOverlay(void)
+{
+	int CharsWritten = 0;
+
+	SetColor(Config.FGHighlightColor);
+	CharsWritten += ConPrintf(_T("  p50/p99/max"));
+
+	for(int i = 0; i < PROF_STAGE_MAX; i++) {
+		const prof_histogram *Histogram = ProfGetHistogram((prof_stage)i);
+		TCHAR P50Str[16], P99Str[16], MaxStr[16];
+		TCHAR StageBuf[128];
+
+		ProfFormatMicroseconds(P50Str, _countof(P50Str), ProfPercentile(Histogram, 50.0));
+		ProfFormatMicroseconds(P99Str, _countof(P99Str), ProfPercentile(Histogram, 99.0));
+		ProfFormatMicroseconds(MaxStr, _countof(MaxStr), Histogram->Max);
+		int StageChars = _stprintf_s(StageBuf, _countof(StageBuf), _T("  %s %s/%s/%s"),
+				ProfStageName((prof_stage)i), P50Str, P99Str, MaxStr);
+
+		if(CharsWritten + StageChars > Width)
+			break;
+
+		SetColor(Config.FGColor);
+		CharsWritten += ConPrintf(_T("%s"), StageBuf);
+	}
+
+	for(int i = 0; i < PROF_COUNTER_MAX; i++) {
+		TCHAR CounterBuf[64];
+		int CounterChars = _stprintf_s(CounterBuf, _countof(CounterBuf), _T("  %s %llu"),
+				ProfCounterName((prof_counter)i), ProfGetCounter((prof_counter)i)->Last);
+
+		if(CharsWritten + CounterChars > Width)
+			break;
+
+		CharsWritten += ConPrintf(_T("%s"), CounterBuf);
+	}
+
+	SetColor(Config.FGColor);
+	for(; CharsWritten < Width; CharsWritten++) {
+		ConPutc(_T(' '));
+	}
+}
+
+static void PrintProfilerHistograms(void)
+{
+	ConPrintf(_T("\nSTAGE        COUNT        MEAN         P50         P99         MAX\n"));
+
+	for(int i = 0; i < PROF_STAGE_MAX; i++) {
+		const prof_histogram *Histogram = ProfGetHistogram((prof_stage)i);
+		ULONGLONG Mean = Histogram->Count ? Histogram->Sum / Histogram->Count : 0;
+
+		ConPrintf(_T("%-8s  %8llu  %8lluus  %8lluus  %8lluus  %8lluus\n"),
+				ProfStageName((prof_stage)i),
+				Histogram->Count,
+				Mean,
+				ProfPercentile(Histogram, 50.0),
+				ProfPercentile(Histogram, 99.0),
+				Histogram->Max);
+	}
+
+	ConPrintf(_T("\nCOUNTER      CYCLES   PER CYCLE        LAST\n"));
+	for(int i = 0; i < PROF_COUNTER_MAX; i++) {
+		const prof_counter_stats *Stats = ProfGetCounter((prof_counter)i);
+		ConPrintf(_T("%-8s  %8llu  %10.1f  %10llu\n"),
+				ProfCounterName((prof_counter)i),
+				Stats->Cycles,
+				Stats->Cycles ? (double)Stats->Sum / (double)Stats->Cycles : 0.0,
+				Stats->Last);
+	}
+
+	for(int i = 0; i < PROF_STAGE_MAX; i++) {
+		const prof_histogram *Histogram = ProfGetHistogram((prof_stage)i);
+		if(Histogram->Count == 0)
+			continue;
+
+		ConPrintf(_T("\n%s histogram (us):\n"), ProfStageName((prof_stage)i));
+		for(int Bucket = 0; Bucket < PROF_BUCKET_COUNT; Bucket++) {
+			if(Histogram->Buckets[Bucket] == 0)
+				continue;
+
+			ConPrintf(_T("  %10llu - %10llu  %8lu\n"),
+					ProfBucketLowerBound(Bucket),
+					ProfBucketUpperBound(Bucket),
+					Histogram->Buckets[Bucket]);
+		}
+	}
+}
+
 static void RestoreConsole(void)
 {
+	ConFlush();
 	SetConsoleActiveScreenBuffer(OldConsoleHandle);
 }
 
+#define RULE_BENCHMARK_ROWS 10000
+
+/*
+ * Times all rules against the current process list repeated up to
+ * RULE_BENCHMARK_ROWS rows, without touching rule state or firing actions.
+ */
+void BenchmarkRules(void)
+{
+	if(RuleGetCount() == 0) {
+		SetViMessage(VI_ERROR, _T("No rules in ntop.conf"));
+		return;
+	}
+
+	process *Rows = xmalloc(RULE_BENCHMARK_ROWS * sizeof(*Rows));
+	DWORD RowCount = 0;
+
+	EnterCriticalSection(&SyncLock);
+	if(ProcessCount > 0) {
+		for(; RowCount < RULE_BENCHMARK_ROWS; RowCount++) {
+			Rows[RowCount] = ProcessList[RowCount % ProcessCount];
+		}
+	}
+	LeaveCriticalSection(&SyncLock);
+
+	DWORD Matches;
+	ULONGLONG Microseconds = RuleBenchmark(Rows, RowCount, &Matches);
+	free(Rows);
+
+	TCHAR P99Str[16];
+	ProfFormatMicroseconds(P99Str, _countof(P99Str), ProfPercentile(ProfGetHistogram(PROF_RULES), 99.0));
+	SetViMessage(VI_NOTICE, _T("%u rules x %u processes: %lluus, %u matches (live p99 %s)"),
+			RuleGetCount(), RowCount, Microseconds, Matches, P99Str);
+}
+
+int SetSparklineMode(const TCHAR *Name)
+{
+	if(!lstrcmpi(Name, _T("cpu"))) {
+		Config.Sparkline = SPARKLINE_CPU;
+	} else if(!lstrcmpi(Name, _T("mem"))) {
+		Config.Sparkline = SPARKLINE_MEMORY;
+	} else if(!lstrcmpi(Name, _T("off"))) {
+		Config.Sparkline = SPARKLINE_OFF;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+static TCHAR *SparklineHeader(void)
+{
+	return Config.Sparkline == SPARKLINE_MEMORY ? _T("MEM HISTORY") : _T("CPU HISTORY");
+}
+
+#ifdef UNICODE
+static const TCHAR SparkLevels[] = { L' ', 0x2581, 0x2582, 0x2583, 0x2584, 0x2585, 0x2586, 0x2587, 0x2588 };
+#else
+static const TCHAR SparkLevels[] = { ' ', '_', '.', '-', '~', '=', '+', '*', '#' };
+#endif
+
+#define SPARK_LEVEL_COUNT (_countof(SparkLevels) - 1)
+
+/*
+ * Draws the ring buffer of a process oldest to newest, right aligned. CPU
+ * is scaled from zero to the highest value in the window, but at least 1%
+ * so that an idle process stays flat; memory from its lowest to highest
+ * value so that small growth is still visible.
+ */
+static void FormatSparkline(TCHAR *Buffer, const process *Process)
+{
+	ULONGLONG Values[TRACK_SPARK_SAMPLES];
+	DWORD Count = 0;
+
+	if(Process->TrackSlot != TRACK_NONE) {
+		const track_slot *Slot = TrackGet(Process->TrackSlot);
+		Count = Slot->SparkCount;
+
+		for(DWORD i = 0; i < Count; i++) {
+			DWORD Index = (Slot->SparkHead + TRACK_SPARK_SAMPLES - Count + i) % TRACK_SPARK_SAMPLES;
+			Values[i] = Config.Sparkline == SPARKLINE_MEMORY ? Slot->SparkMemory[Index] : Slot->SparkCPU[Index];
+		}
+	}
+
+	ULONGLONG Low = Config.Sparkline == SPARKLINE_MEMORY ? ULLONG_MAX : 0;
+	ULONGLONG High = Config.Sparkline == SPARKLINE_MEMORY ? 0 : 100;
+	for(DWORD i = 0; i < Count; i++) {
+		Low = min(Low, Values[i]);
+		High = max(High, Values[i]);
+	}
+
+	DWORD Pad = TRACK_SPARK_SAMPLES - Count;
+	for(DWORD i = 0; i < Pad; i++) {
+		Buffer[i] = _T(' ');
+	}
+
+	for(DWORD i = 0; i < Count; i++) {
+		DWORD Level;
+		if(High > Low) {
+			Level = 1 + (DWORD)((Values[i] - Low) * (SPARK_LEVEL_COUNT - 1) / (High - Low));
+		} else {
+			Level = 1;
+		}
+		if(Config.Sparkline == SPARKLINE_CPU && Values[i] == 0) {
+			Level = 0;
+		}
+		Buffer[Pad + i] = SparkLevels[Level];
+	}
+
+	Buffer[TRACK_SPARK_SAMPLES] = _T('\0');
+}
+
+/* Command lines can be far wider than the window, cut them off at its edge */
+static int WriteProcessName(const TCHAR *Name, int CharsWritten)
+{
+	if(!InteractiveMode)
+		return ConPrintf(_T("%s"), Name);
+	return ConPrintf(_T("%.*s"), max(Width - CharsWritten, 0), Name);
+}
+
 static void WriteProcessInfo(const process *Process, BOOL Highlighted)
 {
 	WORD Color = Config.FGColor;
@@ -1123,59 +2534,606 @@ static void WriteProcessInfo(const process *Process, BOOL Highlighted)
 	}
 	SetColor(Color);
 
+	process_detail Detail;
+	BOOL HasDetail = NeedsProcessDetail() && GetProcessDetail(Process, &Detail);
+
+	/* The command line, or at least the full path, once it is known */
+	const TCHAR *Name = Process->ExeName;
+	if(ShowCommandLine && InteractiveMode && HasDetail) {
+		if(Detail.CommandLine[0]) {
+			Name = Detail.CommandLine;
+		} else if(Detail.ImagePath[0]) {
+			Name = Detail.ImagePath;
+		}
+	}
+
 	int CharsWritten = 0;
-	TCHAR UpTimeStr[TIME_STR_SIZE];
-	FormatTimeString(UpTimeStr, TIME_STR_SIZE, Process->UpTime);
+	ConPutc(_T('\n'));
+
+	for(int i = 0; i < ColumnCount; i++) {
+		TCHAR Cell[64];
+		if(FormatColumn(Columns[i], Process, HasDetail ? &Detail : 0, Cell, _countof(Cell)) && InteractiveMode) {
+			SetColor(Config.ErrorColor);
+		}
+		CharsWritten += ConPrintf(_T("%s"), Cell);
+		SetColor(Color);
+		CharsWritten += ConPrintf(_T("  "));
+	}
+
+	if(InteractiveMode && Config.Sparkline != SPARKLINE_OFF) {
+		TCHAR SparkStr[TRACK_SPARK_SAMPLES + 1];
+		FormatSparkline(SparkStr, Process);
+		CharsWritten += ConPrintf(_T("%s  "), SparkStr);
+	}
+
+	if(ProcessSortType == SORT_BY_TREE) {
+		TCHAR OffsetStr[256] = { 0 };
+		if(Process->TreeDepth > 0) {
+			for(DWORD i = 0; i < Process->TreeDepth-1; i++) {
+				_tcscat_s(OffsetStr, _countof(OffsetStr), _T("|  "));
+			}
+			_tcscat_s(OffsetStr, _countof(OffsetStr), _T("`- "));
+		}
+
+		Color = CurrentColor;
+
+		if(!Highlighted) {
+			SetColor(Config.FGHighlightColor);
+		}
+
+		CharsWritten += ConPrintf(_T("%s"), OffsetStr);
+		SetColor(Color);
+
+		CharsWritten += WriteProcessName(Name, CharsWritten);
+	} else {
+		CharsWritten += WriteProcessName(Name, CharsWritten);
+	}
+
+	if (InteractiveMode) {
+		ConPrintf(_T("%*c"), Width-CharsWritten+1, _T(' '));
+	}
+}
+
+static list_view ListView = LIST_VIEW_PROCESSES;
+
+void SetListView(list_view View)
+{
+	ListView = View;
+}
+
+static void DrawTransientSummary(void)
+{
+	transient_entry Entry;
+	transient_totals Totals;
+	TCHAR CPUTimeStr[TIME_STR_SIZE];
+
+	TransientGetTop(&Entry, 0, &Totals);
+	FormatTimeString(CPUTimeStr, TIME_STR_SIZE, Totals.CPUTime / 10000);
+
+	SetColor(Config.FGHighlightColor);
+	int CharsWritten = ConPrintf(_T("  Transient processes: "));
+	SetColor(Config.FGColor);
+	CharsWritten += ConPrintf(_T("%llu, %s CPU time"), Totals.Processes, CPUTimeStr);
+
+	for(; CharsWritten < Width; CharsWritten++) {
+		ConPutc(_T(' '));
+	}
+}
+
+#define CPU_METER_MIN_WIDTH 20
+#define CPU_METER_MAX_COLUMNS 8
+
+/* From this many processors on, one meter each would bury the process list */
+#define CPU_COMPACT_COUNT 128
+
+/* Length of the run of processors on the same node and package as First */
+static unsigned int CpuGroupLength(const cpu_info *Cpus, unsigned int Count, unsigned int First)
+{
+	unsigned int Last = First + 1;
+	while(Last < Count && Cpus[Last].Node == Cpus[First].Node && Cpus[Last].Package == Cpus[First].Package) {
+		Last++;
+	}
+	return Last - First;
+}
+
+/* Rows of the full meters with Columns processors per row */
+static int CpuMeterRows(const cpu_info *Cpus, unsigned int Count, BOOL Labeled, int Columns)
+{
+	int Rows = 0;
+	for(unsigned int First = 0; First < Count; First += CpuGroupLength(Cpus, Count, First)) {
+		Rows += (Labeled ? 1 : 0) + (CpuGroupLength(Cpus, Count, First) + Columns - 1) / Columns;
+	}
+	return Rows;
+}
+
+/*
+ * One meter per logical processor below the system bars, in runs per NUMA
+ * node and package that are labeled once there is more than one of
+ * either. Compact mode draws one level character per processor instead,
+ * which it also falls back to when the meters would take more than
+ * MaxRows. Returns the number of rows drawn.
+ */
+static int DrawCPUMeters(int MaxRows)
+{
+	const cpu_info *Cpus = CpuGetInfo();
+	unsigned int Count = CpuGetCount();
+
+	/* The meters are live values, they would not match a replayed or past snapshot */
+	if(Config.CPUMeters == CPU_METERS_OFF || Replayer || HistoryViewing || Count == 0 || MaxRows <= 0)
+		return 0;
+
+	BOOL Labeled = CpuGetNodeCount() > 1 || CpuGetPackageCount() > 1;
+	unsigned int MaxNumber = 0;
+	for(unsigned int i = 0; i < Count; i++) {
+		MaxNumber = max(MaxNumber, Cpus[i].Number);
+	}
+
+	TCHAR Label[32];
+	int LabelWidth = _stprintf_s(Label, _countof(Label), _T("%u"), MaxNumber);
+	int Columns = min(max(Width / CPU_METER_MIN_WIDTH, 1), CPU_METER_MAX_COLUMNS);
+	int CellWidth = Width / Columns;
+	int BarWidth = CellWidth - (LabelWidth + 10);
+
+	cpu_meter_mode Mode = Config.CPUMeters;
+	if(Mode == CPU_METERS_ON) {
+		int Rows = CpuMeterRows(Cpus, Count, Labeled, Columns);
+		if(Count >= CPU_COMPACT_COUNT || BarWidth < 1 || Rows > MaxRows)
+			Mode = CPU_METERS_COMPACT;
+	}
+
+	int PrefixWidth = 10;
+	int StripWidth = Width - PrefixWidth - 1;
+	if(Mode == CPU_METERS_COMPACT && StripWidth < 1)
+		return 0;
+
+	int Rows = 0;
+
+	for(unsigned int First = 0; First < Count && Rows < MaxRows; ) {
+		unsigned int Length = CpuGroupLength(Cpus, Count, First);
+		int PerRow = Mode == CPU_METERS_COMPACT ? StripWidth : Columns;
+
+		for(unsigned int RowStart = First; RowStart < First + Length && Rows < MaxRows; RowStart += PerRow) {
+			unsigned int RowEnd = min(RowStart + PerRow, First + Length);
+			int CharsWritten = 0;
+
+			if(Mode == CPU_METERS_COMPACT) {
+				if(RowStart != First) {
+					_tcscpy_s(Label, _countof(Label), _T(""));
+				} else if(Labeled) {
+					_stprintf_s(Label, _countof(Label), _T("N%u P%u"), Cpus[First].Node, Cpus[First].Package);
+				} else {
+					_tcscpy_s(Label, _countof(Label), _T("CPUs"));
+				}
+				SetColor(Config.FGHighlightColor);
+				CharsWritten += ConPrintf(_T("  %-*s"), PrefixWidth - 2, Label);
+				SetColor(Config.CPUBarColor);
+
+				/* Idle is the lowest visible level so that every processor shows */
+				for(unsigned int i = RowStart; i < RowEnd; i++) {
+					int Level = 1 + (int)(Cpus[i].Usage * (SPARK_LEVEL_COUNT - 1) + 0.5);
+					ConPutc(SparkLevels[min(Level, (int)SPARK_LEVEL_COUNT)]);
+					CharsWritten++;
+				}
+				SetColor(Config.FGColor);
+			} else {
+				if(Labeled && RowStart == First) {
+					SetColor(Config.FGHighlightColor);
+					CharsWritten = ConPrintf(_T("  Node %u, package %u: %u processors"),
+							Cpus[First].Node, Cpus[First].Package, Length);
+					SetColor(Config.FGColor);
+					for(; CharsWritten < Width; CharsWritten++) {
+						ConPutc(_T(' '));
+					}
+					CharsWritten = 0;
+					if(++Rows == MaxRows)
+						break;
+				}
+
+				for(unsigned int i = RowStart; i < RowEnd; i++) {
+					_stprintf_s(Label, _countof(Label), _T("%*u"), LabelWidth, Cpus[i].Number);
+					int MeterChars = DrawMeter(Label, Cpus[i].Usage, Config.CPUBarColor, BarWidth);
+					for(; MeterChars < CellWidth; MeterChars++) {
+						ConPutc(_T(' '));
+					}
+					CharsWritten += MeterChars;
+				}
+			}
+
+			for(; CharsWritten < Width; CharsWritten++) {
+				ConPutc(_T(' '));
+			}
+			Rows++;
+		}
+
+		First += Length;
+	}
+
+	return Rows;
+}
+
+/*
+ * Lists the executables whose short-lived processes used the most CPU,
+ * in place of the process list. Returns the number of rows drawn.
+ */
+static DWORD DrawTransientView(DWORD RowCount)
+{
+	const process_list_column Columns[] = {
+		{ _T("SPAWNS"),	8,	SORT_TYPE_MAX },
+		{ _T("CPU TIME"),	TIME_STR_SIZE - 1,	SORT_TYPE_MAX },
+		{ _T("PER SPAWN"),	TIME_STR_SIZE - 1,	SORT_TYPE_MAX },
+		{ _T("ERROR"),	TIME_STR_SIZE - 1,	SORT_TYPE_MAX },
+		{ _T("EXECUTABLE"),	-1,	SORT_TYPE_MAX },
+	};
+
+	DrawProcessListHeader(Columns, _countof(Columns));
+
+	transient_entry Entries[TRANSIENT_CAPACITY];
+	transient_totals Totals;
+	DWORD Count = TransientGetTop(Entries, min(RowCount, TRANSIENT_CAPACITY), &Totals);
+
+	SetColor(Config.FGColor);
+	for(DWORD i = 0; i < Count; i++) {
+		const transient_entry *Entry = &Entries[i];
+		TCHAR CPUTimeStr[TIME_STR_SIZE];
+		TCHAR PerSpawnStr[TIME_STR_SIZE];
+		TCHAR ErrorStr[TIME_STR_SIZE];
+
+		/* Short-lived processes use milliseconds, not seconds; CPU times are in 100 ns */
+		ProfFormatMicroseconds(CPUTimeStr, TIME_STR_SIZE, Entry->CPUTime / 10);
+		ProfFormatMicroseconds(PerSpawnStr, TIME_STR_SIZE, Entry->CPUTime / Entry->Spawns / 10);
+		ProfFormatMicroseconds(ErrorStr, TIME_STR_SIZE, Entry->Error / 10);
+
+		SetConCursorPos(0, (SHORT)(i + ProcessWindowPosY));
+		int CharsWritten = ConPrintf(_T("\n%8u  %*s  %*s  %*s  %s"),
+				Entry->Spawns, TIME_STR_SIZE - 1, CPUTimeStr, TIME_STR_SIZE - 1, PerSpawnStr,
+				TIME_STR_SIZE - 1, ErrorStr, Entry->Name);
+		ConPrintf(_T("%*c"), Width-CharsWritten+1, _T(' '));
+	}
+
+	return Count;
+}
+
+static TCHAR EventsFilter[256];
+static DWORD EventsOffset;	/* matching entries above the first row, newest first */
+
+/* Lower case, rows of the :events view match if they contain it */
+void SetEventsFilter(const TCHAR *Pattern)
+{
+	_tcsncpy_s(EventsFilter, _countof(EventsFilter), Pattern, _TRUNCATE);
+	_tcslwr_s(EventsFilter, _countof(EventsFilter));
+	EventsOffset = 0;
+}
+
+static void FormatJournalEntry(const journal_entry *Entry, TCHAR *Buffer, DWORD BufferSize)
+{
+	TCHAR ExeName[JOURNAL_NAME_SIZE];
+	TCHAR UserName[JOURNAL_USER_SIZE];
+	TCHAR LifetimeStr[TIME_STR_SIZE];
+	TCHAR CPUTimeStr[TIME_STR_SIZE];
+	TCHAR MemoryStr[16];
+
+	Utf8ToTChar(Entry->ExeName, (int)strnlen(Entry->ExeName, JOURNAL_NAME_SIZE), ExeName, _countof(ExeName));
+	Utf8ToTChar(Entry->UserName, (int)strnlen(Entry->UserName, JOURNAL_USER_SIZE), UserName, _countof(UserName));
+	FormatMemoryString(MemoryStr, _countof(MemoryStr), Entry->Memory);
+
+	if(Entry->Type == JOURNAL_EXIT) {
+		FormatTimeString(LifetimeStr, TIME_STR_SIZE, Entry->Lifetime);
+		/* Most exits are of short-lived processes, seconds would read 0; 100 ns units */
+		ProfFormatMicroseconds(CPUTimeStr, TIME_STR_SIZE, Entry->CPUTime / 10);
+	} else {
+		_tcscpy_s(LifetimeStr, TIME_STR_SIZE, _T("-"));
+		_tcscpy_s(CPUTimeStr, TIME_STR_SIZE, _T("-"));
+	}
+
+	ULARGE_INTEGER Time;
+	FILETIME FileTime;
+	SYSTEMTIME UtcTime, LocalTime;
+	Time.QuadPart = Entry->Timestamp * 10000 + FILETIME_UNIX_EPOCH;
+	FileTime.dwLowDateTime = Time.LowPart;
+	FileTime.dwHighDateTime = Time.HighPart;
+	FileTimeToSystemTime(&FileTime, &UtcTime);
+	SystemTimeToTzSpecificLocalTime(0, &UtcTime, &LocalTime);
+
+	_stprintf_s(Buffer, BufferSize, _T("%04u-%02u-%02u %02u:%02u:%02u  %5s  %7u  %7u  %-10.10s  %11s  %11s  %11s  %s"),
+			LocalTime.wYear, LocalTime.wMonth, LocalTime.wDay,
+			LocalTime.wHour, LocalTime.wMinute, LocalTime.wSecond,
+			Entry->Type == JOURNAL_EXIT ? _T("exit") : _T("start"),
+			Entry->ID, Entry->ParentPID, UserName, LifetimeStr, CPUTimeStr, MemoryStr, ExeName);
+}
+
+static BOOL MatchesEventsFilter(const TCHAR *Row)
+{
+	if(EventsFilter[0] == _T('\0'))
+		return TRUE;
+
+	TCHAR Lower[DEFAULT_STR_SIZE];
+	_tcscpy_s(Lower, _countof(Lower), Row);
+	_tcslwr_s(Lower, _countof(Lower));
+	return _tcsstr(Lower, EventsFilter) != 0;
+}
+
+static void DrawEventsSummary(void)
+{
+	SetColor(Config.FGHighlightColor);
+	int CharsWritten = ConPrintf(_T("  Journal: "));
+	SetColor(Config.FGColor);
+	CharsWritten += ConPrintf(_T("%llu of %u entries"),
+			min(JournalGetHead(), (ULONGLONG)JournalGetCapacity()), JournalGetCapacity());
+	if(EventsFilter[0]) {
+		CharsWritten += ConPrintf(_T(", matching \"%s\""), EventsFilter);
+	}
+
+	for(; CharsWritten < Width; CharsWritten++) {
+		ConPutc(_T(' '));
+	}
+}
+
+/*
+ * Lists the journal newest first, in place of the process list. Returns
+ * the number of rows drawn.
+ */
+static DWORD DrawEventsView(DWORD RowCount)
+{
+	const process_list_column Columns[] = {
+		{ _T("TIME"),	19,	SORT_TYPE_MAX },
+		{ _T("EVENT"),	5,	SORT_TYPE_MAX },
+		{ _T("PID"),	7,	SORT_TYPE_MAX },
+		{ _T("PPID"),	7,	SORT_TYPE_MAX },
+		{ _T("USER"),	-10,	SORT_TYPE_MAX },
+		{ _T("LIFETIME"),	TIME_STR_SIZE - 1,	SORT_TYPE_MAX },
+		{ _T("CPU TIME"),	TIME_STR_SIZE - 1,	SORT_TYPE_MAX },
+		{ _T("MEM"),	11,	SORT_TYPE_MAX },
+		{ _T("EXECUTABLE"),	-1,	SORT_TYPE_MAX },
+	};
+
+	DrawProcessListHeader(Columns, _countof(Columns));
+
+	ULONGLONG Head = JournalGetHead();
+	ULONGLONG Oldest = Head - min(Head, (ULONGLONG)JournalGetCapacity());
+	DWORD Skipped = 0;
+	DWORD Count = 0;
+
+	SetColor(Config.FGColor);
+	for(ULONGLONG Position = Head; Position > Oldest && Count < RowCount; Position--) {
+		journal_entry Entry;
+		TCHAR Row[DEFAULT_STR_SIZE];
+
+		/* Being overwritten by the collector, or torn by a crash while written */
+		if(!JournalRead(Position - 1, &Entry))
+			continue;
+
+		FormatJournalEntry(&Entry, Row, _countof(Row));
+		if(!MatchesEventsFilter(Row) || Skipped++ < EventsOffset)
+			continue;
+
+		SetConCursorPos(0, (SHORT)(Count + ProcessWindowPosY));
+		int CharsWritten = ConPrintf(_T("\n%.*s"), Width, Row);
+		ConPrintf(_T("%*c"), Width-CharsWritten+1, _T(' '));
+		Count++;
+	}
+
+	/* Do not scroll past the oldest match */
+	if(Count == 0 && EventsOffset > 0 && Skipped > 0) {
+		EventsOffset = Skipped - 1;
+	}
+
+	return Count;
+}
+
+/*
+ * The pane below the process list: the threads of the selection (Enter)
+ * or the strip charts of the probed processes (z).
+ */
+typedef enum bottom_pane {
+	PANE_NONE,
+	PANE_THREADS,
+	PANE_PROBE,
+} bottom_pane;
+
+static bottom_pane BottomPane;
+
+#define PANE_MIN_ROWS 4
+
+/* Rows of the pane, 0 if the window is too small to split */
+static DWORD BottomPaneRowCount(DWORD ListRowCount)
+{
+	if(BottomPane == PANE_NONE || ListView != LIST_VIEW_PROCESSES || IsReplaying())
+		return 0;
+	DWORD Rows = ListRowCount * 2 / 5;
+	if(Rows < PANE_MIN_ROWS || ListRowCount - Rows < PANE_MIN_ROWS)
+		return 0;
+	return Rows;
+}
+
+/* A title, the column header and the busiest threads, starting at screen row Top */
+static void DrawThreadPane(const process *Process, DWORD Top, DWORD RowCount)
+{
+	const process_list_column Columns[] = {
+		{ _T("TID"),	7,	SORT_TYPE_MAX },
+		{ _T("CPU%"),	5,	SORT_TYPE_MAX },
+		{ _T("PRI"),	3,	SORT_TYPE_MAX },
+		{ _T("STATE"),	9,	SORT_TYPE_MAX },
+		{ _T("CPU TIME"),	TIME_STR_SIZE - 1,	SORT_TYPE_MAX },
+		{ _T("START"),	-1,	SORT_TYPE_MAX },
+	};
+
+	thread_info *Threads = xmalloc(RowCount * sizeof(*Threads));
+	DWORD Total;
+	DWORD Count = ThreadsGetTop(Threads, RowCount - 2, &Total);
+
+	SetConCursorPos(0, (SHORT)Top);
+	SetColor(Config.MenuBarColor);
+	int CharsWritten;
+	if(Total == THREADS_EXITED) {
+		CharsWritten = ConPrintf(_T(" Threads of %s (%u): the process has exited"), Process->ExeName, Process->ID);
+	} else if(Total == THREADS_DENIED) {
+		CharsWritten = ConPrintf(_T(" Threads of %s (%u): access denied"), Process->ExeName, Process->ID);
+	} else if(Total == 0) {
+		CharsWritten = ConPrintf(_T(" Threads of %s (%u): sampling..."), Process->ExeName, Process->ID);
+	} else {
+		CharsWritten = ConPrintf(_T(" Threads of %s (%u): %u, busiest first"), Process->ExeName, Process->ID, Total);
+	}
+	ConPrintf(_T("%*c"), max(Width - CharsWritten, 1), _T(' '));
+
+	SetConCursorPos(0, (SHORT)(Top + 1));
+	DrawProcessListHeader(Columns, _countof(Columns));
+
+	SetColor(Config.FGColor);
+	for(DWORD i = 0; i < RowCount - 2; i++) {
+		SetConCursorPos(0, (SHORT)(Top + 2 + i));
+		if(i >= Count) {
+			WriteBlankLine();
+			continue;
+		}
+
+		const thread_info *Thread = &Threads[i];
+		TCHAR StateStr[10];
+		TCHAR CPUTimeStr[TIME_STR_SIZE];
+		FormatThreadState(Thread, StateStr, _countof(StateStr));
+		FormatTimeString(CPUTimeStr, TIME_STR_SIZE, Thread->CPUTime / 10000);
+
+		CharsWritten = ConPrintf(_T("%7u  %04.1f%%  %3d  %9s  %s  %.*s"),
+				Thread->ID, Thread->PercentProcessorTime, Thread->Priority, StateStr, CPUTimeStr,
+				max(Width - 45, 0), Thread->StartAddress);
+		ConPrintf(_T("%*c"), max(Width - CharsWritten, 1), _T(' '));
+	}
+
+	free(Threads);
+}
+
+/* The probe pane is repainted on its own this often, without the rest of the screen */
+#define PROBE_REDRAW_INTERVAL 100
+
+static DWORD ProbePaneTop;
+static DWORD ProbePaneRowCount;
+static ULONGLONG ProbePaneTicks;
+
+/*
+ * Scales a series from Low to High onto the spark levels, newest sample
+ * in the last column.
+ */
+static void FormatStripChart(TCHAR *Buffer, int ChartWidth, const double *Values, DWORD Count, double Low, double High)
+{
+	DWORD Shown = min(Count, (DWORD)ChartWidth);
+	int Pad = ChartWidth - (int)Shown;
+
+	for(int i = 0; i < Pad; i++) {
+		Buffer[i] = _T(' ');
+	}
+	for(DWORD i = 0; i < Shown; i++) {
+		double Value = Values[Count - Shown + i];
+		DWORD Level = 1;
+		if(High > Low) {
+			Level = 1 + (DWORD)((Value - Low) * (SPARK_LEVEL_COUNT - 1) / (High - Low));
+		}
+		Buffer[Pad + i] = SparkLevels[min(Level, SPARK_LEVEL_COUNT)];
+	}
+	Buffer[ChartWidth] = _T('\0');
+}
+
+/*
+ * A title, then two strip charts per probed process, CPU and working set,
+ * each as wide as the window allows. The labels show the peak in view.
+ */
+static void DrawProbePane(DWORD Top, DWORD RowCount)
+{
+	const int LabelWidth = 36;
+	int ChartWidth = max(Width - LabelWidth - 1, 1);
+	DWORD TargetCount = ProbeGetTargetCount();
+	DWORD Shown = min(TargetCount, (RowCount - 1) / 2);
+
+	SetConCursorPos(0, (SHORT)Top);
+	SetColor(Config.MenuBarColor);
+	int CharsWritten = ConPrintf(_T(" Probe at %u Hz: %u process%s, last %.1f s, z stops"),
+			ProbeGetRate(), TargetCount, TargetCount == 1 ? _T("") : _T("es"),
+			(double)min(ChartWidth, PROBE_SAMPLE_COUNT) / ProbeGetRate());
+	ConPrintf(_T("%*c"), max(Width - CharsWritten, 1), _T(' '));
+
+	probe_series *Series = xmalloc(sizeof(*Series));
+	double *Values = xmalloc(PROBE_SAMPLE_COUNT * sizeof(*Values));
+	TCHAR *Chart = xmalloc((ChartWidth + 1) * sizeof(*Chart));
+
+	SetColor(Config.FGColor);
+	for(DWORD i = 0; i < RowCount - 1; i++) {
+		SetConCursorPos(0, (SHORT)(Top + 1 + i));
+		if(i / 2 >= Shown || !ProbeGetSeries(i / 2, Series, ChartWidth)) {
+			WriteBlankLine();
+			continue;
+		}
+
+		double Low = 0.0, High = 0.0;
+		if(i % 2 == 0) {
+			/* At least 1% so that an idle process stays flat */
+			High = 1.0;
+			for(DWORD j = 0; j < Series->Count; j++) {
+				Values[j] = Series->Samples[j].PercentProcessorTime;
+				High = max(High, Values[j]);
+			}
+		} else {
+			Low = Series->Count > 0 ? (double)Series->Samples[0].WorkingSet : 0.0;
+			for(DWORD j = 0; j < Series->Count; j++) {
+				Values[j] = (double)Series->Samples[j].WorkingSet;
+				Low = min(Low, Values[j]);
+				High = max(High, Values[j]);
+			}
+		}
+		FormatStripChart(Chart, ChartWidth, Values, Series->Count, Low, High);
+
+		TCHAR Name[13];
+		_tcsncpy_s(Name, _countof(Name), Series->ExeName, _TRUNCATE);
+		if(i % 2 == 0) {
+			CharsWritten = ConPrintf(_T("%7u  %-12s  CPU %6.1f%%  "), Series->ID, Name, High);
+		} else {
+			CharsWritten = ConPrintf(_T("%7s  %-12s  MEM %6.0fM  "), _T(""), Series->Exited ? _T("(exited)") : _T(""), High / (1024.0 * 1024.0));
+		}
+		CharsWritten += ConPrintf(_T("%s"), Chart);
+		ConPrintf(_T("%*c"), max(Width - CharsWritten, 1), _T(' '));
+	}
+
+	free(Chart);
+	free(Values);
+	free(Series);
+
+	ProbePaneTop = Top;
+	ProbePaneRowCount = RowCount;
+	ProbePaneTicks = GetTickCount64();
+}
 
-	TCHAR MemoryStr[256];
-	FormatMemoryString(MemoryStr, _countof(MemoryStr), Process->UsedMemory);
+/* Probes the tagged processes, or the selected one if none are tagged */
+static void ToggleProbe(void)
+{
+	if(BottomPane == PANE_PROBE) {
+		ProbeStop();
+		BottomPane = PANE_NONE;
+		return;
+	}
 
-	if(ProcessSortType == SORT_BY_TREE) {
-		TCHAR OffsetStr[256] = { 0 };
-		if(Process->TreeDepth > 0) {
-			for(DWORD i = 0; i < Process->TreeDepth-1; i++) {
-				_tcscat_s(OffsetStr, _countof(OffsetStr), _T("|  "));
-			}
-			_tcscat_s(OffsetStr, _countof(OffsetStr), _T("`- "));
-		}
+	if(IsReplaying()) {
+		SetViMessage(VI_ERROR, _T("Probing needs live processes"));
+		return;
+	}
 
-		CharsWritten = ConPrintf(_T("\n%7u  %9s  %3u  %04.1f%%  %s  %4u  % 03.1f MB/s  %s"),
-				Process->ID,
-				Process->UserName,
-				Process->BasePriority,
-				Process->PercentProcessorTime,
-				MemoryStr,
-				Process->ThreadCount,
-				ceil((double)Process->DiskUsage / 1000000.0 * 10.0) / 10.0,
-				UpTimeStr
-				);
-		Color = CurrentColor;
+	process *Targets = xmalloc(PROBE_MAX_TARGETS * sizeof(*Targets));
+	DWORD Count = 0;
 
-		if(!Highlighted) {
-			SetColor(Config.FGHighlightColor);
+	EnterCriticalSection(&SyncLock);
+	for(DWORD i = 0; i < ProcessCount && Count < PROBE_MAX_TARGETS; i++) {
+		if(IsProcessTagged(ProcessList[i].ID)) {
+			Targets[Count++] = ProcessList[i];
 		}
+	}
+	if(Count == 0 && SelectedProcessIndex < ProcessCount) {
+		Targets[Count++] = ProcessList[SelectedProcessIndex];
+	}
+	LeaveCriticalSection(&SyncLock);
 
-		CharsWritten += ConPrintf(_T("  %s"), OffsetStr);
-		SetColor(Color);
-
-		CharsWritten += ConPrintf(_T("%s"), Process->ExeName);
+	if(ProbeStart(Targets, Count) == 0) {
+		SetViMessage(VI_ERROR, _T("Could not open any process for probing"));
 	} else {
-		CharsWritten = ConPrintf(_T("\n%7u  %9s  %3u  %04.1f%%  %s  %4u  % 03.1f MB/s  %s  %s"),
-				Process->ID,
-				Process->UserName,
-				Process->BasePriority,
-				Process->PercentProcessorTime,
-				MemoryStr,
-				Process->ThreadCount,
-				ceil((double)Process->DiskUsage / 1000000.0 * 10.0) / 10.0,
-				UpTimeStr,
-				Process->ExeName
-				);
+		BottomPane = PANE_PROBE;
 	}
 
-	if (InteractiveMode) {
-		ConPrintf(_T("%*c"), Width-CharsWritten+1, _T(' '));
-	}
+	free(Targets);
 }
 
 static ULONGLONG KeyPressStart = 0;
@@ -1191,8 +3149,33 @@ typedef enum scroll_type {
 	SCROLL_PAGE_DOWN,
 } scroll_type;
 
+static void ScrollEvents(scroll_type ScrollType, BOOL *Redraw)
+{
+	switch(ScrollType) {
+	case SCROLL_UP:
+		if(EventsOffset > 0)
+			EventsOffset--;
+		break;
+	case SCROLL_DOWN:
+		EventsOffset++;
+		break;
+	case SCROLL_PAGE_UP:
+		EventsOffset -= min(EventsOffset, VisibleProcessCount);
+		break;
+	case SCROLL_PAGE_DOWN:
+		EventsOffset += VisibleProcessCount;
+		break;
+	}
+	*Redraw = TRUE;
+}
+
 static void DoScroll(scroll_type ScrollType, BOOL *Redraw)
 {
+	if(ListView == LIST_VIEW_EVENTS) {
+		ScrollEvents(ScrollType, Redraw);
+		return;
+	}
+
 	ULONGLONG Now = GetTickCount64();
 	FollowProcess = FALSE;
 
@@ -1270,6 +3253,32 @@ static void DoScroll(scroll_type ScrollType, BOOL *Redraw)
 	}
 }
 
+/*
+ * Matches "--Name=Value" and "--Name Value", advancing *Index past a
+ * separate value. Returns 0 if argv[*Index] is not this option.
+ */
+static const TCHAR *GetLongOption(int argc, TCHAR *argv[], int *Index, const TCHAR *Name)
+{
+	const TCHAR *Arg = argv[*Index] + 2;
+	size_t NameLength = _tcslen(Name);
+
+	if(_tcsncmp(Arg, Name, NameLength) != 0)
+		return 0;
+
+	if(Arg[NameLength] == _T('='))
+		return &Arg[NameLength + 1];
+
+	if(Arg[NameLength] != _T('\0'))
+		return 0;
+
+	if(*Index + 1 < argc) {
+		*Index = *Index + 1;
+		return argv[*Index];
+	}
+
+	return _T("");
+}
+
 static void PrintVersion(void)
 {
 	ConPrintf(_T("NTop " STRINGIZE_VALUE_OF(NTOP_VER) " - (C) 2019 Gian Sass\n"));
@@ -1323,7 +3332,17 @@ static void PrintHelp(const TCHAR *argv0)
 		{ _T("-s COLUMN\n"), _T("\tSort by this column.") },
 		{ _T("-u USERNAME\n"), _T("\tDisplay only processes of this user.") },
 		{ _T("-d"), _T("Do not run in interactive mode.") },
+		{ _T("-S"), _T("With -d, also print NTop's own stage timing histograms.") },
+		{ _T("-N ITERATIONS\n"), _T("\tWith -d, print this many snapshots, one per interval (0 = forever).") },
+		{ _T("-i INTERVAL\n"), _T("\tCollection interval in milliseconds (default 1000).") },
+		{ _T("-m ROWS\n"), _T("\tWith -d, print at most this many processes per snapshot.") },
 		{ _T("-v"), _T("Print version.") },
+		{ _T("--format=FORMAT\n"), _T("\tNon-interactive output as text, jsonl, csv or tsv, with full-precision values.") },
+		{ _T("--record FILE\n"), _T("\tRecord every snapshot to FILE in NTop's compact binary format.") },
+		{ _T("--replay FILE\n"), _T("\tShow a session recorded with --record instead of live data.") },
+		{ _T("--trace FILE\n"), _T("\tRecord NTop's internal activity to FILE in Chrome trace-event format.") },
+		{ _T("--export-listen IP:PORT\n"), _T("\tServe the current snapshot at /metrics in the Prometheus text format.") },
+		{ _T("--publish NAME\n"), _T("\tWrite every snapshot to the shared-memory segment NAME, see snapshot.h.") },
 	};
 	PrintHelpEntries(_T("OPTIONS"), _countof(Options), Options);
 
@@ -1345,15 +3364,31 @@ static void PrintHelp(const TCHAR *argv0)
 		{ _T("F10, q"), _T("Quit") },
 		{ _T("M"), _T("Sort by memory usage") },
 		{ _T("P"), _T("Sort by processor usage") },
+		{ _T("S"), _T("Show NTop's own stage timings (p50/p99/max)") },
+		{ _T("1"), _T("Cycle the per-processor meters: on, compact, off") },
+		{ _T("c"), _T("Show the command line instead of the process name") },
+		{ _T("Enter"), _T("Show the threads of the selected process below the list") },
+		{ _T("z"), _T("Probe the tagged or selected processes many times a second") },
+		{ _T("p"), _T("Replay: pause or resume playback") },
+		{ _T(", and ."), _T("Replay: step one frame back or forward") },
+		{ _T("- and +"), _T("Replay: halve or double the playback speed (1x to 64x)") },
+		{ _T("[ and ]"), _T("Replay: seek one minute back or forward") },
+		{ _T("{ and }"), _T("Replay: seek one hour back or forward") },
+		{ _T("< and >"), _T("Step back and forward through recent history") },
 	};
 	PrintHelpEntries(_T("INTERACTIVE COMMANDS"), _countof(InteractiveCommands), InteractiveCommands);
 
 	const help_entry ViCommands[] = {
+		{ _T(":events [PATTERN]\n"), _T("\tBrowse the journal of process starts and exits.") },
 		{ _T(":exec CMD\n"), _T("\tExecutes the given Windows command.") },
+		{ _T(":history"), _T("Show the size of the in-memory history.") },
 		{ _T(":kill PID(s)\n"), _T("\tKill all given processes.") },
 		{ _T(":q, :quit\n"), _T("\tQuit NTop.") },
+		{ _T(":rules"), _T("Time all rules against 10000 process rows.") },
 		{ _T("/PATTERN, :search PATTERN\n"), _T("\tDo a search.") },
 		{ _T(":sort COLUMN\n"), _T("\tSort the process list after the given column.") },
+		{ _T(":spark cpu|mem|off\n"), _T("\tShow or hide the CPU%/memory sparkline column.") },
+		{ _T(":transient"), _T("List executables of short-lived processes by CPU time.") },
 		{ _T(":tree"), _T("View process tree.") },
 	};
 	PrintHelpEntries(_T("VI COMMANDS"), _countof(ViCommands), ViCommands);
@@ -1375,9 +3410,27 @@ int GetProcessSortTypeFromName(const TCHAR *Name, process_sort_type *Dest)
 	} else if(!lstrcmpi(Name, _T("CPU%"))) {
 		*Dest = SORT_BY_PROCESSOR_TIME;
 		return TRUE;
+	} else if(!lstrcmpi(Name, _T("CPU95"))) {
+		*Dest = SORT_BY_PROCESSOR_TIME_P95;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("AVG1"))) {
+		*Dest = SORT_BY_PROCESSOR_TIME_AVG1;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("AVG5"))) {
+		*Dest = SORT_BY_PROCESSOR_TIME_AVG5;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("AVG15"))) {
+		*Dest = SORT_BY_PROCESSOR_TIME_AVG15;
+		return TRUE;
 	} else if(!lstrcmpi(Name, _T("MEM"))) {
 		*Dest = SORT_BY_USED_MEMORY;
 		return TRUE;
+	} else if(!lstrcmpi(Name, _T("MEM95"))) {
+		*Dest = SORT_BY_USED_MEMORY_P95;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("GROWTH"))) {
+		*Dest = SORT_BY_MEMORY_GROWTH;
+		return TRUE;
 	} else if(!lstrcmpi(Name, _T("THRD"))) {
 		*Dest = SORT_BY_THREAD_COUNT;
 		return TRUE;
@@ -1390,6 +3443,18 @@ int GetProcessSortTypeFromName(const TCHAR *Name, process_sort_type *Dest)
 	} else if(!lstrcmpi(Name, _T("DISK"))) {
 		*Dest = SORT_BY_DISK_USAGE;
 		return TRUE;
+	} else if(!lstrcmpi(Name, _T("READ"))) {
+		*Dest = SORT_BY_DISK_READ;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("WRITE"))) {
+		*Dest = SORT_BY_DISK_WRITE;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("RIOPS"))) {
+		*Dest = SORT_BY_DISK_READ_OPS;
+		return TRUE;
+	} else if(!lstrcmpi(Name, _T("WIOPS"))) {
+		*Dest = SORT_BY_DISK_WRITE_OPS;
+		return TRUE;
 	}
 
 	return FALSE;
@@ -1458,14 +3523,118 @@ static void HideViMessage(void)
 void ClearViMessage(void)
 {
 	if(ViMessageActive()) {
-		SetConsoleMode(ConsoleHandle, ENABLE_PROCESSED_INPUT | DISABLE_NEWLINE_AUTO_RETURN);
+		ConSetMode(ENABLE_PROCESSED_INPUT | DISABLE_NEWLINE_AUTO_RETURN);
 		HideViMessage();
-		SetConsoleMode(ConsoleHandle, ENABLE_PROCESSED_INPUT | ENABLE_WRAP_AT_EOL_OUTPUT);
+		ConSetMode(ENABLE_PROCESSED_INPUT | ENABLE_WRAP_AT_EOL_OUTPUT);
+	}
+}
+
+/*
+ * Time travel through the history store. Live mode shows the newest
+ * sample; '<' and '>' put a decoded past sample on screen instead and
+ * the collector keeps recording behind it.
+ */
+static ULONGLONG HistorySample;
+static ULONGLONG HistoryTimestamp;
+static process *HistoryProcesses;
+static DWORD HistoryCapacity;
+/* The averages keep being fed while browsing, the header shows them as they were when it began */
+static load_average HistoryCPULoad;
+static load_average HistoryRunningLoad;
+
+static BOOL ShowHistorySample(ULONGLONG Sample, BOOL Viewing)
+{
+	system_summary Summary;
+	ULONGLONG Timestamp;
+	DWORD Queries, Count;
+
+	if(!HistDecode(Sample, &Timestamp, &Summary, &Queries, &HistoryProcesses, &Count, &HistoryCapacity))
+		return FALSE;
+
+	EnterCriticalSection(&SyncLock);
+
+	while(Count >= ProcessListSize) {
+		IncreaseProcListSize();
+	}
+	memcpy(ProcessList, HistoryProcesses, Count * sizeof(*ProcessList));
+	ProcessCount = Count;
+	ApplySystemSummary(&Summary);
+	ShownQueries = Queries;
+
+	if(Viewing && !HistoryViewing) {
+		HistoryCPULoad = CPULoad;
+		HistoryRunningLoad = RunningLoad;
+	}
+	HistoryViewing = Viewing;
+	HistorySample = Sample;
+	HistoryTimestamp = Timestamp;
+
+	SortProcessList();
+	ReadjustCursor();
+
+	LeaveCriticalSection(&SyncLock);
+	return TRUE;
+}
+
+static void HistoryStep(int Direction)
+{
+	ULONGLONG Oldest, Newest;
+
+	if(!HistGetRange(&Oldest, &Newest)) {
+		SetViMessage(VI_ERROR, _T("No history recorded"));
+		return;
+	}
+
+	ULONGLONG Sample = HistoryViewing ? HistorySample : Newest;
+
+	if(Direction < 0) {
+		if(Sample <= Oldest) {
+			SetViMessage(VI_NOTICE, _T("Oldest snapshot in history"));
+		} else {
+			Sample--;
+		}
+	} else {
+		if(!HistoryViewing) {
+			return;
+		}
+		Sample++;
+	}
+
+	/* The oldest chunks may have been dropped meanwhile */
+	Sample = max(Sample, Oldest);
+
+	if(Sample >= Newest) {
+		ShowHistorySample(Newest, FALSE);
+	} else {
+		ShowHistorySample(Sample, TRUE);
 	}
 }
 
+static void FormatHistoryStatus(TCHAR *Buffer, int BufferSize)
+{
+	TCHAR AgoStr[TIME_STR_SIZE];
+	ULONGLONG Now = GetUnixTimeMs();
+
+	EnterCriticalSection(&SyncLock);
+	ULONGLONG Timestamp = HistoryTimestamp;
+	LeaveCriticalSection(&SyncLock);
+
+	FormatTimeString(AgoStr, TIME_STR_SIZE, Now > Timestamp ? Now - Timestamp : 0);
+	_stprintf_s(Buffer, BufferSize, _T("NTop on %s  history -%s"), ComputerName, AgoStr);
+}
+
+BOOL IsReplaying(void)
+{
+	return Replayer != 0;
+}
+
 static void KillTaggedProcesses(void)
 {
+	if(Replayer) {
+		SetViMessage(VI_ERROR, _T("Cannot kill processes of a replayed session"));
+		return;
+	}
+
 	for(DWORD i = 0; i < TaggedProcessListCount; ++i) {
 		HANDLE Handle = OpenProcess(PROCESS_TERMINATE, FALSE, TaggedProcessList[i]);
 		if(Handle) {
@@ -1488,6 +3657,9 @@ static void ResetCaret(void)
 
 static BOOL CTRLState;
 
+/* Set on the first key press that has not been painted yet */
+static ULONGLONG InputPendingTicks;
+
 static void ProcessInput(BOOL *Redraw)
 {
 	DWORD NumEvents, Num;
@@ -1505,7 +3677,18 @@ static void ProcessInput(BOOL *Redraw)
 		INPUT_RECORD InputRecord = Records[i];
 		if (InputRecord.EventType == KEY_EVENT) {
 			if (InputRecord.Event.KeyEvent.bKeyDown) {
-				if(!InInputMode) {
+				if(InputPendingTicks == 0) {
+					InputPendingTicks = ProfNow();
+				}
+
+				if(!InInputMode && ListView != LIST_VIEW_PROCESSES &&
+						(InputRecord.Event.KeyEvent.wVirtualKeyCode == VK_ESCAPE ||
+						 InputRecord.Event.KeyEvent.uChar.AsciiChar == 'q')) {
+					/* Esc and q leave a secondary view instead of quitting */
+					ListView = LIST_VIEW_PROCESSES;
+					ClearViMessage();
+					*Redraw = TRUE;
+				} else if(!InInputMode) {
 					switch(InputRecord.Event.KeyEvent.wVirtualKeyCode) {
 					case VK_UP:
 						DoScroll(SCROLL_UP, Redraw);
@@ -1530,26 +3713,21 @@ static void ProcessInput(BOOL *Redraw)
 						break;
 					case VK_LEFT:
 						if(CTRLState) {
-							if(ProcessSortType == 0) {
-								ProcessSortType = SORT_TYPE_MAX - 1;
-							} else {
-								--ProcessSortType;
-							}
-							ChangeProcessSortType(ProcessSortType);
+							ChangeProcessSortType(StepSortType(-1));
 							*Redraw = TRUE;
 						}
 						break;
 					case VK_RIGHT:
 						if(CTRLState) {
-							if(ProcessSortType == SORT_TYPE_MAX - 1) {
-								ProcessSortType = 0;
-							} else {
-								++ProcessSortType;
-							}
-							ChangeProcessSortType(ProcessSortType);
+							ChangeProcessSortType(StepSortType(1));
 							*Redraw = TRUE;
 						}
 						break;
+					case VK_RETURN:
+						ProbeStop();
+						BottomPane = BottomPane == PANE_THREADS ? PANE_NONE : PANE_THREADS;
+						*Redraw = TRUE;
+						break;
 					case VK_F10:
 						exit(EXIT_SUCCESS);  // Top compatibility
 					default:
@@ -1620,6 +3798,60 @@ static void ProcessInput(BOOL *Redraw)
 							ChangeProcessSortType(SORT_BY_PROCESSOR_TIME);
 							*Redraw = TRUE;
 							break;
+						case 'S':
+							ShowProfiler = !ShowProfiler;
+							*Redraw = TRUE;
+							break;
+						case '1':
+							Config.CPUMeters = (Config.CPUMeters + 1) % (CPU_METERS_COMPACT + 1);
+							*Redraw = TRUE;
+							break;
+						case 'c':
+							ShowCommandLine = !ShowCommandLine;
+							*Redraw = TRUE;
+							break;
+						case 'z':
+							ToggleProbe();
+							*Redraw = TRUE;
+							break;
+						case 'p':
+							if(Replayer) {
+								ReplayTogglePause();
+								*Redraw = TRUE;
+							}
+							break;
+						case ',':
+						case '.':
+							if(Replayer) {
+								ReplayStep(InputRecord.Event.KeyEvent.uChar.AsciiChar == '.' ? 1 : -1);
+							}
+							break;
+						case '+':
+						case '-':
+							if(Replayer) {
+								ReplayChangeSpeed(InputRecord.Event.KeyEvent.uChar.AsciiChar == '+');
+								*Redraw = TRUE;
+							}
+							break;
+						case '[':
+						case ']':
+							if(Replayer) {
+								ReplaySeek(InputRecord.Event.KeyEvent.uChar.AsciiChar == ']' ? 60000 : -60000);
+							}
+							break;
+						case '{':
+						case '}':
+							if(Replayer) {
+								ReplaySeek(InputRecord.Event.KeyEvent.uChar.AsciiChar == '}' ? 3600000 : -3600000);
+							}
+							break;
+						case '<':
+						case '>':
+							if(!Replayer) {
+								HistoryStep(InputRecord.Event.KeyEvent.uChar.AsciiChar == '>' ? 1 : -1);
+								*Redraw = TRUE;
+							}
+							break;
 						case 'q':
 							exit(EXIT_SUCCESS);
 						}
@@ -1643,15 +3875,143 @@ static void ProcessInput(BOOL *Redraw)
 	free(Records);
 }
 
+static void WriteBatchHeader(void)
+{
+	SYSTEMTIME Time;
+	GetLocalTime(&Time);
+
+	TCHAR UpTimeStr[TIME_STR_SIZE];
+	FormatTimeString(UpTimeStr, TIME_STR_SIZE, UpTime);
+
+	ConPrintf(_T("%04u-%02u-%02u %02u:%02u:%02u  Tasks: %u total, %u running  CPU: %.1f%%  Load: %.1f%% %.1f%% %.1f%%  Running: %.1f %.1f %.1f  Mem: %llu/%llu MB  Pge: %llu/%llu MB  Uptime: %s\n"),
+			Time.wYear, Time.wMonth, Time.wDay, Time.wHour, Time.wMinute, Time.wSecond,
+			ProcessCount, RunningProcessCount, 100.0 * CPUUsage,
+			CPULoad.Value[0], CPULoad.Value[1], CPULoad.Value[2],
+			RunningLoad.Value[0], RunningLoad.Value[1], RunningLoad.Value[2],
+			UsedMemory, TotalMemory, UsedPageMemory, TotalPageMemory, UpTimeStr);
+}
+
+/*
+ * Non-interactive mode. The collector thread keeps running between
+ * iterations, so every snapshot after the first one only waits for the
+ * next collection cycle instead of paying for a cold start.
+ */
+static void RunBatchMode(void)
+{
+	out_buffer Out = { 0 };
+
+	for(DWORD Iteration = 0; BatchIterations == 0 || Iteration < BatchIterations; Iteration++) {
+		if(Iteration > 0) {
+			WaitForSingleObject(SnapshotEvent, INFINITE);
+			PollSystemInfo();
+		}
+
+		TRACE_BEGIN("frame");
+		ULONGLONG FrameStart = ProfNow();
+		ConFlushTicks = 0;
+
+		EnterCriticalSection(&SyncLock);
+
+		DWORD Count = ProcessCount;
+		if(BatchRowLimit != 0) {
+			Count = min(Count, BatchRowLimit);
+		}
+
+		if(OutputFormat != FORMAT_TEXT) {
+			system_summary Summary;
+			GetSystemSummary(&Summary);
+
+			OutReset(&Out);
+			FormatSnapshot(&Out, OutputFormat, Iteration == 0, GetUnixTimeMs(), &Summary, ProcessList, Count);
+			LeaveCriticalSection(&SyncLock);
+
+			ConWriteBytes(Out.Data, Out.Length);
+		} else {
+			if(BatchIterations != 1) {
+				if(Iteration > 0) {
+					ConPutc(_T('\n'));
+				}
+				WriteBatchHeader();
+			}
+
+			WriteColumnHeader();
+
+			for(DWORD i = 0; i < Count; i++) {
+				const process *Process = &ProcessList[i];
+				WriteProcessInfo(Process, FALSE);
+			}
+			ConPrintf(_T("\n"));
+			LeaveCriticalSection(&SyncLock);
+		}
+
+		/* Flush every snapshot right away so readers on a pipe see it */
+		ConFlush();
+		ULONGLONG FrameTicks = ProfNow() - FrameStart;
+		ProfRecordTicks(PROF_RENDER, FrameTicks - ConFlushTicks);
+		ProfRecordTicks(PROF_FLUSH, ConFlushTicks);
+		TRACE_END("frame");
+	}
+
+	if(DumpProfiler) {
+		PrintProfilerHistograms();
+	}
+
+	exit(EXIT_SUCCESS);
+}
+
 int _tmain(int argc, TCHAR *argv[])
 {
 	BOOL Monochrome = FALSE;
+	const TCHAR *ExportAddress = 0;
+	const TCHAR *PublishName = 0;
 
 	/* Only set this temporarily for command-line processing */
 	ConsoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
+	atexit(ConFlush);
 
 	for(int i = 1; i < argc; i++) {
-		if(argv[i][0] == _T('-') && _tcslen(argv[i]) == 2) {
+		if(argv[i][0] == _T('-') && argv[i][1] == _T('-')) {
+			const TCHAR *Value;
+			if((Value = GetLongOption(argc, argv, &i, _T("format"))) != 0) {
+				if(!GetOutputFormatFromName(Value, &OutputFormat)) {
+					ConPrintf(_T("Unknown format: '%s'\n"), Value);
+					return EXIT_FAILURE;
+				}
+				if(OutputFormat != FORMAT_TEXT) {
+					InteractiveMode = FALSE;
+				}
+			} else if((Value = GetLongOption(argc, argv, &i, _T("trace"))) != 0) {
+				if(!TraceInit(Value)) {
+					ConPrintf(_T("Could not open trace file: '%s'\n"), Value);
+					return EXIT_FAILURE;
+				}
+				atexit(TraceWrite);
+				TraceThreadName("renderer");
+			} else if((Value = GetLongOption(argc, argv, &i, _T("record"))) != 0) {
+				Recorder = RecCreate(Value);
+				if(!Recorder) {
+					ConPrintf(_T("Could not create recording: '%s'\n"), Value);
+					return EXIT_FAILURE;
+				}
+				/* Registered before RestoreConsole so the summary lands on the original console */
+				atexit(StopRecording);
+			} else if((Value = GetLongOption(argc, argv, &i, _T("replay"))) != 0) {
+				Replayer = RecOpen(Value);
+				if(!Replayer || !RecNextFrame(Replayer)) {
+					ConPrintf(_T("Could not open recording: '%s'\n"), Value);
+					return EXIT_FAILURE;
+				}
+				InitializeCriticalSection(&ReplayLock);
+				ReplayWakeEvent = CreateEvent(0, FALSE, FALSE, 0);
+			} else if((Value = GetLongOption(argc, argv, &i, _T("export-listen"))) != 0) {
+				ExportAddress = Value;
+			} else if((Value = GetLongOption(argc, argv, &i, _T("publish"))) != 0) {
+				PublishName = Value;
+			} else {
+				ConPrintf(_T("Unknown option: '%s'"), argv[i]);
+				return EXIT_FAILURE;
+			}
+		} else if(argv[i][0] == _T('-') && _tcslen(argv[i]) == 2) {
 			switch(argv[i][1]) {
 			case _T('C'):
 				Monochrome = TRUE;
@@ -1676,6 +4036,30 @@ int _tmain(int argc, TCHAR *argv[])
 			case _T('d'):
 				InteractiveMode = FALSE;
 				break;	
+			case _T('S'):
+				DumpProfiler = TRUE;
+				break;
+			case _T('N'):
+				if(++i < argc) {
+					BatchIterations = _tcstoul(argv[i], 0, 10);
+					InteractiveMode = FALSE;
+				}
+				break;
+			case _T('i'):
+				if(++i < argc) {
+					PollInterval = _tcstoul(argv[i], 0, 10);
+					if(PollInterval < 10) {
+						ConPrintf(_T("Interval must be at least 10 ms: '%s'\n"), argv[i]);
+						return EXIT_FAILURE;
+					}
+				}
+				break;
+			case _T('m'):
+				if(++i < argc) {
+					BatchRowLimit = _tcstoul(argv[i], 0, 10);
+					InteractiveMode = FALSE;
+				}
+				break;
 			case _T('v'):
 				PrintVersion();
 				return EXIT_SUCCESS;
@@ -1717,7 +4101,22 @@ int _tmain(int argc, TCHAR *argv[])
 		}
 	}
 
+	/* Replayed snapshots would look like live ones to the scrapers and readers */
+	if((ExportAddress || PublishName) && Replayer) {
+		ConPrintf(_T("--export-listen and --publish cannot be combined with --replay\n"));
+		return EXIT_FAILURE;
+	}
+	if(PublishName && !PublishOpen(PublishName)) {
+		ConPrintf(_T("Could not create the shared-memory segment '%s'\n"), PublishName);
+		return EXIT_FAILURE;
+	}
+	if(ExportAddress && !ExportListen(ExportAddress)) {
+		ConPrintf(_T("Could not listen on '%s', expected IPv4:PORT\n"), ExportAddress);
+		return EXIT_FAILURE;
+	}
+
 	InitializeCriticalSection(&SyncLock);
+	ProfInit();
 	SetConsoleCtrlHandler(CtrlHandler, TRUE);
 	
 	if (InteractiveMode) {
@@ -1741,12 +4140,25 @@ int _tmain(int argc, TCHAR *argv[])
 		atexit(RestoreConsole);
 	}
 
+	RuleInit();
+	ResetColumns();
+
 	if(Monochrome) {
 		Config = MonochromeConfig;
 	} else {
 		ReadConfigFile();
 	}
 
+	/* Time travel only makes sense interactively, replays have their own seeking */
+	if(InteractiveMode && !Replayer) {
+		HistInit((SIZE_T)Config.HistoryMemory * 1024 * 1024);
+	}
+
+	TransientInit();
+	TrackSetGrowthWindow(Config.GrowthWindow);
+	ProbeSetRate(Config.ProbeRate);
+	ExportSetTopN(Config.ExportTopN);
+
 	ProcessList = xmalloc(ProcessListSize * sizeof *ProcessList);
 	NewProcessList = xmalloc(ProcessListSize * sizeof *ProcessList);
 	TaggedProcessList = xmalloc(TaggedProcessListSize * sizeof *TaggedProcessList);
@@ -1755,23 +4167,62 @@ int _tmain(int argc, TCHAR *argv[])
 	ViMessage = xcalloc(DEFAULT_STR_SIZE, 1);
 	ViInit();
 
+	if(ColumnError[0]) {
+		SetViMessage(VI_ERROR, _T("ntop.conf: unknown column: %hs"), ColumnError);
+	}
+
+	/* A replay must not add its processes to the journal of this machine */
+	if(!Replayer && Config.JournalSize > 0 && JournalPath[0] &&
+			!JournalOpen(JournalPath, Config.JournalSize) && InteractiveMode) {
+		SetViMessage(VI_ERROR, _T("Cannot open the journal %hs"), JournalPath);
+	}
+
 	PollConsoleInfo();
 	PollInitialSystemInfo();
-	PollSystemInfo();
-	PollProcessList(50);
+	if(Replayer) {
+		PublishReplayFrame();
+	} else {
+		PollSystemInfo();
+		PollProcessList(50);
+	}
 
 	TCHAR MenuBar[256] = { 0 };
 	wsprintf(MenuBar, _T("NTop on %s"), ComputerName);
 
-	ProcessListThread = CreateThread(0, 0, PollProcessListThreadProc, 0, 0, 0);
+	SnapshotEvent = CreateEvent(0, FALSE, FALSE, 0);
+	if(Replayer) {
+		ProcessListThread = CreateThread(0, 0, ReplayThreadProc, 0, 0, 0);
+	} else {
+		ProcessListThread = CreateThread(0, 0, PollProcessListThreadProc, 0, 0, 0);
+	}
+
+	if(!InteractiveMode) {
+		RunBatchMode();
+	}
 
 	ULONGLONG StartTicks = GetTickCount64();
 
 	while(1) {
-#if _DEBUG
-		ULONGLONG T1 = GetTickCount64();
-#endif
+		TRACE_BEGIN("frame");
+		ULONGLONG FrameStart = ProfNow();
+		ConFlushTicks = 0;
+
 		if (InteractiveMode) {
+			/* Alerts from the collector, one per frame */
+			TCHAR Alert[DEFAULT_STR_SIZE];
+			vi_message_type AlertType;
+			if(!InInputMode && RulePopAlert(Alert, _countof(Alert), &AlertType)) {
+				SetViMessage(AlertType, _T("%s"), Alert);
+			}
+
+			if(Replayer) {
+				FormatReplayStatus(MenuBar, _countof(MenuBar));
+			} else if(HistoryViewing) {
+				FormatHistoryStatus(MenuBar, _countof(MenuBar));
+			} else {
+				wsprintf(MenuBar, _T("NTop on %s"), ComputerName);
+			}
+
 			SetConCursorPos(0, 0);
 			SetColor(Config.FGColor | Config.MenuBarColor);
 
@@ -1836,6 +4287,19 @@ int _tmain(int argc, TCHAR *argv[])
 			SetColor(Config.FGColor);
 			CharsWritten += ConPrintf(_T("%d GB"), (int)TotalMemory/1000);
 
+			const load_average *ShownCPULoad = HistoryViewing ? &HistoryCPULoad : &CPULoad;
+			const load_average *ShownRunningLoad = HistoryViewing ? &HistoryRunningLoad : &RunningLoad;
+			TCHAR LoadBuf[128];
+			int LoadChars = _stprintf_s(LoadBuf, _countof(LoadBuf), _T("%.1f%% %.1f%% %.1f%%  Running: %.1f %.1f %.1f"),
+					ShownCPULoad->Value[0], ShownCPULoad->Value[1], ShownCPULoad->Value[2],
+					ShownRunningLoad->Value[0], ShownRunningLoad->Value[1], ShownRunningLoad->Value[2]);
+			if(CharsWritten + 8 + LoadChars < Width) {
+				SetColor(Config.FGHighlightColor);
+				CharsWritten += ConPrintf(_T("  Load: "));
+				SetColor(Config.FGColor);
+				CharsWritten += ConPrintf(_T("%s"), LoadBuf);
+			}
+
 			for(; CharsWritten < Width; CharsWritten++) {
 				ConPutc(_T(' '));
 			}
@@ -1855,51 +4319,94 @@ int _tmain(int argc, TCHAR *argv[])
 				ConPutc(_T(' '));
 			}
 
-			WriteBlankLine();
+			/* Leave at least half of the window to the process list */
+			ProcessWindowPosY = 6 + DrawCPUMeters(Height / 2 - 6);
 
-			ProcessWindowHeight = Height - ProcessWindowPosY;
-			VisibleProcessCount = ProcessWindowHeight - 2;
+			if(ShowProfiler) {
+				DrawProfilerOverlay();
+			} else if(ListView == LIST_VIEW_TRANSIENT) {
+				DrawTransientSummary();
+			} else if(ListView == LIST_VIEW_EVENTS) {
+				DrawEventsSummary();
+			} else {
+				WriteBlankLine();
+			}
 
-			const process_list_column ProcessListColumns[] = {
-				{ _T("ID"),	7 },
-				{ _T("USER"),	9 },
-				{ _T("PRI"),	3 },
-				{ _T("CPU%"),	5 },
-				{ _T("MEM"),	11 },
-				{ _T("THRD"),	4 },
-				{ _T("DISK"),	9 },
-				{ _T("TIME"),	TIME_STR_SIZE - 1 },
-				{ _T("PROCESS"),	-1 },
-			};
+			DWORD PaneRowCount = BottomPaneRowCount(Height - ProcessWindowPosY - 2);
+			ProbePaneRowCount = 0;
+			ProcessWindowHeight = Height - ProcessWindowPosY - PaneRowCount;
+			VisibleProcessCount = ProcessWindowHeight - 2;
+			if(PaneRowCount > 0) {
+				SelectProcess(SelectedProcessIndex);
+			}
 
-			DrawProcessListHeader(ProcessListColumns, _countof(ProcessListColumns));
+			process_list_column ProcessListColumns[COLUMN_COUNT + 2];
+			int ProcessListColumnCount = 0;
+			for(int i = 0; i < ColumnCount; i++) {
+				const column_def *Column = &ColumnDefs[Columns[i]];
+				process_list_column HeaderColumn = { Column->Name, Column->Width, Column->SortType };
+				ProcessListColumns[ProcessListColumnCount++] = HeaderColumn;
+			}
+			process_list_column SparkColumn = { SparklineHeader(), Config.Sparkline != SPARKLINE_OFF ? TRACK_SPARK_SAMPLES : 0, SORT_TYPE_MAX };
+			process_list_column NameColumn = { _T("PROCESS"), -1, SORT_BY_PROCESS };
+			ProcessListColumns[ProcessListColumnCount++] = SparkColumn;
+			ProcessListColumns[ProcessListColumnCount++] = NameColumn;
 
 			CharsWritten = 0;
-
-			EnterCriticalSection(&SyncLock);
 			DWORD Count = 0;
-			for(DWORD i = 0; i < VisibleProcessCount; i++) {
-				DWORD PID = i+ProcessIndex;
-				if(PID < ProcessCount) {
-					const process *Process = &ProcessList[PID];
-					SetConCursorPos(0, (SHORT)(i + ProcessWindowPosY));
-					WriteProcessInfo(Process, PID == SelectedProcessIndex);
-					Count++;
+			process PaneProcess = { 0 };
+
+			if(PaneRowCount == 0 || BottomPane != PANE_THREADS) {
+				ThreadsSetProcess(0, 0);
+			}
+
+			if(ListView == LIST_VIEW_TRANSIENT) {
+				Count = DrawTransientView(VisibleProcessCount);
+			} else if(ListView == LIST_VIEW_EVENTS) {
+				Count = DrawEventsView(VisibleProcessCount);
+			} else {
+				DrawProcessListHeader(ProcessListColumns, ProcessListColumnCount);
+
+				DetailBeginFrame();
+
+				EnterCriticalSection(&SyncLock);
+				for(DWORD i = 0; i < VisibleProcessCount; i++) {
+					DWORD PID = i+ProcessIndex;
+					if(PID < ProcessCount) {
+						const process *Process = &ProcessList[PID];
+						SetConCursorPos(0, (SHORT)(i + ProcessWindowPosY));
+						WriteProcessInfo(Process, PID == SelectedProcessIndex);
+						Count++;
+					}
+				}
+
+				/* The pane follows the selection, sampling stops once it is closed */
+				if(BottomPane == PANE_THREADS && PaneRowCount > 0 && SelectedProcessIndex < ProcessCount) {
+					PaneProcess = ProcessList[SelectedProcessIndex];
+					ThreadsSetProcess(PaneProcess.ID, PaneProcess.CreationTime);
+				} else if(BottomPane == PANE_THREADS) {
+					PaneRowCount = 0;
 				}
+				LeaveCriticalSection(&SyncLock);
 			}
-			LeaveCriticalSection(&SyncLock);
 		
 			SetColor(0);
 			for(DWORD i = Count; i < VisibleProcessCount - 1; i++) {
 				WriteBlankLine();
 			}
+
+			if(PaneRowCount > 0 && BottomPane == PANE_THREADS) {
+				DrawThreadPane(&PaneProcess, ProcessWindowPosY + VisibleProcessCount + 1, PaneRowCount);
+			} else if(PaneRowCount > 0 && BottomPane == PANE_PROBE) {
+				DrawProbePane(ProcessWindowPosY + VisibleProcessCount + 1, PaneRowCount);
+			}
 		
 			SetConCursorPos(0, (SHORT)Height-2);
 			SetColor(FOREGROUND_WHITE);
 		
 			/* Disable auto newline here. This allows us to fill the last row entirely
 			* without scrolling the screen buffer accidentally which is really annoying. */
-			SetConsoleMode(ConsoleHandle, ENABLE_PROCESSED_INPUT|DISABLE_NEWLINE_AUTO_RETURN);
+			ConSetMode(ENABLE_PROCESSED_INPUT|DISABLE_NEWLINE_AUTO_RETURN);
 			if (InInputMode) {
 				CharsWritten = ConPrintf(_T("\n%s"), CurrentInputStr);
 				if (CaretState) {
@@ -1915,29 +4422,19 @@ int _tmain(int argc, TCHAR *argv[])
 			} else {
 				ConPrintf(_T("\n%*c"), Width - 1, _T(' '));
 			}
-			SetConsoleMode(ConsoleHandle, ENABLE_PROCESSED_INPUT|ENABLE_WRAP_AT_EOL_OUTPUT);
-		}
-		else {
-			ConPrintf(_T("     ID       USER  PRI   CPU%%          MEM  THRD       DISK         TIME  PROCESS"));
-			EnterCriticalSection(&SyncLock);
-			for(DWORD i = 0; i < ProcessCount; i++) {
-				const process *Process = &ProcessList[i];
-				WriteProcessInfo(Process, FALSE);
-			}
-			ConPrintf(_T("\n"));
-			LeaveCriticalSection(&SyncLock);
-			exit(EXIT_SUCCESS);
+			ConSetMode(ENABLE_PROCESSED_INPUT|ENABLE_WRAP_AT_EOL_OUTPUT);
 		}
 
-#ifdef _DEBUG
-		ULONGLONG T2 = GetTickCount64();
+		ConFlush();
+		ULONGLONG FrameEnd = ProfNow();
+		ProfRecordTicks(PROF_RENDER, FrameEnd - FrameStart - ConFlushTicks);
+		ProfRecordTicks(PROF_FLUSH, ConFlushTicks);
+		TRACE_END("frame");
 
-		ULONG Diff = (ULONG)(T2 - T1);
-
-		TCHAR DebugBuffer[256];
-		wsprintf(DebugBuffer, _T("Drawing took: %lu ms\n"), Diff);
-		OutputDebugString(DebugBuffer);
-#endif
+		if(InputPendingTicks != 0) {
+			ProfRecord(PROF_INPUT_LATENCY, InputPendingTicks);
+			InputPendingTicks = 0;
+		}
 
 		/*
 		 * Input loop. Breaks after REDRAW_INTERVAL ms or if forced.
@@ -1954,9 +4451,12 @@ int _tmain(int argc, TCHAR *argv[])
 			RedrawAtCursor = FALSE;
 			BOOL Redraw = FALSE;
 
+			TRACE_BEGIN("input");
 			ProcessInput(&Redraw);
+			TRACE_END("input");
 
-			if(Redraw) {
+			/* The thread pane has to follow the selection */
+			if(Redraw || (RedrawAtCursor && BottomPane == PANE_THREADS)) {
 				break;
 			}
 
@@ -1968,14 +4468,37 @@ int _tmain(int argc, TCHAR *argv[])
 					SetConCursorPos(0, (SHORT)(ProcessWindowPosY + OldSelectedProcessIndex - ProcessIndex));
 					WriteProcessInfo(&ProcessList[OldSelectedProcessIndex], FALSE);
 				}
+				ConFlush();
+
+				if(InputPendingTicks != 0) {
+					ProfRecord(PROF_INPUT_LATENCY, InputPendingTicks);
+				}
 			}
 
+			/* Key presses that did not cause a repaint do not count as latency */
+			InputPendingTicks = 0;
+
 			if(PollConsoleInfo()) {
 				break;
 			}
 
+			/* Replayed frames can arrive faster than the redraw interval */
+			if(Replayer && WaitForSingleObject(SnapshotEvent, 0) == WAIT_OBJECT_0) {
+				break;
+			}
+
+			/* Show fetched details without waiting for the next snapshot */
+			if(DetailConsumeUpdate()) {
+				break;
+			}
+
 			ULONGLONG Now = GetTickCount64();
 
+			if(ProbePaneRowCount > 0 && Now - ProbePaneTicks >= PROBE_REDRAW_INTERVAL) {
+				DrawProbePane(ProbePaneTop, ProbePaneRowCount);
+				ConFlush();
+			}
+
 			if(Now - StartTicks >= Config.RedrawInterval) {
 				PollSystemInfo();
 				StartTicks = Now;
@@ -18,23 +18,105 @@
 #ifndef NTOP_H
 #define NTOP_H
 
+#include <windows.h>
+#include <lmcons.h>
 #include <tchar.h>
 
 #define DEFAULT_STR_SIZE 1024
 
+/* 100ns intervals between 1601-01-01 and 1970-01-01 */
+#define FILETIME_UNIX_EPOCH 116444736000000000ULL
+
+typedef struct process {
+	HANDLE Handle;
+	DWORD ID;
+	TCHAR UserName[UNLEN];
+	DWORD BasePriority;
+	double PercentProcessorTime;
+	unsigned __int64 UsedMemory;
+	DWORD ThreadCount;
+	ULONGLONG UpTime;
+	/* FILETIME of process creation, together with ID identifies a process */
+	ULONGLONG CreationTime;
+	/* Kernel plus user time in 100ns units */
+	ULONGLONG CPUTime;
+	TCHAR ExeName[MAX_PATH];
+	DWORD ParentPID;
+	/* Bytes read plus written so far, and per second over the last interval */
+	ULONGLONG DiskOperations;
+	DWORD DiskUsage;
+	/* Bytes per second by kind of transfer, other is neither read nor write (e.g. DeviceIoControl) */
+	ULONGLONG DiskReadRate;
+	ULONGLONG DiskWriteRate;
+	ULONGLONG DiskOtherRate;
+	/* Read and write operations per second */
+	double DiskReadOps;
+	double DiskWriteOps;
+	DWORD TreeDepth;
+	/* 95th percentiles over the last minutes, see track.c */
+	double PercentProcessorTimeP95;
+	unsigned __int64 UsedMemoryP95;
+	/* Decayed CPU% over 1, 5 and 15 minutes */
+	double PercentProcessorTimeAvg1;
+	double PercentProcessorTimeAvg5;
+	double PercentProcessorTimeAvg15;
+	/* Working set trend in MB per hour, R^2 of the fit, and whether it looks like a leak */
+	double MemoryGrowth;
+	double MemoryGrowthConfidence;
+	BOOL MemoryGrowthSteady;
+	/* Slot of the per-process state in track.c, 0 if none */
+	DWORD TrackSlot;
+
+	struct process *Next;
+	struct process *Parent;
+	struct process *FirstChild;
+} process;
+
+/*
+ * Per-process queries of the collector. Values whose query was skipped
+ * stay zero.
+ */
+#define QUERY_TIMES	0x1	/* GetProcessTimes: CPU% and everything derived from it, uptime */
+#define QUERY_MEMORY	0x2	/* GetProcessMemoryInfo */
+#define QUERY_USER	0x4	/* OpenProcessToken and LookupAccountSid */
+#define QUERY_IO	0x8	/* GetProcessIoCounters */
+#define QUERY_ALL	(QUERY_TIMES | QUERY_MEMORY | QUERY_USER | QUERY_IO)
+
+/* System-wide values shown in the header, memory in bytes */
+typedef struct system_summary {
+	double CPUUsage;
+	ULONGLONG TotalMemory;
+	ULONGLONG UsedMemory;
+	ULONGLONG TotalPageMemory;
+	ULONGLONG UsedPageMemory;
+	ULONGLONG UpTime;
+	DWORD ProcessCount;
+	DWORD RunningProcessCount;
+} system_summary;
+
 typedef enum process_sort_type {
 	SORT_BY_ID,
 	SORT_BY_USER_NAME,
 	SORT_BY_PRIORITY,
 	SORT_BY_PROCESSOR_TIME,
+	SORT_BY_PROCESSOR_TIME_P95,
+	SORT_BY_PROCESSOR_TIME_AVG1,
+	SORT_BY_PROCESSOR_TIME_AVG5,
+	SORT_BY_PROCESSOR_TIME_AVG15,
 	SORT_BY_USED_MEMORY,
+	SORT_BY_USED_MEMORY_P95,
+	SORT_BY_MEMORY_GROWTH,
 	SORT_BY_THREAD_COUNT,
 	SORT_BY_DISK_USAGE,
+	SORT_BY_DISK_READ,
+	SORT_BY_DISK_WRITE,
+	SORT_BY_DISK_READ_OPS,
+	SORT_BY_DISK_WRITE_OPS,
 	SORT_BY_UPTIME,
 	SORT_BY_PROCESS,
 	// NOTE: declaring SORT_TYPE_MAX before SORT_BY_TREE is there solely
-	// because we do not actually treat it as an actual sort type, but the
-	// code in ProcessInput thinks it is.
+	// because we do not actually treat it as an actual sort type. It also
+	// marks header columns that cannot be sorted on.
 	SORT_TYPE_MAX,
 	SORT_BY_TREE,
 } process_sort_type;
@@ -42,6 +124,18 @@ typedef enum process_sort_type {
 int GetProcessSortTypeFromName(const TCHAR *Name, process_sort_type *Dest);
 void ChangeProcessSortType(process_sort_type NewProcessSortType);
 void StartSearch(const TCHAR *Pattern);
+BOOL IsReplaying(void);
+int SetSparklineMode(const TCHAR *Name);
+void BenchmarkRules(void);
+
+typedef enum list_view {
+	LIST_VIEW_PROCESSES,
+	LIST_VIEW_TRANSIENT,
+	LIST_VIEW_EVENTS,
+} list_view;
+
+void SetListView(list_view View);
+void SetEventsFilter(const TCHAR *Pattern);
 
 typedef enum vi_message_type {
 	VI_NOTICE,
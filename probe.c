@@ -0,0 +1,239 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "probe.h"
+#include "cpu.h"
+#include "util.h"
+#include <psapi.h>
+#include <string.h>
+
+typedef struct probe_target {
+	DWORD ID;
+	TCHAR ExeName[MAX_PATH];
+	HANDLE Handle;
+	BOOL Exited;
+	ULONGLONG PrevCPUTime;		/* 100ns units */
+	LONGLONG PrevTimestamp;		/* QPC, 0 before the first tick */
+	DWORD Head;
+	DWORD Count;
+	probe_sample Samples[PROBE_SAMPLE_COUNT];
+} probe_target;
+
+static CRITICAL_SECTION Lock;
+static BOOL LockInitialized;
+static probe_target *Targets;
+static DWORD TargetCount;
+static DWORD Rate = 50;
+
+static HANDLE ProbeThread;
+static HANDLE StopEvent;
+static LARGE_INTEGER Frequency;
+
+void ProbeSetRate(DWORD Hz)
+{
+	Rate = min(max(Hz, PROBE_MIN_RATE), PROBE_MAX_RATE);
+}
+
+DWORD ProbeGetRate(void)
+{
+	return Rate;
+}
+
+static void SampleTarget(probe_target *Target, DWORD ProcessorCount)
+{
+	FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+	PROCESS_MEMORY_COUNTERS Counters;
+	LARGE_INTEGER Now;
+
+	/* Signaled once it exits, an exit code could be STILL_ACTIVE itself */
+	if(WaitForSingleObject(Target->Handle, 0) == WAIT_OBJECT_0 ||
+			!GetProcessTimes(Target->Handle, &CreationTime, &ExitTime, &KernelTime, &UserTime) ||
+			!GetProcessMemoryInfo(Target->Handle, &Counters, sizeof(Counters))) {
+		Target->Exited = TRUE;
+		return;
+	}
+	QueryPerformanceCounter(&Now);
+
+	ULARGE_INTEGER Kernel, User;
+	Kernel.LowPart = KernelTime.dwLowDateTime;
+	Kernel.HighPart = KernelTime.dwHighDateTime;
+	User.LowPart = UserTime.dwLowDateTime;
+	User.HighPart = UserTime.dwHighDateTime;
+	ULONGLONG CPUTime = Kernel.QuadPart + User.QuadPart;
+
+	/* The first tick only sets the baseline */
+	if(Target->PrevTimestamp != 0 && Now.QuadPart > Target->PrevTimestamp) {
+		double Elapsed = (double)(Now.QuadPart - Target->PrevTimestamp) * 10000000.0 / (double)Frequency.QuadPart;
+		double Used = (double)(CPUTime - Target->PrevCPUTime);
+
+		EnterCriticalSection(&Lock);
+		probe_sample *Sample = &Target->Samples[Target->Head];
+		Sample->PercentProcessorTime = min(100.0 * Used / (Elapsed * ProcessorCount), 100.0);
+		Sample->WorkingSet = Counters.WorkingSetSize;
+		Target->Head = (Target->Head + 1) % PROBE_SAMPLE_COUNT;
+		if(Target->Count < PROBE_SAMPLE_COUNT)
+			Target->Count++;
+		LeaveCriticalSection(&Lock);
+	}
+
+	Target->PrevCPUTime = CPUTime;
+	Target->PrevTimestamp = Now.QuadPart;
+}
+
+/*
+ * A high resolution timer (Windows 10 1803 and later) keeps the requested
+ * rate. Older systems fall back to a normal timer, which ticks at most
+ * every 15.6 ms unless some other program raised the timer resolution.
+ */
+static DWORD WINAPI ProbeThreadProc(LPVOID lpParam)
+{
+	UNREFERENCED_PARAMETER(lpParam);
+
+	HANDLE Timer = CreateWaitableTimerEx(0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if(!Timer) {
+		Timer = CreateWaitableTimer(0, FALSE, 0);
+	}
+	if(!Timer)
+		return 0;
+
+	LONG Period = 1000 / Rate;
+	LARGE_INTEGER DueTime;
+	DueTime.QuadPart = -(LONGLONG)Period * 10000;
+	SetWaitableTimer(Timer, &DueTime, Period, 0, 0, FALSE);
+
+	DWORD ProcessorCount = max(CpuGetCount(), 1);
+	HANDLE Handles[2] = { StopEvent, Timer };
+
+	while(WaitForMultipleObjects(2, Handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+		for(DWORD i = 0; i < TargetCount; i++) {
+			if(!Targets[i].Exited) {
+				SampleTarget(&Targets[i], ProcessorCount);
+			}
+		}
+	}
+
+	CancelWaitableTimer(Timer);
+	CloseHandle(Timer);
+	return 0;
+}
+
+void ProbeStop(void)
+{
+	if(!ProbeThread)
+		return;
+
+	SetEvent(StopEvent);
+	WaitForSingleObject(ProbeThread, INFINITE);
+	CloseHandle(ProbeThread);
+	CloseHandle(StopEvent);
+	ProbeThread = 0;
+	StopEvent = 0;
+
+	EnterCriticalSection(&Lock);
+	for(DWORD i = 0; i < TargetCount; i++) {
+		CloseHandle(Targets[i].Handle);
+	}
+	free(Targets);
+	Targets = 0;
+	TargetCount = 0;
+	LeaveCriticalSection(&Lock);
+}
+
+DWORD ProbeStart(const process *Processes, DWORD Count)
+{
+	if(!LockInitialized) {
+		InitializeCriticalSection(&Lock);
+		QueryPerformanceFrequency(&Frequency);
+		LockInitialized = TRUE;
+	}
+
+	ProbeStop();
+
+	Count = min(Count, PROBE_MAX_TARGETS);
+	probe_target *NewTargets = xcalloc(max(Count, 1), sizeof(*NewTargets));
+	DWORD Opened = 0;
+
+	for(DWORD i = 0; i < Count; i++) {
+		HANDLE Handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, FALSE, Processes[i].ID);
+		if(!Handle)
+			continue;
+
+		/* The PID may have been reused since the snapshot */
+		FILETIME Creation, Exit, Kernel, User;
+		ULARGE_INTEGER Created = { 0 };
+		if(GetProcessTimes(Handle, &Creation, &Exit, &Kernel, &User)) {
+			Created.LowPart = Creation.dwLowDateTime;
+			Created.HighPart = Creation.dwHighDateTime;
+		}
+		if(Created.QuadPart != Processes[i].CreationTime) {
+			CloseHandle(Handle);
+			continue;
+		}
+
+		probe_target *Target = &NewTargets[Opened++];
+		Target->ID = Processes[i].ID;
+		Target->Handle = Handle;
+		_tcsncpy_s(Target->ExeName, MAX_PATH, Processes[i].ExeName, _TRUNCATE);
+	}
+
+	if(Opened == 0) {
+		free(NewTargets);
+		return 0;
+	}
+
+	EnterCriticalSection(&Lock);
+	Targets = NewTargets;
+	TargetCount = Opened;
+	LeaveCriticalSection(&Lock);
+
+	StopEvent = CreateEvent(0, TRUE, FALSE, 0);
+	ProbeThread = CreateThread(0, 0, ProbeThreadProc, 0, 0, 0);
+
+	return Opened;
+}
+
+BOOL ProbeActive(void)
+{
+	return ProbeThread != 0;
+}
+
+DWORD ProbeGetTargetCount(void)
+{
+	return TargetCount;
+}
+
+BOOL ProbeGetSeries(DWORD Target, probe_series *Series, DWORD MaxSamples)
+{
+	if(Target >= TargetCount)
+		return FALSE;
+
+	EnterCriticalSection(&Lock);
+	const probe_target *Source = &Targets[Target];
+
+	Series->ID = Source->ID;
+	_tcscpy_s(Series->ExeName, MAX_PATH, Source->ExeName);
+	Series->Exited = Source->Exited;
+	Series->Count = min(Source->Count, min(MaxSamples, PROBE_SAMPLE_COUNT));
+
+	for(DWORD i = 0; i < Series->Count; i++) {
+		DWORD Index = (Source->Head + PROBE_SAMPLE_COUNT - Series->Count + i) % PROBE_SAMPLE_COUNT;
+		Series->Samples[i] = Source->Samples[Index];
+	}
+	LeaveCriticalSection(&Lock);
+
+	return TRUE;
+}
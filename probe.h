@@ -0,0 +1,61 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROBE_H
+#define PROBE_H
+
+#include "ntop.h"
+
+/*
+ * Samples the CPU and working set of a few processes many times a second
+ * on a thread of its own, driven by a periodic waitable timer. Each tick
+ * queries only the probed processes, so the cost does not depend on how
+ * many processes are running. The collector keeps its normal interval.
+ */
+
+#define PROBE_MAX_TARGETS 16
+#define PROBE_SAMPLE_COUNT 1024
+#define PROBE_MIN_RATE 10
+#define PROBE_MAX_RATE 100
+
+typedef struct probe_sample {
+	double PercentProcessorTime;	/* share of all processors, like a process */
+	ULONGLONG WorkingSet;		/* bytes */
+} probe_sample;
+
+typedef struct probe_series {
+	DWORD ID;
+	TCHAR ExeName[MAX_PATH];
+	BOOL Exited;
+	DWORD Count;			/* samples in Samples, oldest first */
+	probe_sample Samples[PROBE_SAMPLE_COUNT];
+} probe_series;
+
+void ProbeSetRate(DWORD Hz);
+DWORD ProbeGetRate(void);
+
+/* Replaces the probed processes, returns how many of them could be opened */
+DWORD ProbeStart(const process *Processes, DWORD Count);
+void ProbeStop(void);
+BOOL ProbeActive(void);
+
+DWORD ProbeGetTargetCount(void);
+
+/* Copies the newest MaxSamples samples of a target */
+BOOL ProbeGetSeries(DWORD Target, probe_series *Series, DWORD MaxSamples);
+
+#endif
@@ -0,0 +1,194 @@
+/* 
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "profiler.h"
+#include <stdio.h>
+#include <tchar.h>
+
+/*
+ * Each stage is only ever recorded from one thread at a time (sorting and
+ * tree building happen under SyncLock), so the histograms need no locking.
+ * Readers may observe a histogram mid-update, which is fine for display.
+ */
+static prof_histogram Histograms[PROF_STAGE_MAX];
+static ULONGLONG TicksPerSecond = 1;
+
+static const TCHAR *StageNames[PROF_STAGE_MAX] = {
+	_T("collect"),
+	_T("delta"),
+	_T("diff"),
+	_T("rules"),
+	_T("sort"),
+	_T("tree"),
+	_T("render"),
+	_T("flush"),
+	_T("input"),
+};
+
+static prof_counter_stats Counters[PROF_COUNTER_MAX];
+
+static const TCHAR *CounterNames[PROF_COUNTER_MAX] = {
+	_T("avoided"),
+	_T("births"),
+	_T("deaths"),
+	_T("changes"),
+};
+
+void ProfInit(void)
+{
+	LARGE_INTEGER Frequency;
+	if(QueryPerformanceFrequency(&Frequency) && Frequency.QuadPart > 0) {
+		TicksPerSecond = (ULONGLONG)Frequency.QuadPart;
+	}
+}
+
+ULONGLONG ProfNow(void)
+{
+	LARGE_INTEGER Counter;
+	QueryPerformanceCounter(&Counter);
+	return (ULONGLONG)Counter.QuadPart;
+}
+
+ULONGLONG ProfTicksToMicroseconds(ULONGLONG Ticks)
+{
+	/* Split to avoid overflowing on large tick counts */
+	return (Ticks / TicksPerSecond) * 1000000 + (Ticks % TicksPerSecond) * 1000000 / TicksPerSecond;
+}
+
+static int HighestBit(ULONGLONG Value)
+{
+	int Bit = 0;
+	if(Value >> 32) { Value >>= 32; Bit += 32; }
+	if(Value >> 16) { Value >>= 16; Bit += 16; }
+	if(Value >> 8) { Value >>= 8; Bit += 8; }
+	if(Value >> 4) { Value >>= 4; Bit += 4; }
+	if(Value >> 2) { Value >>= 2; Bit += 2; }
+	if(Value >> 1) { Bit += 1; }
+	return Bit;
+}
+
+static int BucketFromValue(ULONGLONG Value)
+{
+	if(Value < PROF_SUB_BUCKETS)
+		return (int)Value;
+
+	int Exponent = HighestBit(Value);
+	int Shift = Exponent - PROF_SUB_BUCKET_BITS;
+	int Sub = (int)((Value >> Shift) & (PROF_SUB_BUCKETS - 1));
+	return (Shift + 1) * PROF_SUB_BUCKETS + Sub;
+}
+
+ULONGLONG ProfBucketLowerBound(int Bucket)
+{
+	if(Bucket < PROF_SUB_BUCKETS)
+		return (ULONGLONG)Bucket;
+
+	int Shift = Bucket / PROF_SUB_BUCKETS - 1;
+	ULONGLONG Sub = (ULONGLONG)(Bucket % PROF_SUB_BUCKETS);
+	return (PROF_SUB_BUCKETS + Sub) << Shift;
+}
+
+ULONGLONG ProfBucketUpperBound(int Bucket)
+{
+	if(Bucket < PROF_SUB_BUCKETS)
+		return (ULONGLONG)Bucket;
+
+	int Shift = Bucket / PROF_SUB_BUCKETS - 1;
+	return ProfBucketLowerBound(Bucket) + (1ULL << Shift) - 1;
+}
+
+void ProfRecordTicks(prof_stage Stage, ULONGLONG Ticks)
+{
+	prof_histogram *Histogram = &Histograms[Stage];
+	ULONGLONG Microseconds = ProfTicksToMicroseconds(Ticks);
+
+	Histogram->Buckets[BucketFromValue(Microseconds)]++;
+	Histogram->Count++;
+	Histogram->Sum += Microseconds;
+	if(Microseconds > Histogram->Max)
+		Histogram->Max = Microseconds;
+}
+
+void ProfRecord(prof_stage Stage, ULONGLONG StartTicks)
+{
+	ProfRecordTicks(Stage, ProfNow() - StartTicks);
+}
+
+const prof_histogram *ProfGetHistogram(prof_stage Stage)
+{
+	return &Histograms[Stage];
+}
+
+/*
+ * Returns the upper bound of the bucket containing the given percentile,
+ * clamped to the exact maximum so p100 is never overstated.
+ */
+ULONGLONG ProfPercentile(const prof_histogram *Histogram, double Percentile)
+{
+	if(Histogram->Count == 0)
+		return 0;
+
+	ULONGLONG Target = (ULONGLONG)((double)Histogram->Count * Percentile / 100.0 + 0.5);
+	if(Target == 0)
+		Target = 1;
+
+	ULONGLONG Seen = 0;
+	for(int i = 0; i < PROF_BUCKET_COUNT; i++) {
+		Seen += Histogram->Buckets[i];
+		if(Seen >= Target) {
+			ULONGLONG Value = ProfBucketUpperBound(i);
+			return min(Value, Histogram->Max);
+		}
+	}
+
+	return Histogram->Max;
+}
+
+const TCHAR *ProfStageName(prof_stage Stage)
+{
+	return StageNames[Stage];
+}
+
+void ProfFormatMicroseconds(TCHAR *Buffer, DWORD BufferSize, ULONGLONG Microseconds)
+{
+	if(Microseconds < 1000) {
+		_stprintf_s(Buffer, BufferSize, _T("%uus"), (unsigned int)Microseconds);
+	} else if(Microseconds < 1000000) {
+		_stprintf_s(Buffer, BufferSize, _T("%.1fms"), (double)Microseconds / 1000.0);
+	} else {
+		_stprintf_s(Buffer, BufferSize, _T("%.2fs"), (double)Microseconds / 1000000.0);
+	}
+}
+
+/* Called once per cycle with the count of that cycle */
+void ProfCount(prof_counter Counter, ULONGLONG Value)
+{
+	prof_counter_stats *Stats = &Counters[Counter];
+	Stats->Last = Value;
+	Stats->Sum += Value;
+	Stats->Cycles++;
+}
+
+const prof_counter_stats *ProfGetCounter(prof_counter Counter)
+{
+	return &Counters[Counter];
+}
+
+const TCHAR *ProfCounterName(prof_counter Counter)
+{
+	return CounterNames[Counter];
+}
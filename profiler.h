@@ -0,0 +1,83 @@
+/* 
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <windows.h>
+
+typedef enum prof_stage {
+	PROF_COLLECT,
+	PROF_DELTA,
+	PROF_DIFF,
+	PROF_RULES,
+	PROF_SORT,
+	PROF_TREE,
+	PROF_RENDER,
+	PROF_FLUSH,
+	PROF_INPUT_LATENCY,
+	PROF_STAGE_MAX,
+} prof_stage;
+
+/*
+ * Log-linear histogram of microsecond values: every value below
+ * PROF_SUB_BUCKETS gets its own bucket, every power of two above that is
+ * split into PROF_SUB_BUCKETS linear buckets. That keeps the relative error
+ * of any reported percentile below 1/PROF_SUB_BUCKETS at a fixed size.
+ */
+#define PROF_SUB_BUCKET_BITS 3
+#define PROF_SUB_BUCKETS (1 << PROF_SUB_BUCKET_BITS)
+#define PROF_BUCKET_COUNT ((64 - PROF_SUB_BUCKET_BITS + 1) * PROF_SUB_BUCKETS)
+
+typedef struct prof_histogram {
+	ULONGLONG Count;
+	ULONGLONG Sum;
+	ULONGLONG Max;
+	DWORD Buckets[PROF_BUCKET_COUNT];
+} prof_histogram;
+
+/* Per-cycle counts, reported next to the stage timings */
+typedef enum prof_counter {
+	PROF_QUERIES_AVOIDED,
+	PROF_BIRTHS,
+	PROF_DEATHS,
+	PROF_CHANGES,
+	PROF_COUNTER_MAX,
+} prof_counter;
+
+typedef struct prof_counter_stats {
+	ULONGLONG Last;
+	ULONGLONG Sum;
+	ULONGLONG Cycles;
+} prof_counter_stats;
+
+void ProfInit(void);
+ULONGLONG ProfNow(void);
+ULONGLONG ProfTicksToMicroseconds(ULONGLONG Ticks);
+void ProfRecord(prof_stage Stage, ULONGLONG StartTicks);
+void ProfRecordTicks(prof_stage Stage, ULONGLONG Ticks);
+const prof_histogram *ProfGetHistogram(prof_stage Stage);
+ULONGLONG ProfPercentile(const prof_histogram *Histogram, double Percentile);
+ULONGLONG ProfBucketLowerBound(int Bucket);
+ULONGLONG ProfBucketUpperBound(int Bucket);
+const TCHAR *ProfStageName(prof_stage Stage);
+void ProfFormatMicroseconds(TCHAR *Buffer, DWORD BufferSize, ULONGLONG Microseconds);
+void ProfCount(prof_counter Counter, ULONGLONG Value);
+const prof_counter_stats *ProfGetCounter(prof_counter Counter);
+const TCHAR *ProfCounterName(prof_counter Counter);
+
+#endif
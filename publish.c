@@ -0,0 +1,89 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "publish.h"
+#include "snapshot.h"
+#include "util.h"
+
+static snapshot_segment Segment;
+
+BOOL PublishOpen(const TCHAR *Name)
+{
+	char Utf8[MAX_PATH];
+	TCharToUtf8(Name, Utf8, sizeof(Utf8));
+	return SnapshotCreate(Utf8, PUBLISH_CAPACITY, &Segment);
+}
+
+BOOL PublishEnabled(void)
+{
+	return Segment.Header != 0;
+}
+
+/* Called by the collector once per snapshot, readers retry while this runs */
+void PublishSnapshot(const system_summary *Summary, ULONGLONG Timestamp, const process *Processes, DWORD Count)
+{
+	snapshot_header *Header = Segment.Header;
+	if(!Header)
+		return;
+
+	uint32_t *IDs = SnapshotColumnData(Header, SNAPSHOT_ID);
+	uint32_t *Parents = SnapshotColumnData(Header, SNAPSHOT_PARENT);
+	uint32_t *Priorities = SnapshotColumnData(Header, SNAPSHOT_PRIORITY);
+	uint32_t *Threads = SnapshotColumnData(Header, SNAPSHOT_THREADS);
+	double *CPU = SnapshotColumnData(Header, SNAPSHOT_CPU);
+	uint64_t *CPUTimes = SnapshotColumnData(Header, SNAPSHOT_CPU_TIME);
+	uint64_t *Memory = SnapshotColumnData(Header, SNAPSHOT_MEMORY);
+	uint64_t *DiskRead = SnapshotColumnData(Header, SNAPSHOT_DISK_READ);
+	uint64_t *DiskWrite = SnapshotColumnData(Header, SNAPSHOT_DISK_WRITE);
+	uint64_t *CreationTimes = SnapshotColumnData(Header, SNAPSHOT_CREATION_TIME);
+	char *Names = SnapshotColumnData(Header, SNAPSHOT_NAME);
+	char *Users = SnapshotColumnData(Header, SNAPSHOT_USER);
+
+	DWORD Rows = min(Count, Header->Capacity);
+
+	SnapshotWriteBegin(Header);
+
+	Header->Count = Rows;
+	Header->ProcessCount = Summary->ProcessCount;
+	Header->RunningProcessCount = Summary->RunningProcessCount;
+	Header->Timestamp = Timestamp;
+	Header->CPUUsage = Summary->CPUUsage;
+	Header->TotalMemory = Summary->TotalMemory;
+	Header->UsedMemory = Summary->UsedMemory;
+	Header->TotalPageMemory = Summary->TotalPageMemory;
+	Header->UsedPageMemory = Summary->UsedPageMemory;
+	Header->UpTime = Summary->UpTime;
+
+	for(DWORD i = 0; i < Rows; i++) {
+		const process *Process = &Processes[i];
+
+		IDs[i] = Process->ID;
+		Parents[i] = Process->ParentPID;
+		Priorities[i] = Process->BasePriority;
+		Threads[i] = Process->ThreadCount;
+		CPU[i] = Process->PercentProcessorTime;
+		CPUTimes[i] = Process->CPUTime;
+		Memory[i] = Process->UsedMemory;
+		DiskRead[i] = Process->DiskReadRate;
+		DiskWrite[i] = Process->DiskWriteRate;
+		CreationTimes[i] = Process->CreationTime;
+		TCharToUtf8(Process->ExeName, &Names[i * SNAPSHOT_NAME_SIZE], SNAPSHOT_NAME_SIZE);
+		TCharToUtf8(Process->UserName, &Users[i * SNAPSHOT_USER_SIZE], SNAPSHOT_USER_SIZE);
+	}
+
+	SnapshotWriteEnd(Header);
+}
@@ -0,0 +1,35 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PUBLISH_H
+#define PUBLISH_H
+
+#include "ntop.h"
+
+/*
+ * Writes every live snapshot into a named shared-memory segment in the
+ * layout of snapshot.h, for local programs that would otherwise collect
+ * the same values themselves.
+ */
+
+#define PUBLISH_CAPACITY 8192	/* rows, later processes of a larger snapshot are left out */
+
+BOOL PublishOpen(const TCHAR *Name);
+BOOL PublishEnabled(void);
+void PublishSnapshot(const system_summary *Summary, ULONGLONG Timestamp, const process *Processes, DWORD Count);
+
+#endif
@@ -0,0 +1,1113 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "record.h"
+#include "format.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REC_MAGIC "NTOPREC1"
+#define REC_INDEX_MAGIC "NTOPIDX1"
+#define REC_VERSION 2
+#define REC_HEADER_SIZE 24
+#define REC_FOOTER_SIZE 16
+#define REC_FRAME_HEADER_MAX 11
+
+#define REC_FRAME_KEY 'K'
+#define REC_FRAME_DELTA 'D'
+#define REC_FRAME_INDEX 'I'
+
+/* Per-process values that may change between frames */
+typedef enum rec_field {
+	REC_PRIORITY,
+	REC_CPU,		/* hundredths of a percent */
+	REC_MEMORY,
+	REC_THREADS,
+	REC_DISK_USAGE,
+	REC_DISK_OPERATIONS,
+	/* Since version 2, a version 1 file ends its rows here */
+	REC_DISK_READ,
+	REC_DISK_WRITE,
+	REC_DISK_OTHER,
+	REC_DISK_READ_OPS,	/* hundredths of an operation per second */
+	REC_DISK_WRITE_OPS,
+	REC_FIELD_COUNT,
+} rec_field;
+
+#define REC_V1_FIELD_COUNT (REC_DISK_OPERATIONS + 1)
+
+typedef enum rec_system_field {
+	REC_SYS_CPU,		/* usage fraction in units of 1/10000 */
+	REC_SYS_TOTAL_MEMORY,
+	REC_SYS_USED_MEMORY,
+	REC_SYS_TOTAL_PAGE,
+	REC_SYS_USED_PAGE,
+	REC_SYS_UPTIME,
+	REC_SYS_PROCESS_COUNT,
+	REC_SYS_RUNNING_COUNT,
+	REC_SYS_FIELD_COUNT,
+} rec_system_field;
+
+typedef struct rec_row {
+	DWORD ID;
+	DWORD ParentPID;
+	ULONGLONG CreationTime;
+	ULONGLONG Field[REC_FIELD_COUNT];
+	DWORD Source;
+} rec_row;
+
+typedef struct rec_index_entry {
+	ULONGLONG Timestamp;
+	ULONGLONG Offset;
+} rec_index_entry;
+
+struct rec_writer {
+	CRITICAL_SECTION Lock;
+	HANDLE File;
+	BOOL Failed;
+
+	rec_row *Prev;
+	DWORD PrevCount;
+	rec_row *Cur;
+	DWORD CurCapacity;
+	DWORD *PrevMatch;
+	DWORD PrevMatchCapacity;
+	DWORD *Births;
+	DWORD *Deaths;
+	DWORD *Changes;
+	ULONGLONG PrevSystem[REC_SYS_FIELD_COUNT];
+	ULONGLONG PrevTimestamp;
+
+	rec_index_entry *Index;
+	DWORD IndexCount;
+	DWORD IndexCapacity;
+
+	out_buffer Payload;
+	out_buffer Frame;
+	rec_stats Stats;
+};
+
+struct rec_reader {
+	HANDLE File;
+	ULONGLONG DataEnd;
+	ULONGLONG NextOffset;
+
+	rec_index_entry *Index;
+	DWORD IndexCount;
+
+	BYTE *Payload;
+	DWORD PayloadCapacity;
+
+	/* Fields stored per row, older versions have fewer */
+	int FieldCount;
+
+	ULONGLONG Timestamp;
+	ULONGLONG System[REC_SYS_FIELD_COUNT];
+	rec_row *Rows;
+	process *Processes;
+	DWORD Count;
+	DWORD Capacity;
+	rec_row *NewRows;
+	process *NewProcesses;
+	BOOL HasFrame;
+};
+
+typedef struct rec_decoder {
+	const BYTE *Pos;
+	const BYTE *End;
+	BOOL Error;
+} rec_decoder;
+
+static void OutAppendVarint(out_buffer *Out, ULONGLONG Value)
+{
+	char Buffer[10];
+	size_t Length = 0;
+
+	while(Value >= 0x80) {
+		Buffer[Length++] = (char)(Value | 0x80);
+		Value >>= 7;
+	}
+	Buffer[Length++] = (char)Value;
+	OutAppend(Out, Buffer, Length);
+}
+
+static ULONGLONG ZigZag(LONGLONG Value)
+{
+	return ((ULONGLONG)Value << 1) ^ (ULONGLONG)(Value >> 63);
+}
+
+static LONGLONG UnZigZag(ULONGLONG Value)
+{
+	return (LONGLONG)(Value >> 1) ^ -(LONGLONG)(Value & 1);
+}
+
+static void OutAppendDelta(out_buffer *Out, ULONGLONG Value, ULONGLONG Base)
+{
+	OutAppendVarint(Out, ZigZag((LONGLONG)(Value - Base)));
+}
+
+static ULONGLONG DecodeVarint(rec_decoder *Decoder)
+{
+	ULONGLONG Value = 0;
+	int Shift = 0;
+
+	while(Decoder->Pos < Decoder->End && Shift < 64) {
+		BYTE b = *Decoder->Pos++;
+		Value |= (ULONGLONG)(b & 0x7F) << Shift;
+		if(!(b & 0x80))
+			return Value;
+		Shift += 7;
+	}
+
+	Decoder->Error = TRUE;
+	return 0;
+}
+
+static ULONGLONG DecodeDelta(rec_decoder *Decoder, ULONGLONG Base)
+{
+	return Base + (ULONGLONG)UnZigZag(DecodeVarint(Decoder));
+}
+
+static int CompareRows(const void *A, const void *B)
+{
+	const rec_row *RowA = A;
+	const rec_row *RowB = B;
+
+	if(RowA->ID != RowB->ID)
+		return RowA->ID < RowB->ID ? -1 : 1;
+	if(RowA->CreationTime != RowB->CreationTime)
+		return RowA->CreationTime < RowB->CreationTime ? -1 : 1;
+	return 0;
+}
+
+static void RowFromProcess(rec_row *Row, const process *Process)
+{
+	Row->ID = Process->ID;
+	Row->ParentPID = Process->ParentPID;
+	Row->CreationTime = Process->CreationTime;
+	Row->Field[REC_PRIORITY] = Process->BasePriority;
+	Row->Field[REC_CPU] = (ULONGLONG)(Process->PercentProcessorTime * 100.0 + 0.5);
+	Row->Field[REC_MEMORY] = Process->UsedMemory;
+	Row->Field[REC_THREADS] = Process->ThreadCount;
+	Row->Field[REC_DISK_USAGE] = Process->DiskUsage;
+	Row->Field[REC_DISK_OPERATIONS] = Process->DiskOperations;
+	Row->Field[REC_DISK_READ] = Process->DiskReadRate;
+	Row->Field[REC_DISK_WRITE] = Process->DiskWriteRate;
+	Row->Field[REC_DISK_OTHER] = Process->DiskOtherRate;
+	Row->Field[REC_DISK_READ_OPS] = (ULONGLONG)(Process->DiskReadOps * 100.0 + 0.5);
+	Row->Field[REC_DISK_WRITE_OPS] = (ULONGLONG)(Process->DiskWriteOps * 100.0 + 0.5);
+}
+
+static void SystemToFields(ULONGLONG *Fields, const system_summary *System)
+{
+	Fields[REC_SYS_CPU] = (ULONGLONG)(System->CPUUsage * 10000.0 + 0.5);
+	Fields[REC_SYS_TOTAL_MEMORY] = System->TotalMemory;
+	Fields[REC_SYS_USED_MEMORY] = System->UsedMemory;
+	Fields[REC_SYS_TOTAL_PAGE] = System->TotalPageMemory;
+	Fields[REC_SYS_USED_PAGE] = System->UsedPageMemory;
+	Fields[REC_SYS_UPTIME] = System->UpTime;
+	Fields[REC_SYS_PROCESS_COUNT] = System->ProcessCount;
+	Fields[REC_SYS_RUNNING_COUNT] = System->RunningProcessCount;
+}
+
+static BOOL WriteAll(HANDLE File, const void *Data, DWORD Size)
+{
+	DWORD Written;
+	return WriteFile(File, Data, Size, &Written, 0) && Written == Size;
+}
+
+static BOOL ReadAt(HANDLE File, ULONGLONG Offset, void *Data, DWORD Size, DWORD *Read)
+{
+	LARGE_INTEGER Position;
+
+	Position.QuadPart = (LONGLONG)Offset;
+	if(!SetFilePointerEx(File, Position, 0, FILE_BEGIN))
+		return FALSE;
+	return ReadFile(File, Data, Size, Read, 0);
+}
+
+static void PutU32(char *Dest, DWORD Value)
+{
+	for(int i = 0; i < 4; i++)
+		Dest[i] = (char)(Value >> (i * 8));
+}
+
+static void PutU64(char *Dest, ULONGLONG Value)
+{
+	for(int i = 0; i < 8; i++)
+		Dest[i] = (char)(Value >> (i * 8));
+}
+
+static DWORD GetU32(const BYTE *Src)
+{
+	DWORD Value = 0;
+	for(int i = 3; i >= 0; i--)
+		Value = (Value << 8) | Src[i];
+	return Value;
+}
+
+static ULONGLONG GetU64(const BYTE *Src)
+{
+	ULONGLONG Value = 0;
+	for(int i = 7; i >= 0; i--)
+		Value = (Value << 8) | Src[i];
+	return Value;
+}
+
+/*
+ * Writer
+ */
+
+rec_writer *RecCreate(const TCHAR *FileName)
+{
+	HANDLE File = CreateFile(FileName, GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if(File == INVALID_HANDLE_VALUE)
+		return 0;
+
+	char Header[REC_HEADER_SIZE];
+	memcpy(Header, REC_MAGIC, 8);
+	PutU32(Header + 8, REC_VERSION);
+	PutU32(Header + 12, REC_KEYFRAME_INTERVAL);
+	PutU64(Header + 16, 0);
+
+	if(!WriteAll(File, Header, sizeof(Header))) {
+		CloseHandle(File);
+		return 0;
+	}
+
+	rec_writer *Writer = xcalloc(1, sizeof(*Writer));
+	InitializeCriticalSection(&Writer->Lock);
+	Writer->File = File;
+	Writer->Stats.Bytes = REC_HEADER_SIZE;
+	return Writer;
+}
+
+static void EnsureWriterCapacity(rec_writer *Writer, DWORD Count)
+{
+	if(Count > Writer->CurCapacity) {
+		DWORD Capacity = Count + Count / 2 + 64;
+		Writer->Prev = xrealloc(Writer->Prev, Capacity * sizeof(*Writer->Prev));
+		Writer->Cur = xrealloc(Writer->Cur, Capacity * sizeof(*Writer->Cur));
+		Writer->Births = xrealloc(Writer->Births, Capacity * sizeof(*Writer->Births));
+		Writer->Changes = xrealloc(Writer->Changes, Capacity * sizeof(*Writer->Changes));
+		Writer->CurCapacity = Capacity;
+	}
+
+	if(Writer->PrevCount > Writer->PrevMatchCapacity) {
+		DWORD Capacity = Writer->PrevCount + Writer->PrevCount / 2 + 64;
+		Writer->PrevMatch = xrealloc(Writer->PrevMatch, Capacity * sizeof(*Writer->PrevMatch));
+		Writer->Deaths = xrealloc(Writer->Deaths, Capacity * sizeof(*Writer->Deaths));
+		Writer->PrevMatchCapacity = Capacity;
+	}
+}
+
+/* Identity, birth-time values and names of the given rows */
+static void AppendBirthColumns(out_buffer *Out, const rec_row *Rows, const DWORD *Select, DWORD Count,
+		const process *Processes)
+{
+	DWORD PrevID = 0;
+	ULONGLONG PrevCreationTime = 0;
+
+	for(DWORD i = 0; i < Count; i++) {
+		const rec_row *Row = &Rows[Select ? Select[i] : i];
+		OutAppendDelta(Out, Row->ID, PrevID);
+		PrevID = Row->ID;
+	}
+
+	for(DWORD i = 0; i < Count; i++) {
+		const rec_row *Row = &Rows[Select ? Select[i] : i];
+		OutAppendDelta(Out, Row->CreationTime, PrevCreationTime);
+		PrevCreationTime = Row->CreationTime;
+	}
+
+	for(DWORD i = 0; i < Count; i++)
+		OutAppendVarint(Out, Rows[Select ? Select[i] : i].ParentPID);
+
+	for(int f = 0; f < REC_FIELD_COUNT; f++) {
+		for(DWORD i = 0; i < Count; i++)
+			OutAppendVarint(Out, Rows[Select ? Select[i] : i].Field[f]);
+	}
+
+	char Utf8[MAX_PATH * 3];
+
+	for(DWORD i = 0; i < Count; i++) {
+		const process *Process = &Processes[Rows[Select ? Select[i] : i].Source];
+		int Length = TCharToUtf8(Process->ExeName, Utf8, sizeof(Utf8));
+		OutAppendVarint(Out, Length);
+		OutAppend(Out, Utf8, Length);
+	}
+
+	for(DWORD i = 0; i < Count; i++) {
+		const process *Process = &Processes[Rows[Select ? Select[i] : i].Source];
+		int Length = TCharToUtf8(Process->UserName, Utf8, sizeof(Utf8));
+		OutAppendVarint(Out, Length);
+		OutAppend(Out, Utf8, Length);
+	}
+}
+
+static void AppendKeyframe(rec_writer *Writer, ULONGLONG Timestamp, const ULONGLONG *System,
+		const process *Processes, DWORD Count)
+{
+	out_buffer *Out = &Writer->Payload;
+
+	OutAppendVarint(Out, Timestamp);
+	for(int i = 0; i < REC_SYS_FIELD_COUNT; i++)
+		OutAppendVarint(Out, System[i]);
+
+	OutAppendVarint(Out, Count);
+	AppendBirthColumns(Out, Writer->Cur, 0, Count, Processes);
+}
+
+static void AppendDeltaFrame(rec_writer *Writer, ULONGLONG Timestamp, const ULONGLONG *System,
+		const process *Processes, DWORD Count)
+{
+	out_buffer *Out = &Writer->Payload;
+	const rec_row *Prev = Writer->Prev;
+	const rec_row *Cur = Writer->Cur;
+	DWORD BirthCount = 0;
+	DWORD DeathCount = 0;
+	DWORD p = 0;
+	DWORD c = 0;
+
+	/* Both tables are sorted by identity, so a merge finds the survivors */
+	while(p < Writer->PrevCount || c < Count) {
+		int Order;
+
+		if(p == Writer->PrevCount)
+			Order = 1;
+		else if(c == Count)
+			Order = -1;
+		else
+			Order = CompareRows(&Prev[p], &Cur[c]);
+
+		if(Order < 0) {
+			Writer->Deaths[DeathCount++] = p++;
+		} else if(Order > 0) {
+			Writer->Births[BirthCount++] = c++;
+		} else {
+			Writer->PrevMatch[p] = c;
+			p++;
+			c++;
+		}
+	}
+
+	OutAppendVarint(Out, Timestamp - Writer->PrevTimestamp);
+	for(int i = 0; i < REC_SYS_FIELD_COUNT; i++)
+		OutAppendDelta(Out, System[i], Writer->PrevSystem[i]);
+
+	DWORD Last = 0;
+	OutAppendVarint(Out, DeathCount);
+	for(DWORD i = 0; i < DeathCount; i++) {
+		OutAppendVarint(Out, Writer->Deaths[i] - Last);
+		Last = Writer->Deaths[i];
+	}
+
+	Last = 0;
+	OutAppendVarint(Out, BirthCount);
+	for(DWORD i = 0; i < BirthCount; i++) {
+		OutAppendVarint(Out, Writer->Births[i] - Last);
+		Last = Writer->Births[i];
+	}
+	AppendBirthColumns(Out, Cur, Writer->Births, BirthCount, Processes);
+
+	/*
+	 * One column at a time: the count of changed rows, then each row as
+	 * an index delta followed by the value delta.
+	 */
+	for(int f = 0; f < REC_FIELD_COUNT; f++) {
+		DWORD ChangeCount = 0;
+		DWORD d = 0;
+
+		for(p = 0; p < Writer->PrevCount; p++) {
+			if(d < DeathCount && Writer->Deaths[d] == p) {
+				d++;
+				continue;
+			}
+			if(Prev[p].Field[f] != Cur[Writer->PrevMatch[p]].Field[f])
+				Writer->Changes[ChangeCount++] = p;
+		}
+
+		OutAppendVarint(Out, ChangeCount);
+		Last = 0;
+		for(DWORD i = 0; i < ChangeCount; i++) {
+			DWORD Old = Writer->Changes[i];
+			DWORD New = Writer->PrevMatch[Old];
+			OutAppendVarint(Out, New - Last);
+			OutAppendDelta(Out, Cur[New].Field[f], Prev[Old].Field[f]);
+			Last = New;
+		}
+	}
+}
+
+static void AddIndexEntry(rec_writer *Writer, ULONGLONG Timestamp, ULONGLONG Offset)
+{
+	if(Writer->IndexCount == Writer->IndexCapacity) {
+		Writer->IndexCapacity = Writer->IndexCapacity ? Writer->IndexCapacity * 2 : 64;
+		Writer->Index = xrealloc(Writer->Index, Writer->IndexCapacity * sizeof(*Writer->Index));
+	}
+
+	Writer->Index[Writer->IndexCount].Timestamp = Timestamp;
+	Writer->Index[Writer->IndexCount].Offset = Offset;
+	Writer->IndexCount++;
+}
+
+static BOOL WriteFrame(rec_writer *Writer, char Type)
+{
+	out_buffer *Frame = &Writer->Frame;
+
+	OutReset(Frame);
+	OutAppend(Frame, &Type, 1);
+	OutAppendVarint(Frame, Writer->Payload.Length);
+	OutAppend(Frame, Writer->Payload.Data, Writer->Payload.Length);
+
+	if(!WriteAll(Writer->File, Frame->Data, (DWORD)Frame->Length)) {
+		Writer->Failed = TRUE;
+		return FALSE;
+	}
+
+	Writer->Stats.Bytes += Frame->Length;
+	return TRUE;
+}
+
+void RecWriteFrame(rec_writer *Writer, ULONGLONG Timestamp, const system_summary *System,
+		const process *Processes, DWORD Count)
+{
+	ULONGLONG SystemFields[REC_SYS_FIELD_COUNT];
+
+	EnterCriticalSection(&Writer->Lock);
+
+	if(Writer->Failed || Writer->File == INVALID_HANDLE_VALUE) {
+		LeaveCriticalSection(&Writer->Lock);
+		return;
+	}
+
+	EnsureWriterCapacity(Writer, Count);
+
+	for(DWORD i = 0; i < Count; i++) {
+		RowFromProcess(&Writer->Cur[i], &Processes[i]);
+		Writer->Cur[i].Source = i;
+	}
+	qsort(Writer->Cur, Count, sizeof(*Writer->Cur), CompareRows);
+	SystemToFields(SystemFields, System);
+
+	/* Timestamps must not go backwards or the delta would wrap */
+	if(Writer->Stats.FrameCount && Timestamp < Writer->PrevTimestamp)
+		Timestamp = Writer->PrevTimestamp;
+
+	BOOL Keyframe = Writer->Stats.FrameCount % REC_KEYFRAME_INTERVAL == 0;
+	ULONGLONG Offset = Writer->Stats.Bytes;
+
+	OutReset(&Writer->Payload);
+	if(Keyframe)
+		AppendKeyframe(Writer, Timestamp, SystemFields, Processes, Count);
+	else
+		AppendDeltaFrame(Writer, Timestamp, SystemFields, Processes, Count);
+
+	if(WriteFrame(Writer, Keyframe ? REC_FRAME_KEY : REC_FRAME_DELTA)) {
+		if(Keyframe) {
+			AddIndexEntry(Writer, Timestamp, Offset);
+			Writer->Stats.KeyframeCount++;
+		}
+
+		if(!Writer->Stats.FrameCount)
+			Writer->Stats.FirstTimestamp = Timestamp;
+		Writer->Stats.LastTimestamp = Timestamp;
+		Writer->Stats.FrameCount++;
+		Writer->Stats.ProcessSamples += Count;
+
+		rec_row *Swap = Writer->Prev;
+		Writer->Prev = Writer->Cur;
+		Writer->Cur = Swap;
+		Writer->PrevCount = Count;
+		Writer->PrevTimestamp = Timestamp;
+		memcpy(Writer->PrevSystem, SystemFields, sizeof(SystemFields));
+	}
+
+	LeaveCriticalSection(&Writer->Lock);
+}
+
+void RecGetStats(rec_writer *Writer, rec_stats *Stats)
+{
+	EnterCriticalSection(&Writer->Lock);
+	*Stats = Writer->Stats;
+	LeaveCriticalSection(&Writer->Lock);
+}
+
+/*
+ * Writes the keyframe index and the footer pointing at it. The writer
+ * stays allocated, later frames are dropped, so this is safe to call
+ * while the collector is still running.
+ */
+void RecClose(rec_writer *Writer)
+{
+	EnterCriticalSection(&Writer->Lock);
+
+	if(Writer->File == INVALID_HANDLE_VALUE) {
+		LeaveCriticalSection(&Writer->Lock);
+		return;
+	}
+
+	if(!Writer->Failed) {
+		ULONGLONG Offset = Writer->Stats.Bytes;
+		ULONGLONG LastTimestamp = 0;
+		ULONGLONG LastOffset = 0;
+
+		OutReset(&Writer->Payload);
+		OutAppendVarint(&Writer->Payload, Writer->IndexCount);
+		for(DWORD i = 0; i < Writer->IndexCount; i++) {
+			OutAppendVarint(&Writer->Payload, Writer->Index[i].Timestamp - LastTimestamp);
+			OutAppendVarint(&Writer->Payload, Writer->Index[i].Offset - LastOffset);
+			LastTimestamp = Writer->Index[i].Timestamp;
+			LastOffset = Writer->Index[i].Offset;
+		}
+
+		if(WriteFrame(Writer, REC_FRAME_INDEX)) {
+			char Footer[REC_FOOTER_SIZE];
+			PutU64(Footer, Offset);
+			memcpy(Footer + 8, REC_INDEX_MAGIC, 8);
+			if(WriteAll(Writer->File, Footer, sizeof(Footer)))
+				Writer->Stats.Bytes += sizeof(Footer);
+		}
+	}
+
+	CloseHandle(Writer->File);
+	Writer->File = INVALID_HANDLE_VALUE;
+
+	LeaveCriticalSection(&Writer->Lock);
+}
+
+/*
+ * Reader
+ */
+
+static BOOL ReadFrameHeader(rec_reader *Reader, ULONGLONG Offset, BYTE *Type, DWORD *Length, DWORD *HeaderSize)
+{
+	BYTE Buffer[REC_FRAME_HEADER_MAX];
+	DWORD Read;
+
+	if(Offset >= Reader->DataEnd)
+		return FALSE;
+	if(!ReadAt(Reader->File, Offset, Buffer, sizeof(Buffer), &Read) || Read < 2)
+		return FALSE;
+
+	rec_decoder Decoder = { Buffer + 1, Buffer + Read, FALSE };
+	ULONGLONG PayloadLength = DecodeVarint(&Decoder);
+	if(Decoder.Error || PayloadLength > 0x7FFFFFFF)
+		return FALSE;
+
+	*Type = Buffer[0];
+	*Length = (DWORD)PayloadLength;
+	*HeaderSize = (DWORD)(Decoder.Pos - Buffer);
+	return Offset + *HeaderSize + *Length <= Reader->DataEnd;
+}
+
+static BOOL ReadPayload(rec_reader *Reader, ULONGLONG Offset, DWORD Length)
+{
+	DWORD Read;
+
+	if(Length > Reader->PayloadCapacity) {
+		Reader->PayloadCapacity = Length + Length / 2;
+		Reader->Payload = xrealloc(Reader->Payload, Reader->PayloadCapacity);
+	}
+
+	return ReadAt(Reader->File, Offset, Reader->Payload, Length, &Read) && Read == Length;
+}
+
+static BOOL LoadIndex(rec_reader *Reader, ULONGLONG FileSize)
+{
+	BYTE Footer[REC_FOOTER_SIZE];
+	DWORD Read;
+
+	if(FileSize < REC_HEADER_SIZE + REC_FOOTER_SIZE)
+		return FALSE;
+	if(!ReadAt(Reader->File, FileSize - REC_FOOTER_SIZE, Footer, sizeof(Footer), &Read) || Read != sizeof(Footer))
+		return FALSE;
+	if(memcmp(Footer + 8, REC_INDEX_MAGIC, 8) != 0)
+		return FALSE;
+
+	ULONGLONG Offset = GetU64(Footer);
+	BYTE Type;
+	DWORD Length, HeaderSize;
+
+	Reader->DataEnd = FileSize - REC_FOOTER_SIZE;
+	if(!ReadFrameHeader(Reader, Offset, &Type, &Length, &HeaderSize) || Type != REC_FRAME_INDEX)
+		return FALSE;
+	if(!ReadPayload(Reader, Offset + HeaderSize, Length))
+		return FALSE;
+
+	rec_decoder Decoder = { Reader->Payload, Reader->Payload + Length, FALSE };
+	ULONGLONG Count = DecodeVarint(&Decoder);
+	if(Decoder.Error || Count > Length)
+		return FALSE;
+
+	Reader->Index = xmalloc((size_t)(Count ? Count : 1) * sizeof(*Reader->Index));
+	ULONGLONG Timestamp = 0;
+	ULONGLONG FrameOffset = 0;
+	for(ULONGLONG i = 0; i < Count; i++) {
+		Timestamp += DecodeVarint(&Decoder);
+		FrameOffset += DecodeVarint(&Decoder);
+		Reader->Index[i].Timestamp = Timestamp;
+		Reader->Index[i].Offset = FrameOffset;
+	}
+
+	if(Decoder.Error) {
+		free(Reader->Index);
+		Reader->Index = 0;
+		return FALSE;
+	}
+
+	Reader->IndexCount = (DWORD)Count;
+	Reader->DataEnd = Offset;
+	return TRUE;
+}
+
+/* Recordings cut short by a crash have no index; rebuild it by walking the frames */
+static void ScanIndex(rec_reader *Reader, ULONGLONG FileSize)
+{
+	ULONGLONG Offset = REC_HEADER_SIZE;
+	DWORD Capacity = 0;
+	BYTE Type;
+	DWORD Length, HeaderSize;
+
+	Reader->DataEnd = FileSize;
+
+	while(ReadFrameHeader(Reader, Offset, &Type, &Length, &HeaderSize)) {
+		if(Type == REC_FRAME_INDEX)
+			break;
+
+		if(Type == REC_FRAME_KEY) {
+			BYTE Buffer[10];
+			DWORD Read;
+
+			if(!ReadAt(Reader->File, Offset + HeaderSize, Buffer, min(Length, sizeof(Buffer)), &Read))
+				break;
+
+			rec_decoder Decoder = { Buffer, Buffer + Read, FALSE };
+			ULONGLONG Timestamp = DecodeVarint(&Decoder);
+			if(Decoder.Error)
+				break;
+
+			if(Reader->IndexCount == Capacity) {
+				Capacity = Capacity ? Capacity * 2 : 64;
+				Reader->Index = xrealloc(Reader->Index, Capacity * sizeof(*Reader->Index));
+			}
+			Reader->Index[Reader->IndexCount].Timestamp = Timestamp;
+			Reader->Index[Reader->IndexCount].Offset = Offset;
+			Reader->IndexCount++;
+		}
+
+		Offset += HeaderSize + Length;
+	}
+
+	/* Drop a truncated trailing frame */
+	Reader->DataEnd = Offset;
+}
+
+rec_reader *RecOpen(const TCHAR *FileName)
+{
+	HANDLE File = CreateFile(FileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if(File == INVALID_HANDLE_VALUE)
+		return 0;
+
+	BYTE Header[REC_HEADER_SIZE];
+	DWORD Read;
+	LARGE_INTEGER FileSize;
+
+	if(!GetFileSizeEx(File, &FileSize)
+	|| !ReadFile(File, Header, sizeof(Header), &Read, 0)
+	|| Read != sizeof(Header)
+	|| memcmp(Header, REC_MAGIC, 8) != 0
+	|| (GetU32(Header + 8) != REC_VERSION && GetU32(Header + 8) != 1)) {
+		CloseHandle(File);
+		return 0;
+	}
+
+	rec_reader *Reader = xcalloc(1, sizeof(*Reader));
+	Reader->File = File;
+	Reader->FieldCount = GetU32(Header + 8) == 1 ? REC_V1_FIELD_COUNT : REC_FIELD_COUNT;
+
+	if(!LoadIndex(Reader, FileSize.QuadPart))
+		ScanIndex(Reader, FileSize.QuadPart);
+
+	if(Reader->IndexCount == 0) {
+		RecCloseReader(Reader);
+		return 0;
+	}
+
+	Reader->NextOffset = Reader->Index[0].Offset;
+	return Reader;
+}
+
+void RecCloseReader(rec_reader *Reader)
+{
+	CloseHandle(Reader->File);
+	free(Reader->Index);
+	free(Reader->Payload);
+	free(Reader->Rows);
+	free(Reader->Processes);
+	free(Reader->NewRows);
+	free(Reader->NewProcesses);
+	free(Reader);
+}
+
+ULONGLONG RecGetFirstTimestamp(const rec_reader *Reader)
+{
+	return Reader->Index[0].Timestamp;
+}
+
+/* Start of the last keyframe interval; later delta frames are not indexed */
+ULONGLONG RecGetLastTimestamp(const rec_reader *Reader)
+{
+	return Reader->Index[Reader->IndexCount - 1].Timestamp;
+}
+
+static void EnsureReaderCapacity(rec_reader *Reader, ULONGLONG Count)
+{
+	if(Count > Reader->Capacity) {
+		DWORD Capacity = (DWORD)Count + (DWORD)Count / 2 + 64;
+		Reader->Rows = xrealloc(Reader->Rows, Capacity * sizeof(*Reader->Rows));
+		Reader->Processes = xrealloc(Reader->Processes, Capacity * sizeof(*Reader->Processes));
+		Reader->NewRows = xrealloc(Reader->NewRows, Capacity * sizeof(*Reader->NewRows));
+		Reader->NewProcesses = xrealloc(Reader->NewProcesses, Capacity * sizeof(*Reader->NewProcesses));
+		Reader->Capacity = Capacity;
+	}
+}
+
+static void DecodeString(rec_decoder *Decoder, TCHAR *Dest, int DestSize)
+{
+	ULONGLONG Length = DecodeVarint(Decoder);
+
+	if(Length > (ULONGLONG)(Decoder->End - Decoder->Pos)) {
+		Decoder->Error = TRUE;
+		Dest[0] = 0;
+		return;
+	}
+
+	Utf8ToTChar((const char *)Decoder->Pos, (int)Length, Dest, DestSize);
+	Decoder->Pos += Length;
+}
+
+/* Inverse of AppendBirthColumns; Slots gives the destination rows */
+static void DecodeBirthColumns(rec_decoder *Decoder, int FieldCount, rec_row *Rows, process *Processes, const DWORD *Slots, DWORD Count)
+{
+	ULONGLONG ID = 0;
+	ULONGLONG CreationTime = 0;
+
+	for(DWORD i = 0; i < Count; i++) {
+		ID = DecodeDelta(Decoder, ID);
+		Rows[Slots[i]].ID = (DWORD)ID;
+	}
+
+	for(DWORD i = 0; i < Count; i++) {
+		CreationTime = DecodeDelta(Decoder, CreationTime);
+		Rows[Slots[i]].CreationTime = CreationTime;
+	}
+
+	for(DWORD i = 0; i < Count; i++)
+		Rows[Slots[i]].ParentPID = (DWORD)DecodeVarint(Decoder);
+
+	for(int f = 0; f < REC_FIELD_COUNT; f++) {
+		for(DWORD i = 0; i < Count; i++)
+			Rows[Slots[i]].Field[f] = f < FieldCount ? DecodeVarint(Decoder) : 0;
+	}
+
+	for(DWORD i = 0; i < Count; i++) {
+		process *Process = &Processes[Slots[i]];
+		memset(Process, 0, sizeof(*Process));
+		DecodeString(Decoder, Process->ExeName, MAX_PATH);
+	}
+
+	for(DWORD i = 0; i < Count; i++)
+		DecodeString(Decoder, Processes[Slots[i]].UserName, UNLEN);
+}
+
+static BOOL DecodeKeyframe(rec_reader *Reader, rec_decoder *Decoder)
+{
+	ULONGLONG Timestamp = DecodeVarint(Decoder);
+	ULONGLONG System[REC_SYS_FIELD_COUNT];
+
+	for(int i = 0; i < REC_SYS_FIELD_COUNT; i++)
+		System[i] = DecodeVarint(Decoder);
+
+	ULONGLONG Count = DecodeVarint(Decoder);
+	if(Decoder->Error || Count > (ULONGLONG)(Decoder->End - Decoder->Pos))
+		return FALSE;
+
+	EnsureReaderCapacity(Reader, Count);
+
+	/* Decode into the spare tables so a corrupt frame leaves the state intact */
+	DWORD *Slots = xmalloc((size_t)(Count ? Count : 1) * sizeof(*Slots));
+	for(DWORD i = 0; i < Count; i++)
+		Slots[i] = i;
+	DecodeBirthColumns(Decoder, Reader->FieldCount, Reader->NewRows, Reader->NewProcesses, Slots, (DWORD)Count);
+	free(Slots);
+
+	if(Decoder->Error)
+		return FALSE;
+
+	Reader->Timestamp = Timestamp;
+	memcpy(Reader->System, System, sizeof(System));
+	Reader->Count = (DWORD)Count;
+	return TRUE;
+}
+
+static BOOL DecodeDeltaFrame(rec_reader *Reader, rec_decoder *Decoder)
+{
+	ULONGLONG Timestamp = Reader->Timestamp + DecodeVarint(Decoder);
+	ULONGLONG System[REC_SYS_FIELD_COUNT];
+
+	for(int i = 0; i < REC_SYS_FIELD_COUNT; i++)
+		System[i] = DecodeDelta(Decoder, Reader->System[i]);
+
+	ULONGLONG Available = Decoder->End - Decoder->Pos;
+	ULONGLONG DeathCount = DecodeVarint(Decoder);
+	if(Decoder->Error || DeathCount > Reader->Count || DeathCount > Available)
+		return FALSE;
+
+	DWORD *Deaths = xmalloc((size_t)(DeathCount ? DeathCount : 1) * sizeof(*Deaths));
+	ULONGLONG Last = 0;
+	for(DWORD i = 0; i < DeathCount; i++) {
+		Last += DecodeVarint(Decoder);
+		if(Last >= Reader->Count || (i && Last <= Deaths[i - 1]))
+			Decoder->Error = TRUE;
+		Deaths[i] = (DWORD)Last;
+	}
+
+	ULONGLONG BirthCount = DecodeVarint(Decoder);
+	if(Decoder->Error || BirthCount > Available) {
+		free(Deaths);
+		return FALSE;
+	}
+
+	ULONGLONG NewCount = Reader->Count - DeathCount + BirthCount;
+	EnsureReaderCapacity(Reader, NewCount);
+
+	DWORD *Births = xmalloc((size_t)(BirthCount ? BirthCount : 1) * sizeof(*Births));
+	Last = 0;
+	for(DWORD i = 0; i < BirthCount; i++) {
+		Last += DecodeVarint(Decoder);
+		if(Last >= NewCount || (i && Last <= Births[i - 1]))
+			Decoder->Error = TRUE;
+		Births[i] = (DWORD)Last;
+	}
+
+	if(!Decoder->Error)
+		DecodeBirthColumns(Decoder, Reader->FieldCount, Reader->NewRows, Reader->NewProcesses, Births, (DWORD)BirthCount);
+
+	/* Survivors fill the slots between births in their old order */
+	if(!Decoder->Error) {
+		DWORD p = 0, d = 0, b = 0;
+
+		for(DWORD n = 0; n < NewCount; n++) {
+			if(b < BirthCount && Births[b] == n) {
+				b++;
+				continue;
+			}
+			while(d < DeathCount && Deaths[d] == p) {
+				d++;
+				p++;
+			}
+			Reader->NewRows[n] = Reader->Rows[p];
+			Reader->NewProcesses[n] = Reader->Processes[p];
+			p++;
+		}
+	}
+
+	free(Deaths);
+	free(Births);
+
+	for(int f = 0; f < Reader->FieldCount && !Decoder->Error; f++) {
+		ULONGLONG ChangeCount = DecodeVarint(Decoder);
+		ULONGLONG Index = 0;
+
+		if(ChangeCount > NewCount) {
+			Decoder->Error = TRUE;
+			break;
+		}
+
+		for(DWORD i = 0; i < ChangeCount; i++) {
+			Index += DecodeVarint(Decoder);
+			if(Index >= NewCount) {
+				Decoder->Error = TRUE;
+				break;
+			}
+			rec_row *Row = &Reader->NewRows[Index];
+			Row->Field[f] = DecodeDelta(Decoder, Row->Field[f]);
+		}
+	}
+
+	if(Decoder->Error)
+		return FALSE;
+
+	Reader->Timestamp = Timestamp;
+	memcpy(Reader->System, System, sizeof(System));
+	Reader->Count = (DWORD)NewCount;
+	return TRUE;
+}
+
+static void PublishFrame(rec_reader *Reader)
+{
+	rec_row *SwapRows = Reader->Rows;
+	process *SwapProcesses = Reader->Processes;
+
+	Reader->Rows = Reader->NewRows;
+	Reader->Processes = Reader->NewProcesses;
+	Reader->NewRows = SwapRows;
+	Reader->NewProcesses = SwapProcesses;
+
+	for(DWORD i = 0; i < Reader->Count; i++) {
+		const rec_row *Row = &Reader->Rows[i];
+		process *Process = &Reader->Processes[i];
+
+		Process->ID = Row->ID;
+		Process->ParentPID = Row->ParentPID;
+		Process->CreationTime = Row->CreationTime;
+		Process->BasePriority = (DWORD)Row->Field[REC_PRIORITY];
+		Process->PercentProcessorTime = Row->Field[REC_CPU] / 100.0;
+		Process->UsedMemory = Row->Field[REC_MEMORY];
+		Process->ThreadCount = (DWORD)Row->Field[REC_THREADS];
+		Process->DiskUsage = (DWORD)Row->Field[REC_DISK_USAGE];
+		Process->DiskOperations = Row->Field[REC_DISK_OPERATIONS];
+		Process->DiskReadRate = Row->Field[REC_DISK_READ];
+		Process->DiskWriteRate = Row->Field[REC_DISK_WRITE];
+		Process->DiskOtherRate = Row->Field[REC_DISK_OTHER];
+		Process->DiskReadOps = Row->Field[REC_DISK_READ_OPS] / 100.0;
+		Process->DiskWriteOps = Row->Field[REC_DISK_WRITE_OPS] / 100.0;
+
+		ULONGLONG Created = Row->CreationTime > FILETIME_UNIX_EPOCH ? (Row->CreationTime - FILETIME_UNIX_EPOCH) / 10000 : 0;
+		Process->UpTime = Created && Reader->Timestamp > Created ? Reader->Timestamp - Created : 0;
+
+		Process->Handle = 0;
+		Process->Next = 0;
+		Process->Parent = 0;
+		Process->FirstChild = 0;
+	}
+
+	Reader->HasFrame = TRUE;
+}
+
+/*
+ * Decodes the frame at NextOffset. Delta frames need the state of the
+ * frame before them, so they are only valid after a keyframe.
+ */
+BOOL RecNextFrame(rec_reader *Reader)
+{
+	BYTE Type;
+	DWORD Length, HeaderSize;
+
+	if(!ReadFrameHeader(Reader, Reader->NextOffset, &Type, &Length, &HeaderSize))
+		return FALSE;
+	if(Type == REC_FRAME_DELTA && !Reader->HasFrame)
+		return FALSE;
+	if(Type != REC_FRAME_KEY && Type != REC_FRAME_DELTA)
+		return FALSE;
+	if(!ReadPayload(Reader, Reader->NextOffset + HeaderSize, Length))
+		return FALSE;
+
+	rec_decoder Decoder = { Reader->Payload, Reader->Payload + Length, FALSE };
+	BOOL Ok = Type == REC_FRAME_KEY ? DecodeKeyframe(Reader, &Decoder) : DecodeDeltaFrame(Reader, &Decoder);
+	if(!Ok)
+		return FALSE;
+
+	PublishFrame(Reader);
+	Reader->NextOffset += HeaderSize + Length;
+	return TRUE;
+}
+
+BOOL RecPeekNextTimestamp(rec_reader *Reader, ULONGLONG *Timestamp)
+{
+	BYTE Type;
+	DWORD Length, HeaderSize;
+	BYTE Buffer[10];
+	DWORD Read;
+
+	if(!ReadFrameHeader(Reader, Reader->NextOffset, &Type, &Length, &HeaderSize))
+		return FALSE;
+	if(Type != REC_FRAME_KEY && Type != REC_FRAME_DELTA)
+		return FALSE;
+	if(!ReadAt(Reader->File, Reader->NextOffset + HeaderSize, Buffer, min(Length, sizeof(Buffer)), &Read))
+		return FALSE;
+
+	rec_decoder Decoder = { Buffer, Buffer + Read, FALSE };
+	ULONGLONG Value = DecodeVarint(&Decoder);
+	if(Decoder.Error)
+		return FALSE;
+
+	*Timestamp = Type == REC_FRAME_KEY ? Value : Reader->Timestamp + Value;
+	return TRUE;
+}
+
+/*
+ * Positions the reader on the last frame at or before Timestamp (or the
+ * first frame if Timestamp precedes the recording): jump to the nearest
+ * keyframe through the index, then roll delta frames forward.
+ */
+BOOL RecSeek(rec_reader *Reader, ULONGLONG Timestamp)
+{
+	DWORD Low = 0;
+	DWORD High = Reader->IndexCount;
+
+	while(High - Low > 1) {
+		DWORD Mid = (Low + High) / 2;
+		if(Reader->Index[Mid].Timestamp <= Timestamp)
+			Low = Mid;
+		else
+			High = Mid;
+	}
+
+	Reader->NextOffset = Reader->Index[Low].Offset;
+	Reader->HasFrame = FALSE;
+	if(!RecNextFrame(Reader))
+		return FALSE;
+
+	ULONGLONG Next;
+	while(RecPeekNextTimestamp(Reader, &Next) && Next <= Timestamp) {
+		if(!RecNextFrame(Reader))
+			break;
+	}
+
+	return TRUE;
+}
+
+ULONGLONG RecGetTimestamp(const rec_reader *Reader)
+{
+	return Reader->Timestamp;
+}
+
+void RecGetSystem(const rec_reader *Reader, system_summary *System)
+{
+	System->CPUUsage = Reader->System[REC_SYS_CPU] / 10000.0;
+	System->TotalMemory = Reader->System[REC_SYS_TOTAL_MEMORY];
+	System->UsedMemory = Reader->System[REC_SYS_USED_MEMORY];
+	System->TotalPageMemory = Reader->System[REC_SYS_TOTAL_PAGE];
+	System->UsedPageMemory = Reader->System[REC_SYS_USED_PAGE];
+	System->UpTime = Reader->System[REC_SYS_UPTIME];
+	System->ProcessCount = (DWORD)Reader->System[REC_SYS_PROCESS_COUNT];
+	System->RunningProcessCount = (DWORD)Reader->System[REC_SYS_RUNNING_COUNT];
+}
+
+DWORD RecGetProcessCount(const rec_reader *Reader)
+{
+	return Reader->HasFrame ? Reader->Count : 0;
+}
+
+/* Rows in (PID, creation time) order; valid until the next frame is read */
+const process *RecGetProcesses(const rec_reader *Reader)
+{
+	return Reader->Processes;
+}
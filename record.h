@@ -0,0 +1,73 @@
+/* 
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "ntop.h"
+
+/*
+ * Session recordings. A recording is a header followed by frames:
+ *
+ *   header  "NTOPREC1", u32 version, u32 keyframe interval, u64 reserved
+ *   frame   u8 type, varint payload length, payload
+ *   footer  index frame, u64 offset of the index frame, "NTOPIDX1"
+ *
+ * Keyframes ('K') hold the whole process table. Delta frames ('D') hold
+ * deaths, births and per-column lists of changed fields relative to the
+ * previous frame. Rows are kept sorted by (PID, creation time), so both
+ * sides agree on row indices without storing them. Numbers are varints,
+ * signed deltas are zig-zag encoded and columns are stored one after
+ * another. The index frame ('I') lists every keyframe for seeking; if it
+ * is missing (NTop was killed) the reader rebuilds it by scanning.
+ * Version 2 appended the per-kind disk rates to the row fields, version 1
+ * files still load with those at zero.
+ */
+
+#define REC_KEYFRAME_INTERVAL 60
+
+typedef struct rec_writer rec_writer;
+typedef struct rec_reader rec_reader;
+
+typedef struct rec_stats {
+	DWORD FrameCount;
+	DWORD KeyframeCount;
+	ULONGLONG Bytes;
+	ULONGLONG FirstTimestamp;
+	ULONGLONG LastTimestamp;
+	ULONGLONG ProcessSamples;
+} rec_stats;
+
+rec_writer *RecCreate(const TCHAR *FileName);
+void RecWriteFrame(rec_writer *Writer, ULONGLONG Timestamp, const system_summary *System,
+		const process *Processes, DWORD Count);
+void RecGetStats(rec_writer *Writer, rec_stats *Stats);
+void RecClose(rec_writer *Writer);
+
+rec_reader *RecOpen(const TCHAR *FileName);
+void RecCloseReader(rec_reader *Reader);
+ULONGLONG RecGetFirstTimestamp(const rec_reader *Reader);
+ULONGLONG RecGetLastTimestamp(const rec_reader *Reader);
+BOOL RecSeek(rec_reader *Reader, ULONGLONG Timestamp);
+BOOL RecNextFrame(rec_reader *Reader);
+BOOL RecPeekNextTimestamp(rec_reader *Reader, ULONGLONG *Timestamp);
+ULONGLONG RecGetTimestamp(const rec_reader *Reader);
+void RecGetSystem(const rec_reader *Reader, system_summary *System);
+DWORD RecGetProcessCount(const rec_reader *Reader);
+const process *RecGetProcesses(const rec_reader *Reader);
+
+#endif
@@ -0,0 +1,704 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rules.h"
+#include "util.h"
+#include "profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum rule_field {
+	RULE_CPU,
+	RULE_CPU95,
+	RULE_AVG1,
+	RULE_AVG5,
+	RULE_AVG15,
+	RULE_MEM,
+	RULE_MEM95,
+	RULE_GROWTH,
+	RULE_THREADS,
+	RULE_DISK,
+	RULE_READ,
+	RULE_WRITE,
+	RULE_READ_OPS,
+	RULE_WRITE_OPS,
+	RULE_PRI,
+	/* String fields from here on */
+	RULE_NAME,
+	RULE_USER,
+} rule_field;
+
+typedef enum rule_op {
+	RULE_GREATER,
+	RULE_GREATER_EQUAL,
+	RULE_LESS,
+	RULE_LESS_EQUAL,
+	RULE_EQUAL,
+	RULE_NOT_EQUAL,
+	RULE_CONTAINS,
+	RULE_NOT_CONTAINS,
+} rule_op;
+
+typedef enum rule_action {
+	RULE_NOTIFY,
+	RULE_KILL,
+} rule_action;
+
+typedef struct rule_condition {
+	rule_field Field;
+	rule_op Op;
+	double Value;
+	TCHAR *Pattern;		/* lower case */
+} rule_condition;
+
+typedef struct rule {
+	rule_condition Conditions[RULE_MAX_CONDITIONS];
+	DWORD ConditionCount;
+	ULONGLONG Duration;	/* ms */
+	rule_action Action;
+	TCHAR *Text;
+} rule;
+
+static const struct {
+	const char *Name;
+	rule_field Field;
+} FieldNames[] = {
+	{ "cpu",	RULE_CPU },
+	{ "cpu95",	RULE_CPU95 },
+	{ "avg1",	RULE_AVG1 },
+	{ "avg5",	RULE_AVG5 },
+	{ "avg15",	RULE_AVG15 },
+	{ "mem",	RULE_MEM },
+	{ "mem95",	RULE_MEM95 },
+	{ "growth",	RULE_GROWTH },
+	{ "threads",	RULE_THREADS },
+	{ "disk",	RULE_DISK },
+	{ "read",	RULE_READ },
+	{ "write",	RULE_WRITE },
+	{ "riops",	RULE_READ_OPS },
+	{ "wiops",	RULE_WRITE_OPS },
+	{ "pri",	RULE_PRI },
+	{ "name",	RULE_NAME },
+	{ "user",	RULE_USER },
+};
+
+static const struct {
+	const char *Name;
+	rule_op Op;
+} OpNames[] = {
+	{ ">",	RULE_GREATER },
+	{ ">=",	RULE_GREATER_EQUAL },
+	{ "<",	RULE_LESS },
+	{ "<=",	RULE_LESS_EQUAL },
+	{ "==",	RULE_EQUAL },
+	{ "!=",	RULE_NOT_EQUAL },
+	{ "~",	RULE_CONTAINS },
+	{ "!~",	RULE_NOT_CONTAINS },
+};
+
+static rule *Rules;
+static DWORD RuleCount;
+
+/*
+ * Per-process state of rules whose conditions currently hold, chained in
+ * hash buckets by rule and process identity. States not touched in a cycle
+ * are dropped, so a condition turning false or the process exiting re-arms
+ * the rule. Only the collector thread touches them.
+ */
+#define RULE_BUCKET_COUNT 4096
+#define RULE_NONE 0xFFFFFFFF
+
+typedef struct rule_state {
+	DWORD Rule;
+	DWORD ID;
+	ULONGLONG CreationTime;
+	ULONGLONG Since;
+	DWORD Generation;
+	BOOL Fired;
+	DWORD Next;
+} rule_state;
+
+static rule_state *States;
+static DWORD StateCount;
+static DWORD StateCapacity;
+static DWORD FreeState = RULE_NONE;
+static DWORD StateBuckets[RULE_BUCKET_COUNT];
+static DWORD Generation;
+
+/* Alerts wait here until the UI thread shows them */
+#define RULE_ALERT_QUEUE 32
+#define RULE_ALERT_SIZE 256
+
+typedef struct rule_alert {
+	TCHAR Text[RULE_ALERT_SIZE];
+	vi_message_type Type;
+} rule_alert;
+
+static CRITICAL_SECTION AlertLock;
+static rule_alert Alerts[RULE_ALERT_QUEUE];
+static DWORD AlertHead;
+static DWORD AlertCount;
+static char LogPath[MAX_PATH];
+
+void RuleInit(void)
+{
+	InitializeCriticalSection(&AlertLock);
+	for(DWORD i = 0; i < RULE_BUCKET_COUNT; i++) {
+		StateBuckets[i] = RULE_NONE;
+	}
+}
+
+void RuleSetLogFile(const char *Path)
+{
+	strncpy_s(LogPath, MAX_PATH, Path, _TRUNCATE);
+}
+
+static void WriteAlertLog(const TCHAR *Text)
+{
+	FILE *File;
+	SYSTEMTIME Time;
+	char Utf8[RULE_ALERT_SIZE * 4];
+
+	if(LogPath[0] == '\0' || fopen_s(&File, LogPath, "a") != 0)
+		return;
+
+	GetLocalTime(&Time);
+	TCharToUtf8(Text, Utf8, sizeof(Utf8));
+	fprintf(File, "%04u-%02u-%02u %02u:%02u:%02u  %s\n",
+			Time.wYear, Time.wMonth, Time.wDay, Time.wHour, Time.wMinute, Time.wSecond, Utf8);
+	fclose(File);
+}
+
+void RuleQueueAlert(vi_message_type Type, const TCHAR *Fmt, ...)
+{
+	TCHAR Text[RULE_ALERT_SIZE];
+	va_list VaList;
+
+	va_start(VaList, Fmt);
+	_vstprintf_s(Text, RULE_ALERT_SIZE, Fmt, VaList);
+	va_end(VaList);
+
+	EnterCriticalSection(&AlertLock);
+	if(AlertCount == RULE_ALERT_QUEUE) {
+		/* Drop the oldest one, the log still has it */
+		AlertHead = (AlertHead + 1) % RULE_ALERT_QUEUE;
+		AlertCount--;
+	}
+	rule_alert *Alert = &Alerts[(AlertHead + AlertCount) % RULE_ALERT_QUEUE];
+	_tcscpy_s(Alert->Text, RULE_ALERT_SIZE, Text);
+	Alert->Type = Type;
+	AlertCount++;
+	LeaveCriticalSection(&AlertLock);
+
+	WriteAlertLog(Text);
+}
+
+BOOL RulePopAlert(TCHAR *Buffer, DWORD BufferSize, vi_message_type *Type)
+{
+	BOOL Popped = FALSE;
+
+	EnterCriticalSection(&AlertLock);
+	if(AlertCount > 0) {
+		_tcscpy_s(Buffer, BufferSize, Alerts[AlertHead].Text);
+		*Type = Alerts[AlertHead].Type;
+		AlertHead = (AlertHead + 1) % RULE_ALERT_QUEUE;
+		AlertCount--;
+		Popped = TRUE;
+	}
+	LeaveCriticalSection(&AlertLock);
+
+	return Popped;
+}
+
+/* Splits off the next word or "quoted string", returns 0 at the end */
+static char *NextToken(char **Cursor, BOOL *Quoted)
+{
+	char *Token = *Cursor;
+
+	while(*Token == ' ' || *Token == '\t' || *Token == '\r' || *Token == '\n')
+		Token++;
+
+	if(*Token == '\0')
+		return 0;
+
+	*Quoted = (*Token == '"');
+	if(*Quoted) {
+		char *End = strchr(++Token, '"');
+		if(!End)
+			return 0;
+		*End = '\0';
+		*Cursor = End + 1;
+		return Token;
+	}
+
+	char *End = Token;
+	while(*End && *End != ' ' && *End != '\t' && *End != '\r' && *End != '\n')
+		End++;
+	if(*End) {
+		*End++ = '\0';
+	}
+	*Cursor = End;
+	return Token;
+}
+
+/* 30s, 5m, 1h or plain seconds */
+static BOOL ParseDuration(const char *Text, ULONGLONG *Duration)
+{
+	char *End;
+	double Value = strtod(Text, &End);
+
+	if(End == Text || Value < 0)
+		return FALSE;
+
+	if(_stricmp(End, "ms") == 0) {
+		*Duration = (ULONGLONG)Value;
+	} else if(*End == '\0' || _stricmp(End, "s") == 0) {
+		*Duration = (ULONGLONG)(Value * 1000);
+	} else if(_stricmp(End, "m") == 0) {
+		*Duration = (ULONGLONG)(Value * 60 * 1000);
+	} else if(_stricmp(End, "h") == 0) {
+		*Duration = (ULONGLONG)(Value * 3600 * 1000);
+	} else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static TCHAR *CopyText(const char *Text)
+{
+	int Size = (int)strlen(Text) + 1;
+	TCHAR *Copy = xmalloc(Size * sizeof(TCHAR));
+
+	Utf8ToTChar(Text, Size - 1, Copy, Size);
+	return Copy;
+}
+
+static TCHAR *CopyLower(const char *Text)
+{
+	TCHAR *Copy = CopyText(Text);
+
+	_tcslwr_s(Copy, _tcslen(Copy) + 1);
+	return Copy;
+}
+
+/* Compiles one rule, everything after the "rule" key of a config line */
+BOOL RuleAdd(const char *Text)
+{
+	rule Rule = { 0 };
+	char Line[1024];
+	char *Cursor = Line;
+	char *Token;
+	BOOL Quoted;
+	BOOL HasAction = FALSE;
+
+	strncpy_s(Line, sizeof(Line), Text, _TRUNCATE);
+
+	while((Token = NextToken(&Cursor, &Quoted)) != 0) {
+		if(!Quoted && _stricmp(Token, "and") == 0)
+			continue;
+
+		if(!Quoted && _stricmp(Token, "for") == 0) {
+			Token = NextToken(&Cursor, &Quoted);
+			if(!Token || !ParseDuration(Token, &Rule.Duration))
+				goto Invalid;
+			continue;
+		}
+
+		if(!Quoted && strcmp(Token, "->") == 0) {
+			Token = NextToken(&Cursor, &Quoted);
+			if(!Token)
+				goto Invalid;
+			if(_stricmp(Token, "notify") == 0) {
+				Rule.Action = RULE_NOTIFY;
+			} else if(_stricmp(Token, "kill") == 0) {
+				Rule.Action = RULE_KILL;
+			} else {
+				goto Invalid;
+			}
+			HasAction = TRUE;
+			if(NextToken(&Cursor, &Quoted))
+				goto Invalid;
+			break;
+		}
+
+		if(Rule.ConditionCount == RULE_MAX_CONDITIONS)
+			goto Invalid;
+
+		rule_condition *Condition = &Rule.Conditions[Rule.ConditionCount];
+		int Field = -1;
+		for(DWORD i = 0; i < _countof(FieldNames); i++) {
+			if(_stricmp(Token, FieldNames[i].Name) == 0) {
+				Field = (int)i;
+				break;
+			}
+		}
+		if(Field < 0)
+			goto Invalid;
+		Condition->Field = FieldNames[Field].Field;
+
+		Token = NextToken(&Cursor, &Quoted);
+		if(!Token)
+			goto Invalid;
+		int Op = -1;
+		for(DWORD i = 0; i < _countof(OpNames); i++) {
+			if(strcmp(Token, OpNames[i].Name) == 0) {
+				Op = (int)i;
+				break;
+			}
+		}
+		if(Op < 0)
+			goto Invalid;
+		Condition->Op = OpNames[Op].Op;
+
+		Token = NextToken(&Cursor, &Quoted);
+		if(!Token)
+			goto Invalid;
+
+		if(Condition->Field >= RULE_NAME) {
+			if(Condition->Op != RULE_EQUAL && Condition->Op != RULE_NOT_EQUAL &&
+					Condition->Op != RULE_CONTAINS && Condition->Op != RULE_NOT_CONTAINS)
+				goto Invalid;
+			Condition->Pattern = CopyLower(Token);
+		} else {
+			char *End;
+			if(Condition->Op == RULE_CONTAINS || Condition->Op == RULE_NOT_CONTAINS)
+				goto Invalid;
+			Condition->Value = strtod(Token, &End);
+			if(End == Token || *End != '\0')
+				goto Invalid;
+		}
+
+		Rule.ConditionCount++;
+	}
+
+	if(!HasAction || Rule.ConditionCount == 0)
+		goto Invalid;
+
+	/* Cheap numeric tests first so most processes never reach a string compare */
+	for(DWORD i = 1; i < Rule.ConditionCount; i++) {
+		rule_condition Condition = Rule.Conditions[i];
+		DWORD j = i;
+		for(; j > 0 && Rule.Conditions[j - 1].Field > Condition.Field; j--) {
+			Rule.Conditions[j] = Rule.Conditions[j - 1];
+		}
+		Rule.Conditions[j] = Condition;
+	}
+
+	Rule.Text = CopyText(Text);
+
+	Rules = xrealloc(Rules, (RuleCount + 1) * sizeof(*Rules));
+	Rules[RuleCount++] = Rule;
+	return TRUE;
+
+Invalid:
+	for(DWORD i = 0; i < Rule.ConditionCount; i++) {
+		free(Rule.Conditions[i].Pattern);
+	}
+	{
+		TCHAR RuleText[RULE_ALERT_SIZE - 32];
+		Utf8ToTChar(Text, (int)strlen(Text), RuleText, _countof(RuleText));
+		RuleQueueAlert(VI_ERROR, _T("ntop.conf: invalid rule: %s"), RuleText);
+	}
+	return FALSE;
+}
+
+DWORD RuleGetCount(void)
+{
+	return RuleCount;
+}
+
+/* The collector queries a field is computed from */
+static DWORD FieldQueries(rule_field Field)
+{
+	switch(Field) {
+	case RULE_CPU:
+	case RULE_CPU95:
+	case RULE_AVG1:
+	case RULE_AVG5:
+	case RULE_AVG15:
+		return QUERY_TIMES;
+	case RULE_MEM:
+	case RULE_MEM95:
+	case RULE_GROWTH:
+		return QUERY_MEMORY;
+	case RULE_DISK:
+	case RULE_READ:
+	case RULE_WRITE:
+	case RULE_READ_OPS:
+	case RULE_WRITE_OPS:
+		return QUERY_IO;
+	case RULE_USER:
+		return QUERY_USER;
+	default:
+		return 0;
+	}
+}
+
+DWORD RuleGetQueries(void)
+{
+	DWORD Queries = 0;
+	for(DWORD Index = 0; Index < RuleCount; Index++) {
+		for(DWORD i = 0; i < Rules[Index].ConditionCount; i++) {
+			Queries |= FieldQueries(Rules[Index].Conditions[i].Field);
+		}
+	}
+	return Queries;
+}
+
+static BOOL CompareNumber(rule_op Op, double Left, double Right)
+{
+	switch(Op) {
+	case RULE_GREATER:		return Left > Right;
+	case RULE_GREATER_EQUAL:	return Left >= Right;
+	case RULE_LESS:			return Left < Right;
+	case RULE_LESS_EQUAL:		return Left <= Right;
+	case RULE_EQUAL:		return Left == Right;
+	case RULE_NOT_EQUAL:		return Left != Right;
+	default:			return FALSE;
+	}
+}
+
+static BOOL CompareString(rule_op Op, const TCHAR *Value, const TCHAR *Pattern)
+{
+	switch(Op) {
+	case RULE_EQUAL:		return _tcscmp(Value, Pattern) == 0;
+	case RULE_NOT_EQUAL:		return _tcscmp(Value, Pattern) != 0;
+	case RULE_CONTAINS:		return _tcsstr(Value, Pattern) != 0;
+	case RULE_NOT_CONTAINS:		return _tcsstr(Value, Pattern) == 0;
+	default:			return FALSE;
+	}
+}
+
+/* Lower-case copies of the string fields, made at most once per process */
+typedef struct rule_strings {
+	BOOL Valid;
+	TCHAR Name[MAX_PATH];
+	TCHAR User[UNLEN];
+} rule_strings;
+
+static BOOL MatchRule(const rule *Rule, const process *Process, rule_strings *Strings)
+{
+	for(DWORD i = 0; i < Rule->ConditionCount; i++) {
+		const rule_condition *Condition = &Rule->Conditions[i];
+		double Value;
+
+		switch(Condition->Field) {
+		case RULE_CPU:		Value = Process->PercentProcessorTime; break;
+		case RULE_CPU95:	Value = Process->PercentProcessorTimeP95; break;
+		case RULE_AVG1:		Value = Process->PercentProcessorTimeAvg1; break;
+		case RULE_AVG5:		Value = Process->PercentProcessorTimeAvg5; break;
+		case RULE_AVG15:	Value = Process->PercentProcessorTimeAvg15; break;
+		case RULE_MEM:		Value = (double)Process->UsedMemory / (1024.0 * 1024.0); break;
+		case RULE_MEM95:	Value = (double)Process->UsedMemoryP95 / (1024.0 * 1024.0); break;
+		case RULE_GROWTH:	Value = Process->MemoryGrowth; break;
+		case RULE_THREADS:	Value = Process->ThreadCount; break;
+		case RULE_DISK:		Value = (double)Process->DiskUsage / 1000000.0; break;
+		case RULE_READ:		Value = (double)Process->DiskReadRate / 1000000.0; break;
+		case RULE_WRITE:	Value = (double)Process->DiskWriteRate / 1000000.0; break;
+		case RULE_READ_OPS:	Value = Process->DiskReadOps; break;
+		case RULE_WRITE_OPS:	Value = Process->DiskWriteOps; break;
+		case RULE_PRI:		Value = Process->BasePriority; break;
+		default:
+			if(!Strings->Valid) {
+				_tcsncpy_s(Strings->Name, MAX_PATH, Process->ExeName, _TRUNCATE);
+				_tcslwr_s(Strings->Name, MAX_PATH);
+				_tcsncpy_s(Strings->User, UNLEN, Process->UserName, _TRUNCATE);
+				_tcslwr_s(Strings->User, UNLEN);
+				Strings->Valid = TRUE;
+			}
+			if(!CompareString(Condition->Op, Condition->Field == RULE_NAME ? Strings->Name : Strings->User, Condition->Pattern))
+				return FALSE;
+			continue;
+		}
+
+		if(!CompareNumber(Condition->Op, Value, Condition->Value))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static DWORD HashState(DWORD Rule, DWORD ID, ULONGLONG CreationTime)
+{
+	ULONGLONG Hash = ((ULONGLONG)Rule << 32 | ID) * 0x9E3779B97F4A7C15ULL ^ CreationTime;
+	return (DWORD)(Hash ^ (Hash >> 31)) & (RULE_BUCKET_COUNT - 1);
+}
+
+static rule_state *TouchState(DWORD Rule, const process *Process, ULONGLONG Timestamp)
+{
+	DWORD Bucket = HashState(Rule, Process->ID, Process->CreationTime);
+
+	for(DWORD Index = StateBuckets[Bucket]; Index != RULE_NONE; Index = States[Index].Next) {
+		rule_state *State = &States[Index];
+		if(State->Rule == Rule && State->ID == Process->ID && State->CreationTime == Process->CreationTime) {
+			State->Generation = Generation;
+			return State;
+		}
+	}
+
+	DWORD Index = FreeState;
+	if(Index != RULE_NONE) {
+		FreeState = States[Index].Next;
+	} else {
+		if(StateCount == StateCapacity) {
+			StateCapacity = StateCapacity ? StateCapacity * 2 : 64;
+			States = xrealloc(States, StateCapacity * sizeof(*States));
+		}
+		Index = StateCount++;
+	}
+
+	rule_state *State = &States[Index];
+	State->Rule = Rule;
+	State->ID = Process->ID;
+	State->CreationTime = Process->CreationTime;
+	State->Since = Timestamp;
+	State->Generation = Generation;
+	State->Fired = FALSE;
+	State->Next = StateBuckets[Bucket];
+	StateBuckets[Bucket] = Index;
+	return State;
+}
+
+static void SweepStates(void)
+{
+	for(DWORD Bucket = 0; Bucket < RULE_BUCKET_COUNT; Bucket++) {
+		DWORD *Link = &StateBuckets[Bucket];
+
+		while(*Link != RULE_NONE) {
+			DWORD Index = *Link;
+			rule_state *State = &States[Index];
+
+			if(State->Generation == Generation) {
+				Link = &State->Next;
+				continue;
+			}
+
+			*Link = State->Next;
+			State->Next = FreeState;
+			FreeState = Index;
+		}
+	}
+}
+
+typedef enum kill_result {
+	KILL_DONE,
+	KILL_PID_REUSED,	/* the PID belongs to another process by now */
+	KILL_FAILED,
+} kill_result;
+
+/*
+ * Kills the process only if the PID still belongs to the same process.
+ * Error is the error of the call that failed, for KILL_FAILED.
+ */
+static kill_result KillMatchedProcess(const process *Process, DWORD *Error)
+{
+	HANDLE Handle = OpenProcess(PROCESS_TERMINATE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, Process->ID);
+	if(!Handle) {
+		*Error = GetLastError();
+		return KILL_FAILED;
+	}
+
+	FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+	kill_result Result = KILL_FAILED;
+	if(!GetProcessTimes(Handle, &CreationTime, &ExitTime, &KernelTime, &UserTime)) {
+		*Error = GetLastError();
+	} else {
+		ULARGE_INTEGER Created;
+		Created.LowPart = CreationTime.dwLowDateTime;
+		Created.HighPart = CreationTime.dwHighDateTime;
+		if(Created.QuadPart != Process->CreationTime) {
+			Result = KILL_PID_REUSED;
+		} else if(TerminateProcess(Handle, 9)) {
+			Result = KILL_DONE;
+		} else {
+			*Error = GetLastError();
+		}
+	}
+
+	CloseHandle(Handle);
+	return Result;
+}
+
+static void FireRule(DWORD Index, const process *Process)
+{
+	const rule *Rule = &Rules[Index];
+
+	if(Rule->Action == RULE_KILL) {
+		DWORD Error = 0;
+		switch(KillMatchedProcess(Process, &Error)) {
+		case KILL_DONE:
+			RuleQueueAlert(VI_ERROR, _T("Rule %u killed %s (%u): %s"), Index + 1, Process->ExeName, Process->ID, Rule->Text);
+			break;
+		case KILL_PID_REUSED:
+			RuleQueueAlert(VI_NOTICE, _T("Rule %u did not kill %s (%u): the PID belongs to another process now"), Index + 1, Process->ExeName, Process->ID);
+			break;
+		case KILL_FAILED:
+			RuleQueueAlert(VI_ERROR, _T("Rule %u failed to kill %s (%u): 0x%08x"), Index + 1, Process->ExeName, Process->ID, Error);
+			break;
+		}
+	} else {
+		RuleQueueAlert(VI_NOTICE, _T("Rule %u: %s (%u): %s"), Index + 1, Process->ExeName, Process->ID, Rule->Text);
+	}
+}
+
+void RuleEvaluate(const process *Processes, DWORD Count, ULONGLONG Timestamp)
+{
+	if(RuleCount == 0)
+		return;
+
+	Generation++;
+
+	for(DWORD i = 0; i < Count; i++) {
+		const process *Process = &Processes[i];
+		rule_strings Strings;
+		Strings.Valid = FALSE;
+
+		for(DWORD Index = 0; Index < RuleCount; Index++) {
+			if(!MatchRule(&Rules[Index], Process, &Strings))
+				continue;
+
+			rule_state *State = TouchState(Index, Process, Timestamp);
+			if(!State->Fired && Timestamp - State->Since >= Rules[Index].Duration) {
+				State->Fired = TRUE;
+				FireRule(Index, Process);
+			}
+		}
+	}
+
+	SweepStates();
+}
+
+/* Times matching every rule against every process, without any state or action */
+ULONGLONG RuleBenchmark(const process *Processes, DWORD Count, DWORD *Matches)
+{
+	ULONGLONG Start = ProfNow();
+
+	*Matches = 0;
+	for(DWORD i = 0; i < Count; i++) {
+		rule_strings Strings;
+		Strings.Valid = FALSE;
+
+		for(DWORD Index = 0; Index < RuleCount; Index++) {
+			if(MatchRule(&Rules[Index], &Processes[i], &Strings)) {
+				(*Matches)++;
+			}
+		}
+	}
+
+	return ProfTicksToMicroseconds(ProfNow() - Start);
+}
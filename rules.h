@@ -0,0 +1,50 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include "ntop.h"
+
+/*
+ * Threshold rules from ntop.conf, for example
+ *
+ *	rule cpu > 90 for 30s name ~ "w3wp" -> notify
+ *	rule mem > 4000 and growth > 100 -> kill
+ *
+ * Rules are compiled once when the config is read and evaluated on the
+ * collector thread for every snapshot. A rule with a duration keeps one
+ * small state per process for as long as its conditions hold, and fires
+ * once when they held long enough. Alerts are queued for the UI and
+ * appended to a log file.
+ */
+
+#define RULE_MAX_CONDITIONS 8
+
+void RuleInit(void);
+void RuleSetLogFile(const char *Path);
+BOOL RuleAdd(const char *Text);
+DWORD RuleGetCount(void);
+DWORD RuleGetQueries(void);
+void RuleEvaluate(const process *Processes, DWORD Count, ULONGLONG Timestamp);
+ULONGLONG RuleBenchmark(const process *Processes, DWORD Count, DWORD *Matches);
+BOOL RulePopAlert(TCHAR *Buffer, DWORD BufferSize, vi_message_type *Type);
+
+/* Also used by the collector for events of its own, like a watched process exiting */
+void RuleQueueAlert(vi_message_type Type, const TCHAR *Fmt, ...);
+
+#endif
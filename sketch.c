@@ -0,0 +1,96 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sketch.h"
+#include <math.h>
+#include <string.h>
+
+static double SketchGamma(const sketch_mapping *Mapping)
+{
+	return pow(Mapping->Max / Mapping->Min, 1.0 / (SKETCH_BUCKETS - 2));
+}
+
+static int SketchBucket(const sketch_mapping *Mapping, double Value)
+{
+	if(Value < Mapping->Min)
+		return 0;
+
+	int Bucket = 1 + (int)(log(Value / Mapping->Min) * (SKETCH_BUCKETS - 2) / log(Mapping->Max / Mapping->Min));
+	return min(Bucket, SKETCH_BUCKETS - 1);
+}
+
+static void RetirePane(sketch *Sketch, DWORD Pane)
+{
+	WORD *Counts = Sketch->Panes[Pane];
+
+	for(int i = 0; i < SKETCH_BUCKETS; i++) {
+		Sketch->Window[i] -= Counts[i];
+		Sketch->Count -= Counts[i];
+	}
+	memset(Counts, 0, sizeof(Sketch->Panes[Pane]));
+}
+
+void SketchAdd(sketch *Sketch, const sketch_mapping *Mapping, double Value, ULONGLONG Timestamp)
+{
+	ULONGLONG Pane = Timestamp / SKETCH_PANE_MS;
+
+	if(Pane != Sketch->Pane) {
+		/* A jump backwards (replay seek) or past the whole window starts over */
+		if(Pane < Sketch->Pane || Pane - Sketch->Pane >= SKETCH_PANES) {
+			memset(Sketch, 0, sizeof(*Sketch));
+		} else {
+			for(ULONGLONG Next = Sketch->Pane + 1; Next <= Pane; Next++) {
+				RetirePane(Sketch, (DWORD)(Next % SKETCH_PANES));
+			}
+		}
+		Sketch->Pane = Pane;
+	}
+
+	WORD *Counts = Sketch->Panes[Pane % SKETCH_PANES];
+	int Bucket = SketchBucket(Mapping, Value);
+
+	/* Even at the 10ms minimum interval a window stays below this */
+	if(Sketch->Window[Bucket] == 0xFFFF)
+		return;
+
+	Counts[Bucket]++;
+	Sketch->Window[Bucket]++;
+	Sketch->Count++;
+}
+
+double SketchQuantile(const sketch *Sketch, const sketch_mapping *Mapping, double Quantile)
+{
+	if(Sketch->Count == 0)
+		return 0.0;
+
+	DWORD Rank = (DWORD)(Quantile * (Sketch->Count - 1));
+	DWORD Seen = 0;
+	int Bucket = 0;
+
+	for(; Bucket < SKETCH_BUCKETS - 1; Bucket++) {
+		Seen += Sketch->Window[Bucket];
+		if(Seen > Rank)
+			break;
+	}
+
+	if(Bucket == 0)
+		return 0.0;
+
+	/* The value with the same relative distance to both bucket bounds */
+	double Gamma = SketchGamma(Mapping);
+	return Mapping->Min * pow(Gamma, Bucket - 1) * 2.0 * Gamma / (Gamma + 1.0);
+}
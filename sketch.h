@@ -0,0 +1,53 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <windows.h>
+
+/*
+ * DDSketch-style quantile sketch over a sliding time window.
+ *
+ * Bucket i > 0 holds the values in [Min * Gamma^(i-1), Min * Gamma^i), so
+ * every reported quantile is within a fixed relative error of the true
+ * one; bucket 0 collects everything below Min. The window is split into
+ * SKETCH_PANES panes. Each pane keeps its own counts and Window keeps
+ * their sum, so adding a sample is O(1) and retiring a pane costs one pass
+ * over the buckets once per pane length.
+ */
+
+#define SKETCH_BUCKETS 64
+#define SKETCH_PANES 5
+#define SKETCH_PANE_MS (60 * 1000)
+
+typedef struct sketch_mapping {
+	double Min;
+	double Max;
+} sketch_mapping;
+
+typedef struct sketch {
+	ULONGLONG Pane;		/* number of the newest pane, Timestamp / SKETCH_PANE_MS */
+	DWORD Count;
+	WORD Window[SKETCH_BUCKETS];
+	WORD Panes[SKETCH_PANES][SKETCH_BUCKETS];
+} sketch;
+
+void SketchAdd(sketch *Sketch, const sketch_mapping *Mapping, double Value, ULONGLONG Timestamp);
+double SketchQuantile(const sketch *Sketch, const sketch_mapping *Mapping, double Quantile);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "snapshot.h"
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+	#define SNAPSHOT_FENCE() MemoryBarrier()
+	#define SNAPSHOT_YIELD() SwitchToThread()
+#else
+	#include <fcntl.h>
+	#include <sched.h>
+	#include <stdio.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <time.h>
+	#include <unistd.h>
+	#define SNAPSHOT_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+	#define SNAPSHOT_YIELD() sched_yield()
+#endif
+
+/* Every column starts on its own cache line */
+#define SNAPSHOT_ALIGNMENT 64
+
+static const uint32_t ElementSizes[SNAPSHOT_COLUMN_COUNT] = {
+	sizeof(uint32_t),
+	sizeof(uint32_t),
+	sizeof(uint32_t),
+	sizeof(uint32_t),
+	sizeof(double),
+	sizeof(uint64_t),
+	sizeof(uint64_t),
+	sizeof(uint64_t),
+	sizeof(uint64_t),
+	sizeof(uint64_t),
+	SNAPSHOT_NAME_SIZE,
+	SNAPSHOT_USER_SIZE,
+};
+
+static uint64_t AlignUp(uint64_t Value)
+{
+	return (Value + SNAPSHOT_ALIGNMENT - 1) & ~(uint64_t)(SNAPSHOT_ALIGNMENT - 1);
+}
+
+/* Fills in the column offsets if Columns is not 0, returns the segment size */
+static uint64_t Layout(uint32_t Capacity, snapshot_column_info *Columns)
+{
+	uint64_t Offset = AlignUp(sizeof(snapshot_header));
+
+	for(int Column = 0; Column < SNAPSHOT_COLUMN_COUNT; Column++) {
+		if(Columns) {
+			Columns[Column].Offset = Offset;
+			Columns[Column].ElementSize = ElementSizes[Column];
+			Columns[Column].Reserved = 0;
+		}
+		Offset = AlignUp(Offset + (uint64_t)ElementSizes[Column] * Capacity);
+	}
+
+	return Offset;
+}
+
+size_t SnapshotSegmentSize(uint32_t Capacity)
+{
+	return (size_t)Layout(Capacity, 0);
+}
+
+void *SnapshotColumnData(const snapshot_header *Header, snapshot_column Column)
+{
+	return (char *)Header + Header->Columns[Column].Offset;
+}
+
+#ifndef _WIN32
+/* POSIX shared memory names start with a slash */
+static void PosixName(const char *Name, char *Dest, size_t DestSize)
+{
+	snprintf(Dest, DestSize, "%s%s", Name[0] == '/' ? "" : "/", Name);
+}
+#endif
+
+/* Monotonic milliseconds, only differences are meaningful */
+static uint64_t NowMs(void)
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (uint64_t)Now.tv_sec * 1000 + (uint64_t)Now.tv_nsec / 1000000;
+#endif
+}
+
+static void *MapSegment(const char *Name, size_t Size, int Writable, size_t *MappedSize, void **Mapping)
+{
+#ifdef _WIN32
+	HANDLE Handle;
+	void *View;
+
+	if(Writable) {
+		Handle = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE,
+				(DWORD)((uint64_t)Size >> 32), (DWORD)Size, Name);
+	} else {
+		Handle = OpenFileMappingA(FILE_MAP_READ, FALSE, Name);
+	}
+	if(!Handle)
+		return 0;
+
+	/* A segment left by an earlier writer can be smaller than Size, mapping fails then */
+	View = MapViewOfFile(Handle, Writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, Size);
+	if(!View) {
+		CloseHandle(Handle);
+		return 0;
+	}
+
+	if(!Writable) {
+		MEMORY_BASIC_INFORMATION Info;
+		if(VirtualQuery(View, &Info, sizeof(Info)) == 0) {
+			UnmapViewOfFile(View);
+			CloseHandle(Handle);
+			return 0;
+		}
+		Size = Info.RegionSize;
+	}
+
+	*MappedSize = Size;
+	*Mapping = Handle;
+	return View;
+#else
+	char Path[256];
+	PosixName(Name, Path, sizeof(Path));
+
+	/*
+	 * A segment left by an earlier writer may have been abandoned mid-write,
+	 * the writer starts a fresh one. Readers still mapping the old one keep it.
+	 */
+	if(Writable) {
+		shm_unlink(Path);
+	}
+
+	int File = shm_open(Path, Writable ? O_CREAT | O_EXCL | O_RDWR : O_RDONLY, 0644);
+	if(File < 0)
+		return 0;
+
+	if(Writable) {
+		if(ftruncate(File, (off_t)Size) != 0) {
+			close(File);
+			return 0;
+		}
+	} else {
+		struct stat Stat;
+		if(fstat(File, &Stat) != 0) {
+			close(File);
+			return 0;
+		}
+		Size = (size_t)Stat.st_size;
+	}
+
+	void *View = mmap(0, Size, Writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, File, 0);
+	close(File);
+	if(View == MAP_FAILED)
+		return 0;
+
+	*MappedSize = Size;
+	*Mapping = 0;
+	return View;
+#endif
+}
+
+void SnapshotClose(snapshot_segment *Segment)
+{
+	if(!Segment->Header)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(Segment->Header);
+	CloseHandle(Segment->Mapping);
+#else
+	munmap(Segment->Header, Segment->Size);
+#endif
+	Segment->Header = 0;
+}
+
+/*
+ * On Windows a segment that is still mapped by readers outlives its
+ * writer and is reused by the next one, which lays it out again under
+ * the seqlock. On POSIX the old segment is unlinked and a new one made.
+ * Only one writer may publish to a name at a time.
+ */
+int SnapshotCreate(const char *Name, uint32_t Capacity, snapshot_segment *Segment)
+{
+	size_t Size = SnapshotSegmentSize(Capacity);
+
+	memset(Segment, 0, sizeof(*Segment));
+	Segment->Header = MapSegment(Name, Size, 1, &Segment->Size, &Segment->Mapping);
+	if(!Segment->Header)
+		return 0;
+
+	snapshot_header *Header = Segment->Header;
+	SnapshotWriteBegin(Header);
+
+	/* Everything but the sequence, which has to stay odd meanwhile */
+	size_t SequenceEnd = offsetof(snapshot_header, Sequence) + sizeof(Header->Sequence);
+	memset(Header, 0, offsetof(snapshot_header, Sequence));
+	memset((char *)Header + SequenceEnd, 0, Size - SequenceEnd);
+
+	Header->Magic = SNAPSHOT_MAGIC;
+	Header->Version = SNAPSHOT_VERSION;
+	Header->HeaderSize = sizeof(snapshot_header);
+	Header->ColumnCount = SNAPSHOT_COLUMN_COUNT;
+	Header->Capacity = Capacity;
+	Header->Size = Size;
+	Layout(Capacity, Header->Columns);
+
+	SnapshotWriteEnd(Header);
+	return 1;
+}
+
+void SnapshotWriteBegin(snapshot_header *Header)
+{
+	Header->Sequence = Header->Sequence + 1;
+	SNAPSHOT_FENCE();
+}
+
+void SnapshotWriteEnd(snapshot_header *Header)
+{
+	SNAPSHOT_FENCE();
+	Header->Sequence = Header->Sequence + 1;
+}
+
+/* The layout has to be exactly the one this reader was built for */
+static int CheckLayout(const snapshot_header *Header, size_t MappedSize)
+{
+	snapshot_column_info Columns[SNAPSHOT_COLUMN_COUNT];
+
+	if(Header->Magic != SNAPSHOT_MAGIC || Header->Version != SNAPSHOT_VERSION ||
+			Header->HeaderSize != sizeof(snapshot_header) || Header->ColumnCount != SNAPSHOT_COLUMN_COUNT)
+		return 0;
+	if(Header->Size > MappedSize || Layout(Header->Capacity, Columns) != Header->Size)
+		return 0;
+
+	return memcmp(Columns, Header->Columns, sizeof(Columns)) == 0;
+}
+
+int SnapshotOpen(const char *Name, snapshot_segment *Segment)
+{
+	memset(Segment, 0, sizeof(*Segment));
+	Segment->Header = MapSegment(Name, 0, 0, &Segment->Size, &Segment->Mapping);
+	if(!Segment->Header)
+		return 0;
+
+	if(Segment->Size < sizeof(snapshot_header)) {
+		SnapshotClose(Segment);
+		return 0;
+	}
+
+	/* The writer may be laying the segment out right now */
+	int Valid;
+	uint32_t Sequence;
+	do {
+		if(!SnapshotReadBegin(Segment->Header, &Sequence)) {
+			SnapshotClose(Segment);
+			return 0;
+		}
+		Valid = CheckLayout(Segment->Header, Segment->Size);
+	} while(!SnapshotReadValid(Segment->Header, Sequence));
+
+	if(!Valid) {
+		SnapshotClose(Segment);
+		return 0;
+	}
+	return 1;
+}
+
+int SnapshotReadBegin(const snapshot_header *Header, uint32_t *Sequence)
+{
+	uint32_t Waiting = 0;
+	uint64_t Start = 0;
+
+	while((*Sequence = Header->Sequence) & 1) {
+		/* A writer that died between WriteBegin and WriteEnd never moves on from this write */
+		uint64_t Now = NowMs();
+		if(*Sequence != Waiting) {
+			Waiting = *Sequence;
+			Start = Now;
+		} else if(Now - Start >= SNAPSHOT_READ_TIMEOUT) {
+			return 0;
+		}
+		SNAPSHOT_YIELD();
+	}
+	SNAPSHOT_FENCE();
+	return 1;
+}
+
+int SnapshotReadValid(const snapshot_header *Header, uint32_t Sequence)
+{
+	SNAPSHOT_FENCE();
+	return Header->Sequence == Sequence;
+}
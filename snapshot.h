@@ -0,0 +1,135 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Layout of the snapshots NTop publishes with --publish NAME into a named
+ * shared-memory segment, and the reader side of it. This header and
+ * snapshot.c use no NTop or Windows types, so other programs can read
+ * the segment by building just these two files, on Windows or, against
+ * a POSIX shared-memory writer, on Linux.
+ *
+ * The segment is a fixed header followed by one array per column, each
+ * with room for Capacity rows. Header->Sequence is a seqlock: the writer
+ * makes it odd before it touches anything below and even again when it
+ * is done. A reader takes the sequence with SnapshotReadBegin, reads the
+ * columns in place and keeps what it read only if SnapshotReadValid
+ * still sees the same sequence, retrying otherwise:
+ *
+ *	do {
+ *		if(!SnapshotReadBegin(Header, &Sequence))
+ *			... the writer died mid-write, close and open again ...
+ *		Count = Header->Count;
+ *		... read Count rows of the columns it needs ...
+ *	} while(!SnapshotReadValid(Header, Sequence));
+ *
+ * SnapshotReadBegin gives up once the sequence has stayed odd for
+ * SNAPSHOT_READ_TIMEOUT ms. A new writer on POSIX replaces the segment
+ * rather than reusing it, so readers of a dead writer keep their stale
+ * mapping until they open the name again.
+ *
+ * Readers never write to the segment, so any number of them costs the
+ * writer nothing.
+ */
+
+#define SNAPSHOT_MAGIC 0x504E534E	/* "NSNP" */
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_NAME_SIZE 64		/* UTF-8, NUL-terminated */
+#define SNAPSHOT_USER_SIZE 32
+
+#define SNAPSHOT_READ_TIMEOUT 1000	/* ms */
+
+typedef enum snapshot_column {
+	SNAPSHOT_ID,			/* uint32_t */
+	SNAPSHOT_PARENT,		/* uint32_t */
+	SNAPSHOT_PRIORITY,		/* uint32_t */
+	SNAPSHOT_THREADS,		/* uint32_t, 0 if unknown */
+	SNAPSHOT_CPU,			/* double, percent of all processors */
+	SNAPSHOT_CPU_TIME,		/* uint64_t, 100ns units */
+	SNAPSHOT_MEMORY,		/* uint64_t, working set in bytes */
+	SNAPSHOT_DISK_READ,		/* uint64_t, bytes per second */
+	SNAPSHOT_DISK_WRITE,		/* uint64_t, bytes per second */
+	SNAPSHOT_CREATION_TIME,		/* uint64_t, FILETIME */
+	SNAPSHOT_NAME,			/* char[SNAPSHOT_NAME_SIZE] */
+	SNAPSHOT_USER,			/* char[SNAPSHOT_USER_SIZE] */
+	SNAPSHOT_COLUMN_COUNT,
+} snapshot_column;
+
+typedef struct snapshot_column_info {
+	uint64_t Offset;		/* from the start of the segment */
+	uint32_t ElementSize;
+	uint32_t Reserved;
+} snapshot_column_info;
+
+typedef struct snapshot_header {
+	/* Set once when the segment is created */
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t HeaderSize;
+	uint32_t ColumnCount;
+	uint32_t Capacity;		/* rows every column has room for */
+	uint32_t Reserved;
+	uint64_t Size;			/* of the whole segment */
+	snapshot_column_info Columns[SNAPSHOT_COLUMN_COUNT];
+
+	/* Everything from here on belongs to the snapshot and is covered by Sequence */
+	/* 32 bits so that even 32-bit readers load it in one piece */
+	volatile uint32_t Sequence;	/* even when consistent, odd while written */
+	uint32_t Count;			/* rows, at most Capacity */
+	uint32_t ProcessCount;		/* processes in the snapshot, may exceed Count */
+	uint32_t RunningProcessCount;
+	uint64_t Timestamp;		/* Unix ms */
+	double CPUUsage;		/* 0 to 1 */
+	uint64_t TotalMemory;
+	uint64_t UsedMemory;
+	uint64_t TotalPageMemory;
+	uint64_t UsedPageMemory;
+	uint64_t UpTime;		/* ms */
+} snapshot_header;
+
+typedef struct snapshot_segment {
+	snapshot_header *Header;
+	size_t Size;
+	void *Mapping;			/* platform handle */
+} snapshot_segment;
+
+/* Size of a segment with room for Capacity rows */
+size_t SnapshotSegmentSize(uint32_t Capacity);
+
+/* The writer: creates the named segment and lays it out, 0 on failure */
+int SnapshotCreate(const char *Name, uint32_t Capacity, snapshot_segment *Segment);
+void SnapshotWriteBegin(snapshot_header *Header);
+void SnapshotWriteEnd(snapshot_header *Header);
+
+/* Readers: maps the named segment read-only and checks its layout, 0 on failure */
+int SnapshotOpen(const char *Name, snapshot_segment *Segment);
+/* 0 if a write did not finish within SNAPSHOT_READ_TIMEOUT ms */
+int SnapshotReadBegin(const snapshot_header *Header, uint32_t *Sequence);
+int SnapshotReadValid(const snapshot_header *Header, uint32_t Sequence);
+
+void SnapshotClose(snapshot_segment *Segment);
+
+/* Start of a column array, use Header->Columns[Column].ElementSize as the stride */
+void *SnapshotColumnData(const snapshot_header *Header, snapshot_column Column);
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the processor grouping of cpu.c, fed by cpu_linux.c, against
+ * the CPU lists sysfs publishes for every node, package and core, which
+ * cpu_linux.c itself does not read. Run it on a multi-socket or NUMA
+ * machine to exercise the grouping the meters are drawn by, or build it
+ * with -DCPU_ROOT='"/path"' to read a copy of such a machine's /sys and
+ * /proc/stat from /path. Built from the repository root with:
+ *
+ *	gcc -std=gnu11 -O2 -I. tests/cpu_test.c cpu.c cpu_linux.c -o cpu_test
+ */
+
+#ifdef __linux__
+
+#include "cpu.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_CPUS 8192
+#define MAX_NODES 1024
+
+/* Has to match the CPU_ROOT cpu_linux.c was built with */
+#ifndef CPU_ROOT
+	#define CPU_ROOT ""
+#endif
+
+static int Failures;
+
+static void Check(int Condition, const char *What)
+{
+	printf("%s: %s\n", Condition ? "ok" : "FAILED", What);
+	if(!Condition) {
+		Failures++;
+	}
+}
+
+/* Reads a CPU list like "0-3,8-11" into Set, returns how many it names or -1 */
+static int ReadCpuList(const char *Path, unsigned char *Set)
+{
+	char Line[4096];
+	FILE *File = fopen(Path, "r");
+	if(!File)
+		return -1;
+	if(!fgets(Line, sizeof(Line), File)) {
+		Line[0] = 0;
+	}
+	fclose(File);
+
+	int Count = 0;
+	memset(Set, 0, MAX_CPUS);
+	for(char *Range = strtok(Line, ",\n"); Range; Range = strtok(0, ",\n")) {
+		unsigned int First, Last;
+		int Fields = sscanf(Range, "%u-%u", &First, &Last);
+		if(Fields < 1)
+			continue;
+		if(Fields == 1)
+			Last = First;
+		for(unsigned int Number = First; Number <= Last && Number < MAX_CPUS; Number++) {
+			Set[Number] = 1;
+			Count++;
+		}
+	}
+	return Count;
+}
+
+static int ReadValue(unsigned int Number, const char *Name, unsigned int *Value)
+{
+	char Path[256];
+	snprintf(Path, sizeof(Path), CPU_ROOT "/sys/devices/system/cpu/cpu%u/topology/%s", Number, Name);
+
+	FILE *File = fopen(Path, "r");
+	if(!File)
+		return 0;
+	int Read = fscanf(File, "%u", Value) == 1;
+	fclose(File);
+	return Read;
+}
+
+static unsigned char Online[MAX_CPUS];
+static unsigned char Set[MAX_CPUS];
+static unsigned int NodeOf[MAX_CPUS];
+
+/* The cpulist of every node directory, nodes without processors do not count */
+static unsigned int ReadNodes(void)
+{
+	unsigned int Nodes = 0;
+
+	memset(NodeOf, 0, sizeof(NodeOf));
+	for(unsigned int Node = 0; Node < MAX_NODES; Node++) {
+		char Path[256];
+		snprintf(Path, sizeof(Path), CPU_ROOT "/sys/devices/system/node/node%u/cpulist", Node);
+
+		int InNode = ReadCpuList(Path, Set);
+		if(InNode <= 0)
+			continue;
+
+		int Listed = 0;
+		for(unsigned int Number = 0; Number < MAX_CPUS; Number++) {
+			if(Set[Number] && Online[Number]) {
+				NodeOf[Number] = Node;
+				Listed = 1;
+			}
+		}
+		Nodes += Listed;
+	}
+	return Nodes;
+}
+
+static void TestTopology(void)
+{
+	int OnlineCount = ReadCpuList(CPU_ROOT "/sys/devices/system/cpu/online", Online);
+	unsigned int Count = CpuInit();
+	const cpu_info *Cpus = CpuGetInfo();
+
+	printf("%u processors, %u nodes, %u packages\n", Count, CpuGetNodeCount(), CpuGetPackageCount());
+	Check(Count > 0 && (int)Count == OnlineCount, "one entry per online processor");
+	if(Count == 0)
+		return;
+
+	unsigned int Nodes = ReadNodes();
+	/* Without NUMA support there are no node directories and everything is node 0 */
+	if(Nodes == 0) {
+		Nodes = 1;
+	}
+	Check(CpuGetNodeCount() == Nodes, "node count matches the node cpulists");
+
+	int NodesMatch = 1, PackagesMatch = 1, Sorted = 1, Siblings = 1, Runs = 1;
+	unsigned int MaxPackage = 0;
+
+	for(unsigned int i = 0; i < Count; i++) {
+		const cpu_info *Cpu = &Cpus[i];
+		unsigned int Package = 0;
+
+		if(Cpu->Node != NodeOf[Cpu->Number])
+			NodesMatch = 0;
+		if(ReadValue(Cpu->Number, "physical_package_id", &Package) && Package != Cpu->Package)
+			PackagesMatch = 0;
+		if(Cpu->Package > MaxPackage)
+			MaxPackage = Cpu->Package;
+
+		if(i > 0) {
+			const cpu_info *Prev = &Cpus[i - 1];
+			if(Prev->Node > Cpu->Node ||
+					(Prev->Node == Cpu->Node && Prev->Package > Cpu->Package) ||
+					(Prev->Node == Cpu->Node && Prev->Package == Cpu->Package && Prev->Core > Cpu->Core))
+				Sorted = 0;
+		}
+
+		/* Every node and package forms one run, which is what the meters are grouped by */
+		for(unsigned int j = i + 2; j < Count; j++) {
+			if(Cpus[j].Node == Cpu->Node && Cpus[j].Package == Cpu->Package &&
+					(Cpus[j - 1].Node != Cpu->Node || Cpus[j - 1].Package != Cpu->Package))
+				Runs = 0;
+		}
+
+		/* SMT siblings share the core and so a place in the meters */
+		char Path[256];
+		snprintf(Path, sizeof(Path), CPU_ROOT "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", Cpu->Number);
+		if(ReadCpuList(Path, Set) > 0) {
+			for(unsigned int j = 0; j < Count; j++) {
+				if(Set[Cpus[j].Number] && (Cpus[j].Package != Cpu->Package || Cpus[j].Core != Cpu->Core))
+					Siblings = 0;
+			}
+		}
+	}
+
+	Check(NodesMatch, "every processor is in the node whose cpulist names it");
+	Check(PackagesMatch, "every processor is in its physical package");
+	Check(CpuGetPackageCount() == MaxPackage + 1, "package count covers the highest package");
+	Check(Sorted, "processors are ordered by node, package and core");
+	Check(Runs, "every node and package is one contiguous run");
+	Check(Siblings, "SMT siblings share package and core");
+}
+
+static void TestSample(void)
+{
+	usleep(200 * 1000);
+	Check(CpuSample(), "sample /proc/stat");
+
+	int InRange = 1;
+	for(unsigned int i = 0; i < CpuGetCount(); i++) {
+		double Usage = CpuGetInfo()[i].Usage;
+		if(Usage < 0.0 || Usage > 1.0)
+			InRange = 0;
+	}
+	Check(InRange, "usage is a fraction for every processor");
+}
+
+int main(void)
+{
+	TestTopology();
+	TestSample();
+	return Failures ? 1 : 0;
+}
+
+#endif
@@ -0,0 +1,128 @@
+#!/bin/sh
+#
+# Checks the /metrics endpoint of --export-listen with curl. Run it from
+# a shell with curl on the Windows machine that built NTop, e.g. Git Bash:
+#
+#	tests/export_test.sh path/to/NTop.exe [PORT] [CLIENTS] [REQUESTS]
+#
+# It ends with a load run of CLIENTS concurrent scrapers (default 16),
+# REQUESTS scrapes each (default 50), and prints the scrapes per second
+# and the mean and worst latency. Exits with a non-zero status on the
+# first failed check.
+
+NTOP=${1:-./NTop.exe}
+PORT=${2:-19182}
+LOAD_CLIENTS=${3:-16}
+LOAD_REQUESTS=${4:-50}
+URL=http://127.0.0.1:$PORT
+WORK=$(mktemp -d)
+
+# -N 0 keeps collecting until the script is done, like a real exporter
+"$NTOP" -d -N 0 --export-listen 127.0.0.1:$PORT > /dev/null &
+NTOP_PID=$!
+trap 'kill $NTOP_PID 2> /dev/null; rm -rf "$WORK"' EXIT
+trap 'exit 1' INT TERM
+
+fail()
+{
+	echo "FAILED: $1"
+	exit 1
+}
+
+ok()
+{
+	echo "ok: $1"
+}
+
+# Writes the status code, headers and body of a GET to $WORK
+get()
+{
+	curl -s -D "$WORK/headers" -o "$WORK/body" -w '%{http_code}' "$URL$1" > "$WORK/status"
+}
+
+# The first snapshot takes one update interval, the server answers 503 until then
+for i in $(seq 1 50); do
+	get /metrics
+	[ "$(cat "$WORK/status")" = 200 ] && break
+	sleep 0.2
+done
+[ "$(cat "$WORK/status")" = 200 ] || fail "/metrics answers 200 once a snapshot exists"
+ok "/metrics answers 200"
+
+grep -qi '^Content-Type: text/plain; version=0.0.4' "$WORK/headers" || fail "Prometheus text content type"
+ok "Prometheus text content type"
+
+LENGTH=$(sed -n 's/^Content-Length: *\([0-9]*\).*/\1/ip' "$WORK/headers")
+[ "$LENGTH" = "$(wc -c < "$WORK/body" | tr -d ' ')" ] || fail "Content-Length matches the body"
+ok "Content-Length matches the body"
+
+for METRIC in ntop_cpu_usage_ratio ntop_memory_used_bytes ntop_processes ntop_processes_running ntop_exported_processes; do
+	grep -q "^$METRIC [0-9]" "$WORK/body" || fail "$METRIC is exported"
+done
+ok "system values are exported"
+
+# Every sample line is a name, optional labels and a number
+awk '!/^#/ && !/^[a-z_]+(\{pid="[0-9]+",name="([^"\\]|\\.)*",user="([^"\\]|\\.)*"\})? -?[0-9.e+-]+$/ { print; bad = 1 } END { exit bad }' \
+	"$WORK/body" > "$WORK/bad" || fail "malformed lines: $(head -3 "$WORK/bad")"
+ok "every sample line is well-formed"
+
+# Each family is declared once, before its samples
+for FAMILY in $(sed -n 's/^# TYPE \([a-z_]*\) .*/\1/p' "$WORK/body"); do
+	[ "$(grep -c "^# TYPE $FAMILY " "$WORK/body")" = 1 ] || fail "$FAMILY is declared once"
+	grep -q "^# HELP $FAMILY " "$WORK/body" || fail "$FAMILY has HELP"
+done
+ok "every family has one TYPE and a HELP line"
+
+# Per-process series only for the chosen processes, the top 20 by CPU and by memory by default
+EXPORTED=$(sed -n 's/^ntop_exported_processes \([0-9]*\)$/\1/p' "$WORK/body")
+SERIES=$(grep -c '^ntop_process_memory_bytes{' "$WORK/body")
+[ "$EXPORTED" -gt 0 ] && [ "$EXPORTED" -le 40 ] || fail "between 1 and 2 * ExportTopN processes are exported, got $EXPORTED"
+[ "$SERIES" = "$EXPORTED" ] || fail "one series per exported process, got $SERIES for $EXPORTED"
+[ "$(grep '^ntop_process_memory_bytes{' "$WORK/body" | sed 's/.*{pid="\([0-9]*\)".*/\1/' | sort -u | wc -l | tr -d ' ')" = "$EXPORTED" ] ||
+	fail "exported processes are distinct"
+ok "$EXPORTED processes exported, one series each"
+
+get /other
+[ "$(cat "$WORK/status")" = 404 ] || fail "other paths answer 404"
+ok "other paths answer 404"
+
+# Several clients at once are all served
+CLIENTS=
+for i in 1 2 3 4; do
+	curl -s -o /dev/null -w '%{http_code}' "$URL/metrics" > "$WORK/status$i" &
+	CLIENTS="$CLIENTS $!"
+done
+wait $CLIENTS
+[ "$(cat "$WORK"/status[1-4])" = 200200200200 ] || fail "concurrent requests are served"
+ok "concurrent requests are served"
+
+# Scrapes keep being answered from fresh snapshots, not just the first one
+FIRST=$(sed -n 's/^ntop_uptime_seconds \([0-9.e+]*\)$/\1/p' "$WORK/body")
+sleep 3
+get /metrics
+[ "$(cat "$WORK/status")" = 200 ] || fail "/metrics answers 200 while NTop keeps collecting"
+[ "$(sed -n 's/^ntop_uptime_seconds \([0-9.e+]*\)$/\1/p' "$WORK/body")" != "$FIRST" ] || fail "later scrapes see later snapshots"
+ok "later scrapes see later snapshots"
+
+# Load: every client scrapes in a loop and logs status and latency per request
+START=$(date +%s.%N)
+CLIENTS=
+for i in $(seq 1 "$LOAD_CLIENTS"); do
+	(
+		for j in $(seq 1 "$LOAD_REQUESTS"); do
+			curl -s -o /dev/null -w '%{http_code} %{time_total}\n' "$URL/metrics"
+		done > "$WORK/load$i"
+	) &
+	CLIENTS="$CLIENTS $!"
+done
+wait $CLIENTS
+END=$(date +%s.%N)
+
+cat "$WORK"/load* > "$WORK/load"
+TOTAL=$((LOAD_CLIENTS * LOAD_REQUESTS))
+[ "$(grep -c '^200 ' "$WORK/load")" = "$TOTAL" ] || fail "all $TOTAL scrapes under load answer 200"
+awk -v start="$START" -v end="$END" '
+	{ sum += $2; if($2 > worst) worst = $2 }
+	END { printf "%d scrapes by %d clients: %.0f/s, mean %.1f ms, worst %.1f ms\n", NR, clients, NR / (end - start), 1000 * sum / NR, 1000 * worst }
+' clients="$LOAD_CLIENTS" "$WORK/load"
+ok "all $TOTAL scrapes under load answer 200"
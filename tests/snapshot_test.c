@@ -0,0 +1,206 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the seqlock of snapshot.c across processes, on Linux. A forked
+ * writer publishes snapshots as fast as it can while the parent reads
+ * them; every row is derived from the snapshot's Timestamp, so a row
+ * from another snapshot shows up as soon as a torn read gets through.
+ * It then checks that a write that never ends makes readers give up
+ * and that the next writer starts a fresh segment. Built from the
+ * repository root with:
+ *
+ *	gcc -std=gnu11 -O2 -I. tests/snapshot_test.c snapshot.c -lrt -o snapshot_test
+ */
+
+#ifdef __linux__
+
+#include "snapshot.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_NAME "ntop-snapshot-test"
+#define TEST_CAPACITY 2000
+#define TEST_SECONDS 3
+
+static int Failures;
+
+static void Check(int Condition, const char *What)
+{
+	printf("%s: %s\n", Condition ? "ok" : "FAILED", What);
+	if(!Condition) {
+		Failures++;
+	}
+}
+
+static uint64_t NowMs(void)
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (uint64_t)Now.tv_sec * 1000 + (uint64_t)Now.tv_nsec / 1000000;
+}
+
+/*
+ * The rows of snapshot Timestamp are a function of it and the row index.
+ * They are written last to first, against the order of the reader, so
+ * that an overlapping read meets the writer within the rows.
+ */
+static void FillRows(snapshot_header *Header, uint64_t Timestamp)
+{
+	uint32_t *IDs = SnapshotColumnData(Header, SNAPSHOT_ID);
+	uint64_t *Memory = SnapshotColumnData(Header, SNAPSHOT_MEMORY);
+	char *Names = SnapshotColumnData(Header, SNAPSHOT_NAME);
+	uint32_t Count = (uint32_t)(Timestamp % TEST_CAPACITY);
+
+	Header->Count = Count;
+	Header->Timestamp = Timestamp;
+	for(uint32_t i = Count; i-- > 0; ) {
+		IDs[i] = (uint32_t)(Timestamp * 7 + i);
+		Memory[i] = Timestamp * 1000 + i;
+		snprintf(Names + (size_t)i * SNAPSHOT_NAME_SIZE, SNAPSHOT_NAME_SIZE, "p%llu", (unsigned long long)(Timestamp + i));
+	}
+}
+
+static int RowsMatch(const snapshot_header *Header, uint32_t Count, uint64_t Timestamp)
+{
+	const uint32_t *IDs = SnapshotColumnData(Header, SNAPSHOT_ID);
+	const uint64_t *Memory = SnapshotColumnData(Header, SNAPSHOT_MEMORY);
+	const char *Names = SnapshotColumnData(Header, SNAPSHOT_NAME);
+
+	if(Count != Timestamp % TEST_CAPACITY)
+		return 0;
+
+	for(uint32_t i = 0; i < Count; i++) {
+		char Name[SNAPSHOT_NAME_SIZE];
+		snprintf(Name, sizeof(Name), "p%llu", (unsigned long long)(Timestamp + i));
+		if(IDs[i] != (uint32_t)(Timestamp * 7 + i) || Memory[i] != Timestamp * 1000 + i ||
+				strncmp(Names + (size_t)i * SNAPSHOT_NAME_SIZE, Name, SNAPSHOT_NAME_SIZE) != 0)
+			return 0;
+	}
+	return 1;
+}
+
+static void TestConcurrentReads(void)
+{
+	snapshot_segment Writer;
+	if(!SnapshotCreate(TEST_NAME, TEST_CAPACITY, &Writer)) {
+		Check(0, "create the segment");
+		return;
+	}
+
+	pid_t Child = fork();
+	if(Child == 0) {
+		uint64_t End = NowMs() + TEST_SECONDS * 1000;
+		for(uint64_t Timestamp = 1; NowMs() < End; Timestamp++) {
+			SnapshotWriteBegin(Writer.Header);
+			FillRows(Writer.Header, Timestamp);
+			SnapshotWriteEnd(Writer.Header);
+		}
+		_exit(0);
+	}
+
+	snapshot_segment Reader;
+	Check(SnapshotOpen(TEST_NAME, &Reader), "open the segment");
+
+	unsigned long Reads = 0, Retries = 0, Torn = 0, TimedOut = 0;
+	uint64_t End = NowMs() + TEST_SECONDS * 1000;
+	while(Reader.Header && NowMs() < End) {
+		uint32_t Sequence, Count;
+		uint64_t Timestamp;
+		int Match = 1;
+
+		do {
+			if(!SnapshotReadBegin(Reader.Header, &Sequence)) {
+				TimedOut++;
+				break;
+			}
+			Count = Reader.Header->Count;
+			Timestamp = Reader.Header->Timestamp;
+			Match = Count <= TEST_CAPACITY && RowsMatch(Reader.Header, Count, Timestamp);
+			if(SnapshotReadValid(Reader.Header, Sequence))
+				break;
+			Retries++;
+		} while(1);
+
+		Reads++;
+		if(!Match) {
+			Torn++;
+		}
+	}
+
+	int Status;
+	waitpid(Child, &Status, 0);
+
+	printf("%lu reads, %lu retries\n", Reads, Retries);
+	Check(Reads > 0 && Torn == 0, "every validated read is one whole snapshot");
+	Check(TimedOut == 0, "no read times out while the writer runs");
+
+	SnapshotClose(&Reader);
+	SnapshotClose(&Writer);
+}
+
+static void TestAbandonedWrite(void)
+{
+	snapshot_segment Writer, Reader;
+	uint32_t Sequence;
+
+	if(!SnapshotCreate(TEST_NAME, TEST_CAPACITY, &Writer)) {
+		Check(0, "create the segment");
+		return;
+	}
+	if(!SnapshotOpen(TEST_NAME, &Reader)) {
+		Check(0, "open the segment");
+		SnapshotClose(&Writer);
+		return;
+	}
+
+	/* A writer killed between the two calls */
+	SnapshotWriteBegin(Writer.Header);
+
+	uint64_t Start = NowMs();
+	int Began = SnapshotReadBegin(Reader.Header, &Sequence);
+	uint64_t Waited = NowMs() - Start;
+	Check(!Began && Waited >= SNAPSHOT_READ_TIMEOUT && Waited < 2 * SNAPSHOT_READ_TIMEOUT,
+			"a write that never ends makes the reader give up");
+	SnapshotClose(&Reader);
+	SnapshotClose(&Writer);
+
+	/* The next writer replaces the half-written segment */
+	if(!SnapshotCreate(TEST_NAME, TEST_CAPACITY, &Writer)) {
+		Check(0, "create the segment again");
+		return;
+	}
+	Check(SnapshotOpen(TEST_NAME, &Reader) && SnapshotReadBegin(Reader.Header, &Sequence),
+			"the next writer starts a fresh segment");
+	SnapshotClose(&Reader);
+	SnapshotClose(&Writer);
+}
+
+int main(void)
+{
+	TestConcurrentReads();
+	TestAbandonedWrite();
+
+	shm_unlink("/" TEST_NAME);
+	return Failures ? 1 : 0;
+}
+
+#endif
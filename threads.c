@@ -0,0 +1,359 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "threads.h"
+#include "ntapi.h"
+#include "util.h"
+#include <psapi.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct module_range {
+	ULONG_PTR Base;
+	ULONG_PTR Size;
+	TCHAR Name[32];
+} module_range;
+
+static nt_get_next_thread NtGetNextThread;
+static nt_query_information_thread NtQueryInformationThread;
+
+/* Set by the UI, picked up by the collector on its next sample */
+static CRITICAL_SECTION Lock;
+static DWORD TargetID;
+static ULONGLONG TargetCreationTime;
+static BOOL TargetChanged;
+
+/* Published sample, sorted by thread ID, guarded by Lock */
+static thread_info *Threads;
+static DWORD ThreadCount;
+static DWORD ThreadStatus;
+
+/* Owned by the collector thread */
+static thread_info *NextThreads;
+static DWORD ThreadCapacity;
+static ULONGLONG PrevSystemTime;
+static HANDLE Process;
+static DWORD ProcessStatus;
+static ACCESS_MASK ThreadAccess = THREAD_QUERY_INFORMATION;
+static module_range *Modules;
+static DWORD ModuleCount;
+
+void ThreadsInit(void)
+{
+	NtGetNextThread = (nt_get_next_thread)NT_GET_PROC("NtGetNextThread");
+	NtQueryInformationThread = (nt_query_information_thread)NT_GET_PROC("NtQueryInformationThread");
+	InitializeCriticalSection(&Lock);
+}
+
+void ThreadsSetProcess(DWORD ID, ULONGLONG CreationTime)
+{
+	EnterCriticalSection(&Lock);
+	if(ID != TargetID || CreationTime != TargetCreationTime) {
+		TargetID = ID;
+		TargetCreationTime = CreationTime;
+		TargetChanged = TRUE;
+		ThreadCount = 0;
+		ThreadStatus = 0;
+	}
+	LeaveCriticalSection(&Lock);
+}
+
+static void ReleaseProcess(void)
+{
+	if(Process) {
+		CloseHandle(Process);
+		Process = 0;
+	}
+	ProcessStatus = 0;
+	ThreadAccess = THREAD_QUERY_INFORMATION;
+	free(Modules);
+	Modules = 0;
+	ModuleCount = 0;
+	PrevSystemTime = 0;
+}
+
+/*
+ * Opens the target once and keeps it open while it is shown. Walking its
+ * threads needs PROCESS_QUERY_INFORMATION, reading its modules also
+ * PROCESS_VM_READ, which some processes that allow the walk deny.
+ */
+static BOOL OpenTargetProcess(void)
+{
+	if(Process || ProcessStatus)
+		return Process != 0;
+
+	Process = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ | SYNCHRONIZE, FALSE, TargetID);
+	if(!Process) {
+		Process = OpenProcess(PROCESS_QUERY_INFORMATION | SYNCHRONIZE, FALSE, TargetID);
+	}
+	if(!Process) {
+		ProcessStatus = GetLastError() == ERROR_INVALID_PARAMETER ? THREADS_EXITED : THREADS_DENIED;
+		return FALSE;
+	}
+
+	/* The PID may already belong to another process */
+	FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+	if(GetProcessTimes(Process, &CreationTime, &ExitTime, &KernelTime, &UserTime) &&
+			(((ULONGLONG)CreationTime.dwHighDateTime << 32) | CreationTime.dwLowDateTime) != TargetCreationTime) {
+		CloseHandle(Process);
+		Process = 0;
+		ProcessStatus = THREADS_EXITED;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void LoadModules(void)
+{
+	DWORD Needed;
+	if(!EnumProcessModulesEx(Process, 0, 0, &Needed, LIST_MODULES_ALL))
+		return;
+
+	HMODULE *Handles = xmalloc(Needed);
+	if(EnumProcessModulesEx(Process, Handles, Needed, &Needed, LIST_MODULES_ALL)) {
+		DWORD Count = Needed / sizeof(HMODULE);
+		Modules = xrealloc(Modules, max(Count, 1) * sizeof(*Modules));
+		ModuleCount = 0;
+
+		for(DWORD i = 0; i < Count; i++) {
+			MODULEINFO Info;
+			module_range *Module = &Modules[ModuleCount];
+			if(GetModuleInformation(Process, Handles[i], &Info, sizeof(Info)) &&
+					GetModuleBaseName(Process, Handles[i], Module->Name, _countof(Module->Name))) {
+				Module->Base = (ULONG_PTR)Info.lpBaseOfDll;
+				Module->Size = Info.SizeOfImage;
+				ModuleCount++;
+			}
+		}
+	}
+	free(Handles);
+}
+
+static const module_range *FindModule(ULONG_PTR Address)
+{
+	for(DWORD i = 0; i < ModuleCount; i++) {
+		if(Address - Modules[i].Base < Modules[i].Size)
+			return &Modules[i];
+	}
+	return 0;
+}
+
+/* The Win32 start address is the function passed to CreateThread */
+static void ResolveStartAddress(HANDLE Thread, thread_info *Entry, BOOL *ModulesReloaded)
+{
+	void *Address;
+
+	if(!NtQueryInformationThread ||
+			!NT_SUCCEEDED(NtQueryInformationThread(Thread, NT_THREAD_QUERY_SET_WIN32_START_ADDRESS, &Address, sizeof(Address), 0))) {
+		_tcscpy_s(Entry->StartAddress, THREAD_START_SIZE, _T("-"));
+		return;
+	}
+
+	/* A thread started in a module loaded since the last lookup */
+	const module_range *Module = FindModule((ULONG_PTR)Address);
+	if(!Module && !*ModulesReloaded) {
+		LoadModules();
+		*ModulesReloaded = TRUE;
+		Module = FindModule((ULONG_PTR)Address);
+	}
+
+	if(Module) {
+		_stprintf_s(Entry->StartAddress, THREAD_START_SIZE, _T("%s+0x%llx"), Module->Name, (ULONGLONG)((ULONG_PTR)Address - Module->Base));
+	} else {
+		_stprintf_s(Entry->StartAddress, THREAD_START_SIZE, _T("0x%llx"), (ULONGLONG)(ULONG_PTR)Address);
+	}
+}
+
+static int CompareThreadIDs(const void *A, const void *B)
+{
+	DWORD IDA = ((const thread_info *)A)->ID;
+	DWORD IDB = ((const thread_info *)B)->ID;
+	return (IDA > IDB) - (IDA < IDB);
+}
+
+/*
+ * Replaces Thread, 0 to start, by a handle to the next thread of the
+ * target and closes it. Returns FALSE after the last one.
+ */
+static BOOL NextThread(HANDLE *Thread)
+{
+	HANDLE Next;
+	nt_status Status = NtGetNextThread(Process, *Thread, ThreadAccess, 0, 0, &Next);
+
+	/* Protected processes only hand out limited thread handles */
+	if(!NT_SUCCEEDED(Status) && !*Thread && ThreadAccess != THREAD_QUERY_LIMITED_INFORMATION) {
+		ThreadAccess = THREAD_QUERY_LIMITED_INFORMATION;
+		Status = NtGetNextThread(Process, 0, ThreadAccess, 0, 0, &Next);
+	}
+
+	if(*Thread) {
+		CloseHandle(*Thread);
+	}
+	*Thread = NT_SUCCEEDED(Status) ? Next : 0;
+	return *Thread != 0;
+}
+
+/* What can be read from the thread itself, the dispatcher state is only in system-wide queries */
+static void QueryThread(HANDLE Thread, thread_info *Entry)
+{
+	FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+
+	Entry->ID = GetThreadId(Thread);
+	Entry->CPUTime = 0;
+	Entry->Priority = 0;
+	Entry->State = THREAD_STATE_IDLE;
+	Entry->PercentProcessorTime = 0.0;
+
+	if(GetThreadTimes(Thread, &CreationTime, &ExitTime, &KernelTime, &UserTime)) {
+		Entry->CPUTime = (((ULONGLONG)KernelTime.dwHighDateTime << 32) | KernelTime.dwLowDateTime) +
+				(((ULONGLONG)UserTime.dwHighDateTime << 32) | UserTime.dwLowDateTime);
+	}
+
+	if(!NtQueryInformationThread)
+		return;
+
+	nt_thread_basic_information Basic;
+	if(NT_SUCCEEDED(NtQueryInformationThread(Thread, NT_THREAD_BASIC_INFORMATION, &Basic, sizeof(Basic), 0))) {
+		Entry->Priority = Basic.Priority;
+	}
+
+	ULONG SuspendCount;
+	if(NT_SUCCEEDED(NtQueryInformationThread(Thread, NT_THREAD_SUSPEND_COUNT, &SuspendCount, sizeof(SuspendCount), 0)) && SuspendCount > 0) {
+		Entry->State = THREAD_STATE_SUSPENDED;
+	}
+}
+
+/*
+ * Walks the threads of the target with one handle each, so the cost
+ * depends on the size of the target, not on everything else running.
+ */
+void ThreadsSample(void)
+{
+	EnterCriticalSection(&Lock);
+	BOOL Changed = TargetChanged;
+	TargetChanged = FALSE;
+	DWORD ID = TargetID;
+	/* Threads of a previous process must not be matched by ID */
+	DWORD PrevCount = Changed ? 0 : ThreadCount;
+	LeaveCriticalSection(&Lock);
+
+	if(Changed) {
+		ReleaseProcess();
+	}
+	if(ID == 0 || !NtGetNextThread)
+		return;
+
+	FILETIME IdleTime, KernelTime, UserTime;
+	GetSystemTimes(&IdleTime, &KernelTime, &UserTime);
+	ULARGE_INTEGER Kernel, User;
+	Kernel.LowPart = KernelTime.dwLowDateTime;
+	Kernel.HighPart = KernelTime.dwHighDateTime;
+	User.LowPart = UserTime.dwLowDateTime;
+	User.HighPart = UserTime.dwHighDateTime;
+	ULONGLONG SystemTime = Kernel.QuadPart + User.QuadPart;
+	ULONGLONG SystemDiff = PrevSystemTime ? SystemTime - PrevSystemTime : 0;
+	PrevSystemTime = SystemTime;
+
+	DWORD Count = 0;
+	BOOL ModulesReloaded = FALSE;
+
+	if(OpenTargetProcess() && WaitForSingleObject(Process, 0) == WAIT_OBJECT_0) {
+		ProcessStatus = THREADS_EXITED;
+	}
+
+	HANDLE Thread = 0;
+	while(ProcessStatus == 0 && NextThread(&Thread)) {
+		if(Count == ThreadCapacity) {
+			EnterCriticalSection(&Lock);
+			ThreadCapacity = max(ThreadCapacity * 2, 64);
+			NextThreads = xrealloc(NextThreads, ThreadCapacity * sizeof(*NextThreads));
+			Threads = xrealloc(Threads, ThreadCapacity * sizeof(*Threads));
+			LeaveCriticalSection(&Lock);
+		}
+
+		thread_info *Entry = &NextThreads[Count++];
+		QueryThread(Thread, Entry);
+
+		/* The published list is only replaced by this thread, reading it without the lock is safe */
+		const thread_info *Prev = bsearch(Entry, Threads, PrevCount, sizeof(*Threads), CompareThreadIDs);
+		if(Prev) {
+			_tcscpy_s(Entry->StartAddress, THREAD_START_SIZE, Prev->StartAddress);
+			if(SystemDiff > 0 && Entry->CPUTime >= Prev->CPUTime) {
+				Entry->PercentProcessorTime = 100.0 * (double)(Entry->CPUTime - Prev->CPUTime) / (double)SystemDiff;
+			}
+			if(Entry->State != THREAD_STATE_SUSPENDED && Entry->CPUTime > Prev->CPUTime) {
+				Entry->State = THREAD_STATE_RUNNING;
+			}
+		} else {
+			ResolveStartAddress(Thread, Entry, &ModulesReloaded);
+		}
+	}
+
+	qsort(NextThreads, Count, sizeof(*NextThreads), CompareThreadIDs);
+
+	EnterCriticalSection(&Lock);
+	/* Dropped if the UI moved on to another process meanwhile */
+	if(!TargetChanged) {
+		thread_info *Temp = Threads;
+		Threads = NextThreads;
+		NextThreads = Temp;
+		ThreadCount = Count;
+		ThreadStatus = ProcessStatus;
+	}
+	LeaveCriticalSection(&Lock);
+}
+
+static int CompareThreadLoad(const void *A, const void *B)
+{
+	const thread_info *ThreadA = A;
+	const thread_info *ThreadB = B;
+	if(ThreadA->PercentProcessorTime != ThreadB->PercentProcessorTime)
+		return ThreadA->PercentProcessorTime < ThreadB->PercentProcessorTime ? 1 : -1;
+	if(ThreadA->CPUTime != ThreadB->CPUTime)
+		return ThreadA->CPUTime < ThreadB->CPUTime ? 1 : -1;
+	return (ThreadA->ID > ThreadB->ID) - (ThreadA->ID < ThreadB->ID);
+}
+
+DWORD ThreadsGetTop(thread_info *Dest, DWORD MaxCount, DWORD *Total)
+{
+	EnterCriticalSection(&Lock);
+
+	*Total = ThreadStatus ? ThreadStatus : ThreadCount;
+
+	thread_info *Sorted = xmalloc(max(ThreadCount, 1) * sizeof(*Sorted));
+	memcpy(Sorted, Threads, ThreadCount * sizeof(*Sorted));
+	DWORD Count = ThreadCount;
+
+	LeaveCriticalSection(&Lock);
+
+	qsort(Sorted, Count, sizeof(*Sorted), CompareThreadLoad);
+	Count = min(Count, MaxCount);
+	memcpy(Dest, Sorted, Count * sizeof(*Dest));
+	free(Sorted);
+
+	return Count;
+}
+
+static const TCHAR *ThreadStates[] = {
+	_T("Idle"), _T("Running"), _T("Suspended"),
+};
+
+void FormatThreadState(const thread_info *Thread, TCHAR *Buffer, DWORD BufferSize)
+{
+	_tcscpy_s(Buffer, BufferSize, ThreadStates[Thread->State]);
+}
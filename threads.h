@@ -0,0 +1,69 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <windows.h>
+#include <tchar.h>
+
+/*
+ * The threads of the one process shown in the detail pane. The collector
+ * walks them at its normal interval while a process is set, and does
+ * nothing else while the pane is closed. Threads are matched to the
+ * previous sample by ID, so only new threads have their start address
+ * resolved.
+ */
+
+#define THREAD_START_SIZE 64
+
+/* Totals of ThreadsGetTop that are not a thread count */
+#define THREADS_EXITED ((DWORD)-1)
+#define THREADS_DENIED ((DWORD)-2)
+
+typedef enum thread_state {
+	THREAD_STATE_IDLE,		/* no CPU time since the last sample */
+	THREAD_STATE_RUNNING,
+	THREAD_STATE_SUSPENDED,
+} thread_state;
+
+typedef struct thread_info {
+	DWORD ID;
+	double PercentProcessorTime;	/* share of all processors, like a process */
+	ULONGLONG CPUTime;		/* 100ns units */
+	LONG Priority;
+	thread_state State;
+	TCHAR StartAddress[THREAD_START_SIZE];	/* module+offset if the modules could be read, "-" if denied */
+} thread_info;
+
+void ThreadsInit(void);
+
+/* ID 0 stops sampling and releases everything held for the last process */
+void ThreadsSetProcess(DWORD ID, ULONGLONG CreationTime);
+
+void ThreadsSample(void);
+
+/*
+ * Copies up to MaxCount threads, busiest first. Returns how many were
+ * copied and stores the number of threads in Total, or THREADS_EXITED or
+ * THREADS_DENIED if the process has exited or cannot be walked.
+ */
+DWORD ThreadsGetTop(thread_info *Dest, DWORD MaxCount, DWORD *Total);
+
+void FormatThreadState(const thread_info *Thread, TCHAR *Buffer, DWORD BufferSize);
+
+#endif
@@ -0,0 +1,174 @@
+/* 
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+#include "profiler.h"
+#include "util.h"
+#include <stdio.h>
+#include <tchar.h>
+
+/* 64k events of 24 bytes bound each thread to 1.5 MB while tracing */
+#define TRACE_RING_SIZE 65536
+#define TRACE_MAX_THREADS 16
+
+typedef struct trace_event {
+	const char *Name;
+	ULONGLONG Ticks;
+	char Phase;
+} trace_event;
+
+/*
+ * Only the owning thread ever writes to a ring, so recording needs no
+ * locks. Head counts all events ever recorded and is published with a
+ * full barrier after the slot is filled, so the writer at exit only reads
+ * completed slots.
+ */
+typedef struct trace_ring {
+	DWORD ThreadID;
+	const char *ThreadName;
+	volatile LONG Head;
+	trace_event Events[TRACE_RING_SIZE];
+} trace_ring;
+
+volatile LONG TraceEnabled = FALSE;
+
+static FILE *TraceFile;
+static DWORD TraceTlsIndex = TLS_OUT_OF_INDEXES;
+static trace_ring *Rings[TRACE_MAX_THREADS];
+static volatile LONG RingCount;
+static ULONGLONG TraceStartTicks;
+
+BOOL TraceInit(const TCHAR *FileName)
+{
+	if(_tfopen_s(&TraceFile, FileName, _T("w")) != 0 || !TraceFile) {
+		return FALSE;
+	}
+
+	TraceTlsIndex = TlsAlloc();
+	if(TraceTlsIndex == TLS_OUT_OF_INDEXES) {
+		fclose(TraceFile);
+		TraceFile = 0;
+		return FALSE;
+	}
+
+	TraceStartTicks = ProfNow();
+	InterlockedExchange(&TraceEnabled, TRUE);
+	return TRUE;
+}
+
+static trace_ring *GetThreadRing(void)
+{
+	trace_ring *Ring = TlsGetValue(TraceTlsIndex);
+	if(Ring)
+		return Ring;
+
+	LONG Slot = InterlockedIncrement(&RingCount) - 1;
+	if(Slot >= TRACE_MAX_THREADS)
+		return 0;
+
+	Ring = xcalloc(1, sizeof(*Ring));
+	Ring->ThreadID = GetCurrentThreadId();
+	Ring->ThreadName = "thread";
+	TlsSetValue(TraceTlsIndex, Ring);
+	InterlockedExchangePointer((PVOID volatile *)&Rings[Slot], Ring);
+	return Ring;
+}
+
+void TraceThreadName(const char *Name)
+{
+	if(!TraceEnabled)
+		return;
+
+	trace_ring *Ring = GetThreadRing();
+	if(Ring) {
+		Ring->ThreadName = Name;
+	}
+}
+
+void TraceEvent(const char *Name, char Phase)
+{
+	trace_ring *Ring = GetThreadRing();
+	if(!Ring)
+		return;
+
+	LONG Head = Ring->Head;
+	trace_event *Event = &Ring->Events[(ULONG)Head % TRACE_RING_SIZE];
+	Event->Name = Name;
+	Event->Phase = Phase;
+	Event->Ticks = ProfNow();
+
+	InterlockedExchange(&Ring->Head, Head + 1);
+}
+
+/*
+ * Chrome trace-event JSON as understood by chrome://tracing and Perfetto.
+ * Timestamps are microseconds since TraceInit.
+ */
+void TraceWrite(void)
+{
+	if(!TraceFile)
+		return;
+
+	InterlockedExchange(&TraceEnabled, FALSE);
+
+	DWORD ProcessID = GetCurrentProcessId();
+	LONG Count = min(RingCount, TRACE_MAX_THREADS);
+	BOOL First = TRUE;
+
+	fprintf(TraceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	for(LONG i = 0; i < Count; i++) {
+		trace_ring *Ring = Rings[i];
+		if(!Ring)
+			continue;
+
+		fprintf(TraceFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+				First ? "" : ",\n", ProcessID, Ring->ThreadID, Ring->ThreadName);
+		First = FALSE;
+
+		/*
+		 * A thread may still be filling the slot at Head, which is the
+		 * oldest one once the ring has wrapped, so skip that one.
+		 */
+		ULONG Head = (ULONG)Ring->Head;
+		ULONG Start = (Head >= TRACE_RING_SIZE) ? Head - TRACE_RING_SIZE + 1 : 0;
+
+		/* End events whose begin was overwritten would unbalance the track */
+		int Depth = 0;
+
+		for(ULONG j = Start; j < Head; j++) {
+			const trace_event *Event = &Ring->Events[j % TRACE_RING_SIZE];
+			if(Event->Phase == 'E') {
+				if(Depth == 0)
+					continue;
+				Depth--;
+			} else {
+				Depth++;
+			}
+
+			ULONGLONG Ticks = (Event->Ticks > TraceStartTicks) ? Event->Ticks - TraceStartTicks : 0;
+			ULONGLONG Microseconds = ProfTicksToMicroseconds(Ticks);
+
+			fprintf(TraceFile, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%lu,\"tid\":%lu,\"ts\":%llu}",
+					Event->Name, Event->Phase, ProcessID, Ring->ThreadID, Microseconds);
+		}
+	}
+
+	fprintf(TraceFile, "\n]}\n");
+	fclose(TraceFile);
+	TraceFile = 0;
+}
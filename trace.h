@@ -0,0 +1,39 @@
+/* 
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ * 
+ * This program is free software: you can redistribute it and/or modify  
+ * it under the terms of the GNU General Public License as published by  
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but 
+ * WITHOUT ANY WARRANTY; without even the implied warranty of 
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU 
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License 
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <windows.h>
+
+/*
+ * Opt-in tracing of NTop's own activity. Every thread records begin/end
+ * events into its own fixed-size ring buffer, which are written out as
+ * Chrome trace-event JSON when NTop exits. When tracing is off the only
+ * cost is the TraceEnabled check in the macros below.
+ */
+extern volatile LONG TraceEnabled;
+
+BOOL TraceInit(const TCHAR *FileName);
+void TraceThreadName(const char *Name);
+void TraceEvent(const char *Name, char Phase);
+void TraceWrite(void);
+
+#define TRACE_BEGIN(Name) do { if(TraceEnabled) TraceEvent(Name, 'B'); } while(0)
+#define TRACE_END(Name) do { if(TraceEnabled) TraceEvent(Name, 'E'); } while(0)
+
+#endif
@@ -0,0 +1,292 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "track.h"
+#include "util.h"
+#include "transient.h"
+#include <string.h>
+#include <math.h>
+
+#define TRACK_PAGE_BITS 10
+#define TRACK_PAGE_SIZE (1 << TRACK_PAGE_BITS)
+#define TRACK_MAX_PAGES 256
+#define TRACK_BUCKET_COUNT 8192
+
+/* Page 0 slot 0 is never handed out so that TRACK_NONE can be 0 */
+static track_slot *Pages[TRACK_MAX_PAGES];
+static DWORD PageCount;
+static DWORD SlotLimit = 1;
+static DWORD FreeSlot = TRACK_NONE;
+static DWORD UsedSlots;
+static DWORD Buckets[TRACK_BUCKET_COUNT];
+static DWORD Generation = 1;
+static DWORD StartGeneration;
+
+/*
+ * A process born while we were watching that went away after at most
+ * this many samples counts as transient, it was hardly visible in the list.
+ */
+#define TRANSIENT_MAX_SAMPLES 3
+
+/* About 6% relative error for CPU% and 11% for the working set */
+static const sketch_mapping CPUMapping = { 0.05, 100.0 };
+static const sketch_mapping MemoryMapping = { 1024.0 * 1024.0, 1024.0 * 1024.0 * 1024.0 * 1024.0 };
+
+#define TRACK_QUANTILE 0.95
+
+static const double LoadPeriods[LOAD_PERIODS] = { 60.0 * 1000, 300.0 * 1000, 900.0 * 1000 };
+
+static double GrowthWindow = 3600.0 * 1000;
+
+/* A steady leak: a good fit, visible growth and a quarter window of data */
+#define GROWTH_MIN_CONFIDENCE 0.9
+#define GROWTH_MIN_RATE 1.0		/* MB per hour */
+
+static DWORD HashSlot(DWORD ID, ULONGLONG CreationTime)
+{
+	ULONGLONG Hash = (ID * 0x9E3779B97F4A7C15ULL) ^ CreationTime;
+	return (DWORD)(Hash ^ (Hash >> 29)) & (TRACK_BUCKET_COUNT - 1);
+}
+
+track_slot *TrackGet(DWORD Slot)
+{
+	return &Pages[Slot >> TRACK_PAGE_BITS][Slot & (TRACK_PAGE_SIZE - 1)];
+}
+
+void TrackBeginCycle(void)
+{
+	Generation++;
+	if(StartGeneration == 0) {
+		StartGeneration = Generation;
+	}
+}
+
+/*
+ * After a jump in a replay the next cycle is treated like the first one:
+ * processes that appear or vanish across the jump are not transient.
+ */
+void TrackRestart(void)
+{
+	StartGeneration = 0;
+}
+
+static DWORD AllocateSlot(void)
+{
+	if(FreeSlot != TRACK_NONE) {
+		DWORD Slot = FreeSlot;
+		FreeSlot = TrackGet(Slot)->Next;
+		return Slot;
+	}
+
+	if(SlotLimit == PageCount * TRACK_PAGE_SIZE) {
+		if(PageCount == TRACK_MAX_PAGES)
+			return TRACK_NONE;
+		Pages[PageCount++] = xcalloc(TRACK_PAGE_SIZE, sizeof(track_slot));
+	}
+
+	return SlotLimit++;
+}
+
+/* Finds or creates the slot of a process and marks it alive in this cycle */
+DWORD TrackAcquire(DWORD ID, ULONGLONG CreationTime)
+{
+	if(PageCount == 0) {
+		Pages[PageCount++] = xcalloc(TRACK_PAGE_SIZE, sizeof(track_slot));
+	}
+
+	DWORD Bucket = HashSlot(ID, CreationTime);
+
+	for(DWORD Slot = Buckets[Bucket]; Slot != TRACK_NONE; Slot = TrackGet(Slot)->Next) {
+		track_slot *Entry = TrackGet(Slot);
+		if(Entry->ID == ID && Entry->CreationTime == CreationTime) {
+			Entry->Generation = Generation;
+			return Slot;
+		}
+	}
+
+	DWORD Slot = AllocateSlot();
+	if(Slot == TRACK_NONE)
+		return TRACK_NONE;
+
+	track_slot *Entry = TrackGet(Slot);
+	memset(Entry, 0, sizeof(*Entry));
+	Entry->ID = ID;
+	Entry->CreationTime = CreationTime;
+	Entry->Generation = Generation;
+	Entry->FirstGeneration = Generation;
+	Entry->Next = Buckets[Bucket];
+	Buckets[Bucket] = Slot;
+	UsedSlots++;
+
+	return Slot;
+}
+
+/*
+ * Releases the slot of a process that went away. A released slot keeps its
+ * contents until it is handed out again in a later cycle, so a list
+ * published before this one can still be drawn.
+ */
+void TrackRelease(DWORD ID, ULONGLONG CreationTime)
+{
+	if(PageCount == 0)
+		return;
+
+	DWORD *Link = &Buckets[HashSlot(ID, CreationTime)];
+
+	while(*Link != TRACK_NONE) {
+		DWORD Slot = *Link;
+		track_slot *Entry = TrackGet(Slot);
+
+		if(Entry->ID != ID || Entry->CreationTime != CreationTime) {
+			Link = &Entry->Next;
+			continue;
+		}
+
+		if(Entry->FirstGeneration > StartGeneration && Generation != StartGeneration &&
+				Entry->Samples <= TRANSIENT_MAX_SAMPLES) {
+			TransientAdd(Entry->ExeName, Entry->CPUTime);
+		}
+
+		*Link = Entry->Next;
+		Entry->Next = FreeSlot;
+		FreeSlot = Slot;
+		UsedSlots--;
+		return;
+	}
+}
+
+void LoadUpdate(load_average *Load, double Sample, ULONGLONG Timestamp)
+{
+	/* A paused replay publishes the same frame again */
+	if(Timestamp == Load->Timestamp)
+		return;
+
+	/* The first sample, or a jump backwards in a replay, starts over */
+	if(Load->Timestamp == 0 || Timestamp < Load->Timestamp) {
+		for(int i = 0; i < LOAD_PERIODS; i++) {
+			Load->Value[i] = Sample;
+		}
+	} else {
+		double Elapsed = (double)(Timestamp - Load->Timestamp);
+		for(int i = 0; i < LOAD_PERIODS; i++) {
+			double Decay = exp(-Elapsed / LoadPeriods[i]);
+			Load->Value[i] = Load->Value[i] * Decay + Sample * (1.0 - Decay);
+		}
+	}
+	Load->Timestamp = Timestamp;
+}
+
+void TrackSetGrowthWindow(DWORD Seconds)
+{
+	GrowthWindow = max(Seconds, 60) * 1000.0;
+}
+
+static void GrowthUpdate(growth_fit *Fit, double Memory, ULONGLONG Timestamp)
+{
+	if(Fit->Timestamp == 0 || Timestamp < Fit->Timestamp) {
+		memset(Fit, 0, sizeof(*Fit));
+		Fit->Origin = Memory;
+		Fit->FirstTimestamp = Timestamp;
+	} else if(Timestamp > Fit->Timestamp) {
+		/* Move every X back by the elapsed hours, then decay all weights */
+		double Shift = (double)(Timestamp - Fit->Timestamp) / 3600000.0;
+		double Decay = exp(-(double)(Timestamp - Fit->Timestamp) / GrowthWindow);
+
+		Fit->XX = (Fit->XX - 2.0 * Shift * Fit->X + Shift * Shift * Fit->W) * Decay;
+		Fit->XY = (Fit->XY - Shift * Fit->Y) * Decay;
+		Fit->X = (Fit->X - Shift * Fit->W) * Decay;
+		Fit->W *= Decay;
+		Fit->Y *= Decay;
+		Fit->YY *= Decay;
+	}
+	Fit->Timestamp = Timestamp;
+
+	/* The new sample sits at X = 0 */
+	double Y = Memory - Fit->Origin;
+	Fit->W += 1.0;
+	Fit->Y += Y;
+	Fit->YY += Y * Y;
+}
+
+/* Slope in MB per hour and R^2 of the fit */
+static void GrowthGet(const growth_fit *Fit, double *Slope, double *Confidence)
+{
+	double VarX = Fit->W * Fit->XX - Fit->X * Fit->X;
+	double VarY = Fit->W * Fit->YY - Fit->Y * Fit->Y;
+	double CovXY = Fit->W * Fit->XY - Fit->X * Fit->Y;
+
+	*Slope = 0.0;
+	*Confidence = 0.0;
+
+	if(VarX <= 1e-12)
+		return;
+
+	*Slope = CovXY / VarX;
+	if(VarY > 1e-12) {
+		*Confidence = min(CovXY * CovXY / (VarX * VarY), 1.0);
+	}
+}
+
+/*
+ * Adds the current values of a process, timestamped in milliseconds, and
+ * stores the values derived from its history back into the process. A
+ * working set that was not queried in this cycle (Queries) reads 0, it
+ * is left out of the memory history instead of being added as a sample.
+ */
+void TrackPushSample(track_slot *Slot, process *Process, DWORD Queries, ULONGLONG Timestamp)
+{
+	double CPU = Process->PercentProcessorTime * 100.0 + 0.5;
+	BOOL HasMemory = (Queries & QUERY_MEMORY) != 0;
+
+	if(Slot->Samples++ == 0) {
+		_tcsncpy_s(Slot->ExeName, MAX_PATH, Process->ExeName, _TRUNCATE);
+	}
+	Slot->CPUTime = Process->CPUTime;
+
+	/* Without a new value the memory sparkline repeats the last one */
+	DWORD Last = (Slot->SparkHead + TRACK_SPARK_SAMPLES - 1) % TRACK_SPARK_SAMPLES;
+	Slot->SparkCPU[Slot->SparkHead] = (WORD)min(CPU, 65535.0);
+	Slot->SparkMemory[Slot->SparkHead] = HasMemory ? Process->UsedMemory : Slot->SparkMemory[Last];
+	Slot->SparkHead = (Slot->SparkHead + 1) % TRACK_SPARK_SAMPLES;
+	if(Slot->SparkCount < TRACK_SPARK_SAMPLES)
+		Slot->SparkCount++;
+
+	SketchAdd(&Slot->CPUSketch, &CPUMapping, Process->PercentProcessorTime, Timestamp);
+	if(HasMemory) {
+		SketchAdd(&Slot->MemorySketch, &MemoryMapping, (double)Process->UsedMemory, Timestamp);
+	}
+	Process->PercentProcessorTimeP95 = SketchQuantile(&Slot->CPUSketch, &CPUMapping, TRACK_QUANTILE);
+	Process->UsedMemoryP95 = (unsigned __int64)SketchQuantile(&Slot->MemorySketch, &MemoryMapping, TRACK_QUANTILE);
+
+	LoadUpdate(&Slot->CPULoad, Process->PercentProcessorTime, Timestamp);
+	Process->PercentProcessorTimeAvg1 = Slot->CPULoad.Value[0];
+	Process->PercentProcessorTimeAvg5 = Slot->CPULoad.Value[1];
+	Process->PercentProcessorTimeAvg15 = Slot->CPULoad.Value[2];
+
+	if(HasMemory) {
+		GrowthUpdate(&Slot->MemoryGrowth, (double)Process->UsedMemory / (1024.0 * 1024.0), Timestamp);
+	}
+	GrowthGet(&Slot->MemoryGrowth, &Process->MemoryGrowth, &Process->MemoryGrowthConfidence);
+	Process->MemoryGrowthSteady = Process->MemoryGrowthConfidence >= GROWTH_MIN_CONFIDENCE &&
+		Process->MemoryGrowth >= GROWTH_MIN_RATE &&
+		(double)(Timestamp - Slot->MemoryGrowth.FirstTimestamp) >= GrowthWindow / 4;
+}
+
+DWORD TrackGetSlotCount(void)
+{
+	return UsedSlots;
+}
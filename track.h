@@ -0,0 +1,95 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACK_H
+#define TRACK_H
+
+#include "ntop.h"
+#include "sketch.h"
+
+/*
+ * State that has to outlive a single snapshot, one slot per process,
+ * keyed by PID and creation time. Slots live in fixed-size slab pages that
+ * never move, so the UI can read a slot through process.TrackSlot while
+ * the collector is working on the next snapshot. Only the collector
+ * thread acquires and releases slots.
+ */
+
+#define TRACK_NONE 0
+
+/*
+ * Exponentially decayed averages over 1, 5 and 15 minutes, the way Unix
+ * computes its load average, but weighted by the real time between two
+ * samples so that any polling interval works.
+ */
+#define LOAD_PERIODS 3
+
+typedef struct load_average {
+	double Value[LOAD_PERIODS];
+	ULONGLONG Timestamp;	/* ms, 0 before the first sample */
+} load_average;
+
+void LoadUpdate(load_average *Load, double Sample, ULONGLONG Timestamp);
+
+/*
+ * Exponentially weighted least-squares fit of the working set over time.
+ * X is kept relative to the newest sample and Y relative to the first
+ * one, so the sums stay small and every update is O(1).
+ */
+typedef struct growth_fit {
+	double W, X, Y, XX, XY, YY;
+	double Origin;		/* MB of the first sample */
+	ULONGLONG FirstTimestamp;
+	ULONGLONG Timestamp;
+} growth_fit;
+
+#define TRACK_SPARK_SAMPLES 16
+
+typedef struct track_slot {
+	DWORD ID;
+	ULONGLONG CreationTime;
+	DWORD Generation;
+	DWORD FirstGeneration;
+	DWORD Next;
+
+	TCHAR ExeName[MAX_PATH];
+	DWORD Samples;
+	ULONGLONG CPUTime;		/* last seen, 100ns units */
+
+	/* Ring buffers of the last TRACK_SPARK_SAMPLES samples */
+	DWORD SparkHead;
+	DWORD SparkCount;
+	WORD SparkCPU[TRACK_SPARK_SAMPLES];		/* hundredths of a percent */
+	ULONGLONG SparkMemory[TRACK_SPARK_SAMPLES];
+
+	sketch CPUSketch;
+	sketch MemorySketch;
+
+	load_average CPULoad;
+	growth_fit MemoryGrowth;
+} track_slot;
+
+void TrackBeginCycle(void);
+void TrackRestart(void);
+DWORD TrackAcquire(DWORD ID, ULONGLONG CreationTime);
+void TrackRelease(DWORD ID, ULONGLONG CreationTime);
+track_slot *TrackGet(DWORD Slot);
+void TrackPushSample(track_slot *Slot, process *Process, DWORD Queries, ULONGLONG Timestamp);
+DWORD TrackGetSlotCount(void);
+void TrackSetGrowthWindow(DWORD Seconds);
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "transient.h"
+#include <stdlib.h>
+#include <string.h>
+
+static CRITICAL_SECTION TransientLock;
+static transient_entry Entries[TRANSIENT_CAPACITY];
+static DWORD EntryCount;
+static transient_totals Totals;
+
+void TransientInit(void)
+{
+	InitializeCriticalSection(&TransientLock);
+}
+
+/* Called by the collector for every process that lived only a few samples */
+void TransientAdd(const TCHAR *Name, ULONGLONG CPUTime)
+{
+	EnterCriticalSection(&TransientLock);
+
+	Totals.Processes++;
+	Totals.CPUTime += CPUTime;
+
+	transient_entry *Entry = 0;
+	transient_entry *Smallest = 0;
+
+	for(DWORD i = 0; i < EntryCount; i++) {
+		if(_tcsicmp(Entries[i].Name, Name) == 0) {
+			Entry = &Entries[i];
+			break;
+		}
+		if(!Smallest || Entries[i].CPUTime < Smallest->CPUTime) {
+			Smallest = &Entries[i];
+		}
+	}
+
+	if(!Entry) {
+		if(EntryCount < TRANSIENT_CAPACITY) {
+			Entry = &Entries[EntryCount++];
+			Entry->CPUTime = 0;
+			Entry->Error = 0;
+		} else {
+			Entry = Smallest;
+			Entry->Error = Entry->CPUTime;
+		}
+		_tcsncpy_s(Entry->Name, MAX_PATH, Name, _TRUNCATE);
+		Entry->Spawns = 0;
+	}
+
+	Entry->CPUTime += CPUTime;
+	Entry->Spawns++;
+
+	LeaveCriticalSection(&TransientLock);
+}
+
+static int CompareTransientEntries(const void *A, const void *B)
+{
+	ULONGLONG TimeA = ((const transient_entry *)A)->CPUTime;
+	ULONGLONG TimeB = ((const transient_entry *)B)->CPUTime;
+
+	if(TimeA != TimeB)
+		return TimeA < TimeB ? 1 : -1;
+	return (int)((const transient_entry *)B)->Spawns - (int)((const transient_entry *)A)->Spawns;
+}
+
+/* Copies the hottest entries, most CPU time first */
+DWORD TransientGetTop(transient_entry *Dest, DWORD Capacity, transient_totals *DestTotals)
+{
+	EnterCriticalSection(&TransientLock);
+	DWORD Count = min(EntryCount, TRANSIENT_CAPACITY);
+	transient_entry Sorted[TRANSIENT_CAPACITY];
+	memcpy(Sorted, Entries, Count * sizeof(*Sorted));
+	*DestTotals = Totals;
+	LeaveCriticalSection(&TransientLock);
+
+	qsort(Sorted, Count, sizeof(*Sorted), CompareTransientEntries);
+
+	Count = min(Count, Capacity);
+	memcpy(Dest, Sorted, Count * sizeof(*Dest));
+	return Count;
+}
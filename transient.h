@@ -0,0 +1,50 @@
+/*
+ * NTop - an htop clone for Windows
+ * Copyright (c) 2019 Gian Sass
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRANSIENT_H
+#define TRANSIENT_H
+
+#include "ntop.h"
+
+/*
+ * Top executables by CPU time among short-lived processes, kept with the
+ * weighted space-saving algorithm: at most TRANSIENT_CAPACITY names are
+ * counted, and a new name replaces the one with the least CPU time,
+ * inheriting that time as its possible overestimate (Error). Every name
+ * whose true CPU time exceeds the smallest counted one is guaranteed to
+ * be in the table, however many distinct names show up.
+ */
+
+#define TRANSIENT_CAPACITY 64
+
+typedef struct transient_entry {
+	TCHAR Name[MAX_PATH];
+	ULONGLONG CPUTime;	/* 100ns units, includes Error */
+	ULONGLONG Error;
+	DWORD Spawns;
+} transient_entry;
+
+typedef struct transient_totals {
+	ULONGLONG Processes;
+	ULONGLONG CPUTime;
+} transient_totals;
+
+void TransientInit(void);
+void TransientAdd(const TCHAR *Name, ULONGLONG CPUTime);
+DWORD TransientGetTop(transient_entry *Entries, DWORD Capacity, transient_totals *Totals);
+
+#endif
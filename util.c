@@ -69,3 +69,75 @@ void *xcalloc(size_t num, size_t size)
 
 	return m;
 }
+
+/*
+ * Converts a NUL-terminated TCHAR string to UTF-8 without allocating.
+ * Returns the number of bytes written, not counting the terminator.
+ */
+int TCharToUtf8(const TCHAR *Src, char *Dest, int DestSize)
+{
+	int Length = 0;
+
+	/* Plain ASCII is by far the common case and needs no conversion */
+	while(Src[Length] && (unsigned int)Src[Length] < 0x80) {
+		if(Length + 1 >= DestSize)
+			break;
+		Dest[Length] = (char)Src[Length];
+		Length++;
+	}
+
+	if(!Src[Length] || Length + 1 >= DestSize) {
+		Dest[Length] = '\0';
+		return Length;
+	}
+
+#ifdef UNICODE
+	const WCHAR *Wide = Src;
+#else
+	WCHAR Wide[1024];
+	if(MultiByteToWideChar(CP_ACP, 0, Src, -1, Wide, _countof(Wide)) == 0) {
+		Dest[Length] = '\0';
+		return Length;
+	}
+#endif
+
+	Length = WideCharToMultiByte(CP_UTF8, 0, Wide, -1, Dest, DestSize, 0, 0);
+	if(Length == 0) {
+		Dest[0] = '\0';
+		return 0;
+	}
+
+	return Length - 1;
+}
+
+/*
+ * Converts SrcLength bytes of UTF-8 to a NUL-terminated TCHAR string.
+ * Returns the number of characters written, not counting the terminator.
+ */
+int Utf8ToTChar(const char *Src, int SrcLength, TCHAR *Dest, int DestSize)
+{
+	int Length = 0;
+
+	while(Length < SrcLength && (unsigned char)Src[Length] < 0x80) {
+		if(Length + 1 >= DestSize)
+			break;
+		Dest[Length] = (TCHAR)Src[Length];
+		Length++;
+	}
+
+	if(Length == SrcLength || Length + 1 >= DestSize) {
+		Dest[Length] = 0;
+		return Length;
+	}
+
+#ifdef UNICODE
+	Length = MultiByteToWideChar(CP_UTF8, 0, Src, SrcLength, Dest, DestSize - 1);
+#else
+	WCHAR Wide[1024];
+	int WideLength = MultiByteToWideChar(CP_UTF8, 0, Src, SrcLength, Wide, _countof(Wide));
+	Length = WideCharToMultiByte(CP_ACP, 0, Wide, WideLength, Dest, DestSize - 1, 0, 0);
+#endif
+
+	Dest[Length] = 0;
+	return Length;
+}
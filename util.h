@@ -32,6 +32,8 @@ NORETURN void Die(TCHAR *Fmt, ...);
 void *xmalloc(size_t size);
 void *xrealloc(void *ptr, size_t size);
 void *xcalloc(size_t num, size_t size);
+int TCharToUtf8(const TCHAR *Src, char *Dest, int DestSize);
+int Utf8ToTChar(const char *Src, int SrcLength, TCHAR *Dest, int DestSize);
 
 #ifdef UNICODE
 	/*
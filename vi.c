@@ -17,6 +17,8 @@
 
 #include "vi.h"
 #include "ntop.h"
+#include "history.h"
+#include "journal.h"
 #include "util.h"
 #include <conio.h>
 #include <stdio.h>
@@ -72,6 +74,11 @@ COMMAND_FUNC(kill)
 		return 1;
 	}
 
+	if(IsReplaying()) {
+		SetViMessage(VI_ERROR, _T("Cannot kill processes of a replayed session"));
+		return 1;
+	}
+
 	for(DWORD i = 0; i < Argc; i++) {
 		DWORD Pid = _tcstoul(Argv[i], 0, 10);
 
@@ -150,6 +157,49 @@ COMMAND_FUNC(exec)
 	return 1;
 }
 
+COMMAND_FUNC(events)
+{
+	if(Argc > 1) {
+		SetViMessage(VI_ERROR, _T("Usage: events [pattern]"));
+		return 1;
+	}
+
+	if(!JournalEnabled()) {
+		SetViMessage(VI_ERROR, _T("The journal is disabled (JournalSize 0) or could not be opened"));
+		return 1;
+	}
+
+	SetEventsFilter(Argc == 1 ? Argv[0] : _T(""));
+	SetListView(LIST_VIEW_EVENTS);
+	SetViMessage(VI_NOTICE, _T("Esc or q returns to the process list"));
+	return 1;
+}
+
+COMMAND_FUNC(history)
+{
+	UNREFERENCED_PARAMETER(Argv);
+
+	if(Argc != 0) {
+		SetViMessage(VI_ERROR, _T("Error: trailing characters"));
+		return 1;
+	}
+
+	if(!HistEnabled()) {
+		SetViMessage(VI_ERROR, _T("History is disabled (HistoryMemory 0)"));
+		return 1;
+	}
+
+	hist_stats Stats;
+	HistGetStats(&Stats);
+
+	double PerSample = Stats.ProcessSamples ? (double)Stats.Bytes / (double)Stats.ProcessSamples : 0.0;
+	double ValuesPerSample = Stats.ProcessSamples ? (double)Stats.ValueBytes / (double)Stats.ProcessSamples : 0.0;
+
+	SetViMessage(VI_NOTICE, _T("History: %llu snapshots, %u processes, %llu KB, %.2f bytes per process sample (%.2f values)"),
+			Stats.SampleCount, Stats.IdentityCount, Stats.Bytes / 1024, PerSample, ValuesPerSample);
+	return 1;
+}
+
 COMMAND_FUNC(q)
 {
 	UNREFERENCED_PARAMETER(Argc);
@@ -177,6 +227,43 @@ COMMAND_FUNC(sort)
 	return 0;
 }
 
+COMMAND_FUNC(spark)
+{
+	if(Argc != 1 || !SetSparklineMode(Argv[0])) {
+		SetViMessage(VI_ERROR, _T("Usage: spark cpu|mem|off"));
+		return 1;
+	}
+
+	return 0;
+}
+
+COMMAND_FUNC(transient)
+{
+	UNREFERENCED_PARAMETER(Argv);
+
+	if(Argc != 0) {
+		SetViMessage(VI_ERROR, _T("Error: trailing characters"));
+		return 1;
+	}
+
+	SetListView(LIST_VIEW_TRANSIENT);
+	SetViMessage(VI_NOTICE, _T("Esc or q returns to the process list"));
+	return 1;
+}
+
+COMMAND_FUNC(rules)
+{
+	UNREFERENCED_PARAMETER(Argv);
+
+	if(Argc != 0) {
+		SetViMessage(VI_ERROR, _T("Error: trailing characters"));
+		return 1;
+	}
+
+	BenchmarkRules();
+	return 1;
+}
+
 COMMAND_FUNC(search)
 {
 	if(Argc != 1) {
@@ -192,11 +279,16 @@ COMMAND_FUNC(search)
 }
 
 static cmd Commands[] = {
+	COMMAND(events),
 	COMMAND(exec),
+	COMMAND(history),
 	COMMAND(kill),
 	COMMAND(q),
 	COMMAND(quit),
+	COMMAND(rules),
 	COMMAND(sort),
+	COMMAND(spark),
+	COMMAND(transient),
 	COMMAND(tree),
 	COMMAND(search),
 };